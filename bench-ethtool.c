@@ -0,0 +1,726 @@
+/****************************************************************************
+ * Microbenchmarks of ethtool parsing, decoding and formatting code
+ *
+ * Each benchmark runs one operation over a fixed input repeatedly and
+ * reports CPU time (ns/op) and number of heap allocations (allocs/op).
+ * Netlink benchmarks take their input from the in-process fake of ethtool
+ * genetlink family (test-nlfake.c); replies are captured once and served
+ * from memory afterwards so that the fake is not measured. Output of the
+ * code under test goes to /dev/null.
+ *
+ * Usage: bench-ethtool [name ...]
+ * Only benchmarks whose name contains one of the arguments are run. Minimum
+ * run time of each benchmark (ms) can be set with ETHTOOL_BENCH_TIME.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, incorporated herein by reference.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define TEST_NO_WRAPPERS
+#include "internal.h"
+#ifdef ETHTOOL_ENABLE_PRETTY_DUMP
+#include "cmis.h"
+#include "qsfp.h"
+#include "sff-common.h"
+#endif
+#ifdef ETHTOOL_ENABLE_NETLINK
+#include "netlink/netlink.h"
+#include "netlink/parser.h"
+#include "netlink/bitset.h"
+#include "test-nlfake.h"
+#endif
+
+/* operations are timed in batches, reset callback runs between them */
+#define BENCH_BATCH		64
+#define BENCH_DEFAULT_TIME	200	/* ms */
+
+/**
+ * struct bench - one microbenchmark
+ * @name:  name used in output and for selection on command line
+ * @setup: prepare input (optional); return 0 on success
+ * @run:   one operation
+ * @reset: release memory accumulated by a batch of operations (optional)
+ */
+struct bench {
+	const char	*name;
+	int		(*setup)(void);
+	void		(*run)(void);
+	void		(*reset)(void);
+};
+
+static struct cmd_context bench_ctx = {
+	.devname	= "fake0",
+};
+
+int send_ioctl(struct cmd_context *ctx __maybe_unused, void *cmd __maybe_unused)
+{
+	/* nothing to talk to */
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+static uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* json_writer */
+
+static json_writer_t *bench_jw;
+
+static int bench_json_setup(void)
+{
+	bench_jw = jsonw_new(stdout);
+	if (!bench_jw)
+		return -ENOMEM;
+	jsonw_start_array(bench_jw);
+	return 0;
+}
+
+static void bench_json_run(void)
+{
+	unsigned int i;
+
+	jsonw_start_object(bench_jw);
+	jsonw_string_field(bench_jw, "ifname", "eth0");
+	jsonw_bool_field(bench_jw, "link", true);
+	jsonw_uint_field(bench_jw, "speed", 100000);
+	jsonw_name(bench_jw, "counters");
+	jsonw_start_object(bench_jw);
+	for (i = 0; i < 16; i++) {
+		char name[16];
+
+		snprintf(name, sizeof(name), "rx%u_packets", i);
+		jsonw_u64_field(bench_jw, name, 0x123456789ULL * (i + 1));
+	}
+	jsonw_end_object(bench_jw);
+	jsonw_name(bench_jw, "modes");
+	jsonw_start_array(bench_jw);
+	for (i = 0; i < 8; i++)
+		jsonw_string(bench_jw, "100000baseKR4/Full");
+	jsonw_end_array(bench_jw);
+	jsonw_float_field(bench_jw, "temperature", 36.5);
+	jsonw_end_object(bench_jw);
+}
+
+/* rxclass */
+
+/* "ethtool -N" arguments after "flow-type" */
+static char *rxclass_args[] = {
+	"tcp4", "src-ip", "192.168.10.1", "m", "0.0.0.255", "dst-ip",
+	"10.0.0.2", "src-port", "1234", "dst-port", "80", "vlan", "0x0123",
+	"user-def", "0x1234567890", "action", "3", "loc", "17",
+};
+
+static void bench_rxclass_run(void)
+{
+	struct ethtool_rx_flow_spec fsp;
+	__u32 rss_context = 0;
+
+	bench_ctx.argp = rxclass_args;
+	bench_ctx.argc = ARRAY_SIZE(rxclass_args);
+	rxclass_parse_ruleopts(&bench_ctx, &fsp, &rss_context);
+}
+
+#ifdef ETHTOOL_ENABLE_PRETTY_DUMP
+
+/* register dumps */
+
+static struct ethtool_drvinfo bench_drvinfo;
+static struct ethtool_regs *sfc_regs;
+static struct ethtool_regs *ixgbe_regs;
+
+static struct ethtool_regs *bench_alloc_regs(unsigned int len, __u32 version)
+{
+	struct ethtool_regs *regs;
+	unsigned int i;
+
+	regs = malloc(sizeof(*regs) + len);
+	if (!regs)
+		return NULL;
+	regs->version = version;
+	regs->len = len;
+	for (i = 0; i < len; i++)
+		regs->data[i] = i * 37 + (i >> 8);
+	return regs;
+}
+
+static int bench_sfc_setup(void)
+{
+	/* Siena-class (EF10 arch) register dump */
+	sfc_regs = bench_alloc_regs(16384, 4);
+	return sfc_regs ? 0 : -ENOMEM;
+}
+
+static void bench_sfc_run(void)
+{
+	sfc_dump_regs(&bench_drvinfo, sfc_regs);
+}
+
+static int bench_ixgbe_setup(void)
+{
+	/* format version 3 (MAC type reported), 82599 */
+	ixgbe_regs = bench_alloc_regs(1152 * sizeof(u32), 3 << 24 | 0x10fb);
+	return ixgbe_regs ? 0 : -ENOMEM;
+}
+
+static void bench_ixgbe_run(void)
+{
+	ixgbe_dump_regs(&bench_drvinfo, ixgbe_regs);
+}
+
+/* module EEPROM */
+
+static __u8 sff8636_eeprom[ETH_MODULE_SFF_8636_MAX_LEN];
+static __u8 cmis_eeprom[4 * 128];
+
+static void bench_fill_eeprom(__u8 *id, unsigned int len, __u8 identifier,
+			      unsigned int name_offset, unsigned int pn_offset)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		id[i] = i * 7;
+	id[0] = identifier;
+	memcpy(id + name_offset, "BENCH VENDOR    ", 16);
+	memcpy(id + pn_offset, "BENCH-PN-0001   ", 16);
+}
+
+static int bench_sff8636_setup(void)
+{
+	bench_fill_eeprom(sff8636_eeprom, sizeof(sff8636_eeprom),
+			  SFF8024_ID_QSFP28, SFF8636_VENDOR_NAME_START_OFFSET,
+			  SFF8636_VENDOR_PN_START_OFFSET);
+	/* paged memory with page 03h */
+	sff8636_eeprom[SFF8636_STATUS_2_OFFSET] &=
+		~SFF8636_STATUS_PAGE_3_PRESENT;
+	return 0;
+}
+
+static void bench_sff8636_run(void)
+{
+	sff8636_show_all_ioctl(sff8636_eeprom, sizeof(sff8636_eeprom));
+}
+
+static int bench_cmis_setup(void)
+{
+	bench_fill_eeprom(cmis_eeprom, sizeof(cmis_eeprom),
+			  SFF8024_ID_QSFP_DD, CMIS_VENDOR_NAME_START_OFFSET,
+			  CMIS_VENDOR_PN_START_OFFSET);
+	/* paged memory with page 01h */
+	cmis_eeprom[CMIS_MEMORY_MODEL_OFFSET] &= ~CMIS_MEMORY_MODEL_MASK;
+	return 0;
+}
+
+static void bench_cmis_run(void)
+{
+	cmis_show_all_ioctl(cmis_eeprom);
+}
+
+#endif /* ETHTOOL_ENABLE_PRETTY_DUMP */
+
+#ifdef ETHTOOL_ENABLE_NETLINK
+
+static const struct nlfake_config bench_nlfake_config = {
+	.n_devices	= 4,
+	.n_queues	= 16,
+	.n_counters	= 512,
+};
+
+#define BENCH_MAX_DGRAMS	8
+
+/**
+ * struct bench_dgrams - reply datagrams captured from the fake backend
+ * @n:    number of datagrams
+ * @next: next datagram to serve
+ * @len:  datagram lengths
+ * @data: datagram contents
+ */
+struct bench_dgrams {
+	unsigned int	n;
+	unsigned int	next;
+	unsigned int	len[BENCH_MAX_DGRAMS];
+	void		*data[BENCH_MAX_DGRAMS];
+};
+
+static struct nl_context *nlctx;
+static struct bench_dgrams *bench_dgrams;
+
+static ssize_t capture_send(struct nl_socket *nlsk,
+			    const struct nlmsghdr *nlhdr)
+{
+	return nlfake_backend.send(nlsk, nlhdr);
+}
+
+static ssize_t capture_peek_len(struct nl_socket *nlsk)
+{
+	return nlfake_backend.peek_len(nlsk);
+}
+
+static ssize_t capture_recv(struct nl_socket *nlsk, void *buff,
+			    unsigned int size)
+{
+	struct bench_dgrams *dgrams = bench_dgrams;
+	ssize_t ret;
+
+	ret = nlfake_backend.recv(nlsk, buff, size);
+	if (ret <= 0 || dgrams->n == BENCH_MAX_DGRAMS)
+		return ret;
+	dgrams->data[dgrams->n] = malloc(ret);
+	if (!dgrams->data[dgrams->n])
+		return -ENOMEM;
+	memcpy(dgrams->data[dgrams->n], buff, ret);
+	dgrams->len[dgrams->n++] = ret;
+	return ret;
+}
+
+/* passes requests to the fake and saves a copy of its replies */
+static const struct nlsock_backend capture_backend = {
+	.send		= capture_send,
+	.peek_len	= capture_peek_len,
+	.recv		= capture_recv,
+};
+
+static ssize_t canned_send(struct nl_socket *nlsk __maybe_unused,
+			   const struct nlmsghdr *nlhdr)
+{
+	bench_dgrams->next = 0;
+	return nlhdr->nlmsg_len;
+}
+
+static ssize_t canned_peek_len(struct nl_socket *nlsk __maybe_unused)
+{
+	const struct bench_dgrams *dgrams = bench_dgrams;
+
+	return dgrams->next < dgrams->n ? dgrams->len[dgrams->next] : 0;
+}
+
+static ssize_t canned_recv(struct nl_socket *nlsk, void *buff,
+			   unsigned int size)
+{
+	struct bench_dgrams *dgrams = bench_dgrams;
+	struct nlmsghdr *nlhdr = buff;
+	int len, left;
+
+	if (dgrams->next >= dgrams->n)
+		return 0;
+	len = dgrams->len[dgrams->next];
+	if ((unsigned int)len > size)
+		return -EMSGSIZE;
+	memcpy(buff, dgrams->data[dgrams->next++], len);
+
+	left = len;
+	while (mnl_nlmsg_ok(nlhdr, left)) {
+		nlhdr->nlmsg_seq = nlsk->seq;
+		nlhdr->nlmsg_pid = nlsk->port;
+		nlhdr = mnl_nlmsg_next(nlhdr, &left);
+	}
+	return len;
+}
+
+/* serves captured replies to every request */
+static const struct nlsock_backend canned_backend = {
+	.send		= canned_send,
+	.peek_len	= canned_peek_len,
+	.recv		= canned_recv,
+};
+
+static void bench_capture(struct bench_dgrams *dgrams)
+{
+	dgrams->n = 0;
+	bench_dgrams = dgrams;
+	nlctx->backend = &capture_backend;
+}
+
+static void bench_serve(struct bench_dgrams *dgrams)
+{
+	bench_dgrams = dgrams;
+	nlctx->backend = &canned_backend;
+}
+
+/* back to the fake */
+static void bench_live(void)
+{
+	nlctx->backend = &nlfake_backend;
+}
+
+static int bench_netlink_init(void)
+{
+	int ret;
+
+	nlfake_setup(&bench_nlfake_config);
+	ret = netlink_init(&bench_ctx);
+	if (ret < 0)
+		return ret;
+	nlctx = bench_ctx.nlctx;
+	return netlink_init_ethnl2_socket(nlctx);
+}
+
+/* string sets and parser messages live in the arena */
+static void bench_arena_reset(void)
+{
+	cleanup_all_strings();
+	arena_release(&nlctx->arena);
+	msgbuff_init(&nlctx->ethnl_socket->msgbuff, &nlctx->arena);
+	msgbuff_init(&nlctx->ethnl2_socket->msgbuff, &nlctx->arena);
+	/* receive slots too */
+	memset(nlctx->ethnl_socket->rx_slots, '\0',
+	       sizeof(nlctx->ethnl_socket->rx_slots));
+	memset(nlctx->ethnl2_socket->rx_slots, '\0',
+	       sizeof(nlctx->ethnl2_socket->rx_slots));
+}
+
+/* nl_parser() */
+
+static const struct lookup_entry_u8 bench_autoneg_values[] = {
+	{ .arg = "off",	.val = AUTONEG_DISABLE },
+	{ .arg = "on",	.val = AUTONEG_ENABLE },
+	{}
+};
+
+static const struct lookup_entry_u8 bench_duplex_values[] = {
+	{ .arg = "half",	.val = DUPLEX_HALF },
+	{ .arg = "full",	.val = DUPLEX_FULL },
+	{ .arg = "unknown",	.val = DUPLEX_UNKNOWN },
+	{}
+};
+
+static const struct bitset_parser_data bench_advertise_data = {
+	.no_mask	= false,
+	.force_hex	= true,
+};
+
+/* subset of "ethtool -s" parameters */
+static const struct param_parser bench_params[] = {
+	{
+		.arg		= "autoneg",
+		.type		= ETHTOOL_A_LINKMODES_AUTONEG,
+		.handler	= nl_parse_lookup_u8,
+		.handler_data	= bench_autoneg_values,
+		.min_argc	= 1,
+	},
+	{
+		.arg		= "advertise",
+		.type		= ETHTOOL_A_LINKMODES_OURS,
+		.handler	= nl_parse_bitset,
+		.handler_data	= &bench_advertise_data,
+		.min_argc	= 1,
+	},
+	{
+		.arg		= "speed",
+		.type		= ETHTOOL_A_LINKMODES_SPEED,
+		.handler	= nl_parse_direct_u32,
+		.min_argc	= 1,
+	},
+	{
+		.arg		= "lanes",
+		.type		= ETHTOOL_A_LINKMODES_LANES,
+		.handler	= nl_parse_direct_u32,
+		.min_argc	= 1,
+	},
+	{
+		.arg		= "duplex",
+		.type		= ETHTOOL_A_LINKMODES_DUPLEX,
+		.handler	= nl_parse_lookup_u8,
+		.handler_data	= bench_duplex_values,
+		.min_argc	= 1,
+	},
+	{}
+};
+
+static char *parser_args[] = {
+	"speed", "100000", "duplex", "full", "lanes", "4", "autoneg", "on",
+	"advertise", "0x800000000000000000000000/0xffffffffffffffffffffffff",
+};
+
+static void bench_parser_run(void)
+{
+	struct nl_msg_buff *msgbuff = &nlctx->ethnl_socket->msgbuff;
+
+	nlctx->cmd = "-s";
+	nlctx->argp = parser_args;
+	nlctx->argc = ARRAY_SIZE(parser_args);
+	nlctx->devname = bench_ctx.devname;
+	if (msg_init(nlctx, msgbuff, ETHTOOL_MSG_LINKMODES_SET,
+		     NLM_F_REQUEST | NLM_F_ACK) < 0 ||
+	    ethnla_fill_header(msgbuff, ETHTOOL_A_LINKMODES_HEADER,
+			       bench_ctx.devname, 0))
+		return;
+	nl_parser(nlctx, bench_params, NULL, PARSER_GROUP_NONE, NULL);
+}
+
+/* walk_bitset() and dump_link_modes() */
+
+static struct nl_msg_buff bitset_msg;
+static const struct nlattr *bench_bitset_attr;
+static struct nl_bitset bench_bitset;
+static const struct stringset *lm_strings;
+
+static int bench_bitset_setup(void)
+{
+	uint32_t value[8] = {}, mask[8] = {};
+	unsigned int nbits, i;
+	struct nlattr *nest;
+	int ret;
+
+	bench_live();
+	lm_strings = global_stringset(ETH_SS_LINK_MODES, nlctx->ethnl2_socket);
+	nbits = get_count(lm_strings);
+	if (!nbits || nbits > 32 * ARRAY_SIZE(value))
+		return -EINVAL;
+	/* every other mode advertised, all of them supported */
+	for (i = 0; i < nbits; i++) {
+		mask[i / 32] |= 1U << (i % 32);
+		if (i % 2 == 0)
+			value[i / 32] |= 1U << (i % 32);
+	}
+
+	msgbuff_init(&bitset_msg, NULL);
+	ret = __msg_init(&bitset_msg, nlctx->ethnl_fam,
+			 ETHTOOL_MSG_LINKMODES_GET_REPLY, 0, ETHTOOL_GENL_VERSION);
+	if (ret < 0)
+		return ret;
+	nest = ethnla_nest_start(&bitset_msg, ETHTOOL_A_LINKMODES_OURS);
+	if (!nest ||
+	    ethnla_put_u32(&bitset_msg, ETHTOOL_A_BITSET_SIZE, nbits) ||
+	    ethnla_put(&bitset_msg, ETHTOOL_A_BITSET_VALUE,
+		       DIV_ROUND_UP(nbits, 32) * sizeof(uint32_t), value) ||
+	    ethnla_put(&bitset_msg, ETHTOOL_A_BITSET_MASK,
+		       DIV_ROUND_UP(nbits, 32) * sizeof(uint32_t), mask))
+		return -EMSGSIZE;
+	ethnla_nest_end(&bitset_msg, nest);
+	bench_bitset_attr = nest;
+
+	return bitset_decode(&bench_bitset, bench_bitset_attr);
+}
+
+static void bench_walk_cb(unsigned int idx __maybe_unused,
+			  const char *name __maybe_unused, bool val,
+			  void *data)
+{
+	unsigned int *count = data;
+
+	*count += val;
+}
+
+static void bench_walk_bitset_run(void)
+{
+	unsigned int count = 0;
+
+	walk_bitset(bench_bitset_attr, lm_strings, bench_walk_cb, &count);
+}
+
+static void bench_dump_link_modes_run(void)
+{
+	dump_link_modes(nlctx, &bench_bitset, false, LM_CLASS_REAL,
+			"Advertised link modes:  ", NULL, "\n", "Not reported");
+}
+
+/* import_stringset() */
+
+static struct bench_dgrams strset_dgrams;
+
+#define BENCH_STRSETS \
+	(STRSET_BIT(ETH_SS_FEATURES) | STRSET_BIT(ETH_SS_LINK_MODES) | \
+	 STRSET_BIT(ETH_SS_MSG_CLASSES) | STRSET_BIT(ETH_SS_WOL_MODES) | \
+	 STRSET_BIT(ETH_SS_STATS_STD) | STRSET_BIT(ETH_SS_STATS_ETH_PHY) | \
+	 STRSET_BIT(ETH_SS_STATS_ETH_MAC) | STRSET_BIT(ETH_SS_STATS_ETH_CTRL) | \
+	 STRSET_BIT(ETH_SS_STATS_RMON))
+
+static int bench_strset_setup(void)
+{
+	int ret;
+
+	cleanup_all_strings();
+	bench_capture(&strset_dgrams);
+	ret = preload_stringsets(nlctx->ethnl_socket, NULL, BENCH_STRSETS, 0);
+	bench_serve(&strset_dgrams);
+	return ret;
+}
+
+static void bench_strset_run(void)
+{
+	cleanup_all_strings();
+	preload_stringsets(nlctx->ethnl_socket, NULL, BENCH_STRSETS, 0);
+}
+
+static void bench_strset_reset(void)
+{
+	bench_arena_reset();
+}
+
+/* stats_reply_cb() */
+
+static struct bench_dgrams stats_dgrams;
+
+static int bench_stats_setup(void)
+{
+	struct nl_socket *nlsk = nlctx->ethnl_socket;
+	uint32_t groups = (1U << __ETHTOOL_STATS_CNT) - 1;
+	struct nlattr *nest;
+	int ret;
+
+	bench_live();
+	ret = preload_stringsets(nlsk, NULL, BENCH_STRSETS, 0);
+	if (ret < 0)
+		return ret;
+	ret = nlsock_prep_get_request(nlsk, ETHTOOL_MSG_STATS_GET,
+				      ETHTOOL_A_STATS_HEADER, 0);
+	if (ret < 0)
+		return ret;
+	nest = ethnla_nest_start(&nlsk->msgbuff, ETHTOOL_A_STATS_GROUPS);
+	if (!nest ||
+	    ethnla_put_flag(&nlsk->msgbuff, ETHTOOL_A_BITSET_NOMASK, true) ||
+	    ethnla_put_u32(&nlsk->msgbuff, ETHTOOL_A_BITSET_SIZE,
+			   __ETHTOOL_STATS_CNT) ||
+	    ethnla_put(&nlsk->msgbuff, ETHTOOL_A_BITSET_VALUE, sizeof(groups),
+		       &groups))
+		return -EMSGSIZE;
+	ethnla_nest_end(&nlsk->msgbuff, nest);
+
+	bench_capture(&stats_dgrams);
+	ret = nlsock_sendmsg(nlsk, NULL);
+	if (ret >= 0)
+		ret = nlsock_process_reply(nlsk, stats_reply_cb, nlctx);
+	bench_live();
+	if (ret < 0)
+		return ret;
+	/* reply and ack */
+	return stats_dgrams.n == 2 ? 0 : -EPROTO;
+}
+
+static void bench_stats_run(void)
+{
+	/* zero sequence number and port id are not checked */
+	mnl_cb_run(stats_dgrams.data[0], stats_dgrams.len[0], 0, 0,
+		   stats_reply_cb, nlctx);
+}
+
+#endif /* ETHTOOL_ENABLE_NETLINK */
+
+static const struct bench benchmarks[] = {
+#ifdef ETHTOOL_ENABLE_NETLINK
+	{ "nl_parser", NULL, bench_parser_run, bench_arena_reset },
+	{ "walk_bitset", bench_bitset_setup, bench_walk_bitset_run, NULL },
+	{ "dump_link_modes", bench_bitset_setup, bench_dump_link_modes_run,
+	  NULL },
+	{ "import_stringset", bench_strset_setup, bench_strset_run,
+	  bench_strset_reset },
+	{ "stats_reply_cb", bench_stats_setup, bench_stats_run, NULL },
+#endif
+	{ "jsonw", bench_json_setup, bench_json_run, NULL },
+#ifdef ETHTOOL_ENABLE_PRETTY_DUMP
+	{ "sff8636_show_all", bench_sff8636_setup, bench_sff8636_run, NULL },
+	{ "cmis_show_all", bench_cmis_setup, bench_cmis_run, NULL },
+	{ "sfc_dump_regs", bench_sfc_setup, bench_sfc_run, NULL },
+	{ "ixgbe_dump_regs", bench_ixgbe_setup, bench_ixgbe_run, NULL },
+#endif
+	{ "rxclass_parse_ruleopts", NULL, bench_rxclass_run, NULL },
+};
+
+static bool bench_selected(const struct bench *b, int argc, char **argv)
+{
+	int i;
+
+	if (argc < 2)
+		return true;
+	for (i = 1; i < argc; i++)
+		if (strstr(b->name, argv[i]))
+			return true;
+	return false;
+}
+
+/**
+ * run_bench() - run one benchmark and report results
+ * @b:       benchmark
+ * @min_ns:  minimum total time of timed operations
+ * @results: stream to print results to
+ *
+ * Operations run in batches of BENCH_BATCH; only the batches themselves are
+ * timed, not the reset callback between them.
+ *
+ * Return: 0 on success, 1 if setup failed
+ */
+static int run_bench(const struct bench *b, uint64_t min_ns, FILE *results)
+{
+	unsigned long allocs = 0;
+	unsigned long ops = 0;
+	uint64_t elapsed = 0;
+	unsigned long start_allocs;
+	uint64_t start;
+	unsigned int i;
+	int ret;
+
+	ret = b->setup ? b->setup() : 0;
+	if (ret < 0) {
+		fprintf(results, "%-24s setup failed: %s\n", b->name,
+			strerror(-ret));
+		return 1;
+	}
+	/* warm up caches (and lazily loaded string sets) */
+	b->run();
+	if (b->reset)
+		b->reset();
+
+	while (elapsed < min_ns) {
+		start_allocs = test_alloc_count;
+		start = bench_now();
+		for (i = 0; i < BENCH_BATCH; i++)
+			b->run();
+		elapsed += bench_now() - start;
+		allocs += test_alloc_count - start_allocs;
+		ops += BENCH_BATCH;
+		if (b->reset)
+			b->reset();
+	}
+	fflush(stdout);
+
+	fprintf(results, "%-24s %10lu %12.1f %10.2f\n", b->name, ops,
+		(double)elapsed / ops, (double)allocs / ops);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t min_ns = BENCH_DEFAULT_TIME * 1000000ULL;
+	const struct bench *b;
+	const char *env;
+	FILE *results;
+	int rc = 0;
+
+	env = getenv("ETHTOOL_BENCH_TIME");
+	if (env)
+		min_ns = strtoul(env, NULL, 10) * 1000000ULL;
+
+	/* results go to original stdout, output of benchmarked code is lost */
+	results = fdopen(dup(STDOUT_FILENO), "w");
+	if (!results || !freopen("/dev/null", "w", stdout)) {
+		perror("bench-ethtool");
+		return 1;
+	}
+
+#ifdef ETHTOOL_ENABLE_NETLINK
+	if (bench_netlink_init() < 0) {
+		fprintf(stderr, "failed to initialize netlink context\n");
+		return 1;
+	}
+#endif
+
+	fprintf(results, "%-24s %10s %12s %10s\n", "benchmark", "ops", "ns/op",
+		"allocs/op");
+	for (b = benchmarks; b < benchmarks + ARRAY_SIZE(benchmarks); b++)
+		if (bench_selected(b, argc, argv))
+			rc |= run_bench(b, min_ns, results);
+
+	fclose(results);
+	return rc;
+}
@@ -36,6 +36,14 @@ struct cmis_memory_map {
 #define CMIS_PAGE_SIZE		0x80
 #define CMIS_I2C_ADDRESS	0x50
 
+/* Pages read at once by cmis_memory_map_init_pages(): first Page 00h, 01h,
+ * 02h and Bank 0 of Page 11h, then the other Banks of Page 11h.
+ */
+#define CMIS_FIRST_PAGES	4
+#define CMIS_MAX_REQUESTS						\
+	(CMIS_FIRST_PAGES > CMIS_MAX_BANKS - 1 ?			\
+	 CMIS_FIRST_PAGES : CMIS_MAX_BANKS - 1)
+
 static struct {
 	const char *str;
 	int offset;
@@ -929,8 +937,10 @@ static int
 cmis_memory_map_init_pages(struct cmd_context *ctx,
 			   struct cmis_memory_map *map)
 {
+	struct ethtool_module_eeprom requests[CMIS_MAX_REQUESTS];
 	struct ethtool_module_eeprom request;
-	int num_banks, i, ret;
+	int num_banks, n = 0, i, ret;
+	bool paged;
 
 	/* Lower Memory and Page 00h are always present.
 	 *
@@ -944,30 +954,29 @@ cmis_memory_map_init_pages(struct cmd_context *ctx,
 		return ret;
 	map->lower_memory = request.data;
 
-	cmis_request_init(&request, 0, 0x0, CMIS_PAGE_SIZE);
-	ret = nl_get_eeprom_page(ctx, &request);
-	if (ret < 0)
-		return ret;
-	map->page_00h = request.data - CMIS_PAGE_SIZE;
-
 	/* Pages 01h and 02h are only present when the module memory model is
-	 * paged and not flat.
+	 * paged and not flat. So is Bank 0 of Page 11h; the number of other
+	 * Banks is only known from Page 01h. Request all pages known to be
+	 * present at once so that they are read without waiting for each
+	 * other.
 	 */
-	if (map->lower_memory[CMIS_MEMORY_MODEL_OFFSET] &
-	    CMIS_MEMORY_MODEL_MASK)
-		return 0;
-
-	cmis_request_init(&request, 0, 0x1, CMIS_PAGE_SIZE);
-	ret = nl_get_eeprom_page(ctx, &request);
-	if (ret < 0)
-		return ret;
-	map->page_01h = request.data - CMIS_PAGE_SIZE;
-
-	cmis_request_init(&request, 0, 0x2, CMIS_PAGE_SIZE);
-	ret = nl_get_eeprom_page(ctx, &request);
+	paged = !(map->lower_memory[CMIS_MEMORY_MODEL_OFFSET] &
+		  CMIS_MEMORY_MODEL_MASK);
+	cmis_request_init(&requests[n++], 0, 0x0, CMIS_PAGE_SIZE);
+	if (paged) {
+		cmis_request_init(&requests[n++], 0, 0x1, CMIS_PAGE_SIZE);
+		cmis_request_init(&requests[n++], 0, 0x2, CMIS_PAGE_SIZE);
+		cmis_request_init(&requests[n++], 0, 0x11, CMIS_PAGE_SIZE);
+	}
+	ret = nl_get_eeprom_pages(ctx, requests, n);
 	if (ret < 0)
 		return ret;
-	map->page_02h = request.data - CMIS_PAGE_SIZE;
+	map->page_00h = requests[0].data - CMIS_PAGE_SIZE;
+	if (!paged)
+		return 0;
+	map->page_01h = requests[1].data - CMIS_PAGE_SIZE;
+	map->page_02h = requests[2].data - CMIS_PAGE_SIZE;
+	map->upper_memory[0][0x11] = requests[3].data - CMIS_PAGE_SIZE;
 
 	/* Bank 0 of Page 11h provides lane-specific registers for the first 8
 	 * lanes, and each additional Banks provides support for an additional
@@ -977,13 +986,14 @@ cmis_memory_map_init_pages(struct cmd_context *ctx,
 	if (ret < 0)
 		return ret;
 
-	for (i = 0; i < num_banks; i++) {
-		cmis_request_init(&request, i, 0x11, CMIS_PAGE_SIZE);
-		ret = nl_get_eeprom_page(ctx, &request);
-		if (ret < 0)
-			return ret;
-		map->upper_memory[i][0x11] = request.data - CMIS_PAGE_SIZE;
-	}
+	for (i = 1; i < num_banks; i++)
+		cmis_request_init(&requests[i - 1], i, 0x11, CMIS_PAGE_SIZE);
+	ret = nl_get_eeprom_pages(ctx, requests, num_banks - 1);
+	if (ret < 0)
+		return ret;
+	for (i = 1; i < num_banks; i++)
+		map->upper_memory[i][0x11] = requests[i - 1].data -
+					     CMIS_PAGE_SIZE;
 
 	return 0;
 }
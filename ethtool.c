@@ -50,6 +50,7 @@
 #include <linux/netlink.h>
 
 #include "common.h"
+#include "strcache.h"
 #include "netlink/extapi.h"
 
 #ifndef MAX_ADDR_LEN
@@ -1698,25 +1699,150 @@ static int dump_tsinfo(const struct ethtool_ts_info *info)
 	return 0;
 }
 
-static struct ethtool_gstrings *
-get_stringset(struct cmd_context *ctx, enum ethtool_stringset set_id,
-	      ptrdiff_t drvinfo_offset, int null_terminate)
+/* string sets used by ioctl code; their lengths are all fetched by the first
+ * ETHTOOL_GSSET_INFO request
+ */
+#define IOCTL_SSET_MASK \
+	((1ULL << ETH_SS_TEST) | (1ULL << ETH_SS_STATS) | \
+	 (1ULL << ETH_SS_PRIV_FLAGS) | (1ULL << ETH_SS_FEATURES) | \
+	 (1ULL << ETH_SS_RSS_HASH_FUNCS) | (1ULL << ETH_SS_PHY_STATS))
+#define IOCTL_SSET_COUNT	6
+
+/**
+ * struct sset_cache - string sets retrieved by ioctl
+ * @info_mask:    sets for which @len is known
+ * @info_errno:   errno of failed ETHTOOL_GSSET_INFO request (0 if none)
+ * @len:          number of strings in each set
+ * @strings:      string sets retrieved so far (without null termination)
+ *
+ * Each string set is retrieved from the kernel at most once per command
+ * context; get_stringset() returns a copy so that callers can modify and
+ * free it as before.
+ */
+struct sset_cache {
+	u64			info_mask;
+	int			info_errno;
+	u32			len[ETH_SS_COUNT];
+	struct ethtool_gstrings	*strings[ETH_SS_COUNT];
+};
+
+static void free_stringsets(struct cmd_context *ctx)
+{
+	struct sset_cache *cache = ctx->sset_cache;
+	unsigned int i;
+
+	if (!cache)
+		return;
+	for (i = 0; i < ETH_SS_COUNT; i++)
+		free(cache->strings[i]);
+	free(cache);
+	ctx->sset_cache = NULL;
+}
+
+static struct sset_cache *get_sset_cache(struct cmd_context *ctx)
+{
+	if (!ctx->sset_cache)
+		ctx->sset_cache = calloc(1, sizeof(struct sset_cache));
+	return ctx->sset_cache;
+}
+
+/* Fetch lengths of all ioctl string sets (or only @set_id if it is not one of
+ * them) with one ETHTOOL_GSSET_INFO request. Sets not supported by the device
+ * are reported with length 0.
+ */
+static int get_sset_lengths(struct cmd_context *ctx, struct sset_cache *cache,
+			    enum ethtool_stringset set_id)
 {
 	struct {
 		struct ethtool_sset_info hdr;
-		u32 buf[1];
+		u32 buf[IOCTL_SSET_COUNT];
 	} sset_info;
-	struct ethtool_drvinfo drvinfo;
-	u32 len, i;
-	struct ethtool_gstrings *strings;
+	const u32 *sset_lengths = sset_info.hdr.data;
+	u64 mask = IOCTL_SSET_MASK;
+	unsigned int i, n = 0;
+
+	if (!(mask & (1ULL << set_id)))
+		mask = 1ULL << set_id;
+	else if (cache->info_errno) {
+		errno = cache->info_errno;
+		return -1;
+	}
 
 	sset_info.hdr.cmd = ETHTOOL_GSSET_INFO;
 	sset_info.hdr.reserved = 0;
-	sset_info.hdr.sset_mask = 1ULL << set_id;
-	if (send_ioctl(ctx, &sset_info) == 0) {
-		const u32 *sset_lengths = sset_info.hdr.data;
+	sset_info.hdr.sset_mask = mask;
+	if (send_ioctl(ctx, &sset_info)) {
+		if (mask == IOCTL_SSET_MASK)
+			cache->info_errno = errno;
+		return -1;
+	}
+
+	for (i = 0; i < ETH_SS_COUNT; i++) {
+		if (!(mask & (1ULL << i)))
+			continue;
+		if (sset_info.hdr.sset_mask & (1ULL << i))
+			cache->len[i] = sset_lengths[n++];
+		else
+			cache->len[i] = 0;
+	}
+	cache->info_mask |= mask;
+	return 0;
+}
+
+static struct ethtool_gstrings *
+copy_stringset(const struct ethtool_gstrings *strings, int null_terminate)
+{
+	size_t size = sizeof(*strings) + strings->len * ETH_GSTRING_LEN;
+	struct ethtool_gstrings *copy;
+	u32 i;
+
+	copy = malloc(size);
+	if (!copy)
+		return NULL;
+	memcpy(copy, strings, size);
+	if (null_terminate)
+		for (i = 0; i < copy->len; i++)
+			copy->data[(i + 1) * ETH_GSTRING_LEN - 1] = 0;
+
+	return copy;
+}
+
+static struct ethtool_gstrings *
+get_stringset(struct cmd_context *ctx, enum ethtool_stringset set_id,
+	      ptrdiff_t drvinfo_offset, int null_terminate)
+{
+	struct ethtool_drvinfo drvinfo;
+	struct ethtool_gstrings *strings;
+	struct strcache_key key;
+	struct sset_cache *cache;
+	bool use_cache = false;
+	u32 len;
 
-		len = sset_info.hdr.sset_mask ? sset_lengths[0] : 0;
+	cache = get_sset_cache(ctx);
+	if (!cache)
+		return NULL;
+	if (cache->strings[set_id])
+		goto out;
+
+	/* Sets with length in drvinfo can be looked up in the on-disk cache;
+	 * on a miss, the length is already known so that ETHTOOL_GSSET_INFO
+	 * can be skipped.
+	 */
+	drvinfo.cmd = ETHTOOL_GDRVINFO;
+	if (drvinfo_offset != 0 && strcache_enabled() &&
+	    send_ioctl(ctx, &drvinfo) == 0 &&
+	    strcache_key_init(&key, &drvinfo, set_id) == 0) {
+		strings = strcache_load(&key);
+		if (strings)
+			goto store;
+		use_cache = true;
+		len = key.len;
+		goto get_strings;
+	}
+
+	if (cache->info_mask & (1ULL << set_id) ||
+	    get_sset_lengths(ctx, cache, set_id) == 0) {
+		len = cache->len[set_id];
 	} else if (errno == EOPNOTSUPP && drvinfo_offset != 0) {
 		/* Fallback for old kernel versions */
 		drvinfo.cmd = ETHTOOL_GDRVINFO;
@@ -1727,6 +1853,7 @@ get_stringset(struct cmd_context *ctx, enum ethtool_stringset set_id,
 		return NULL;
 	}
 
+get_strings:
 	strings = calloc(1, sizeof(*strings) + len * ETH_GSTRING_LEN);
 	if (!strings)
 		return NULL;
@@ -1738,12 +1865,13 @@ get_stringset(struct cmd_context *ctx, enum ethtool_stringset set_id,
 		free(strings);
 		return NULL;
 	}
+	if (use_cache && strings->len == len)
+		strcache_store(&key, strings);
 
-	if (null_terminate)
-		for (i = 0; i < len; i++)
-			strings->data[(i + 1) * ETH_GSTRING_LEN - 1] = 0;
-
-	return strings;
+store:
+	cache->strings[set_id] = strings;
+out:
+	return copy_stringset(cache->strings[set_id], null_terminate);
 }
 
 static struct feature_defs *get_feature_defs(struct cmd_context *ctx)
@@ -5623,6 +5751,7 @@ struct option {
 	const char	*opts;
 	bool		no_dev;
 	bool		json;
+	bool		fields;
 	int		(*func)(struct cmd_context *);
 	nl_chk_t	nlchk;
 	nl_func_t	nlfunc;
@@ -5660,6 +5789,7 @@ static const struct option args[] = {
 	{
 		.opts	= "-a|--show-pause",
 		.json	= true,
+		.fields	= true,
 		.func	= do_gpause,
 		.nlfunc	= nl_gpause,
 		.help	= "Show pause options"
@@ -5999,6 +6129,7 @@ static const struct option args[] = {
 	{
 		.opts	= "--show-fec",
 		.json	= true,
+		.fields	= true,
 		.func	= do_gfec,
 		.nlfunc	= nl_gfec,
 		.help	= "Show FEC settings",
@@ -6073,8 +6204,12 @@ static int show_usage(struct cmd_context *ctx __maybe_unused)
 	fprintf(stdout, "\n");
 	fprintf(stdout, "FLAGS:\n");
 	fprintf(stdout, "	--debug MASK	turn on debugging messages\n");
+	fprintf(stdout, "	--trace FILE	trace netlink requests into FILE, print latency summary\n");
+	fprintf(stdout, "	--record FILE	record netlink session into FILE\n");
+	fprintf(stdout, "	--replay FILE	replay recorded netlink session instead of talking to kernel\n");
 	fprintf(stdout, "	--json		enable JSON output format (not supported by all commands)\n");
 	fprintf(stdout, "	-I|--include-statistics		request device statistics related to the command (not supported by all commands)\n");
+	fprintf(stdout, "	--fields LIST	show only listed fields, e.g. rx,statistics.rx_pause_frames (not supported by all commands)\n");
 
 	return 0;
 }
@@ -6326,6 +6461,26 @@ int main(int argc, char **argp)
 			argc -= 2;
 			continue;
 		}
+		if (*argp && !strcmp(*argp, "--trace")) {
+			if (argc < 2)
+				exit_bad_args();
+			ctx.trace_file = argp[1];
+			argp += 2;
+			argc -= 2;
+			continue;
+		}
+		if (*argp && (!strcmp(*argp, "--record") ||
+			      !strcmp(*argp, "--replay"))) {
+			if (argc < 2)
+				exit_bad_args();
+			if (!strcmp(*argp, "--record"))
+				ctx.record_file = argp[1];
+			else
+				ctx.replay_file = argp[1];
+			argp += 2;
+			argc -= 2;
+			continue;
+		}
 		if (*argp && !strcmp(*argp, "--json")) {
 			ctx.json = true;
 			argp += 1;
@@ -6339,8 +6494,18 @@ int main(int argc, char **argp)
 			argc -= 1;
 			continue;
 		}
+		if (*argp && !strcmp(*argp, "--fields")) {
+			if (argc < 2)
+				exit_bad_args();
+			ctx.fields = argp[1];
+			argp += 2;
+			argc -= 2;
+			continue;
+		}
 		break;
 	}
+	if (ctx.record_file && ctx.replay_file)
+		exit_bad_args();
 	if (*argp && !strcmp(*argp, "--monitor")) {
 		ctx.argp = ++argp;
 		ctx.argc = --argc;
@@ -6374,16 +6539,21 @@ int main(int argc, char **argp)
 	}
 	if (ctx.json && !args[k].json)
 		exit_bad_args();
+	if (ctx.fields && !args[k].fields)
+		exit_bad_args();
 	ctx.argc = argc;
 	ctx.argp = argp;
 	netlink_run_handler(&ctx, args[k].nlchk, args[k].nlfunc, !args[k].func);
 
-	if (ctx.json) /* no IOCTL command supports JSON output */
+	/* no IOCTL command supports JSON output or field selection */
+	if (ctx.json || ctx.fields)
 		exit_bad_args();
 
 	ret = ioctl_init(&ctx, args[k].no_dev);
 	if (ret)
 		return ret;
 
-	return args[k].func(&ctx);
+	ret = args[k].func(&ctx);
+	free_stringsets(&ctx);
+	return ret;
 }
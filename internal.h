@@ -126,6 +126,7 @@ enum {
 	DEBUG_NL_DUMP_SND,	/* dump outgoing netlink messages */
 	DEBUG_NL_DUMP_RCV,	/* dump incoming netlink messages */
 	DEBUG_NL_PRETTY_MSG,	/* pretty print of messages and errors */
+	DEBUG_NL_TRACE,		/* trace netlink requests, latency summary */
 };
 
 static inline bool debug_on(unsigned long debug, unsigned int bit)
@@ -234,8 +235,13 @@ struct cmd_context {
 	unsigned int argc;	/* number of arguments to the sub-command */
 	char **argp;		/* arguments to the sub-command */
 	unsigned long debug;	/* debugging mask */
+	const char *trace_file;	/* netlink request trace file */
+	const char *record_file;	/* record netlink session into file */
+	const char *replay_file;	/* replay recorded netlink session */
 	bool json;		/* Output JSON, if supported */
 	bool show_stats;	/* include command-specific stats */
+	const char *fields;	/* selected output fields (--fields) */
+	struct sset_cache *sset_cache;	/* ioctl string sets (opaque) */
 #ifdef ETHTOOL_ENABLE_NETLINK
 	struct nl_context *nlctx;	/* netlink context (opaque) */
 #endif
@@ -243,6 +249,7 @@ struct cmd_context {
 
 #ifdef TEST_ETHTOOL
 int test_cmdline(const char *args);
+int test_cmdline_output(const char *args, char *buff, size_t size);
 
 struct cmd_expect {
 	const void *cmd;	/* expected command; NULL at end of list */
@@ -256,6 +263,8 @@ int test_ioctl(const struct cmd_expect *expect, void *cmd);
 
 int test_main(int argc, char **argp);
 void test_exit(int rc) __attribute__((noreturn));
+/* number of test_malloc() and test_realloc() calls so far */
+extern unsigned long test_alloc_count;
 
 #ifndef TEST_NO_WRAPPERS
 #define main(...) test_main(__VA_ARGS__)
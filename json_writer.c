@@ -110,7 +110,9 @@ void jsonw_destroy(json_writer_t **self_p)
 	json_writer_t *self = *self_p;
 
 	assert(self->depth == 0);
-	fputs("\n", self->out);
+	/* a record (jsonw_end_record()) already ended its line */
+	if (self->sep != '\0')
+		fputs("\n", self->out);
 	fflush(self->out);
 	free(self);
 	*self_p = NULL;
@@ -121,6 +123,14 @@ void jsonw_pretty(json_writer_t *self, bool on)
 	self->pretty = on;
 }
 
+/* End a top level value and its line (newline delimited JSON) */
+void jsonw_end_record(json_writer_t *self)
+{
+	assert(self->depth == 0);
+	putc('\n', self->out);
+	self->sep = '\0';
+}
+
 /* Basic blocks */
 static void jsonw_begin(json_writer_t *self, int c)
 {
@@ -0,0 +1,207 @@
+/*
+ * arena.c - region allocator
+ *
+ * Simple region allocator: small blocks are carved from larger chunks, large
+ * blocks get a chunk of their own. Nothing is freed until the whole arena is
+ * released so that a command touching many devices does not pay for many
+ * small malloc()/free() pairs and teardown does not need to walk all the
+ * data structures.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../internal.h"
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE	16384
+/* larger blocks get a dedicated chunk */
+#define ARENA_LARGE_BLOCK	(ARENA_CHUNK_SIZE / 4)
+#define ARENA_ALIGN		16
+#define ARENA_ALIGN_UP(x)	(((x) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct nl_arena_chunk {
+	struct nl_arena_chunk	*next;
+	size_t			size;
+	size_t			used;
+};
+
+#define ARENA_CHUNK_HDRLEN	ARENA_ALIGN_UP(sizeof(struct nl_arena_chunk))
+
+static char *chunk_data(struct nl_arena_chunk *chunk)
+{
+	return (char *)chunk + ARENA_CHUNK_HDRLEN;
+}
+
+static struct nl_arena_chunk *chunk_new(size_t size)
+{
+	struct nl_arena_chunk *chunk;
+
+	if (size > SIZE_MAX - ARENA_CHUNK_HDRLEN)
+		return NULL;
+	chunk = malloc(ARENA_CHUNK_HDRLEN + size);
+	if (!chunk)
+		return NULL;
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+/**
+ * arena_alloc() - allocate a block from arena
+ * @arena: arena to allocate from
+ * @size:  size of the block
+ *
+ * The block is aligned to 16 bytes and its contents are undefined.
+ *
+ * Return: pointer to the block or null if out of memory
+ */
+void *arena_alloc(struct nl_arena *arena, size_t size)
+{
+	struct nl_arena_chunk *chunk = arena->chunks;
+	void *ptr;
+
+	size = ARENA_ALIGN_UP(size ?: 1);
+	if (size > ARENA_LARGE_BLOCK) {
+		chunk = chunk_new(size);
+		if (!chunk)
+			return NULL;
+		chunk->used = size;
+		/* keep the current chunk at the head of the list */
+		if (arena->chunks) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			arena->chunks = chunk;
+		}
+		arena->n_chunks++;
+		arena->n_allocs++;
+		return chunk_data(chunk);
+	}
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		chunk = chunk_new(ARENA_CHUNK_SIZE);
+		if (!chunk)
+			return NULL;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+		arena->n_chunks++;
+	}
+	ptr = chunk_data(chunk) + chunk->used;
+	chunk->used += size;
+	arena->last = ptr;
+	arena->n_allocs++;
+
+	return ptr;
+}
+
+/**
+ * arena_zalloc() - allocate a zero initialized block from arena
+ * @arena: arena to allocate from
+ * @size:  size of the block
+ *
+ * Return: pointer to the block or null if out of memory
+ */
+void *arena_zalloc(struct nl_arena *arena, size_t size)
+{
+	void *ptr = arena_alloc(arena, size);
+
+	if (ptr)
+		memset(ptr, '\0', size);
+	return ptr;
+}
+
+/* dedicated chunk holding @ptr (and only @ptr), with its list link */
+static struct nl_arena_chunk **find_large_chunk(struct nl_arena *arena,
+						void *ptr)
+{
+	struct nl_arena_chunk **pchunk;
+
+	for (pchunk = &arena->chunks; *pchunk; pchunk = &(*pchunk)->next)
+		if (chunk_data(*pchunk) == ptr &&
+		    (*pchunk)->size > ARENA_LARGE_BLOCK)
+			return pchunk;
+
+	return NULL;
+}
+
+/**
+ * arena_realloc() - grow a block allocated from arena
+ * @arena:    arena the block was allocated from
+ * @ptr:      block to grow (null to allocate a new one)
+ * @old_size: current size of the block
+ * @new_size: requested size
+ *
+ * The most recent small block is grown in place if there is room in its
+ * chunk and large blocks are reallocated together with their dedicated
+ * chunk; otherwise a new block is allocated and the contents copied, the old
+ * block is only released with the whole arena. Contents of the added part
+ * are undefined. Blocks are never shrunk.
+ *
+ * Return: pointer to the (possibly moved) block or null if out of memory,
+ *         the original block is left intact in that case
+ */
+void *arena_realloc(struct nl_arena *arena, void *ptr, size_t old_size,
+		    size_t new_size)
+{
+	struct nl_arena_chunk *chunk = arena->chunks;
+	struct nl_arena_chunk **pchunk;
+	void *nptr;
+
+	if (!ptr)
+		return arena_alloc(arena, new_size);
+	if (new_size <= old_size)
+		return ptr;
+
+	old_size = ARENA_ALIGN_UP(old_size ?: 1);
+	if (ptr == arena->last && chunk &&
+	    chunk_data(chunk) + chunk->used == (char *)ptr + old_size &&
+	    ARENA_ALIGN_UP(new_size) - old_size <= chunk->size - chunk->used &&
+	    new_size <= ARENA_LARGE_BLOCK) {
+		chunk->used += ARENA_ALIGN_UP(new_size) - old_size;
+		return ptr;
+	}
+
+	pchunk = (old_size > ARENA_LARGE_BLOCK) ?
+		 find_large_chunk(arena, ptr) : NULL;
+	if (pchunk && new_size <= SIZE_MAX - ARENA_CHUNK_HDRLEN) {
+		new_size = ARENA_ALIGN_UP(new_size);
+		chunk = realloc(*pchunk, ARENA_CHUNK_HDRLEN + new_size);
+		if (!chunk)
+			return NULL;
+		chunk->size = new_size;
+		chunk->used = new_size;
+		*pchunk = chunk;
+		return chunk_data(chunk);
+	}
+
+	nptr = arena_alloc(arena, new_size);
+	if (!nptr)
+		return NULL;
+	memcpy(nptr, ptr, old_size);
+
+	return nptr;
+}
+
+/**
+ * arena_release() - free all memory allocated from arena
+ * @arena: arena to release
+ *
+ * All blocks allocated from @arena become invalid, the arena itself is left
+ * empty and can be used again.
+ */
+void arena_release(struct nl_arena *arena)
+{
+	struct nl_arena_chunk *chunk = arena->chunks;
+	struct nl_arena_chunk *next;
+
+	while (chunk) {
+		next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	memset(arena, '\0', sizeof(*arena));
+}
@@ -0,0 +1,39 @@
+/*
+ * arena.h - region allocator
+ *
+ * Declarations of region allocator for data which live until the end of
+ * a netlink command.
+ */
+
+#ifndef ETHTOOL_NETLINK_ARENA_H__
+#define ETHTOOL_NETLINK_ARENA_H__
+
+#include <stddef.h>
+
+struct nl_arena_chunk;
+
+/**
+ * struct nl_arena - region allocator
+ * @chunks:    list of allocated chunks, current chunk first
+ * @last:      most recent allocation from current chunk (can grow in place)
+ * @n_allocs:  number of allocations served
+ * @n_chunks:  number of chunks allocated from the system
+ *
+ * Memory obtained from an arena cannot be freed individually, it is all
+ * released at once by arena_release(). A zero initialized structure is an
+ * empty arena.
+ */
+struct nl_arena {
+	struct nl_arena_chunk	*chunks;
+	void			*last;
+	unsigned int		n_allocs;
+	unsigned int		n_chunks;
+};
+
+void *arena_alloc(struct nl_arena *arena, size_t size);
+void *arena_zalloc(struct nl_arena *arena, size_t size);
+void *arena_realloc(struct nl_arena *arena, void *ptr, size_t old_size,
+		    size_t new_size);
+void arena_release(struct nl_arena *arena);
+
+#endif /* ETHTOOL_NETLINK_ARENA_H__ */
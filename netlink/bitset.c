@@ -5,6 +5,8 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
 #include <errno.h>
 
 #include "../common.h"
@@ -43,124 +45,24 @@ bool bitset_is_compact(const struct nlattr *bitset)
 	return false;
 }
 
-bool bitset_get_bit(const struct nlattr *bitset, bool mask, unsigned int idx,
-		    int *retptr)
-{
-	const struct nlattr *bitset_tb[ETHTOOL_A_BITSET_MAX + 1] = {};
-	DECLARE_ATTR_TB_INFO(bitset_tb);
-	const struct nlattr *bits;
-	const struct nlattr *bit;
-	bool nomask;
-	int ret;
-
-	*retptr = 0;
-	ret = mnl_attr_parse_nested(bitset, attr_cb, &bitset_tb_info);
-	if (ret < 0)
-		goto err;
-
-	nomask = bitset_tb[ETHTOOL_A_BITSET_NOMASK];
-	if (mask && nomask) {
-		/* Trying to determine if a bit is set in the mask of a "no
-		 * mask" bitset doesn't make sense.
-		 */
-		ret = -EFAULT;
-		goto err;
-	}
-
-	bits = mask ? bitset_tb[ETHTOOL_A_BITSET_MASK] :
-		      bitset_tb[ETHTOOL_A_BITSET_VALUE];
-	if (bits) {
-		const uint32_t *bitmap =
-			(const uint32_t *)mnl_attr_get_payload(bits);
-
-		if (idx >= 8 * mnl_attr_get_payload_len(bits))
-			return false;
-		return bitmap[idx / 32] & (1U << (idx % 32));
-	}
-
-	bits = bitset_tb[ETHTOOL_A_BITSET_BITS];
-	if (!bits)
-		goto err;
-	mnl_attr_for_each_nested(bit, bits) {
-		const struct nlattr *tb[ETHTOOL_A_BITSET_BIT_MAX + 1] = {};
-		DECLARE_ATTR_TB_INFO(tb);
-		unsigned int my_idx;
-
-		if (mnl_attr_get_type(bit) != ETHTOOL_A_BITSET_BITS_BIT)
-			continue;
-		ret = mnl_attr_parse_nested(bit, attr_cb, &tb_info);
-		if (ret < 0)
-			goto err;
-		ret = -EFAULT;
-		if (!tb[ETHTOOL_A_BITSET_BIT_INDEX])
-			goto err;
-
-		my_idx = mnl_attr_get_u32(tb[ETHTOOL_A_BITSET_BIT_INDEX]);
-		if (my_idx == idx)
-			return mask || nomask || tb[ETHTOOL_A_BITSET_BIT_VALUE];
-	}
-
-	return false;
-err:
-	fprintf(stderr, "malformed netlink message (bitset)\n");
-	*retptr = ret;
-	return false;
-}
-
 bool bitset_is_empty(const struct nlattr *bitset, bool mask, int *retptr)
 {
-	const struct nlattr *bitset_tb[ETHTOOL_A_BITSET_MAX + 1] = {};
-	DECLARE_ATTR_TB_INFO(bitset_tb);
-	const struct nlattr *bits;
-	const struct nlattr *bit;
+	struct nl_bitset bs;
+	bool empty;
 	int ret;
 
 	*retptr = 0;
-	ret = mnl_attr_parse_nested(bitset, attr_cb, &bitset_tb_info);
-	if (ret < 0)
-		goto err;
-
-	bits = mask ? bitset_tb[ETHTOOL_A_BITSET_MASK] :
-		      bitset_tb[ETHTOOL_A_BITSET_VALUE];
-	if (bits) {
-		const uint32_t *bitmap =
-			(const uint32_t *)mnl_attr_get_payload(bits);
-		unsigned int n = mnl_attr_get_payload_len(bits);
-		unsigned int i;
-
-		ret = -EFAULT;
-		if (n % 4)
-			goto err;
-		for (i = 0; i < n / 4; i++)
-			if (bitmap[i])
-				return false;
+	ret = bitset_decode(&bs, bitset);
+	if (ret < 0) {
+		fprintf(stderr, "malformed netlink message (bitset)\n");
+		*retptr = ret;
 		return true;
 	}
+	/* mask of a list is all ones but only listed bits were sent */
+	empty = !bitset_weight(&bs, mask && !bs.nomask);
+	bitset_release(&bs);
 
-	bits = bitset_tb[ETHTOOL_A_BITSET_BITS];
-	if (!bits)
-		goto err;
-	mnl_attr_for_each_nested(bit, bits) {
-		const struct nlattr *tb[ETHTOOL_A_BITSET_BIT_MAX + 1] = {};
-		DECLARE_ATTR_TB_INFO(tb);
-
-		if (mnl_attr_get_type(bit) != ETHTOOL_A_BITSET_BITS_BIT)
-			continue;
-		if (mask || bitset_tb[ETHTOOL_A_BITSET_NOMASK])
-			return false;
-
-		ret = mnl_attr_parse_nested(bit, attr_cb, &tb_info);
-		if (ret < 0)
-			goto err;
-		if (tb[ETHTOOL_A_BITSET_BIT_VALUE])
-			return false;
-	}
-
-	return true;
-err:
-	fprintf(stderr, "malformed netlink message (bitset)\n");
-	*retptr = ret;
-	return true;
+	return empty;
 }
 
 static uint32_t *get_compact_bitset_attr(const struct nlattr *bitset,
@@ -194,66 +96,268 @@ uint32_t *get_compact_bitset_mask(const struct nlattr *bitset)
 	return get_compact_bitset_attr(bitset, ETHTOOL_A_BITSET_MASK);
 }
 
-int walk_bitset(const struct nlattr *bitset, const struct stringset *labels,
-		bitset_walk_callback cb, void *data)
+/* storage for @nwords of value and mask (and @count names if requested) */
+static int bitset_alloc(struct nl_bitset *bs, unsigned int count,
+			bool with_names)
+{
+	unsigned int nwords = DIV_ROUND_UP(count, 32);
+	size_t names_size = with_names ? count * sizeof(bs->names[0]) : 0;
+	uint32_t *words;
+
+	if (nwords <= BITSET_INLINE_WORDS && !with_names) {
+		words = bs->buff;
+	} else {
+		bs->alloc = malloc(names_size + 2 * nwords * sizeof(uint32_t));
+		if (!bs->alloc)
+			return -ENOMEM;
+		words = (uint32_t *)((char *)bs->alloc + names_size);
+		if (with_names) {
+			bs->names = bs->alloc;
+			memset(bs->names, '\0', names_size);
+		}
+	}
+	memset(words, '\0', 2 * nwords * sizeof(uint32_t));
+	bs->value = words;
+	bs->mask = words + nwords;
+
+	return 0;
+}
+
+/* all ones up to @count */
+static void bitmap_fill(uint32_t *map, unsigned int count)
+{
+	unsigned int nwords = DIV_ROUND_UP(count, 32);
+
+	if (!nwords)
+		return;
+	memset(map, 0xff, nwords * sizeof(uint32_t));
+	if (count % 32)
+		map[nwords - 1] = (1U << (count % 32)) - 1;
+}
+
+static int bitset_decode_verbose(struct nl_bitset *bs,
+				 const struct nlattr *bits)
 {
-	const struct nlattr *bitset_tb[ETHTOOL_A_BITSET_MAX + 1] = {};
-	DECLARE_ATTR_TB_INFO(bitset_tb);
-	const struct nlattr *bits;
 	const struct nlattr *bit;
-	bool is_list;
+	uint32_t *value;
+	uint32_t *mask;
 	int ret;
 
-	ret = mnl_attr_parse_nested(bitset, attr_cb, &bitset_tb_info);
+	ret = bitset_alloc(bs, bs->count, true);
 	if (ret < 0)
 		return ret;
-	is_list = bitset_tb[ETHTOOL_A_BITSET_NOMASK];
-
-	bits = bitset_tb[ETHTOOL_A_BITSET_VALUE];
-	if (bits) {
-		const struct nlattr *mask = bitset_tb[ETHTOOL_A_BITSET_MASK];
-		unsigned int count, nwords, idx;
-		uint32_t *val_bm;
-		uint32_t *mask_bm;
+	value = (uint32_t *)bs->value;
+	mask = (uint32_t *)bs->mask;
 
-		if (!bitset_tb[ETHTOOL_A_BITSET_SIZE])
-			return -EFAULT;
-		count = mnl_attr_get_u32(bitset_tb[ETHTOOL_A_BITSET_SIZE]);
-		nwords = (count + 31) / 32;
-		if ((mnl_attr_get_payload_len(bits) / 4 < nwords) ||
-		    (mask && mnl_attr_get_payload_len(mask) / 4 < nwords))
-			return -EFAULT;
-
-		val_bm = mnl_attr_get_payload(bits);
-		mask_bm = mask ? mnl_attr_get_payload(mask) : NULL;
-		for (idx = 0; idx < count; idx++)
-			if (!mask_bm || (mask_bm[idx / 32] & (1 << (idx % 32))))
-				cb(idx, get_string(labels, idx),
-				   val_bm[idx / 32] & (1 << (idx % 32)), data);
-		return 0;
-	}
-
-	bits = bitset_tb[ETHTOOL_A_BITSET_BITS];
-	if (!bits)
-		return -EFAULT;
 	mnl_attr_for_each_nested(bit, bits) {
 		const struct nlattr *tb[ETHTOOL_A_BITSET_BIT_MAX + 1] = {};
 		DECLARE_ATTR_TB_INFO(tb);
-		const char *name;
 		unsigned int idx;
 
 		if (mnl_attr_get_type(bit) != ETHTOOL_A_BITSET_BITS_BIT)
 			continue;
-
 		ret = mnl_attr_parse_nested(bit, attr_cb, &tb_info);
-		if (ret < 0 || !tb[ETHTOOL_A_BITSET_BIT_INDEX] ||
-		    !tb[ETHTOOL_A_BITSET_BIT_NAME])
+		if (ret < 0 || !tb[ETHTOOL_A_BITSET_BIT_INDEX])
 			return -EFAULT;
-
 		idx = mnl_attr_get_u32(tb[ETHTOOL_A_BITSET_BIT_INDEX]);
-		name = mnl_attr_get_str(tb[ETHTOOL_A_BITSET_BIT_NAME]);
-		cb(idx, name, is_list || tb[ETHTOOL_A_BITSET_BIT_VALUE], data);
+		if (idx >= bs->count)
+			return -EFAULT;
+
+		mask[idx / 32] |= (1U << (idx % 32));
+		if (bs->nomask || tb[ETHTOOL_A_BITSET_BIT_VALUE])
+			value[idx / 32] |= (1U << (idx % 32));
+		if (tb[ETHTOOL_A_BITSET_BIT_NAME])
+			bs->names[idx] =
+				mnl_attr_get_str(tb[ETHTOOL_A_BITSET_BIT_NAME]);
 	}
 
 	return 0;
 }
+
+/**
+ * bitset_decode() - decode a bitset attribute
+ * @bs:     decoded bitset to fill
+ * @bitset: ETHTOOL_A_*_BITSET nest (compact or verbose)
+ *
+ * On success, bitset_release() must be called when @bs is no longer used.
+ * For a list (no mask) bitset, the mask has all @count bits set.
+ *
+ * Return: 0 on success or negative error code
+ */
+int bitset_decode(struct nl_bitset *bs, const struct nlattr *bitset)
+{
+	const struct nlattr *tb[ETHTOOL_A_BITSET_MAX + 1] = {};
+	DECLARE_ATTR_TB_INFO(tb);
+	const struct nlattr *value;
+	const struct nlattr *mask;
+	int ret;
+
+	memset(bs, '\0', offsetof(struct nl_bitset, buff));
+	ret = mnl_attr_parse_nested(bitset, attr_cb, &tb_info);
+	if (ret < 0)
+		return ret;
+	if (!tb[ETHTOOL_A_BITSET_SIZE])
+		return -EFAULT;
+	bs->count = mnl_attr_get_u32(tb[ETHTOOL_A_BITSET_SIZE]);
+	bs->nwords = DIV_ROUND_UP(bs->count, 32);
+	bs->nomask = tb[ETHTOOL_A_BITSET_NOMASK];
+
+	value = tb[ETHTOOL_A_BITSET_VALUE];
+	if (!value) {
+		if (!tb[ETHTOOL_A_BITSET_BITS])
+			return -EFAULT;
+		ret = bitset_decode_verbose(bs, tb[ETHTOOL_A_BITSET_BITS]);
+		if (ret < 0)
+			bitset_release(bs);
+		return ret;
+	}
+
+	mask = bs->nomask ? NULL : tb[ETHTOOL_A_BITSET_MASK];
+	if (mnl_attr_get_payload_len(value) / 4 < bs->nwords ||
+	    (mask && mnl_attr_get_payload_len(mask) / 4 < bs->nwords))
+		return -EFAULT;
+	if (mask) {
+		bs->value = mnl_attr_get_payload(value);
+		bs->mask = mnl_attr_get_payload(mask);
+		return 0;
+	}
+
+	/* no mask: all bits are valid */
+	ret = bitset_alloc(bs, bs->count, false);
+	if (ret < 0)
+		return ret;
+	memcpy((uint32_t *)bs->value, mnl_attr_get_payload(value),
+	       bs->nwords * sizeof(uint32_t));
+	bitmap_fill((uint32_t *)bs->mask, bs->count);
+
+	return 0;
+}
+
+/**
+ * bitset_release() - free resources of a decoded bitset
+ * @bs: bitset decoded by bitset_decode()
+ */
+void bitset_release(struct nl_bitset *bs)
+{
+	free(bs->alloc);
+	bs->alloc = NULL;
+	bs->names = NULL;
+	bs->value = NULL;
+	bs->mask = NULL;
+}
+
+/**
+ * bitmap_next_set() - find next set bit
+ * @map:   bitmap (32-bit words)
+ * @count: number of valid bits in @map
+ * @start: index to start at
+ *
+ * Return: index of first set bit at or after @start or @count if none
+ */
+unsigned int bitmap_next_set(const uint32_t *map, unsigned int count,
+			     unsigned int start)
+{
+	unsigned int word_idx = start / 32;
+	uint32_t word;
+
+	if (start >= count)
+		return count;
+	word = map[word_idx] & (~0U << (start % 32));
+	while (!word) {
+		if (++word_idx >= DIV_ROUND_UP(count, 32))
+			return count;
+		word = map[word_idx];
+	}
+	start = word_idx * 32 + __builtin_ctz(word);
+
+	return start < count ? start : count;
+}
+
+/**
+ * bitmap_weight() - count set bits
+ * @map:   bitmap (32-bit words)
+ * @count: number of valid bits in @map
+ *
+ * Return: number of bits set among first @count bits of @map
+ */
+unsigned int bitmap_weight(const uint32_t *map, unsigned int count)
+{
+	unsigned int nwords = count / 32;
+	unsigned int weight = 0;
+	unsigned int i;
+
+	for (i = 0; i < nwords; i++)
+		weight += __builtin_popcount(map[i]);
+	if (count % 32)
+		weight += __builtin_popcount(map[nwords] &
+					     ((1U << (count % 32)) - 1));
+
+	return weight;
+}
+
+void bitmap_and(uint32_t *dst, const uint32_t *src1, const uint32_t *src2,
+		unsigned int nwords)
+{
+	unsigned int i;
+
+	for (i = 0; i < nwords; i++)
+		dst[i] = src1[i] & src2[i];
+}
+
+void bitmap_or(uint32_t *dst, const uint32_t *src1, const uint32_t *src2,
+	       unsigned int nwords)
+{
+	unsigned int i;
+
+	for (i = 0; i < nwords; i++)
+		dst[i] = src1[i] | src2[i];
+}
+
+/* bits set in @src1 but not in @src2 */
+void bitmap_andnot(uint32_t *dst, const uint32_t *src1, const uint32_t *src2,
+		   unsigned int nwords)
+{
+	unsigned int i;
+
+	for (i = 0; i < nwords; i++)
+		dst[i] = src1[i] & ~src2[i];
+}
+
+/**
+ * bitset_walk() - call a function for each bit of a decoded bitset
+ * @bs:     decoded bitset
+ * @labels: names for compact bitsets (verbose bitsets carry their own)
+ * @cb:     callback, called with bit index, name and value
+ * @data:   pointer passed to @cb
+ *
+ * @cb is called for each bit in the mask, i.e. for all bits of a list and
+ * for bits present in the message for a verbose bitset.
+ *
+ * Return: 0 (for consistency with walk_bitset())
+ */
+int bitset_walk(const struct nl_bitset *bs, const struct stringset *labels,
+		bitset_walk_callback cb, void *data)
+{
+	unsigned int idx;
+
+	bitset_for_each_set(idx, bs, true)
+		cb(idx, bs->names ? bs->names[idx] : get_string(labels, idx),
+		   bitset_test(bs, false, idx), data);
+
+	return 0;
+}
+
+int walk_bitset(const struct nlattr *bitset, const struct stringset *labels,
+		bitset_walk_callback cb, void *data)
+{
+	struct nl_bitset bs;
+	int ret;
+
+	ret = bitset_decode(&bs, bitset);
+	if (ret < 0)
+		return ret;
+	ret = bitset_walk(&bs, labels, cb, data);
+	bitset_release(&bs);
+
+	return ret;
+}
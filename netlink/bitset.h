@@ -15,9 +15,88 @@
 
 typedef void (*bitset_walk_callback)(unsigned int, const char *, bool, void *);
 
+/* bitsets up to this size (in 32-bit words) are decoded without malloc() */
+#define BITSET_INLINE_WORDS	8
+
+/**
+ * struct nl_bitset - decoded ethtool netlink bitset
+ * @count:  number of bits
+ * @nwords: number of 32-bit words in @value and @mask
+ * @nomask: bitset is a list (ETHTOOL_A_BITSET_NOMASK), @mask is all ones
+ * @value:  bit values
+ * @mask:   bit mask (bits listed in a verbose bitset)
+ * @names:  bit names indexed by bit (verbose bitsets only, null otherwise)
+ * @alloc:  allocated storage (if not null)
+ * @buff:   inline storage for small bitsets
+ *
+ * Both compact and verbose bitsets are decoded into value and mask words so
+ * that bits can be tested in constant time and set bits iterated over word
+ * by word. Words of a compact bitset point into the message when possible,
+ * the structure is then only valid while the message is.
+ */
+struct nl_bitset {
+	unsigned int	count;
+	unsigned int	nwords;
+	bool		nomask;
+	const uint32_t	*value;
+	const uint32_t	*mask;
+	const char	**names;
+	void		*alloc;
+	uint32_t	buff[2 * BITSET_INLINE_WORDS];
+};
+
+int bitset_decode(struct nl_bitset *bs, const struct nlattr *bitset);
+void bitset_release(struct nl_bitset *bs);
+unsigned int bitmap_next_set(const uint32_t *map, unsigned int count,
+			     unsigned int start);
+unsigned int bitmap_weight(const uint32_t *map, unsigned int count);
+void bitmap_and(uint32_t *dst, const uint32_t *src1, const uint32_t *src2,
+		unsigned int nwords);
+void bitmap_or(uint32_t *dst, const uint32_t *src1, const uint32_t *src2,
+	       unsigned int nwords);
+void bitmap_andnot(uint32_t *dst, const uint32_t *src1, const uint32_t *src2,
+		   unsigned int nwords);
+int bitset_walk(const struct nl_bitset *bs, const struct stringset *labels,
+		bitset_walk_callback cb, void *data);
+
+static inline bool bitmap_test(const uint32_t *map, unsigned int idx)
+{
+	return map[idx / 32] & (1U << (idx % 32));
+}
+
+static inline const uint32_t *bitset_words(const struct nl_bitset *bs,
+					   bool mask)
+{
+	return mask ? bs->mask : bs->value;
+}
+
+static inline bool bitset_test(const struct nl_bitset *bs, bool mask,
+			       unsigned int idx)
+{
+	return idx < bs->count && bitmap_test(bitset_words(bs, mask), idx);
+}
+
+static inline unsigned int bitset_weight(const struct nl_bitset *bs,
+					 bool mask)
+{
+	return bitmap_weight(bitset_words(bs, mask), bs->count);
+}
+
+/* first bit set in value (or mask) at or after @start, bs->count if none */
+static inline unsigned int bitset_next(const struct nl_bitset *bs, bool mask,
+				       unsigned int start)
+{
+	return bitmap_next_set(bitset_words(bs, mask), bs->count, start);
+}
+
+#define bitmap_for_each_set(idx, map, count) \
+	for ((idx) = bitmap_next_set((map), (count), 0); (idx) < (count); \
+	     (idx) = bitmap_next_set((map), (count), (idx) + 1))
+
+#define bitset_for_each_set(idx, bs, mask) \
+	bitmap_for_each_set(idx, bitset_words((bs), (mask)), (bs)->count)
+
 uint32_t bitset_get_count(const struct nlattr *bitset, int *retptr);
-bool bitset_get_bit(const struct nlattr *bitset, bool mask, unsigned int idx,
-		    int *retptr);
 bool bitset_is_compact(const struct nlattr *bitset);
 bool bitset_is_empty(const struct nlattr *bitset, bool mask, int *retptr);
 uint32_t *get_compact_bitset_value(const struct nlattr *bitset);
@@ -255,8 +255,7 @@ int nl_cable_test(struct cmd_context *ctx)
 		return -EOPNOTSUPP;
 	}
 
-	ret = mnl_socket_setsockopt(nlsk->sk, NETLINK_ADD_MEMBERSHIP,
-				    &grpid, sizeof(grpid));
+	ret = nlsock_add_membership(nlsk, grpid);
 	if (ret < 0)
 		return ret;
 
@@ -562,8 +561,7 @@ int nl_cable_test_tdr(struct cmd_context *ctx)
 		return -EOPNOTSUPP;
 	}
 
-	ret = mnl_socket_setsockopt(nlsk->sk, NETLINK_ADD_MEMBERSHIP,
-				    &grpid, sizeof(grpid));
+	ret = nlsock_add_membership(nlsk, grpid);
 	if (ret < 0)
 		return ret;
 
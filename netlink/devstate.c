@@ -0,0 +1,422 @@
+/*
+ * devstate.c - device state model
+ *
+ * State of each device (link settings, features, rings, channels, ...) is
+ * kept as the last message received for it, either a reply to the initial
+ * dump or a notification; ethtool notifications carry the same complete
+ * information as get replies. Each change (a message differing from the
+ * stored one) gets a sequence number so that consumers can tell what changed
+ * since they last looked. The model can be written as a JSON snapshot which
+ * is replaced atomically so that readers always see a consistent state.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../internal.h"
+#include "../json_writer.h"
+#include "netlink.h"
+#include "prettymsg.h"
+#include "devstate.h"
+
+/* devices are indexed by ifindex, ignore insanely high ones */
+#define DEVSTATE_MAX_INDEX	(1 << 20)
+
+enum devstate_type_id {
+	DS_LINKINFO,
+	DS_LINKMODES,
+	DS_WOL,
+	DS_DEBUG,
+	DS_FEATURES,
+	DS_PRIVFLAGS,
+	DS_RINGS,
+	DS_CHANNELS,
+	DS_COALESCE,
+	DS_PAUSE,
+	DS_EEE,
+	DS_FEC,
+
+	DS_COUNT
+};
+
+/**
+ * struct devstate_type - kind of device state
+ * @name:      name in JSON snapshot
+ * @get_cmd:   get request (ETHTOOL_MSG_*_GET)
+ * @reply_cmd: reply to @get_cmd (ETHTOOL_MSG_*_GET_REPLY)
+ * @ntf_cmd:   notification (ETHTOOL_MSG_*_NTF)
+ */
+struct devstate_type {
+	const char	*name;
+	uint8_t		get_cmd;
+	uint8_t		reply_cmd;
+	uint8_t		ntf_cmd;
+};
+
+#define DEVSTATE_TYPE(_id, _name, _MSG) \
+	[_id] = { \
+		.name		= _name, \
+		.get_cmd	= ETHTOOL_MSG_ ## _MSG ## _GET, \
+		.reply_cmd	= ETHTOOL_MSG_ ## _MSG ## _GET_REPLY, \
+		.ntf_cmd	= ETHTOOL_MSG_ ## _MSG ## _NTF, \
+	}
+
+static const struct devstate_type devstate_types[DS_COUNT] = {
+	DEVSTATE_TYPE(DS_LINKINFO, "linkinfo", LINKINFO),
+	DEVSTATE_TYPE(DS_LINKMODES, "linkmodes", LINKMODES),
+	DEVSTATE_TYPE(DS_WOL, "wol", WOL),
+	DEVSTATE_TYPE(DS_DEBUG, "debug", DEBUG),
+	DEVSTATE_TYPE(DS_FEATURES, "features", FEATURES),
+	DEVSTATE_TYPE(DS_PRIVFLAGS, "privflags", PRIVFLAGS),
+	DEVSTATE_TYPE(DS_RINGS, "rings", RINGS),
+	DEVSTATE_TYPE(DS_CHANNELS, "channels", CHANNELS),
+	DEVSTATE_TYPE(DS_COALESCE, "coalesce", COALESCE),
+	DEVSTATE_TYPE(DS_PAUSE, "pause", PAUSE),
+	DEVSTATE_TYPE(DS_EEE, "eee", EEE),
+	DEVSTATE_TYPE(DS_FEC, "fec", FEC),
+};
+
+/**
+ * struct devstate_entry - one kind of state of a device
+ * @msg:  last message received (null if none)
+ * @seq:  sequence number of last change
+ * @time: time of last change (CLOCK_REALTIME, ns)
+ * @gen:  dump generation the message was last seen in
+ */
+struct devstate_entry {
+	struct nlmsghdr	*msg;
+	uint64_t	seq;
+	uint64_t	time;
+	unsigned int	gen;
+};
+
+/**
+ * struct devstate_dev - state of a device
+ * @name:    device name
+ * @seq:     sequence number of last change of any entry
+ * @entries: state entries indexed by enum devstate_type_id
+ */
+struct devstate_dev {
+	char			name[IFNAMSIZ];
+	uint64_t		seq;
+	struct devstate_entry	entries[DS_COUNT];
+};
+
+/**
+ * struct devstate - device state model
+ * @devs:        devices indexed by ifindex
+ * @n_devs:      number of entries in @devs
+ * @seq:         sequence number of last change
+ * @written_seq: value of @seq when last snapshot was written
+ * @gen:         current dump generation
+ */
+struct devstate {
+	struct devstate_dev	*devs;
+	unsigned int		n_devs;
+	uint64_t		seq;
+	uint64_t		written_seq;
+	unsigned int		gen;
+};
+
+static uint64_t devstate_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int devstate_type_by_cmd(unsigned int cmd)
+{
+	unsigned int i;
+
+	for (i = 0; i < DS_COUNT; i++)
+		if (devstate_types[i].reply_cmd == cmd ||
+		    devstate_types[i].ntf_cmd == cmd)
+			return i;
+	return -1;
+}
+
+static bool devstate_dev_present(const struct devstate_dev *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < DS_COUNT; i++)
+		if (dev->entries[i].msg)
+			return true;
+	return false;
+}
+
+struct devstate *devstate_new(void)
+{
+	return calloc(1, sizeof(struct devstate));
+}
+
+void devstate_free(struct devstate *ds)
+{
+	unsigned int i, j;
+
+	if (!ds)
+		return;
+	for (i = 0; i < ds->n_devs; i++)
+		for (j = 0; j < DS_COUNT; j++)
+			free(ds->devs[i].entries[j].msg);
+	free(ds->devs);
+	free(ds);
+}
+
+static struct devstate_dev *devstate_get_dev(struct devstate *ds, int ifindex)
+{
+	struct devstate_dev *devs;
+	unsigned int n;
+
+	if (ifindex <= 0 || ifindex >= DEVSTATE_MAX_INDEX)
+		return NULL;
+	if ((unsigned int)ifindex < ds->n_devs)
+		return &ds->devs[ifindex];
+
+	n = ds->n_devs ?: 64;
+	while (n <= (unsigned int)ifindex)
+		n *= 2;
+	devs = realloc(ds->devs, n * sizeof(devs[0]));
+	if (!devs)
+		return NULL;
+	memset(devs + ds->n_devs, '\0', (n - ds->n_devs) * sizeof(devs[0]));
+	ds->devs = devs;
+	ds->n_devs = n;
+
+	return &ds->devs[ifindex];
+}
+
+/* messages carry the same state if everything after genetlink header is
+ * the same (command differs between replies and notifications)
+ */
+static bool devstate_msg_equal(const struct nlmsghdr *a,
+			       const struct nlmsghdr *b)
+{
+	return a->nlmsg_len == b->nlmsg_len &&
+	       !memcmp(mnl_nlmsg_get_payload_offset(a, GENL_HDRLEN),
+		       mnl_nlmsg_get_payload_offset(b, GENL_HDRLEN),
+		       a->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN);
+}
+
+/**
+ * devstate_update() - update device state from a message
+ * @ds:    device state model
+ * @nlhdr: get reply or notification
+ *
+ * Store @nlhdr as current state of its device and kind unless it is the same
+ * as the one already stored. Messages of other types are ignored.
+ *
+ * Return: 1 if the state changed, 0 if not, negative error code on failure
+ */
+int devstate_update(struct devstate *ds, const struct nlmsghdr *nlhdr)
+{
+	const struct genlmsghdr *ghdr = mnl_nlmsg_get_payload(nlhdr);
+	int len = mnl_nlmsg_get_payload_len(nlhdr) - GENL_HDRLEN;
+	char ifname[ALTIFNAMSIZ];
+	struct devstate_entry *entry;
+	const struct nlattr *header;
+	struct devstate_dev *dev;
+	struct nlmsghdr *msg;
+	int ifindex;
+	int type;
+	int ret;
+
+	if (len < NLA_HDRLEN)
+		return 0;
+	type = devstate_type_by_cmd(ghdr->cmd);
+	if (type < 0)
+		return 0;
+	/* header is the first attribute of all ethtool messages */
+	header = mnl_nlmsg_get_payload_offset(nlhdr, GENL_HDRLEN);
+	if (!mnl_attr_ok(header, len))
+		return 0;
+	ret = get_dev_info(header, &ifindex, ifname);
+	if (ret < 0)
+		return 0;
+	dev = devstate_get_dev(ds, ifindex);
+	if (!dev)
+		return ifindex > 0 ? -ENOMEM : 0;
+	entry = &dev->entries[type];
+	entry->gen = ds->gen;
+	if (entry->msg && devstate_msg_equal(entry->msg, nlhdr) &&
+	    !strcmp(dev->name, ifname))
+		return 0;
+
+	msg = malloc(nlhdr->nlmsg_len);
+	if (!msg)
+		return -ENOMEM;
+	memcpy(msg, nlhdr, nlhdr->nlmsg_len);
+	free(entry->msg);
+	entry->msg = msg;
+	entry->seq = dev->seq = ++ds->seq;
+	entry->time = devstate_now();
+	len = strnlen(ifname, sizeof(dev->name) - 1);
+	memcpy(dev->name, ifname, len);
+	dev->name[len] = '\0';
+
+	return 1;
+}
+
+/**
+ * devstate_dump_start() - start a dump refreshing the model
+ * @ds: device state model
+ *
+ * Entries not seen in the dump are dropped by devstate_dump_end().
+ */
+void devstate_dump_start(struct devstate *ds)
+{
+	ds->gen++;
+}
+
+/**
+ * devstate_dump_end() - finish a dump refreshing the model
+ * @ds:      device state model
+ * @get_cmd: get request which was dumped (ETHTOOL_MSG_*_GET)
+ *
+ * Drop state of the kind provided by @get_cmd of devices which were not in
+ * the dump (e.g. because they were removed).
+ */
+void devstate_dump_end(struct devstate *ds, unsigned int get_cmd)
+{
+	struct devstate_entry *entry;
+	unsigned int type, i;
+
+	for (type = 0; type < DS_COUNT; type++)
+		if (devstate_types[type].get_cmd == get_cmd)
+			break;
+	if (type == DS_COUNT)
+		return;
+
+	for (i = 0; i < ds->n_devs; i++) {
+		entry = &ds->devs[i].entries[type];
+		if (!entry->msg || entry->gen == ds->gen)
+			continue;
+		free(entry->msg);
+		entry->msg = NULL;
+		entry->seq = ds->devs[i].seq = ++ds->seq;
+		entry->time = devstate_now();
+	}
+}
+
+/**
+ * devstate_dirty() - check for changes not written yet
+ * @ds: device state model
+ *
+ * Return: true if the model changed since devstate_write() was last called
+ */
+bool devstate_dirty(const struct devstate *ds)
+{
+	return ds->seq != ds->written_seq;
+}
+
+static void devstate_json_time(json_writer_t *jw, const char *name,
+			       uint64_t time)
+{
+	jsonw_name(jw, name);
+	jsonw_printf(jw, "%llu.%09llu",
+		     (unsigned long long)(time / 1000000000ULL),
+		     (unsigned long long)(time % 1000000000ULL));
+}
+
+static void devstate_json_dev(json_writer_t *jw, const struct devstate_dev *dev,
+			      unsigned int ifindex)
+{
+	const struct devstate_entry *entry;
+	unsigned int i;
+
+	jsonw_start_object(jw);
+	jsonw_uint_field(jw, "ifindex", ifindex);
+	jsonw_string_field(jw, "dev", dev->name);
+	jsonw_u64_field(jw, "seq", dev->seq);
+	jsonw_name(jw, "state");
+	jsonw_start_object(jw);
+	for (i = 0; i < DS_COUNT; i++) {
+		entry = &dev->entries[i];
+		if (!entry->msg)
+			continue;
+		jsonw_name(jw, devstate_types[i].name);
+		jsonw_start_object(jw);
+		jsonw_u64_field(jw, "seq", entry->seq);
+		devstate_json_time(jw, "time", entry->time);
+		json_print_genlmsg(jw, entry->msg, ethnl_kmsg_desc,
+				   ethnl_kmsg_n_desc);
+		jsonw_end_object(jw);
+	}
+	jsonw_end_object(jw);
+	jsonw_end_object(jw);
+}
+
+/**
+ * devstate_write() - write snapshot of the model
+ * @ds:   device state model
+ * @path: snapshot file
+ *
+ * Snapshot is a JSON object with the sequence number of last change and an
+ * array of devices, each with its sequence number and decoded messages. It
+ * is written into a temporary file which then replaces @path so that readers
+ * never see a partially written snapshot.
+ *
+ * Return: 0 on success or negative error code
+ */
+int devstate_write(struct devstate *ds, const char *path)
+{
+	json_writer_t *jw;
+	unsigned int i;
+	char *tmp_path;
+	bool failed;
+	FILE *file;
+	int ret;
+
+	tmp_path = malloc(strlen(path) + 5);
+	if (!tmp_path)
+		return -ENOMEM;
+	sprintf(tmp_path, "%s.tmp", path);
+	file = fopen(tmp_path, "w");
+	if (!file) {
+		ret = -errno;
+		goto err_path;
+	}
+	jw = jsonw_new(file);
+	if (!jw) {
+		ret = -ENOMEM;
+		fclose(file);
+		goto err_unlink;
+	}
+
+	jsonw_start_object(jw);
+	jsonw_u64_field(jw, "seq", ds->seq);
+	devstate_json_time(jw, "time", devstate_now());
+	jsonw_name(jw, "devices");
+	jsonw_start_array(jw);
+	for (i = 0; i < ds->n_devs; i++)
+		if (devstate_dev_present(&ds->devs[i]))
+			devstate_json_dev(jw, &ds->devs[i], i);
+	jsonw_end_array(jw);
+	jsonw_end_object(jw);
+	jsonw_destroy(&jw);
+
+	failed = ferror(file);
+	if (fclose(file) || failed) {
+		ret = -EIO;
+		goto err_unlink;
+	}
+	if (rename(tmp_path, path) < 0) {
+		ret = -errno;
+		goto err_unlink;
+	}
+
+	free(tmp_path);
+	ds->written_seq = ds->seq;
+	return 0;
+err_unlink:
+	unlink(tmp_path);
+err_path:
+	fprintf(stderr, "failed to write state file %s: %s\n", path,
+		strerror(-ret));
+	free(tmp_path);
+	return ret;
+}
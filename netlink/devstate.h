@@ -0,0 +1,23 @@
+/*
+ * devstate.h - device state model
+ *
+ * Declarations of per device state maintained from ethtool notifications.
+ */
+
+#ifndef ETHTOOL_NETLINK_DEVSTATE_H__
+#define ETHTOOL_NETLINK_DEVSTATE_H__
+
+#include <stdbool.h>
+#include <linux/netlink.h>
+
+struct devstate;
+
+struct devstate *devstate_new(void);
+void devstate_free(struct devstate *ds);
+int devstate_update(struct devstate *ds, const struct nlmsghdr *nlhdr);
+void devstate_dump_start(struct devstate *ds);
+void devstate_dump_end(struct devstate *ds, unsigned int get_cmd);
+bool devstate_dirty(const struct devstate *ds);
+int devstate_write(struct devstate *ds, const char *path);
+
+#endif /* ETHTOOL_NETLINK_DEVSTATE_H__ */
@@ -12,8 +12,10 @@
 #include "../internal.h"
 #include "../common.h"
 #include "netlink.h"
+#include "strset.h"
 #include "bitset.h"
 #include "parser.h"
+#include "template.h"
 
 /* EEE_GET */
 
@@ -22,6 +24,7 @@ int eee_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 	const struct nlattr *tb[ETHTOOL_A_EEE_MAX + 1] = {};
 	DECLARE_ATTR_TB_INFO(tb);
 	bool enabled, active, tx_lpi_enabled;
+	struct nl_bitset ours, peer;
 	struct nl_context *nlctx = data;
 	bool silent;
 	int err_ret;
@@ -36,7 +39,7 @@ int eee_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 	if (!dev_ok(nlctx))
 		return err_ret;
 
-	if (!tb[ETHTOOL_A_EEE_MODES_OURS] ||
+	if (!tb[ETHTOOL_A_EEE_MODES_OURS] || !tb[ETHTOOL_A_EEE_MODES_PEER] ||
 	    !tb[ETHTOOL_A_EEE_ACTIVE] || !tb[ETHTOOL_A_EEE_ENABLED] ||
 	    !tb[ETHTOOL_A_EEE_TX_LPI_ENABLED] ||
 	    !tb[ETHTOOL_A_EEE_TX_LPI_TIMER]) {
@@ -50,10 +53,21 @@ int eee_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 	if (silent)
 		putchar('\n');
 	printf("EEE settings for %s:\n", nlctx->devname);
+	if (bitset_decode(&ours, tb[ETHTOOL_A_EEE_MODES_OURS]) < 0) {
+		fprintf(stderr, "Malformed response from kernel\n");
+		return err_ret;
+	}
+	if (bitset_decode(&peer, tb[ETHTOOL_A_EEE_MODES_PEER]) < 0) {
+		fprintf(stderr, "Malformed response from kernel\n");
+		bitset_release(&ours);
+		return err_ret;
+	}
+	ret = MNL_CB_OK;
+
 	printf("\tEEE status: ");
-	if (bitset_is_empty(tb[ETHTOOL_A_EEE_MODES_OURS], true, &ret)) {
+	if (!bitset_weight(&ours, true)) {
 		printf("not supported\n");
-		return MNL_CB_OK;
+		goto out;
 	}
 	if (!enabled)
 		printf("disabled\n");
@@ -66,32 +80,28 @@ int eee_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 	else
 		printf("disabled\n");
 
-	ret = dump_link_modes(nlctx, tb[ETHTOOL_A_EEE_MODES_OURS], true,
-			      LM_CLASS_REAL,
-			      "Supported EEE link modes:  ", NULL, "\n",
-			      "Not reported");
-	if (ret < 0)
-		return err_ret;
-	ret = dump_link_modes(nlctx, tb[ETHTOOL_A_EEE_MODES_OURS], false,
-			      LM_CLASS_REAL,
-			      "Advertised EEE link modes:  ", NULL, "\n",
-			      "Not reported");
-	if (ret < 0)
-		return err_ret;
-	ret = dump_link_modes(nlctx, tb[ETHTOOL_A_EEE_MODES_PEER], false,
-			      LM_CLASS_REAL,
-			      "Link partner advertised EEE link modes:  ", NULL,
-			      "\n", "Not reported");
-	if (ret < 0)
-		return err_ret;
-
-	return MNL_CB_OK;
+	if (dump_link_modes(nlctx, &ours, true, LM_CLASS_REAL,
+			    "Supported EEE link modes:  ", NULL, "\n",
+			    "Not reported") < 0 ||
+	    dump_link_modes(nlctx, &ours, false, LM_CLASS_REAL,
+			    "Advertised EEE link modes:  ", NULL, "\n",
+			    "Not reported") < 0 ||
+	    dump_link_modes(nlctx, &peer, false, LM_CLASS_REAL,
+			    "Link partner advertised EEE link modes:  ", NULL,
+			    "\n", "Not reported") < 0)
+		ret = err_ret;
+
+out:
+	bitset_release(&ours);
+	bitset_release(&peer);
+	return ret;
 }
 
 int nl_geee(struct cmd_context *ctx)
 {
 	struct nl_context *nlctx = ctx->nlctx;
 	struct nl_socket *nlsk = nlctx->ethnl_socket;
+	u32 flags;
 	int ret;
 
 	if (netlink_cmd_check(ctx, ETHTOOL_MSG_EEE_GET, true))
@@ -102,8 +112,9 @@ int nl_geee(struct cmd_context *ctx)
 		return 1;
 	}
 
+	flags = get_bitset_flags(nlctx, STRSET_BIT(ETH_SS_LINK_MODES), 0);
 	ret = nlsock_prep_get_request(nlsk, ETHTOOL_MSG_EEE_GET,
-				      ETHTOOL_A_EEE_HEADER, 0);
+				      ETHTOOL_A_EEE_HEADER, flags);
 	if (ret < 0)
 		return ret;
 	return nlsock_send_get_request(nlsk, eee_reply_cb);
@@ -148,11 +159,9 @@ static const struct param_parser seee_params[] = {
 int nl_seee(struct cmd_context *ctx)
 {
 	struct nl_context *nlctx = ctx->nlctx;
-	struct nl_msg_buff *msgbuff;
-	struct nl_socket *nlsk;
 	int ret;
 
-	if (netlink_cmd_check(ctx, ETHTOOL_MSG_EEE_SET, false))
+	if (tmpl_cmd_check(ctx, ETHTOOL_MSG_EEE_SET, ETHTOOL_MSG_EEE_GET))
 		return -EOPNOTSUPP;
 	if (!ctx->argc) {
 		fprintf(stderr, "ethtool (--set-eee): parameters missing\n");
@@ -163,25 +172,17 @@ int nl_seee(struct cmd_context *ctx)
 	nlctx->argp = ctx->argp;
 	nlctx->argc = ctx->argc;
 	nlctx->devname = ctx->devname;
-	nlsk = nlctx->ethnl_socket;
-	msgbuff = &nlsk->msgbuff;
 
-	ret = msg_init(nlctx, msgbuff, ETHTOOL_MSG_EEE_SET,
-		       NLM_F_REQUEST | NLM_F_ACK);
+	ret = tmpl_msg_init(nlctx, ETHTOOL_MSG_EEE_SET,
+			    ETHTOOL_A_EEE_HEADER);
 	if (ret < 0)
 		return 2;
-	if (ethnla_fill_header(msgbuff, ETHTOOL_A_EEE_HEADER,
-			       ctx->devname, 0))
-		return -EMSGSIZE;
 
 	ret = nl_parser(nlctx, seee_params, NULL, PARSER_GROUP_NONE, NULL);
 	if (ret < 0)
 		return 1;
 
-	ret = nlsock_sendmsg(nlsk, NULL);
-	if (ret < 0)
-		return 76;
-	ret = nlsock_process_reply(nlsk, nomsg_reply_cb, nlctx);
+	ret = tmpl_send(nlctx, ETHTOOL_MSG_EEE_GET, ETHTOOL_A_EEE_HEADER);
 	if (ret == 0)
 		return 0;
 	else
@@ -0,0 +1,509 @@
+/*
+ * evlog.c - binary log of notifications
+ *
+ * Notifications are appended to the log as raw netlink messages with their
+ * receive time. The file is a header followed by fixed size blocks; each
+ * block starts with its index entry: time of the first and the last record
+ * and the set of devices with records in the block (a bitmap of device name
+ * hashes). A query can therefore find the first block of a time range by
+ * binary search and skip blocks without records for the devices it looks for
+ * without reading them. Blocks are written in append order and the search
+ * relies on receive times not going backwards (e.g. a large step of the
+ * system clock).
+ *
+ * Data are stored in host byte order, logs are meant to be queried on the
+ * system they were written on (or one of the same architecture).
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../internal.h"
+#include "netlink.h"
+#include "evlog.h"
+
+#define EVLOG_MAGIC		"ETHEVLOG"
+#define EVLOG_VERSION		1
+#define EVLOG_BLOCK_MAGIC	0x424c5645	/* "EVLB" */
+#define EVLOG_BLOCK_SIZE	(64 << 10)
+#define EVLOG_DEV_BITS		256
+#define EVLOG_ALIGN(len)	(((len) + 7) & ~7U)
+
+/**
+ * struct evlog_file_hdr - log file header
+ * @magic:      EVLOG_MAGIC
+ * @version:    format version (EVLOG_VERSION)
+ * @block_size: size of blocks following the header
+ * @reserved:   zero
+ */
+struct evlog_file_hdr {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	block_size;
+	uint32_t	reserved[12];
+};
+
+/**
+ * struct evlog_block_hdr - block header (index entry)
+ * @magic:     EVLOG_BLOCK_MAGIC
+ * @n_records: number of records in the block
+ * @used:      bytes used by the header and the records
+ * @reserved:  zero
+ * @first:     time of the first record (CLOCK_REALTIME, ns)
+ * @last:      time of the last record (CLOCK_REALTIME, ns)
+ * @devs:      bitmap of hashes of device names in records
+ */
+struct evlog_block_hdr {
+	uint32_t	magic;
+	uint32_t	n_records;
+	uint32_t	used;
+	uint32_t	reserved;
+	uint64_t	first;
+	uint64_t	last;
+	uint32_t	devs[EVLOG_DEV_BITS / 32];
+};
+
+/**
+ * struct evlog_rec - record header, followed by the message
+ * @time:  receive time (CLOCK_REALTIME, ns)
+ * @len:   length of the message
+ * @flags: EVLOG_F_* flags
+ */
+struct evlog_rec {
+	uint64_t	time;
+	uint32_t	len;
+	uint32_t	flags;
+};
+
+/**
+ * struct evlog - log open for appending
+ * @fd:     file descriptor
+ * @block:  current block (header and records)
+ * @index:  index of current block in the file
+ * @synced: bytes of current block written to the file (0 if none)
+ */
+struct evlog {
+	int		fd;
+	char		*block;
+	unsigned int	index;
+	unsigned int	synced;
+};
+
+static off_t evlog_block_offset(unsigned int index)
+{
+	return sizeof(struct evlog_file_hdr) + (off_t)index * EVLOG_BLOCK_SIZE;
+}
+
+static uint64_t evlog_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* FNV-1a */
+static unsigned int evlog_dev_hash(const char *name)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619U;
+	}
+	return hash % EVLOG_DEV_BITS;
+}
+
+static void evlog_block_reset(struct evlog *log)
+{
+	struct evlog_block_hdr *hdr = (struct evlog_block_hdr *)log->block;
+
+	memset(log->block, '\0', EVLOG_BLOCK_SIZE);
+	hdr->magic = EVLOG_BLOCK_MAGIC;
+	hdr->used = sizeof(*hdr);
+	log->synced = 0;
+}
+
+static int evlog_pwrite(int fd, const void *buff, size_t len, off_t offset)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = pwrite(fd, buff, len, offset);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return ret < 0 ? -errno : -EIO;
+		buff = (const char *)buff + ret;
+		len -= ret;
+		offset += ret;
+	}
+	return 0;
+}
+
+/* Return: 0 on success, -ENODATA at end of file, other negative on error */
+static int evlog_pread(int fd, void *buff, size_t len, off_t offset)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = pread(fd, buff, len, offset);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return ret < 0 ? -errno : -ENODATA;
+		buff = (char *)buff + ret;
+		len -= ret;
+		offset += ret;
+	}
+	return 0;
+}
+
+static int evlog_check_hdr(const struct evlog_file_hdr *hdr)
+{
+	if (memcmp(hdr->magic, EVLOG_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != EVLOG_VERSION ||
+	    hdr->block_size != EVLOG_BLOCK_SIZE)
+		return -EINVAL;
+	return 0;
+}
+
+/**
+ * evlog_open() - open a log for appending
+ * @path: log file
+ * @err:  store error code here on failure
+ *
+ * A new file is created if @path does not exist. Records are appended to an
+ * existing log in a new block so that blocks written before are never
+ * modified.
+ *
+ * Return: log handle or null on failure
+ */
+struct evlog *evlog_open(const char *path, int *err)
+{
+	struct evlog_file_hdr hdr = {};
+	struct evlog *log;
+	struct stat st;
+	int ret;
+
+	log = calloc(1, sizeof(*log));
+	if (!log) {
+		*err = -ENOMEM;
+		return NULL;
+	}
+	log->block = malloc(EVLOG_BLOCK_SIZE);
+	if (!log->block) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+	log->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (log->fd < 0) {
+		ret = -errno;
+		goto err_free;
+	}
+	if (fstat(log->fd, &st) < 0) {
+		ret = -errno;
+		goto err_close;
+	}
+
+	if (st.st_size == 0) {
+		memcpy(hdr.magic, EVLOG_MAGIC, sizeof(hdr.magic));
+		hdr.version = EVLOG_VERSION;
+		hdr.block_size = EVLOG_BLOCK_SIZE;
+		ret = evlog_pwrite(log->fd, &hdr, sizeof(hdr), 0);
+		if (ret < 0)
+			goto err_close;
+	} else {
+		ret = evlog_pread(log->fd, &hdr, sizeof(hdr), 0);
+		if (ret == 0)
+			ret = evlog_check_hdr(&hdr);
+		if (ret < 0) {
+			ret = -EINVAL;
+			goto err_close;
+		}
+		/* a partially written last block is overwritten */
+		log->index = (st.st_size - sizeof(hdr)) / EVLOG_BLOCK_SIZE;
+	}
+	evlog_block_reset(log);
+
+	return log;
+err_close:
+	close(log->fd);
+err_free:
+	free(log->block);
+	free(log);
+	*err = ret;
+	return NULL;
+}
+
+/**
+ * evlog_sync() - write records appended to current block
+ * @log: log handle
+ *
+ * Write the records appended since the last call and the block header so
+ * that the log is up to date whenever the monitor is idle. Queries count
+ * whole blocks, the file is extended to the end of a new block (leaving
+ * a hole) when it is written for the first time. Records go first so that
+ * the header never covers records which are not in the file yet.
+ *
+ * Return: 0 on success or negative error code
+ */
+int evlog_sync(struct evlog *log)
+{
+	struct evlog_block_hdr *hdr = (struct evlog_block_hdr *)log->block;
+	off_t offset = evlog_block_offset(log->index);
+	unsigned int start;
+	int ret;
+
+	if (!hdr->n_records || hdr->used == log->synced)
+		return 0;
+	if (!log->synced &&
+	    ftruncate(log->fd, evlog_block_offset(log->index + 1)) < 0)
+		return -errno;
+	start = log->synced ?: sizeof(*hdr);
+	ret = evlog_pwrite(log->fd, log->block + start, hdr->used - start,
+			   offset + start);
+	if (ret == 0)
+		ret = evlog_pwrite(log->fd, hdr, sizeof(*hdr), offset);
+	if (ret < 0)
+		return ret;
+	log->synced = hdr->used;
+	return 0;
+}
+
+/**
+ * evlog_close() - write pending records and close the log
+ * @log: log handle (may be null)
+ *
+ * Return: 0 on success or negative error code
+ */
+int evlog_close(struct evlog *log)
+{
+	int ret;
+
+	if (!log)
+		return 0;
+	ret = evlog_sync(log);
+	close(log->fd);
+	free(log->block);
+	free(log);
+	return ret;
+}
+
+/**
+ * evlog_append() - append a message to the log
+ * @log:   log handle
+ * @nlhdr: notification or reply to a dump
+ * @cmd:   genetlink command to store (notification type for dump replies)
+ * @flags: EVLOG_F_* flags of the record
+ *
+ * Return: 0 on success or negative error code (-EMSGSIZE if the message does
+ * not fit into a block)
+ */
+int evlog_append(struct evlog *log, const struct nlmsghdr *nlhdr,
+		 uint8_t cmd, unsigned int flags)
+{
+	struct evlog_block_hdr *hdr = (struct evlog_block_hdr *)log->block;
+	unsigned int len = EVLOG_ALIGN(sizeof(struct evlog_rec) +
+				       nlhdr->nlmsg_len);
+	unsigned int payload_len = nlhdr->nlmsg_len - NLMSG_HDRLEN;
+	const struct nlattr *header;
+	struct genlmsghdr *ghdr;
+	char ifname[ALTIFNAMSIZ];
+	struct evlog_rec *rec;
+	int ifindex;
+	int ret;
+
+	if (sizeof(*hdr) + len > EVLOG_BLOCK_SIZE ||
+	    nlhdr->nlmsg_len < NLMSG_HDRLEN + GENL_HDRLEN)
+		return -EMSGSIZE;
+	if (hdr->used + len > EVLOG_BLOCK_SIZE) {
+		ret = evlog_sync(log);
+		if (ret < 0)
+			return ret;
+		log->index++;
+		evlog_block_reset(log);
+	}
+
+	rec = (struct evlog_rec *)(log->block + hdr->used);
+	rec->time = evlog_now();
+	rec->len = nlhdr->nlmsg_len;
+	rec->flags = flags;
+	memcpy(rec + 1, nlhdr, nlhdr->nlmsg_len);
+	ghdr = mnl_nlmsg_get_payload((struct nlmsghdr *)(rec + 1));
+	ghdr->cmd = cmd;
+
+	if (!hdr->n_records++)
+		hdr->first = rec->time;
+	hdr->last = rec->time;
+	hdr->used += len;
+	/* header is the first attribute of all ethtool messages */
+	header = mnl_nlmsg_get_payload_offset(nlhdr, GENL_HDRLEN);
+	if (mnl_attr_ok(header, payload_len - GENL_HDRLEN) &&
+	    !get_dev_info(header, &ifindex, ifname) && ifname[0]) {
+		unsigned int bit = evlog_dev_hash(ifname);
+
+		hdr->devs[bit / 32] |= 1U << (bit % 32);
+	}
+
+	return 0;
+}
+
+/* block may contain records for one of the devices (all if none given) */
+static bool evlog_block_devs(const struct evlog_block_hdr *hdr,
+			     const char *const *devs, unsigned int n_devs)
+{
+	unsigned int bit;
+	unsigned int i;
+
+	if (!devs)
+		return true;
+	for (i = 0; i < n_devs; i++) {
+		bit = evlog_dev_hash(devs[i]);
+		if (hdr->devs[bit / 32] & (1U << (bit % 32)))
+			return true;
+	}
+	return false;
+}
+
+static bool evlog_block_valid(const struct evlog_block_hdr *hdr)
+{
+	return hdr->magic == EVLOG_BLOCK_MAGIC && hdr->n_records &&
+	       hdr->used >= sizeof(*hdr) && hdr->used <= EVLOG_BLOCK_SIZE;
+}
+
+/* first block which may contain records from @since or later */
+static int evlog_find_block(int fd, unsigned int n_blocks, uint64_t since,
+			    unsigned int *index)
+{
+	struct evlog_block_hdr hdr;
+	unsigned int lo = 0;
+	unsigned int hi = n_blocks;
+	unsigned int mid;
+	int ret;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		ret = evlog_pread(fd, &hdr, sizeof(hdr),
+				  evlog_block_offset(mid));
+		if (ret < 0)
+			return ret;
+		/* damaged blocks are skipped by the scan */
+		if (evlog_block_valid(&hdr) && hdr.last >= since)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	*index = lo;
+	return 0;
+}
+
+static int evlog_scan_block(const char *block, uint64_t since, uint64_t until,
+			    evlog_cb_t cb, void *data)
+{
+	const struct evlog_block_hdr *hdr;
+	const struct evlog_rec *rec;
+	unsigned int offset;
+	unsigned int i;
+	int ret;
+
+	hdr = (const struct evlog_block_hdr *)block;
+	offset = sizeof(*hdr);
+	for (i = 0; i < hdr->n_records; i++) {
+		rec = (const struct evlog_rec *)(block + offset);
+		if (offset + sizeof(*rec) > hdr->used ||
+		    rec->len < NLMSG_HDRLEN + GENL_HDRLEN ||
+		    rec->len > hdr->used - offset - sizeof(*rec))
+			return -EINVAL;
+		offset += EVLOG_ALIGN(sizeof(*rec) + rec->len);
+		if (rec->time < since || rec->time > until)
+			continue;
+		ret = cb((const struct nlmsghdr *)(rec + 1), rec->time,
+			 rec->flags, data);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * evlog_query() - pass logged messages from a time range to a callback
+ * @path:   log file
+ * @since:  start of the time range (CLOCK_REALTIME, ns)
+ * @until:  end of the time range (CLOCK_REALTIME, ns)
+ * @devs:   device names, blocks without them are not read (null for all)
+ * @n_devs: number of entries in @devs
+ * @cb:     callback called for each record in the time range
+ * @data:   data passed to @cb
+ *
+ * Records of other devices than those in @devs may still be passed to @cb
+ * (the device set of a block is a bitmap of hashes), the callback is
+ * expected to do exact filtering.
+ *
+ * Return: 0 on success or negative error code
+ */
+int evlog_query(const char *path, uint64_t since, uint64_t until,
+		const char *const *devs, unsigned int n_devs, evlog_cb_t cb,
+		void *data)
+{
+	struct evlog_file_hdr file_hdr;
+	struct evlog_block_hdr *hdr;
+	unsigned int n_blocks;
+	unsigned int index;
+	struct stat st;
+	char *block;
+	int ret;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	block = malloc(EVLOG_BLOCK_SIZE);
+	if (!block) {
+		ret = -ENOMEM;
+		goto out_close;
+	}
+	hdr = (struct evlog_block_hdr *)block;
+	if (fstat(fd, &st) < 0) {
+		ret = -errno;
+		goto out_free;
+	}
+	ret = evlog_pread(fd, &file_hdr, sizeof(file_hdr), 0);
+	if (ret == 0)
+		ret = evlog_check_hdr(&file_hdr);
+	if (ret < 0) {
+		ret = -EINVAL;
+		goto out_free;
+	}
+
+	n_blocks = (st.st_size - sizeof(file_hdr)) / EVLOG_BLOCK_SIZE;
+	ret = evlog_find_block(fd, n_blocks, since, &index);
+	for (; ret == 0 && index < n_blocks; index++) {
+		ret = evlog_pread(fd, hdr, sizeof(*hdr),
+				  evlog_block_offset(index));
+		if (ret < 0)
+			break;
+		if (!evlog_block_valid(hdr))
+			continue;
+		if (hdr->first > until)
+			break;
+		if (hdr->last < since || !evlog_block_devs(hdr, devs, n_devs))
+			continue;
+		ret = evlog_pread(fd, block, hdr->used,
+				  evlog_block_offset(index));
+		if (ret == 0)
+			ret = evlog_scan_block(block, since, until, cb, data);
+	}
+
+out_free:
+	free(block);
+out_close:
+	close(fd);
+	return ret;
+}
@@ -0,0 +1,31 @@
+/*
+ * evlog.h - binary log of notifications
+ *
+ * Declarations of the block structured notification log written and queried
+ * by the notification monitor.
+ */
+
+#ifndef ETHTOOL_NETLINK_EVLOG_H__
+#define ETHTOOL_NETLINK_EVLOG_H__
+
+#include <stdint.h>
+#include <linux/netlink.h>
+
+/* record flags */
+#define EVLOG_F_DUMP	(1U << 0)	/* reply to a state dump */
+
+struct evlog;
+
+typedef int (*evlog_cb_t)(const struct nlmsghdr *nlhdr, uint64_t time,
+			  unsigned int flags, void *data);
+
+struct evlog *evlog_open(const char *path, int *err);
+int evlog_close(struct evlog *log);
+int evlog_append(struct evlog *log, const struct nlmsghdr *nlhdr,
+		 uint8_t cmd, unsigned int flags);
+int evlog_sync(struct evlog *log);
+int evlog_query(const char *path, uint64_t since, uint64_t until,
+		const char *const *devs, unsigned int n_devs, evlog_cb_t cb,
+		void *data);
+
+#endif /* ETHTOOL_NETLINK_EVLOG_H__ */
@@ -50,6 +50,8 @@ void nl_monitor_usage(void);
 
 int nl_get_eeprom_page(struct cmd_context *ctx,
 		       struct ethtool_module_eeprom *request);
+int nl_get_eeprom_pages(struct cmd_context *ctx,
+			struct ethtool_module_eeprom *requests, unsigned int n);
 
 #else /* ETHTOOL_ENABLE_NETLINK */
 
@@ -84,6 +86,15 @@ nl_get_eeprom_page(struct cmd_context *ctx __maybe_unused,
 	return -EOPNOTSUPP;
 }
 
+static inline int
+nl_get_eeprom_pages(struct cmd_context *ctx __maybe_unused,
+		    struct ethtool_module_eeprom *requests __maybe_unused,
+		    unsigned int n __maybe_unused)
+{
+	fprintf(stderr, "Netlink not supported by ethtool.\n");
+	return -EOPNOTSUPP;
+}
+
 #define nl_gset			NULL
 #define nl_sset			NULL
 #define nl_permaddr		NULL
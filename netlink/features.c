@@ -16,50 +16,63 @@
 
 /* FEATURES_GET */
 
+enum {
+	FEATURES_HW,
+	FEATURES_WANTED,
+	FEATURES_ACTIVE,
+	FEATURES_NOCHANGE,
+
+	FEATURES_NSETS
+};
+
 struct feature_results {
-	uint32_t	*hw;
-	uint32_t	*wanted;
-	uint32_t	*active;
-	uint32_t	*nochange;
+	const uint32_t	*hw;
+	const uint32_t	*wanted;
+	const uint32_t	*active;
+	const uint32_t	*nochange;
 	unsigned int	count;
 	unsigned int	words;
+	struct nl_bitset sets[FEATURES_NSETS];
 };
 
+static void release_feature_results(struct feature_results *results)
+{
+	unsigned int i;
+
+	for (i = 0; i < FEATURES_NSETS; i++)
+		bitset_release(&results->sets[i]);
+}
+
 static int prepare_feature_results(const struct nlattr *const *tb,
 				   struct feature_results *dest)
 {
-	unsigned int count;
-	int ret;
+	static const uint16_t attrs[FEATURES_NSETS] = {
+		[FEATURES_HW]		= ETHTOOL_A_FEATURES_HW,
+		[FEATURES_WANTED]	= ETHTOOL_A_FEATURES_WANTED,
+		[FEATURES_ACTIVE]	= ETHTOOL_A_FEATURES_ACTIVE,
+		[FEATURES_NOCHANGE]	= ETHTOOL_A_FEATURES_NOCHANGE,
+	};
+	unsigned int i;
 
 	memset(dest, '\0', sizeof(*dest));
-	if (!tb[ETHTOOL_A_FEATURES_HW] || !tb[ETHTOOL_A_FEATURES_WANTED] ||
-	    !tb[ETHTOOL_A_FEATURES_ACTIVE] || !tb[ETHTOOL_A_FEATURES_NOCHANGE])
-		return -EFAULT;
-	count = bitset_get_count(tb[ETHTOOL_A_FEATURES_HW], &ret);
-	if (ret < 0)
-		return -EFAULT;
-	if ((bitset_get_count(tb[ETHTOOL_A_FEATURES_WANTED], &ret) != count) ||
-	    (bitset_get_count(tb[ETHTOOL_A_FEATURES_ACTIVE], &ret) != count) ||
-	    (bitset_get_count(tb[ETHTOOL_A_FEATURES_NOCHANGE], &ret) != count))
-		return -EFAULT;
-	dest->hw = get_compact_bitset_value(tb[ETHTOOL_A_FEATURES_HW]);
-	dest->wanted = get_compact_bitset_value(tb[ETHTOOL_A_FEATURES_WANTED]);
-	dest->active = get_compact_bitset_value(tb[ETHTOOL_A_FEATURES_ACTIVE]);
-	dest->nochange =
-		get_compact_bitset_value(tb[ETHTOOL_A_FEATURES_NOCHANGE]);
-	if (!dest->hw || !dest->wanted || !dest->active || !dest->nochange)
-		return -EFAULT;
-	dest->count = count;
-	dest->words = (count + 31) / 32;
+	for (i = 0; i < FEATURES_NSETS; i++) {
+		if (!tb[attrs[i]] ||
+		    bitset_decode(&dest->sets[i], tb[attrs[i]]) < 0 ||
+		    dest->sets[i].count != dest->sets[0].count) {
+			release_feature_results(dest);
+			return -EFAULT;
+		}
+	}
+	dest->hw = dest->sets[FEATURES_HW].value;
+	dest->wanted = dest->sets[FEATURES_WANTED].value;
+	dest->active = dest->sets[FEATURES_ACTIVE].value;
+	dest->nochange = dest->sets[FEATURES_NOCHANGE].value;
+	dest->count = dest->sets[FEATURES_HW].count;
+	dest->words = dest->sets[FEATURES_HW].nwords;
 
 	return 0;
 }
 
-static bool feature_on(const uint32_t *bitmap, unsigned int idx)
-{
-	return bitmap[idx / 32] & (1 << (idx % 32));
-}
-
 static void dump_feature(const struct feature_results *results,
 			 const uint32_t *ref, const uint32_t *ref_mask,
 			 unsigned int idx, const char *name, const char *prefix)
@@ -69,21 +82,21 @@ static void dump_feature(const struct feature_results *results,
 	if (!name || !*name)
 		return;
 	if (ref) {
-		if (ref_mask && !feature_on(ref_mask, idx))
+		if (ref_mask && !bitmap_test(ref_mask, idx))
 			return;
-		if ((!ref_mask || feature_on(ref_mask, idx)) &&
-		    (feature_on(results->active, idx) == feature_on(ref, idx)))
+		if ((!ref_mask || bitmap_test(ref_mask, idx)) &&
+		    (bitmap_test(results->active, idx) == bitmap_test(ref, idx)))
 			return;
 	}
 
-	if (!feature_on(results->hw, idx) || feature_on(results->nochange, idx))
+	if (!bitmap_test(results->hw, idx) || bitmap_test(results->nochange, idx))
 		suffix = " [fixed]";
-	else if (feature_on(results->active, idx) !=
-		 feature_on(results->wanted, idx))
-		suffix = feature_on(results->wanted, idx) ?
+	else if (bitmap_test(results->active, idx) !=
+		 bitmap_test(results->wanted, idx))
+		suffix = bitmap_test(results->wanted, idx) ?
 			" [requested on]" : " [requested off]";
 	printf("%s%s: %s%s\n", prefix, name,
-	       feature_on(results->active, idx) ? "on" : "off", suffix);
+	       bitmap_test(results->active, idx) ? "on" : "off", suffix);
 }
 
 /* this assumes pattern contains no more than one asterisk */
@@ -118,8 +131,10 @@ int dump_features(const struct nlattr *const *tb,
 	if (ret < 0)
 		return -EFAULT;
 	feature_flags = calloc(results.count, sizeof(feature_flags[0]));
-	if (!feature_flags)
+	if (!feature_flags) {
+		release_feature_results(&results);
 		return -ENOMEM;
+	}
 
 	/* map netdev features to legacy flags */
 	for (i = 0; i < results.count; i++) {
@@ -150,7 +165,7 @@ int dump_features(const struct nlattr *const *tb,
 			if (feature_flags[j] == i) {
 				n_match++;
 				flag_value = flag_value ||
-					feature_on(results.active, j);
+					bitmap_test(results.active, j);
 			}
 		}
 		if (n_match != 1)
@@ -181,6 +196,7 @@ int dump_features(const struct nlattr *const *tb,
 	}
 
 	free(feature_flags);
+	release_feature_results(&results);
 	return 0;
 }
 
@@ -229,6 +245,7 @@ int nl_gfeatures(struct cmd_context *ctx)
 		return 1;
 	}
 
+	preload_cmd_strings(nlctx, STRSET_BIT(ETH_SS_FEATURES), 0);
 	ret = nlsock_prep_get_request(nlsk, ETHTOOL_MSG_FEATURES_GET,
 				      ETHTOOL_A_FEATURES_HEADER,
 				      ETHTOOL_FLAG_COMPACT_BITSETS);
@@ -381,13 +398,10 @@ static void show_feature_changes(struct nl_context *nlctx,
 {
 	struct sfeatures_context *sfctx = nlctx->cmd_private;
 	const struct stringset *feature_names;
-	const uint32_t *wanted_mask;
-	const uint32_t *active_mask;
-	const uint32_t *wanted_val;
-	const uint32_t *active_val;
+	struct nl_bitset wanted, active;
 	unsigned int count, words;
+	uint32_t *changed;
 	unsigned int i;
-	bool diff;
 	int ret;
 
 	feature_names = global_stringset(ETH_SS_FEATURES, nlctx->ethnl_socket);
@@ -396,55 +410,62 @@ static void show_feature_changes(struct nl_context *nlctx,
 
 	if (!tb[ETHTOOL_A_FEATURES_WANTED] || !tb[ETHTOOL_A_FEATURES_ACTIVE])
 		goto err;
-	if (bitset_get_count(tb[ETHTOOL_A_FEATURES_WANTED], &ret) != count ||
-	    ret < 0)
-		goto err;
-	if (bitset_get_count(tb[ETHTOOL_A_FEATURES_ACTIVE], &ret) != count ||
-	    ret < 0)
-		goto err;
-	wanted_val = get_compact_bitset_value(tb[ETHTOOL_A_FEATURES_WANTED]);
-	wanted_mask = get_compact_bitset_mask(tb[ETHTOOL_A_FEATURES_WANTED]);
-	active_val = get_compact_bitset_value(tb[ETHTOOL_A_FEATURES_ACTIVE]);
-	active_mask = get_compact_bitset_mask(tb[ETHTOOL_A_FEATURES_ACTIVE]);
-	if (!wanted_val || !wanted_mask || !active_val || !active_mask)
+	ret = bitset_decode(&wanted, tb[ETHTOOL_A_FEATURES_WANTED]);
+	if (ret < 0)
 		goto err;
-
-	sfctx->nothing_changed = true;
-	diff = false;
-	for (i = 0; i < words; i++) {
-		if (wanted_mask[i] != sfctx->req_mask[i])
-			sfctx->nothing_changed = false;
-		if (wanted_mask[i] || (active_mask[i] & ~sfctx->req_mask[i]))
-			diff = true;
-	}
-	if (!diff)
-		return;
+	ret = bitset_decode(&active, tb[ETHTOOL_A_FEATURES_ACTIVE]);
+	if (ret < 0)
+		goto err_wanted;
+	if (wanted.count != count || active.count != count ||
+	    wanted.nomask || active.nomask)
+		goto err_active;
+	changed = calloc(words ?: 1, sizeof(changed[0]));
+	if (!changed)
+		goto err_active;
+
+	/* features we requested but got a different value for, and features
+	 * which changed without being requested
+	 */
+	bitmap_andnot(changed, active.mask, sfctx->req_mask, words);
+	bitmap_or(changed, changed, wanted.mask, words);
+	sfctx->nothing_changed =
+		!memcmp(wanted.mask, sfctx->req_mask, words * sizeof(uint32_t));
+	if (!bitmap_weight(changed, count))
+		goto out;
 
 	/* result is not exactly as requested, show differences */
 	printf("Actual changes:\n");
-	for (i = 0; i < count; i++) {
+	bitmap_or(changed, wanted.mask, active.mask, words);
+	bitmap_for_each_set(i, changed, count) {
 		const char *name = get_string(feature_names, i);
 
 		if (!name)
 			continue;
-		if (!feature_on(wanted_mask, i) && !feature_on(active_mask, i))
-			continue;
 		printf("%s: ", name);
-		if (feature_on(wanted_mask, i))
+		if (bitmap_test(wanted.mask, i))
 			/* we requested a value but result is different */
 			printf("%s [requested %s]",
-			       feature_on(wanted_val, i) ? "off" : "on",
-			       feature_on(wanted_val, i) ? "on" : "off");
-		else if (!feature_on(sfctx->req_mask, i))
+			       bitmap_test(wanted.value, i) ? "off" : "on",
+			       bitmap_test(wanted.value, i) ? "on" : "off");
+		else if (!bitmap_test(sfctx->req_mask, i))
 			/* not requested but changed anyway */
 			printf("%s [not requested]",
-			       feature_on(active_val, i) ? "on" : "off");
+			       bitmap_test(active.value, i) ? "on" : "off");
 		else
-			printf("%s", feature_on(active_val, i) ? "on" : "off");
+			printf("%s",
+			       bitmap_test(active.value, i) ? "on" : "off");
 		fputc('\n', stdout);
 	}
 
+out:
+	free(changed);
+	bitset_release(&active);
+	bitset_release(&wanted);
 	return;
+err_active:
+	bitset_release(&active);
+err_wanted:
+	bitset_release(&wanted);
 err:
 	fprintf(stderr, "malformed diff info from kernel\n");
 }
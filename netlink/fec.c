@@ -16,6 +16,7 @@
 #include "netlink.h"
 #include "bitset.h"
 #include "parser.h"
+#include "template.h"
 
 /* FEC_GET */
 
@@ -41,7 +42,8 @@ fec_mode_walk(unsigned int idx, const char *name, bool val, void *data)
 	print_string(PRINT_ANY, NULL, " %s", name);
 }
 
-static int fec_show_stats(const struct nlattr *nest)
+static int fec_show_stats(const struct nl_context *nlctx,
+			  const struct nlattr *nest)
 {
 	const struct nlattr *tb[ETHTOOL_A_FEC_STAT_MAX + 1] = {};
 	DECLARE_ATTR_TB_INFO(tb);
@@ -63,12 +65,16 @@ static int fec_show_stats(const struct nlattr *nest)
 
 	open_json_object("statistics");
 	for (i = 0; i < ARRAY_SIZE(stats); i++) {
+		char path[48];
 		uint64_t *vals;
 		int lanes, l;
 
 		if (!tb[stats[i].attr] ||
 		    !mnl_attr_get_payload_len(tb[stats[i].attr]))
 			continue;
+		snprintf(path, sizeof(path), "statistics.%s", stats[i].name);
+		if (!field_wanted(nlctx, path))
+			continue;
 
 		if (!header && !is_json_context()) {
 			printf("Statistics:\n");
@@ -120,6 +126,7 @@ int fec_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 	DECLARE_ATTR_TB_INFO(tb);
 	struct nl_context *nlctx = data;
 	const struct stringset *lm_strings;
+	bool show_config, show_active;
 	const char *name;
 	bool fa, empty;
 	bool silent;
@@ -136,10 +143,17 @@ int fec_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 	if (!dev_ok(nlctx))
 		return err_ret;
 
-	ret = netlink_init_ethnl2_socket(nlctx);
-	if (ret < 0)
-		return err_ret;
-	lm_strings = global_stringset(ETH_SS_LINK_MODES, nlctx->ethnl2_socket);
+	/* link mode names are only needed for encodings */
+	show_config = field_wanted(nlctx, "config");
+	show_active = field_wanted(nlctx, "active");
+	lm_strings = NULL;
+	if (show_config || show_active) {
+		ret = netlink_init_ethnl2_socket(nlctx);
+		if (ret < 0)
+			return err_ret;
+		lm_strings = global_stringset(ETH_SS_LINK_MODES,
+					      nlctx->ethnl2_socket);
+	}
 
 	active = 0;
 	if (tb[ETHTOOL_A_FEC_ACTIVE])
@@ -153,35 +167,40 @@ int fec_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 	print_string(PRINT_ANY, "ifname", "FEC parameters for %s:\n",
 		     nlctx->devname);
 
-	open_json_array("config", "Configured FEC encodings:");
-	fa = tb[ETHTOOL_A_FEC_AUTO] && mnl_attr_get_u8(tb[ETHTOOL_A_FEC_AUTO]);
-	if (fa)
-		print_string(PRINT_ANY, NULL, " %s", "Auto");
-	empty = !fa;
+	if (show_config) {
+		open_json_array("config", "Configured FEC encodings:");
+		fa = tb[ETHTOOL_A_FEC_AUTO] &&
+		     mnl_attr_get_u8(tb[ETHTOOL_A_FEC_AUTO]);
+		if (fa)
+			print_string(PRINT_ANY, NULL, " %s", "Auto");
+		empty = !fa;
 
-	ret = walk_bitset(tb[ETHTOOL_A_FEC_MODES], lm_strings, fec_mode_walk,
-			  &empty);
-	if (ret < 0)
-		goto err_close_dev;
-	if (empty)
-		print_string(PRINT_ANY, NULL, " %s", "None");
-	close_json_array("\n");
-
-	open_json_array("active", "Active FEC encoding:");
-	if (active) {
-		name = get_string(lm_strings, active);
-		if (name)
-			/* Take care of renames */
-			fec_mode_walk(active, name, true, NULL);
-		else
-			print_uint(PRINT_ANY, NULL, " BIT%u", active);
-	} else {
-		print_string(PRINT_ANY, NULL, " %s", "None");
+		ret = walk_bitset(tb[ETHTOOL_A_FEC_MODES], lm_strings,
+				  fec_mode_walk, &empty);
+		if (ret < 0)
+			goto err_close_dev;
+		if (empty)
+			print_string(PRINT_ANY, NULL, " %s", "None");
+		close_json_array("\n");
 	}
-	close_json_array("\n");
 
-	if (tb[ETHTOOL_A_FEC_STATS]) {
-		ret = fec_show_stats(tb[ETHTOOL_A_FEC_STATS]);
+	if (show_active) {
+		open_json_array("active", "Active FEC encoding:");
+		if (active) {
+			name = get_string(lm_strings, active);
+			if (name)
+				/* Take care of renames */
+				fec_mode_walk(active, name, true, NULL);
+			else
+				print_uint(PRINT_ANY, NULL, " BIT%u", active);
+		} else {
+			print_string(PRINT_ANY, NULL, " %s", "None");
+		}
+		close_json_array("\n");
+	}
+
+	if (tb[ETHTOOL_A_FEC_STATS] && field_wanted(nlctx, "statistics")) {
+		ret = fec_show_stats(nlctx, tb[ETHTOOL_A_FEC_STATS]);
 		if (ret < 0)
 			goto err_close_dev;
 	}
@@ -210,8 +229,14 @@ int nl_gfec(struct cmd_context *ctx)
 		return 1;
 	}
 
-	flags = get_stats_flag(nlctx, ETHTOOL_MSG_FEC_GET,
-			       ETHTOOL_A_FEC_HEADER);
+	/* link mode names are not needed if encodings are not shown */
+	if (field_wanted(nlctx, "config") || field_wanted(nlctx, "active"))
+		flags = get_bitset_flags(nlctx, STRSET_BIT(ETH_SS_LINK_MODES),
+					 0);
+	else
+		flags = ETHTOOL_FLAG_COMPACT_BITSETS;
+	flags |= get_stats_flag(nlctx, ETHTOOL_MSG_FEC_GET,
+				ETHTOOL_A_FEC_HEADER);
 	ret = nlsock_prep_get_request(nlsk, ETHTOOL_MSG_FEC_GET,
 				      ETHTOOL_A_FEC_HEADER, flags);
 	if (ret < 0)
@@ -318,11 +343,9 @@ static const struct param_parser sfec_params[] = {
 int nl_sfec(struct cmd_context *ctx)
 {
 	struct nl_context *nlctx = ctx->nlctx;
-	struct nl_msg_buff *msgbuff;
-	struct nl_socket *nlsk;
 	int ret;
 
-	if (netlink_cmd_check(ctx, ETHTOOL_MSG_FEC_SET, false))
+	if (tmpl_cmd_check(ctx, ETHTOOL_MSG_FEC_SET, ETHTOOL_MSG_FEC_GET))
 		return -EOPNOTSUPP;
 	if (!ctx->argc) {
 		fprintf(stderr, "ethtool (--set-fec): parameters missing\n");
@@ -333,25 +356,17 @@ int nl_sfec(struct cmd_context *ctx)
 	nlctx->argp = ctx->argp;
 	nlctx->argc = ctx->argc;
 	nlctx->devname = ctx->devname;
-	nlsk = nlctx->ethnl_socket;
-	msgbuff = &nlsk->msgbuff;
 
-	ret = msg_init(nlctx, msgbuff, ETHTOOL_MSG_FEC_SET,
-		       NLM_F_REQUEST | NLM_F_ACK);
+	ret = tmpl_msg_init(nlctx, ETHTOOL_MSG_FEC_SET,
+			    ETHTOOL_A_FEC_HEADER);
 	if (ret < 0)
 		return 2;
-	if (ethnla_fill_header(msgbuff, ETHTOOL_A_FEC_HEADER,
-			       ctx->devname, 0))
-		return -EMSGSIZE;
 
 	ret = nl_parser(nlctx, sfec_params, NULL, PARSER_GROUP_NONE, NULL);
 	if (ret < 0)
 		return 1;
 
-	ret = nlsock_sendmsg(nlsk, NULL);
-	if (ret < 0)
-		return 83;
-	ret = nlsock_process_reply(nlsk, nomsg_reply_cb, nlctx);
+	ret = tmpl_send(nlctx, ETHTOOL_MSG_FEC_GET, ETHTOOL_A_FEC_HEADER);
 	if (ret == 0)
 		return 0;
 	else
@@ -0,0 +1,382 @@
+/*
+ * linkhist.c - link state history
+ *
+ * Link state of each device observed by the notification monitor (carrier
+ * changes reported by rtnetlink, replies to link state requests seeding the
+ * history and sampling SQI) is accumulated into up and down periods, reasons
+ * of going down (extended link state reported by the driver) and SQI
+ * statistics so that marginal links can be told from the report: mean time
+ * between failures, mean and longest downtime, most common down reasons and
+ * whether signal quality is getting worse.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../internal.h"
+#include "netlink.h"
+#include "linkhist.h"
+
+/* devices are indexed by ifindex, ignore insanely high ones */
+#define LINKHIST_MAX_INDEX	(1 << 20)
+/* number of most common down reasons in the report */
+#define LINKHIST_TOP_REASONS	3
+
+#define NS_PER_SEC		1000000000ULL
+#define NS_PER_HOUR		(3600 * NS_PER_SEC)
+
+/**
+ * struct linkhist - link state history of all devices
+ * @devs:   devices indexed by ifindex
+ * @n_devs: number of entries in @devs
+ */
+struct linkhist {
+	struct linkhist_dev	*devs;
+	unsigned int		n_devs;
+};
+
+/**
+ * linkhist_now() - current time for link history
+ *
+ * Return: CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t linkhist_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+struct linkhist *linkhist_new(void)
+{
+	return calloc(1, sizeof(struct linkhist));
+}
+
+void linkhist_free(struct linkhist *lh)
+{
+	if (!lh)
+		return;
+	free(lh->devs);
+	free(lh);
+}
+
+static struct linkhist_dev *linkhist_get_dev(struct linkhist *lh, int ifindex)
+{
+	struct linkhist_dev *devs;
+	unsigned int n;
+
+	if (ifindex <= 0 || ifindex >= LINKHIST_MAX_INDEX)
+		return NULL;
+	if ((unsigned int)ifindex < lh->n_devs)
+		return &lh->devs[ifindex];
+
+	n = lh->n_devs ?: 64;
+	while (n <= (unsigned int)ifindex)
+		n *= 2;
+	devs = realloc(lh->devs, n * sizeof(devs[0]));
+	if (!devs)
+		return NULL;
+	memset(devs + lh->n_devs, '\0', (n - lh->n_devs) * sizeof(devs[0]));
+	lh->devs = devs;
+	lh->n_devs = n;
+
+	return &lh->devs[ifindex];
+}
+
+/**
+ * linkhist_get() - look up link history of a device
+ * @lh:      link history
+ * @ifindex: device index
+ *
+ * Return: history of the device or null if its link state was not observed
+ */
+const struct linkhist_dev *linkhist_get(const struct linkhist *lh, int ifindex)
+{
+	if (ifindex <= 0 || (unsigned int)ifindex >= lh->n_devs ||
+	    !lh->devs[ifindex].known)
+		return NULL;
+	return &lh->devs[ifindex];
+}
+
+static void linkhist_sqi(struct linkhist_dev *dev,
+			 const struct linkhist_sample *sample, uint64_t now)
+{
+	double t;
+
+	if (sample->sqi < 0)
+		return;
+	if (!dev->sqi_n++) {
+		dev->sqi_t0 = now;
+		dev->sqi_min = sample->sqi;
+	}
+	if (sample->sqi < dev->sqi_min)
+		dev->sqi_min = sample->sqi;
+	t = (double)(now - dev->sqi_t0) / NS_PER_HOUR;
+	dev->sqi_sum += sample->sqi;
+	dev->sqi_st += t;
+	dev->sqi_stt += t * t;
+	dev->sqi_sty += t * sample->sqi;
+}
+
+/**
+ * linkhist_update() - add an observation of link state
+ * @lh:       link history
+ * @ifindex:  device index
+ * @ifname:   device name
+ * @sample:   observed link state
+ * @pdev:     store pointer to history of the device here
+ * @duration: store length of the period which ended here (0 if none)
+ *
+ * Return: 1 if the link changed state (or was observed for the first time),
+ * 0 if not, negative error code on failure
+ */
+int linkhist_update(struct linkhist *lh, int ifindex, const char *ifname,
+		    const struct linkhist_sample *sample,
+		    const struct linkhist_dev **pdev, uint64_t *duration)
+{
+	struct linkhist_dev *dev;
+	unsigned int reason;
+	uint64_t now;
+	size_t len;
+
+	dev = linkhist_get_dev(lh, ifindex);
+	if (!dev)
+		return ifindex > 0 && ifindex < LINKHIST_MAX_INDEX ?
+		       -ENOMEM : -EINVAL;
+	*pdev = dev;
+	*duration = 0;
+	now = linkhist_now();
+	len = strnlen(ifname, sizeof(dev->name) - 1);
+	memcpy(dev->name, ifname, len);
+	dev->name[len] = '\0';
+	linkhist_sqi(dev, sample, now);
+	dev->last = *sample;
+
+	if (!dev->known) {
+		dev->known = true;
+		dev->up = sample->up;
+		dev->changed = now;
+		return 1;
+	}
+	if (dev->up == sample->up)
+		return 0;
+
+	*duration = now - dev->changed;
+	if (sample->up) {
+		dev->n_down++;
+		dev->down_total += *duration;
+		if (*duration > dev->down_max)
+			dev->down_max = *duration;
+	} else {
+		dev->flaps++;
+		dev->up_total += *duration;
+		reason = sample->ext_state + 1;
+		if (reason > LINKHIST_N_REASONS)
+			reason = 0;
+		dev->reasons[reason]++;
+	}
+	dev->up = sample->up;
+	dev->changed = now;
+
+	return 1;
+}
+
+static double linkhist_seconds(uint64_t ns)
+{
+	return (double)ns / NS_PER_SEC;
+}
+
+static const char *linkhist_reason_name(unsigned int reason, char *buff,
+					size_t size)
+{
+	const char *name;
+
+	if (!reason)
+		return "unknown";
+	name = link_ext_state_name(reason - 1);
+	if (name)
+		return name;
+	snprintf(buff, size, "extended state %u", reason - 1);
+	return buff;
+}
+
+/* indices of most common down reasons, returns their number */
+static unsigned int linkhist_top_reasons(const struct linkhist_dev *dev,
+					 unsigned int *top)
+{
+	unsigned int n = 0;
+	unsigned int i, j;
+
+	for (i = 0; i <= LINKHIST_N_REASONS; i++) {
+		if (!dev->reasons[i])
+			continue;
+		for (j = n; j > 0 && dev->reasons[top[j - 1]] < dev->reasons[i];
+		     j--)
+			if (j < LINKHIST_TOP_REASONS)
+				top[j] = top[j - 1];
+		if (j < LINKHIST_TOP_REASONS) {
+			top[j] = i;
+			if (n < LINKHIST_TOP_REASONS)
+				n++;
+		}
+	}
+
+	return n;
+}
+
+/* least squares slope of SQI over time in units per hour, false if unknown */
+static bool linkhist_sqi_trend(const struct linkhist_dev *dev, double *trend)
+{
+	double n = dev->sqi_n;
+	double denom;
+
+	if (dev->sqi_n < 2)
+		return false;
+	denom = n * dev->sqi_stt - dev->sqi_st * dev->sqi_st;
+	if (denom <= 1e-12)
+		return false;
+	*trend = (n * dev->sqi_sty - dev->sqi_st * dev->sqi_sum) / denom;
+	return true;
+}
+
+static void linkhist_print_dev(const struct linkhist_dev *dev, uint64_t now)
+{
+	unsigned int top[LINKHIST_TOP_REASONS];
+	uint64_t up_total = dev->up_total;
+	char buff[32];
+	unsigned int n, i;
+	double trend;
+
+	if (dev->up)
+		up_total += now - dev->changed;
+	printf("\nLink history for %s:\n", dev->name);
+	printf("\tLink: %s for %.3f s\n", dev->up ? "up" : "down",
+	       linkhist_seconds(now - dev->changed));
+	printf("\tFlaps: %u\n", dev->flaps);
+	if (dev->flaps)
+		printf("\tMTBF: %.3f s\n",
+		       linkhist_seconds(up_total) / dev->flaps);
+	if (dev->n_down)
+		printf("\tMean downtime: %.3f s (longest %.3f s)\n",
+		       linkhist_seconds(dev->down_total) / dev->n_down,
+		       linkhist_seconds(dev->down_max));
+	n = linkhist_top_reasons(dev, top);
+	if (n) {
+		printf("\tDown reasons:");
+		for (i = 0; i < n; i++)
+			printf("%s %s (%u)", i ? "," : "",
+			       linkhist_reason_name(top[i], buff, sizeof(buff)),
+			       dev->reasons[top[i]]);
+		putchar('\n');
+	}
+	if (dev->sqi_n) {
+		printf("\tSQI: %d", dev->last.sqi);
+		if (dev->last.sqi_max >= 0)
+			printf("/%d", dev->last.sqi_max);
+		printf(" (min %d, mean %.2f", dev->sqi_min,
+		       dev->sqi_sum / dev->sqi_n);
+		if (linkhist_sqi_trend(dev, &trend))
+			printf(", trend %+.2f/h", trend);
+		printf(", %u samples)\n", dev->sqi_n);
+	}
+}
+
+/* durations (in seconds) and SQI statistics with three decimal places */
+static void linkhist_json_float(json_writer_t *jw, const char *name,
+				double val)
+{
+	jsonw_name(jw, name);
+	jsonw_printf(jw, "%.3f", val);
+}
+
+static void linkhist_json_dev(json_writer_t *jw, const struct linkhist_dev *dev,
+			      unsigned int ifindex, uint64_t now)
+{
+	unsigned int top[LINKHIST_TOP_REASONS];
+	uint64_t up_total = dev->up_total;
+	char buff[32];
+	unsigned int n, i;
+	double trend;
+
+	if (dev->up)
+		up_total += now - dev->changed;
+	jsonw_start_object(jw);
+	jsonw_uint_field(jw, "ifindex", ifindex);
+	jsonw_string_field(jw, "dev", dev->name);
+	jsonw_bool_field(jw, "up", dev->up);
+	linkhist_json_float(jw, "since", linkhist_seconds(now - dev->changed));
+	jsonw_uint_field(jw, "flaps", dev->flaps);
+	if (dev->flaps)
+		linkhist_json_float(jw, "mtbf",
+				    linkhist_seconds(up_total) / dev->flaps);
+	if (dev->n_down) {
+		linkhist_json_float(jw, "down_mean",
+				    linkhist_seconds(dev->down_total) /
+				    dev->n_down);
+		linkhist_json_float(jw, "down_max",
+				    linkhist_seconds(dev->down_max));
+	}
+	n = linkhist_top_reasons(dev, top);
+	jsonw_name(jw, "down_reasons");
+	jsonw_start_array(jw);
+	for (i = 0; i < n; i++) {
+		jsonw_start_object(jw);
+		jsonw_string_field(jw, "reason",
+				   linkhist_reason_name(top[i], buff,
+							sizeof(buff)));
+		jsonw_uint_field(jw, "count", dev->reasons[top[i]]);
+		jsonw_end_object(jw);
+	}
+	jsonw_end_array(jw);
+	if (dev->sqi_n) {
+		jsonw_name(jw, "sqi");
+		jsonw_start_object(jw);
+		jsonw_int_field(jw, "last", dev->last.sqi);
+		if (dev->last.sqi_max >= 0)
+			jsonw_int_field(jw, "max", dev->last.sqi_max);
+		jsonw_int_field(jw, "min", dev->sqi_min);
+		linkhist_json_float(jw, "mean", dev->sqi_sum / dev->sqi_n);
+		if (linkhist_sqi_trend(dev, &trend))
+			linkhist_json_float(jw, "trend", trend);
+		jsonw_uint_field(jw, "samples", dev->sqi_n);
+		jsonw_end_object(jw);
+	}
+	jsonw_end_object(jw);
+}
+
+/**
+ * linkhist_print_report() - show link history of all devices
+ * @lh: link history
+ * @jw: JSON writer, text output if null
+ *
+ * For each device with observed link state, show current state and its
+ * duration, number of flaps, MTBF (total time up divided by the number of
+ * flaps), mean and longest downtime, most common down reasons and SQI
+ * statistics with its trend. In JSON, the report is one object with
+ * a "devices" array, durations are in seconds and SQI trend in units per
+ * hour.
+ */
+void linkhist_print_report(const struct linkhist *lh, json_writer_t *jw)
+{
+	uint64_t now = linkhist_now();
+	unsigned int i;
+
+	if (jw) {
+		jsonw_string_field(jw, "msg", "link_report");
+		jsonw_name(jw, "devices");
+		jsonw_start_array(jw);
+	}
+	for (i = 0; i < lh->n_devs; i++) {
+		if (!lh->devs[i].known)
+			continue;
+		if (jw)
+			linkhist_json_dev(jw, &lh->devs[i], i, now);
+		else
+			linkhist_print_dev(&lh->devs[i], now);
+	}
+	if (jw)
+		jsonw_end_array(jw);
+}
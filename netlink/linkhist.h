@@ -0,0 +1,92 @@
+/*
+ * linkhist.h - link state history
+ *
+ * Declarations of per device link state history and flap analytics used by
+ * the notification monitor.
+ */
+
+#ifndef ETHTOOL_NETLINK_LINKHIST_H__
+#define ETHTOOL_NETLINK_LINKHIST_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../json_writer.h"
+
+/* number of extended link states (reasons of link down) told apart */
+#define LINKHIST_N_REASONS	16
+
+/**
+ * struct linkhist_sample - observed link state
+ * @up:           link is up
+ * @ext_state:    extended link state (ETHTOOL_LINK_EXT_STATE_*), -1 if none
+ * @ext_substate: extended link substate, -1 if none
+ * @sqi:          signal quality index, -1 if not reported
+ * @sqi_max:      maximum signal quality index, -1 if not reported
+ */
+struct linkhist_sample {
+	bool	up;
+	int	ext_state;
+	int	ext_substate;
+	int	sqi;
+	int	sqi_max;
+};
+
+/**
+ * struct linkhist_dev - link history of a device
+ * @name:        device name
+ * @known:       link state has been observed
+ * @up:          link was up when last observed
+ * @changed:     time of last transition or first observation
+ *               (CLOCK_MONOTONIC, ns)
+ * @flaps:       number of transitions from up to down
+ * @n_down:      number of completed down periods
+ * @up_total:    total time of completed up periods (ns)
+ * @down_total:  total time of completed down periods (ns)
+ * @down_max:    longest completed down period (ns)
+ * @reasons:     number of down transitions by extended state (index is
+ *               extended state + 1, 0 if none reported)
+ * @last:        last observed sample
+ * @sqi_n:       number of SQI samples
+ * @sqi_min:     lowest SQI observed
+ * @sqi_sum:     sum of SQI samples
+ * @sqi_t0:      time of first SQI sample (CLOCK_MONOTONIC, ns)
+ * @sqi_st:      sum of sample times (hours since @sqi_t0)
+ * @sqi_stt:     sum of squared sample times
+ * @sqi_sty:     sum of products of sample times and SQI values
+ *
+ * SQI trend is the slope of least squares fit of SQI samples over time,
+ * computed from the running sums.
+ */
+struct linkhist_dev {
+	char			name[IFNAMSIZ];
+	bool			known;
+	bool			up;
+	uint64_t		changed;
+	unsigned int		flaps;
+	unsigned int		n_down;
+	uint64_t		up_total;
+	uint64_t		down_total;
+	uint64_t		down_max;
+	unsigned int		reasons[LINKHIST_N_REASONS + 1];
+	struct linkhist_sample	last;
+	unsigned int		sqi_n;
+	int			sqi_min;
+	double			sqi_sum;
+	uint64_t		sqi_t0;
+	double			sqi_st;
+	double			sqi_stt;
+	double			sqi_sty;
+};
+
+struct linkhist;
+
+uint64_t linkhist_now(void);
+struct linkhist *linkhist_new(void);
+void linkhist_free(struct linkhist *lh);
+const struct linkhist_dev *linkhist_get(const struct linkhist *lh, int ifindex);
+int linkhist_update(struct linkhist *lh, int ifindex, const char *ifname,
+		    const struct linkhist_sample *sample,
+		    const struct linkhist_dev **pdev, uint64_t *duration);
+void linkhist_print_report(const struct linkhist *lh, json_writer_t *jw);
+
+#endif /* ETHTOOL_NETLINK_LINKHIST_H__ */
@@ -14,12 +14,64 @@
 #include "../cmis.h"
 #include "../internal.h"
 #include "../common.h"
-#include "../list.h"
 #include "netlink.h"
 #include "parser.h"
 
 #define ETH_I2C_ADDRESS_LOW	0x50
 #define ETH_I2C_MAX_ADDRESS	0x7F
+/* lower memory and each upper page are read and cached as a whole */
+#define EEPROM_HALF_PAGE	128
+/* enough for a full CMIS decode of a module with 8 banks */
+#define EEPROM_CACHE_SLOTS	16
+/* maximum number of module EEPROM requests in flight */
+#define EEPROM_BATCH_MAX	8
+
+/**
+ * struct eeprom_cache_slot - cached half of a module EEPROM page
+ * @i2c_address: I2C address
+ * @bank:        bank number
+ * @page:        page number
+ * @upper:       upper half (offsets 128-255), lower memory if false
+ * @data:        contents
+ */
+struct eeprom_cache_slot {
+	u8	i2c_address;
+	u8	bank;
+	u8	page;
+	bool	upper;
+	u8	data[EEPROM_HALF_PAGE];
+};
+
+/**
+ * struct eeprom_cache - module EEPROM page cache
+ * @devname: device the module belongs to
+ * @n_slots: number of slots in use
+ * @slots:   pool of half page slots
+ *
+ * I2C reads take milliseconds so each half page is only read once per
+ * command: requests are served from the slot holding their half page, reading
+ * the whole half page into a free slot on a miss. The cache lives in the arena
+ * of netlink context and pointers to slot data handed to callers stay valid
+ * until netlink_done() like any page data. Once the pool is exhausted, pages
+ * are read directly.
+ */
+struct eeprom_cache {
+	const char			*devname;
+	unsigned int			n_slots;
+	struct eeprom_cache_slot	slots[EEPROM_CACHE_SLOTS];
+};
+
+/**
+ * struct eeprom_batch - module EEPROM reads in flight
+ * @reads:     reads sent, in the order of their sequence numbers
+ * @n_reads:   number of entries in @reads
+ * @first_seq: sequence number of the request for @reads[0]
+ */
+struct eeprom_batch {
+	struct ethtool_module_eeprom	reads[EEPROM_BATCH_MAX];
+	unsigned int			n_reads;
+	unsigned int			first_seq;
+};
 
 struct cmd_params {
 	u8 dump_hex;
@@ -77,40 +129,6 @@ static const struct param_parser getmodule_params[] = {
 	{}
 };
 
-static struct list_head eeprom_page_list = LIST_HEAD_INIT(eeprom_page_list);
-
-struct eeprom_page_entry {
-	struct list_head list;	/* Member of eeprom_page_list */
-	void *data;
-};
-
-static int eeprom_page_list_add(void *data)
-{
-	struct eeprom_page_entry *entry;
-
-	entry = malloc(sizeof(*entry));
-	if (!entry)
-		return -ENOMEM;
-
-	entry->data = data;
-	list_add(&entry->list, &eeprom_page_list);
-
-	return 0;
-}
-
-static void eeprom_page_list_flush(void)
-{
-	struct eeprom_page_entry *entry;
-	struct list_head *head, *next;
-
-	list_for_each_safe(head, next, &eeprom_page_list) {
-		entry = (struct eeprom_page_entry *) head;
-		free(entry->data);
-		list_del(head);
-		free(entry);
-	}
-}
-
 static int get_eeprom_page_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 {
 	const struct nlattr *tb[ETHTOOL_A_MODULE_EEPROM_DATA + 1] = {};
@@ -126,34 +144,23 @@ static int get_eeprom_page_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 	if (!tb[ETHTOOL_A_MODULE_EEPROM_DATA])
 		return MNL_CB_ERROR;
 
-	eeprom_data = mnl_attr_get_payload(tb[ETHTOOL_A_MODULE_EEPROM_DATA]);
-	request->data = malloc(request->length);
-	if (!request->data)
+	if (mnl_attr_get_payload_len(tb[ETHTOOL_A_MODULE_EEPROM_DATA]) <
+	    request->length)
 		return MNL_CB_ERROR;
+	eeprom_data = mnl_attr_get_payload(tb[ETHTOOL_A_MODULE_EEPROM_DATA]);
 	memcpy(request->data, eeprom_data, request->length);
 
-	ret = eeprom_page_list_add(request->data);
-	if (ret < 0)
-		goto err_list_add;
-
 	return MNL_CB_OK;
-
-err_list_add:
-	free(request->data);
-	return MNL_CB_ERROR;
 }
 
-int nl_get_eeprom_page(struct cmd_context *ctx,
-		       struct ethtool_module_eeprom *request)
+/* send request for module EEPROM data, the reply is not processed */
+static int eeprom_send(struct nl_context *nlctx,
+		       const struct ethtool_module_eeprom *request)
 {
-	struct nl_context *nlctx = ctx->nlctx;
 	struct nl_socket *nlsock;
 	struct nl_msg_buff *msg;
 	int ret;
 
-	if (!request || request->i2c_address > ETH_I2C_MAX_ADDRESS)
-		return -EINVAL;
-
 	nlsock = nlctx->ethnl_socket;
 	msg = &nlsock->msgbuff;
 
@@ -175,10 +182,260 @@ int nl_get_eeprom_page(struct cmd_context *ctx,
 		return -EMSGSIZE;
 
 	ret = nlsock_sendmsg(nlsock, NULL);
+	return ret < 0 ? ret : 0;
+}
+
+/* read into request->data */
+static int eeprom_read(struct nl_context *nlctx,
+		       struct ethtool_module_eeprom *request)
+{
+	int ret;
+
+	ret = eeprom_send(nlctx, request);
+	if (ret < 0)
+		return ret;
+	return nlsock_process_reply(nlctx->ethnl_socket,
+				    get_eeprom_page_reply_cb, (void *)request);
+}
+
+static int eeprom_batch_reply_cb(const struct nlmsghdr *nlhdr, void *data)
+{
+	struct eeprom_batch *batch = data;
+	unsigned int i = nlhdr->nlmsg_seq - batch->first_seq;
+
+	if (i >= batch->n_reads)
+		return MNL_CB_ERROR;
+	return get_eeprom_page_reply_cb(nlhdr, &batch->reads[i]);
+}
+
+/* send a read (its data already allocated), the reply is processed by
+ * eeprom_batch_flush()
+ */
+static int eeprom_batch_add(struct nl_context *nlctx,
+			    struct eeprom_batch *batch,
+			    const struct ethtool_module_eeprom *read)
+{
+	int ret;
+
+	ret = eeprom_send(nlctx, read);
 	if (ret < 0)
 		return ret;
-	return nlsock_process_reply(nlsock, get_eeprom_page_reply_cb,
-				    (void *)request);
+	if (!batch->n_reads)
+		batch->first_seq = nlctx->ethnl_socket->seq;
+	batch->reads[batch->n_reads++] = *read;
+
+	return 0;
+}
+
+/* process replies to all reads in flight; even if one of them fails, all
+ * replies are received so that none is left for later requests
+ */
+static int eeprom_batch_flush(struct nl_context *nlctx,
+			      struct eeprom_batch *batch)
+{
+	int ret;
+
+	ret = nlsock_process_replies(nlctx->ethnl_socket, batch->n_reads,
+				     eeprom_batch_reply_cb, batch);
+	batch->n_reads = 0;
+
+	return ret;
+}
+
+/**
+ * eeprom_cache_slot() - find cache slot for a request
+ * @nlctx:   netlink context
+ * @request: module EEPROM request
+ * @miss:    set to true if the half page is to be read into the slot
+ *
+ * Requests not contained in one half page (or for the lower half of a page
+ * other than 0) are not cached and left to the kernel to reject. On a miss,
+ * a free slot is taken; it is the last one in use and the caller releases it
+ * (by decrementing @n_slots) if the read fails.
+ *
+ * Return: slot holding (or to hold) the half page of @request or null if
+ * @request cannot be cached
+ */
+static struct eeprom_cache_slot *
+eeprom_cache_slot(struct nl_context *nlctx,
+		  const struct ethtool_module_eeprom *request, bool *miss)
+{
+	struct eeprom_cache *cache = nlctx->eeprom_cache;
+	const char *devname = nlctx->ctx->devname;
+	u32 start = request->offset % EEPROM_HALF_PAGE;
+	bool upper = request->offset >= EEPROM_HALF_PAGE;
+	struct eeprom_cache_slot *slot;
+	unsigned int i;
+
+	*miss = false;
+	if (!devname || !request->length ||
+	    request->offset >= 2 * EEPROM_HALF_PAGE ||
+	    request->length > EEPROM_HALF_PAGE - start ||
+	    (request->page && !upper))
+		return NULL;
+	/* data of previous module stay valid, its cache is just abandoned */
+	if (!cache || strcmp(cache->devname, devname)) {
+		cache = arena_alloc(&nlctx->arena, sizeof(*cache));
+		if (!cache)
+			return NULL;
+		cache->devname = devname;
+		cache->n_slots = 0;
+		nlctx->eeprom_cache = cache;
+	}
+
+	for (i = 0; i < cache->n_slots; i++) {
+		slot = &cache->slots[i];
+		if (slot->i2c_address == request->i2c_address &&
+		    slot->bank == request->bank && slot->page == request->page &&
+		    slot->upper == upper)
+			return slot;
+	}
+	if (cache->n_slots == EEPROM_CACHE_SLOTS)
+		return NULL;
+	slot = &cache->slots[cache->n_slots++];
+	slot->i2c_address = request->i2c_address;
+	slot->bank = request->bank;
+	slot->page = request->page;
+	slot->upper = upper;
+	*miss = true;
+
+	return slot;
+}
+
+/* request reading the whole half page of a cache slot */
+static void eeprom_half_init(struct ethtool_module_eeprom *half,
+			     const struct ethtool_module_eeprom *request,
+			     struct eeprom_cache_slot *slot)
+{
+	*half = *request;
+	half->offset = slot->upper ? EEPROM_HALF_PAGE : 0;
+	half->length = EEPROM_HALF_PAGE;
+	half->data = slot->data;
+}
+
+/* Page data are allocated from the arena of netlink context (or point into
+ * the page cache kept there) and stay valid until netlink_done().
+ */
+int nl_get_eeprom_page(struct cmd_context *ctx,
+		       struct ethtool_module_eeprom *request)
+{
+	struct nl_context *nlctx = ctx->nlctx;
+	struct ethtool_module_eeprom half;
+	struct eeprom_cache_slot *slot;
+	bool miss;
+	int ret;
+
+	if (!request || request->i2c_address > ETH_I2C_MAX_ADDRESS)
+		return -EINVAL;
+
+	slot = eeprom_cache_slot(nlctx, request, &miss);
+	if (!slot) {
+		request->data = arena_alloc(&nlctx->arena, request->length);
+		if (!request->data)
+			return -ENOMEM;
+		return eeprom_read(nlctx, request);
+	}
+
+	if (miss) {
+		eeprom_half_init(&half, request, slot);
+		ret = eeprom_read(nlctx, &half);
+		if (ret < 0) {
+			nlctx->eeprom_cache->n_slots--;
+			return ret;
+		}
+	}
+	request->data = slot->data + request->offset % EEPROM_HALF_PAGE;
+
+	return 0;
+}
+
+/**
+ * nl_get_eeprom_pages() - read several module EEPROM pages
+ * @ctx:      command context
+ * @requests: array of requests
+ * @n:        number of @requests
+ *
+ * Same as nl_get_eeprom_page() for each of @requests except that the reads
+ * needed (half pages not cached yet) are sent back to back, up to
+ * EEPROM_BATCH_MAX of them, and only then their replies are received and
+ * matched to the reads by sequence number. A decoder which knows which pages
+ * it needs thus does not wait for each reply before sending the next request.
+ * If requests cannot be pipelined (tracing, recording or replaying
+ * a session), pages are read one by one.
+ *
+ * Return: 0 on success or negative error code (data of all @requests are
+ * invalid then)
+ */
+int nl_get_eeprom_pages(struct cmd_context *ctx,
+			struct ethtool_module_eeprom *requests, unsigned int n)
+{
+	struct nl_context *nlctx = ctx->nlctx;
+	struct ethtool_module_eeprom *request;
+	struct ethtool_module_eeprom read;
+	struct eeprom_cache_slot *slot;
+	struct eeprom_batch batch = {};
+	unsigned int n_missed = 0;
+	unsigned int i;
+	bool miss;
+	int ret;
+
+	if (!nlsock_can_pipeline(nlctx->ethnl_socket)) {
+		for (i = 0; i < n; i++) {
+			ret = nl_get_eeprom_page(ctx, &requests[i]);
+			if (ret < 0)
+				return ret;
+		}
+		return 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		request = &requests[i];
+		if (request->i2c_address > ETH_I2C_MAX_ADDRESS) {
+			ret = -EINVAL;
+			goto err;
+		}
+		slot = eeprom_cache_slot(nlctx, request, &miss);
+		if (slot) {
+			request->data = slot->data +
+					request->offset % EEPROM_HALF_PAGE;
+			if (!miss)
+				continue;
+			n_missed++;
+			eeprom_half_init(&read, request, slot);
+		} else {
+			request->data = arena_alloc(&nlctx->arena,
+						    request->length);
+			if (!request->data) {
+				ret = -ENOMEM;
+				goto err;
+			}
+			read = *request;
+		}
+
+		if (batch.n_reads == EEPROM_BATCH_MAX) {
+			ret = eeprom_batch_flush(nlctx, &batch);
+			if (ret < 0)
+				goto err;
+			/* slots of the reads just completed are kept */
+			n_missed = miss;
+		}
+		ret = eeprom_batch_add(nlctx, &batch, &read);
+		if (ret < 0)
+			goto err;
+	}
+
+	ret = eeprom_batch_flush(nlctx, &batch);
+	if (ret < 0)
+		goto err;
+	return 0;
+
+err:
+	/* reads sent before the failure still have replies to receive */
+	if (batch.n_reads)
+		eeprom_batch_flush(nlctx, &batch);
+	if (n_missed)
+		nlctx->eeprom_cache->n_slots -= n_missed;
+	return ret;
 }
 
 static int eeprom_dump_hex(struct cmd_context *ctx)
@@ -285,7 +542,7 @@ int nl_getmodule(struct cmd_context *ctx)
 	if (getmodule_cmd_params.dump_hex || getmodule_cmd_params.dump_raw) {
 		ret = nl_get_eeprom_page(ctx, &request);
 		if (ret < 0)
-			goto cleanup;
+			return ret;
 
 		if (getmodule_cmd_params.dump_raw)
 			fwrite(request.data, 1, request.length, stdout);
@@ -294,11 +551,7 @@ int nl_getmodule(struct cmd_context *ctx)
 				 request.offset);
 	} else {
 		ret = eeprom_parse(ctx);
-		if (ret < 0)
-			goto cleanup;
 	}
 
-cleanup:
-	eeprom_page_list_flush();
 	return ret;
 }
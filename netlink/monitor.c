@@ -4,117 +4,972 @@
  * Implementation of "ethtool --monitor" for watching netlink notifications.
  */
 
+#define _GNU_SOURCE
+#include <ctype.h>
 #include <errno.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
 
 #include "../internal.h"
+#include "../json_writer.h"
 #include "netlink.h"
 #include "nlsock.h"
+#include "prettymsg.h"
 #include "strset.h"
+#include "devstate.h"
+#include "ntfburst.h"
+#include "evlog.h"
+#include "linkhist.h"
 
-static struct {
-	uint8_t		cmd;
-	mnl_cb_t	cb;
-} monitor_callbacks[] = {
-	{
-		.cmd	= ETHTOOL_MSG_LINKMODES_NTF,
-		.cb	= linkmodes_reply_cb,
+/* default receive buffer size; a storm of notifications (e.g. many links
+ * flapping at once) easily overflows the system default
+ */
+#define MONITOR_RCVBUF_DEFAULT	(4 << 20)
+/* JSON records are written in large blocks unless --line-buffered is used */
+#define MONITOR_JSON_BUFSIZE	(1 << 20)
+/* verdicts are cached for devices with ifindex below this limit */
+#define MONITOR_DEVSET_MAX_INDEX	(1 << 20)
+/* link watch and report intervals are converted to poll() timeouts */
+#define MONITOR_MAX_INTERVAL	(INT_MAX / 1000)
+/* state snapshot (--state) is rewritten at most once per second (ns) */
+#define MONITOR_STATE_INTERVAL	1000000000ULL
+
+/* handlers indexed by notification type, entries without @cb are unused */
+static const struct monitor_callback
+monitor_callbacks[__ETHTOOL_MSG_KERNEL_CNT] = {
+	[ETHTOOL_MSG_LINKMODES_NTF] = {
+		.cmd		= ETHTOOL_MSG_LINKMODES_NTF,
+		.cb		= linkmodes_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_LINKMODES_GET,
+		.hdr_attr	= ETHTOOL_A_LINKMODES_HEADER,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_LINKINFO_NTF,
-		.cb	= linkinfo_reply_cb,
+	[ETHTOOL_MSG_LINKINFO_NTF] = {
+		.cmd		= ETHTOOL_MSG_LINKINFO_NTF,
+		.cb		= linkinfo_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_LINKINFO_GET,
+		.hdr_attr	= ETHTOOL_A_LINKINFO_HEADER,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_WOL_NTF,
-		.cb	= wol_reply_cb,
+	[ETHTOOL_MSG_WOL_NTF] = {
+		.cmd		= ETHTOOL_MSG_WOL_NTF,
+		.cb		= wol_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_WOL_GET,
+		.hdr_attr	= ETHTOOL_A_WOL_HEADER,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_DEBUG_NTF,
-		.cb	= debug_reply_cb,
+	[ETHTOOL_MSG_DEBUG_NTF] = {
+		.cmd		= ETHTOOL_MSG_DEBUG_NTF,
+		.cb		= debug_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_DEBUG_GET,
+		.hdr_attr	= ETHTOOL_A_DEBUG_HEADER,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_FEATURES_NTF,
-		.cb	= features_reply_cb,
+	[ETHTOOL_MSG_FEATURES_NTF] = {
+		.cmd		= ETHTOOL_MSG_FEATURES_NTF,
+		.cb		= features_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_FEATURES_GET,
+		.hdr_attr	= ETHTOOL_A_FEATURES_HEADER,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_PRIVFLAGS_NTF,
-		.cb	= privflags_reply_cb,
+	[ETHTOOL_MSG_PRIVFLAGS_NTF] = {
+		.cmd		= ETHTOOL_MSG_PRIVFLAGS_NTF,
+		.cb		= privflags_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_PRIVFLAGS_GET,
+		.hdr_attr	= ETHTOOL_A_PRIVFLAGS_HEADER,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_RINGS_NTF,
-		.cb	= rings_reply_cb,
+	[ETHTOOL_MSG_RINGS_NTF] = {
+		.cmd		= ETHTOOL_MSG_RINGS_NTF,
+		.cb		= rings_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_RINGS_GET,
+		.hdr_attr	= ETHTOOL_A_RINGS_HEADER,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_CHANNELS_NTF,
-		.cb	= channels_reply_cb,
+	[ETHTOOL_MSG_CHANNELS_NTF] = {
+		.cmd		= ETHTOOL_MSG_CHANNELS_NTF,
+		.cb		= channels_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_CHANNELS_GET,
+		.hdr_attr	= ETHTOOL_A_CHANNELS_HEADER,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_COALESCE_NTF,
-		.cb	= coalesce_reply_cb,
+	[ETHTOOL_MSG_COALESCE_NTF] = {
+		.cmd		= ETHTOOL_MSG_COALESCE_NTF,
+		.cb		= coalesce_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_COALESCE_GET,
+		.hdr_attr	= ETHTOOL_A_COALESCE_HEADER,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_PAUSE_NTF,
-		.cb	= pause_reply_cb,
+	[ETHTOOL_MSG_PAUSE_NTF] = {
+		.cmd		= ETHTOOL_MSG_PAUSE_NTF,
+		.cb		= pause_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_PAUSE_GET,
+		.hdr_attr	= ETHTOOL_A_PAUSE_HEADER,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_EEE_NTF,
-		.cb	= eee_reply_cb,
+	[ETHTOOL_MSG_EEE_NTF] = {
+		.cmd		= ETHTOOL_MSG_EEE_NTF,
+		.cb		= eee_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_EEE_GET,
+		.hdr_attr	= ETHTOOL_A_EEE_HEADER,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_CABLE_TEST_NTF,
-		.cb	= cable_test_ntf_cb,
+	[ETHTOOL_MSG_CABLE_TEST_NTF] = {
+		.cmd		= ETHTOOL_MSG_CABLE_TEST_NTF,
+		.cb		= cable_test_ntf_cb,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_CABLE_TEST_TDR_NTF,
-		.cb	= cable_test_tdr_ntf_cb,
+	[ETHTOOL_MSG_CABLE_TEST_TDR_NTF] = {
+		.cmd		= ETHTOOL_MSG_CABLE_TEST_TDR_NTF,
+		.cb		= cable_test_tdr_ntf_cb,
 	},
-	{
-		.cmd	= ETHTOOL_MSG_FEC_NTF,
-		.cb	= fec_reply_cb,
+	[ETHTOOL_MSG_FEC_NTF] = {
+		.cmd		= ETHTOOL_MSG_FEC_NTF,
+		.cb		= fec_reply_cb,
+		.get_cmd	= ETHTOOL_MSG_FEC_GET,
+		.hdr_attr	= ETHTOOL_A_FEC_HEADER,
 	},
 };
 
-static void clear_filter(struct nl_context *nlctx)
+/**
+ * monitor_callback_get() - look up handling of a notification type
+ * @cmd: notification message type (ETHTOOL_MSG_*_NTF)
+ *
+ * Return: handler of @cmd or null if notifications of this type are not
+ * handled
+ */
+const struct monitor_callback *monitor_callback_get(unsigned int cmd)
 {
-	unsigned int i;
-
-	for (i = 0; i < CMDMASK_WORDS; i++)
-		nlctx->filter_cmds[i] = 0;
+	if (cmd >= ARRAY_SIZE(monitor_callbacks) || !monitor_callbacks[cmd].cb)
+		return NULL;
+	return &monitor_callbacks[cmd];
 }
 
+/* only types with a handler can be set so no further checks are needed */
 static bool test_filter_cmd(const struct nl_context *nlctx, unsigned int cmd)
 {
-	return nlctx->filter_cmds[cmd / 32] & (1U << (cmd % 32));
+	return cmd < __ETHTOOL_MSG_KERNEL_CNT &&
+	       (nlctx->filter_cmds[cmd / 32] & (1U << (cmd % 32)));
 }
 
-static void set_filter_cmd(struct nl_context *nlctx, unsigned int cmd)
+static void cmdmask_set(uint32_t *mask, unsigned int cmd)
 {
-	nlctx->filter_cmds[cmd / 32] |= (1U << (cmd % 32));
+	mask[cmd / 32] |= (1U << (cmd % 32));
 }
 
-static void set_filter_all(struct nl_context *nlctx)
+static void cmdmask_set_all(uint32_t *mask)
 {
 	unsigned int i;
 
 	for (i = 0; i < ARRAY_SIZE(monitor_callbacks); i++)
-		set_filter_cmd(nlctx, monitor_callbacks[i].cmd);
+		if (monitor_callbacks[i].cb)
+			cmdmask_set(mask, i);
 }
 
-static int monitor_any_cb(const struct nlmsghdr *nlhdr, void *data)
+/**
+ * struct monitor_dev - cached device filter verdict
+ * @name:  device name the verdict was computed for
+ * @match: device is monitored
+ */
+struct monitor_dev {
+	char	name[IFNAMSIZ];
+	bool	match;
+};
+
+/**
+ * struct monitor_devset - set of monitored devices
+ * @patterns:   device names and shell patterns (all devices if none)
+ * @n_patterns: number of entries in @patterns
+ * @excludes:   device names and shell patterns of devices not monitored
+ * @n_excludes: number of entries in @excludes
+ * @devs:       verdicts indexed by ifindex
+ * @n_devs:     number of entries in @devs
+ *
+ * Patterns are matched against the device name when a notification for an
+ * ifindex is seen for the first time, further notifications only need
+ * a lookup by ifindex from the message header. The verdict is recomputed if
+ * the name in the header differs from the cached one, i.e. after the device
+ * was renamed (RTM_NEWLINK) or the ifindex reused after RTM_DELLINK.
+ */
+struct monitor_devset {
+	const char		**patterns;
+	unsigned int		n_patterns;
+	const char		**excludes;
+	unsigned int		n_excludes;
+	struct monitor_dev	*devs;
+	unsigned int		n_devs;
+};
+
+/**
+ * enum monitor_link_src - use of link state replies
+ * @MONITOR_LINK_SEED:   record link state from the reply (at start and after
+ *                       carrier changes were lost)
+ * @MONITOR_LINK_SAMPLE: keep link state known from carrier changes, only
+ *                       sample SQI (periodic queries)
+ * @MONITOR_LINK_DOWN:   record link going down (carrier lost), the reply adds
+ *                       the reason and SQI
+ */
+enum monitor_link_src {
+	MONITOR_LINK_SEED,
+	MONITOR_LINK_SAMPLE,
+	MONITOR_LINK_DOWN,
+};
+
+/**
+ * struct monitor_state - state of notification monitor
+ * @nlctx:       netlink context
+ * @rcvbuf:      requested receive buffer size
+ * @overruns:    number of receive buffer overruns (lost notifications)
+ * @resync_sock: socket for state dumps after an overrun
+ * @jw:          JSON writer (null unless --json was used)
+ * @line_flush:  flush output after each JSON record
+ * @devset:      monitored devices (no patterns if not filtering or if
+ *               filtering by one device name)
+ * @resync_mcb:  notification type being resynchronized
+ * @state_file:  file to write device state snapshots into (--state)
+ * @devstate:    device state model (only with --state)
+ * @window:      coalescing window in milliseconds (0 if not coalescing)
+ * @bursts:      notification coalescing state (only with --window)
+ * @log_file:    binary notification log (--log)
+ * @evlog:       log open for appending (only with --log and not --query)
+ * @query:       show notifications from @log_file (--query)
+ * @since:       start of queried time range (CLOCK_REALTIME, ns)
+ * @until:       end of queried time range (CLOCK_REALTIME, ns)
+ * @log_time:    time of logged notification being shown (0 if live)
+ * @log_flags:   flags of logged notification being shown (EVLOG_F_*)
+ * @watch:       SQI sampling interval in seconds (0 if not watching)
+ * @report:      link history report interval in seconds (0 if only at exit)
+ * @carriers:    link history follows carrier changes (with --link-watch and
+ *               with --window if link settings notifications are shown)
+ * @linkhist:    link state history (only if @carriers)
+ * @link_dev:    history of the device whose link state was received last
+ * @link_src:    how link state replies are recorded
+ * @link_time:   receive time of the carrier change being recorded (zero if
+ *               link state was polled)
+ * @next_poll:   time of next link state poll (CLOCK_MONOTONIC, ns)
+ * @next_report: time of next link history report (CLOCK_MONOTONIC, ns)
+ * @state_written: time @state_file was last written (CLOCK_MONOTONIC, ns)
+ */
+struct monitor_state {
+	struct nl_context	*nlctx;
+	int			rcvbuf;
+	unsigned int		overruns;
+	struct nl_socket	*resync_sock;
+	json_writer_t		*jw;
+	bool			line_flush;
+	struct monitor_devset	devset;
+	const struct monitor_callback *resync_mcb;
+	const char		*state_file;
+	struct devstate		*devstate;
+	unsigned int		window;
+	struct ntfburst_table	*bursts;
+	const char		*log_file;
+	struct evlog		*evlog;
+	bool			query;
+	uint64_t		since;
+	uint64_t		until;
+	uint64_t		log_time;
+	unsigned int		log_flags;
+	unsigned int		watch;
+	unsigned int		report;
+	bool			carriers;
+	struct linkhist		*linkhist;
+	const struct linkhist_dev *link_dev;
+	enum monitor_link_src	link_src;
+	struct timespec		link_time;
+	uint64_t		next_poll;
+	uint64_t		next_report;
+	uint64_t		state_written;
+};
+
+/* set by SIGINT and SIGTERM so that link history is reported at exit */
+static volatile sig_atomic_t monitor_stopped;
+
+/* output buffer for JSON records, static as stdout may outlive nl_monitor() */
+static char monitor_json_buff[MONITOR_JSON_BUFSIZE];
+
+/* device index and name from request header (first attribute) */
+static void monitor_msg_dev(const struct nlmsghdr *nlhdr, int *ifindex,
+			    const char **ifname)
+{
+	const struct nlattr *header;
+	const struct nlattr *attr;
+	int len;
+
+	*ifindex = 0;
+	*ifname = NULL;
+	len = mnl_nlmsg_get_payload_len(nlhdr) - GENL_HDRLEN;
+	header = mnl_nlmsg_get_payload_offset(nlhdr, GENL_HDRLEN);
+	if (len < NLA_HDRLEN || !mnl_attr_ok(header, len) ||
+	    mnl_attr_get_type(header) != 1)
+		return;
+	mnl_attr_for_each_nested(attr, header) {
+		switch (mnl_attr_get_type(attr)) {
+		case ETHTOOL_A_HEADER_DEV_INDEX:
+			if (mnl_attr_get_payload_len(attr) >= sizeof(uint32_t))
+				*ifindex = mnl_attr_get_u32(attr);
+			break;
+		case ETHTOOL_A_HEADER_DEV_NAME:
+			if (!mnl_attr_validate(attr, MNL_TYPE_NUL_STRING))
+				*ifname = mnl_attr_get_str(attr);
+			break;
+		}
+	}
+}
+
+static bool devset_match_any(const char *const *patterns, unsigned int n,
+			     const char *ifname)
 {
-	const struct genlmsghdr *ghdr = (const struct genlmsghdr *)(nlhdr + 1);
-	struct nl_context *nlctx = data;
 	unsigned int i;
 
-	if (!test_filter_cmd(nlctx, ghdr->cmd))
+	for (i = 0; i < n; i++)
+		if (!fnmatch(patterns[i], ifname, 0))
+			return true;
+	return false;
+}
+
+static bool devset_match_name(const struct monitor_devset *devset,
+			      const char *ifname)
+{
+	return (!devset->n_patterns ||
+		devset_match_any(devset->patterns, devset->n_patterns,
+				 ifname)) &&
+	       !devset_match_any(devset->excludes, devset->n_excludes, ifname);
+}
+
+/* the same for a device known by name only (rtnetlink messages) */
+static bool monitor_name_wanted(const struct monitor_state *state,
+				const char *ifname)
+{
+	if (state->nlctx->filter_devname)
+		return !strcmp(ifname, state->nlctx->filter_devname);
+	return devset_match_name(&state->devset, ifname);
+}
+
+/**
+ * monitor_dev_wanted() - check if notification is for a monitored device
+ * @state: monitor state
+ * @nlhdr: notification
+ *
+ * Only the header is parsed and, for a known device, the result is looked up
+ * by ifindex so that notifications for other devices are dropped cheaply.
+ * A single device name (filter_devname) is compared directly; this matters
+ * for --state which does not pass notifications to the callbacks checking it.
+ *
+ * Return: true if the notification is to be shown
+ */
+static bool monitor_dev_wanted(struct monitor_state *state,
+			       const struct nlmsghdr *nlhdr)
+{
+	struct monitor_devset *devset = &state->devset;
+	struct monitor_dev *dev;
+	const char *ifname;
+	int ifindex;
+
+	if (state->nlctx->filter_devname) {
+		monitor_msg_dev(nlhdr, &ifindex, &ifname);
+		return ifname && !strcmp(ifname, state->nlctx->filter_devname);
+	}
+	if (!devset->n_patterns && !devset->n_excludes)
+		return true;
+	monitor_msg_dev(nlhdr, &ifindex, &ifname);
+	if (!ifname)
+		return false;
+	if (ifindex <= 0 || ifindex >= MONITOR_DEVSET_MAX_INDEX)
+		return devset_match_name(devset, ifname);
+
+	if ((unsigned int)ifindex >= devset->n_devs) {
+		unsigned int n = devset->n_devs ?: 64;
+		struct monitor_dev *devs;
+
+		while (n <= (unsigned int)ifindex)
+			n *= 2;
+		devs = realloc(devset->devs, n * sizeof(devs[0]));
+		if (!devs)
+			return devset_match_name(devset, ifname);
+		memset(devs + devset->n_devs, '\0',
+		       (n - devset->n_devs) * sizeof(devs[0]));
+		devset->devs = devs;
+		devset->n_devs = n;
+	}
+	dev = &devset->devs[ifindex];
+	if (strcmp(dev->name, ifname)) {
+		snprintf(dev->name, sizeof(dev->name), "%s", ifname);
+		dev->match = devset_match_name(devset, ifname);
+	}
+
+	return dev->match;
+}
+
+static void monitor_json_ns(json_writer_t *jw, const char *name,
+			    uint64_t time)
+{
+	jsonw_name(jw, name);
+	jsonw_printf(jw, "%llu.%09llu",
+		     (unsigned long long)(time / 1000000000ULL),
+		     (unsigned long long)(time % 1000000000ULL));
+}
+
+static uint64_t monitor_ts_ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/* Receive time @rx_ts of the notification if the socket reports it,
+ * otherwise (backend, coalesced bursts shown from a timer) the current time.
+ * The kernel timestamp is CLOCK_REALTIME, its monotonic counterpart is
+ * derived from the time elapsed since.
+ */
+static void monitor_json_time(json_writer_t *jw, const struct timespec *rx_ts)
+{
+	struct timespec real, mono;
+	uint64_t now, rx_time;
+
+	clock_gettime(CLOCK_REALTIME, &real);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	now = monitor_ts_ns(&real);
+	rx_time = monitor_ts_ns(rx_ts);
+	if (!rx_time || rx_time > now)
+		rx_time = now;
+	monitor_json_ns(jw, "time", rx_time);
+	monitor_json_ns(jw, "monotonic", monitor_ts_ns(&mono) - (now - rx_time));
+}
+
+static void monitor_json_link(json_writer_t *jw,
+			      const struct linkhist_dev *link)
+{
+	jsonw_name(jw, "link");
+	jsonw_start_object(jw);
+	jsonw_bool_field(jw, "up", link->up);
+	jsonw_uint_field(jw, "flaps", link->flaps);
+	if (!link->up)
+		monitor_json_ns(jw, "down", linkhist_now() - link->changed);
+	monitor_json_ns(jw, "down_total", link->down_total);
+	monitor_json_ns(jw, "down_max", link->down_max);
+	jsonw_end_object(jw);
+}
+
+/**
+ * monitor_json_record() - show a notification as a JSON record
+ * @state: monitor state
+ * @nlhdr: notification (or reply to a resync dump)
+ * @burst: coalesced notifications @nlhdr is the last of (null if none)
+ * @link:  link flap statistics of the device (null if not known)
+ *
+ * Write one line with a compact JSON object: receive time (CLOCK_REALTIME
+ * and CLOCK_MONOTONIC, in seconds; time of processing if the kernel does not
+ * report it), message type, device and all attributes decoded using the
+ * message descriptions of the pretty printer. Notifications read from a log
+ * have only the logged receive time (and "dump" flag for replies to state
+ * dumps). Coalesced notifications add their number and time of the first and
+ * last one, link related ones also flap statistics (durations in seconds).
+ *
+ * Return: MNL_CB_OK
+ */
+static int monitor_json_record(struct monitor_state *state,
+			       const struct nlmsghdr *nlhdr,
+			       const struct ntfburst *burst,
+			       const struct linkhist_dev *link)
+{
+	struct nl_context *nlctx = state->nlctx;
+	json_writer_t *jw = state->jw;
+	const char *ifname;
+	int ifindex;
+
+	monitor_msg_dev(nlhdr, &ifindex, &ifname);
+	if (nlctx->filter_devname &&
+	    (!ifname || strcmp(ifname, nlctx->filter_devname)))
+		return MNL_CB_OK;
+
+	jsonw_start_object(jw);
+	if (state->log_time) {
+		monitor_json_ns(jw, "time", state->log_time);
+		if (state->log_flags & EVLOG_F_DUMP)
+			jsonw_bool_field(jw, "dump", true);
+	} else {
+		monitor_json_time(jw, &nlctx->rx_time);
+	}
+	if (ifindex)
+		jsonw_int_field(jw, "ifindex", ifindex);
+	if (ifname)
+		jsonw_string_field(jw, "dev", ifname);
+	if (burst) {
+		jsonw_uint_field(jw, "count", burst->count);
+		monitor_json_ns(jw, "first", burst->first);
+		monitor_json_ns(jw, "last", burst->last);
+	}
+	if (link)
+		monitor_json_link(jw, link);
+	json_print_genlmsg(jw, nlhdr, ethnl_kmsg_desc, ethnl_kmsg_n_desc);
+	jsonw_end_object(jw);
+	jsonw_end_record(jw);
+
+	return MNL_CB_OK;
+}
+
+static int monitor_json_cb(const struct nlmsghdr *nlhdr, void *data)
+{
+	return monitor_json_record(data, nlhdr, NULL, NULL);
+}
+
+/* show a notification (or a coalesced burst) */
+static int monitor_show(struct monitor_state *state,
+			const struct nlmsghdr *nlhdr)
+{
+	const struct genlmsghdr *ghdr = mnl_nlmsg_get_payload(nlhdr);
+	const struct monitor_callback *mcb;
+
+	if (state->jw)
+		return monitor_json_cb(nlhdr, state);
+	mcb = monitor_callback_get(ghdr->cmd);
+
+	return mcb ? mcb->cb(nlhdr, state->nlctx) : MNL_CB_OK;
+}
+
+static int monitor_resync_sock(struct monitor_state *state)
+{
+	if (state->resync_sock)
+		return 0;
+	return nlsock_init(state->nlctx, &state->resync_sock,
+			   NETLINK_GENERIC);
+}
+
+static double monitor_seconds(uint64_t ns)
+{
+	return ns / 1e9;
+}
+
+/* show a change of link state (or its first observation) in watch mode */
+static void monitor_link_event(struct monitor_state *state,
+			       const struct linkhist_dev *dev, int ifindex,
+			       uint64_t duration)
+{
+	const struct linkhist_sample *sample = &dev->last;
+	bool first = !dev->flaps && !dev->n_down;
+	json_writer_t *jw = state->jw;
+	const char *name;
+
+	if (jw) {
+		jsonw_start_object(jw);
+		monitor_json_time(jw, &state->link_time);
+		jsonw_string_field(jw, "msg", "link");
+		jsonw_int_field(jw, "ifindex", ifindex);
+		jsonw_string_field(jw, "dev", dev->name);
+		jsonw_bool_field(jw, "up", sample->up);
+		if (sample->ext_state >= 0)
+			jsonw_uint_field(jw, "ext_state", sample->ext_state);
+		if (sample->ext_substate >= 0)
+			jsonw_uint_field(jw, "ext_substate",
+					 sample->ext_substate);
+		if (sample->sqi >= 0)
+			jsonw_int_field(jw, "sqi", sample->sqi);
+		if (sample->sqi_max >= 0)
+			jsonw_int_field(jw, "sqi_max", sample->sqi_max);
+		if (!first)
+			monitor_json_ns(jw, "duration", duration);
+		jsonw_end_object(jw);
+		jsonw_end_record(jw);
+		return;
+	}
+
+	printf("%s: link %s", dev->name, sample->up ? "up" : "down");
+	if (!sample->up && sample->ext_state >= 0) {
+		name = link_ext_state_name(sample->ext_state);
+		if (name)
+			printf(" (%s", name);
+		else
+			printf(" (extended state %d", sample->ext_state);
+		name = sample->ext_substate < 0 ? NULL :
+		       link_ext_substate_name(sample->ext_state,
+					      sample->ext_substate);
+		if (name)
+			printf(", %s", name);
+		putchar(')');
+	}
+	if (sample->sqi >= 0 && sample->sqi_max >= 0)
+		printf(", SQI %d/%d", sample->sqi, sample->sqi_max);
+	else if (sample->sqi >= 0)
+		printf(", SQI %d", sample->sqi);
+	if (!first)
+		printf(", was %s for %.3f s", sample->up ? "down" : "up",
+		       monitor_seconds(duration));
+	putchar('\n');
+}
+
+/* record observed link state, show it in watch mode if it changed */
+static int monitor_link_update(struct monitor_state *state, int ifindex,
+			       const char *ifname,
+			       const struct linkhist_sample *sample)
+{
+	const struct linkhist_dev *dev;
+	uint64_t duration;
+	int ret;
+
+	ret = linkhist_update(state->linkhist, ifindex, ifname, sample, &dev,
+			      &duration);
+	if (ret < 0)
+		return ret;
+	state->link_dev = dev;
+	if (ret > 0 && state->watch)
+		monitor_link_event(state, dev, ifindex, duration);
+
+	return 0;
+}
+
+/* link state reply: update link history of the device */
+static int monitor_link_cb(const struct nlmsghdr *nlhdr, void *data)
+{
+	const struct nlattr *tb[ETHTOOL_A_LINKSTATE_MAX + 1] = {};
+	struct linkhist_sample sample = {
+		.ext_state	= -1,
+		.ext_substate	= -1,
+		.sqi		= -1,
+		.sqi_max	= -1,
+	};
+	DECLARE_ATTR_TB_INFO(tb);
+	struct monitor_state *state = data;
+	const struct linkhist_dev *known;
+	const char *ifname;
+	int ifindex;
+	int ret;
+
+	if (!monitor_dev_wanted(state, nlhdr))
+		return MNL_CB_OK;
+	ret = mnl_attr_parse(nlhdr, GENL_HDRLEN, attr_cb, &tb_info);
+	if (ret < 0)
+		return ret;
+	monitor_msg_dev(nlhdr, &ifindex, &ifname);
+	if (!ifname || !tb[ETHTOOL_A_LINKSTATE_LINK])
+		return MNL_CB_OK;
+	sample.up = mnl_attr_get_u8(tb[ETHTOOL_A_LINKSTATE_LINK]);
+	if (tb[ETHTOOL_A_LINKSTATE_EXT_STATE])
+		sample.ext_state =
+			mnl_attr_get_u8(tb[ETHTOOL_A_LINKSTATE_EXT_STATE]);
+	if (tb[ETHTOOL_A_LINKSTATE_EXT_SUBSTATE])
+		sample.ext_substate =
+			mnl_attr_get_u8(tb[ETHTOOL_A_LINKSTATE_EXT_SUBSTATE]);
+	if (tb[ETHTOOL_A_LINKSTATE_SQI])
+		sample.sqi = mnl_attr_get_u32(tb[ETHTOOL_A_LINKSTATE_SQI]);
+	if (tb[ETHTOOL_A_LINKSTATE_SQI_MAX])
+		sample.sqi_max =
+			mnl_attr_get_u32(tb[ETHTOOL_A_LINKSTATE_SQI_MAX]);
+
+	switch (state->link_src) {
+	case MONITOR_LINK_SEED:
+		break;
+	case MONITOR_LINK_SAMPLE:
+		known = linkhist_get(state->linkhist, ifindex);
+		if (known)
+			sample.up = known->up;
+		break;
+	case MONITOR_LINK_DOWN:
+		sample.up = false;
+		break;
+	}
+
+	return monitor_link_update(state, ifindex, ifname, &sample) < 0 ?
+	       MNL_CB_ERROR : MNL_CB_OK;
+}
+
+/**
+ * monitor_probe_link() - query link state
+ * @state:   monitor state
+ * @devname: device name or WILDCARD_DEVNAME for all devices
+ *
+ * Link state is queried (through the resync socket) to seed link history of
+ * the devices, to sample SQI periodically in watch mode and for the reason of
+ * link going down; @state->link_src tells the replies apart.
+ *
+ * Return: 0 on success or negative error code
+ */
+static int monitor_probe_link(struct monitor_state *state,
+			      const char *devname)
+{
+	struct nl_context *nlctx = state->nlctx;
+	struct cmd_context *ctx = nlctx->ctx;
+	struct timespec saved_rx_time = nlctx->rx_time;
+	const char *saved_devname = ctx->devname;
+	bool saved_is_dump = nlctx->is_dump;
+	struct nl_socket *nlsk;
+	uint32_t cap;
+	int ret;
+
+	cap = strcmp(devname, WILDCARD_DEVNAME) ? GENL_CMD_CAP_DO :
+						  GENL_CMD_CAP_DUMP;
+	if (nlctx->ops_info &&
+	    !(nlctx->ops_info[ETHTOOL_MSG_LINKSTATE_GET].op_flags & cap))
+		return -EOPNOTSUPP;
+	ret = monitor_resync_sock(state);
+	if (ret < 0)
+		return ret;
+	nlsk = state->resync_sock;
+
+	ctx->devname = devname;
+	ret = nlsock_prep_get_request(nlsk, ETHTOOL_MSG_LINKSTATE_GET,
+				      ETHTOOL_A_LINKSTATE_HEADER, 0);
+	if (ret == 0)
+		ret = nlsock_sendmsg(nlsk, NULL);
+	if (ret >= 0)
+		ret = nlsock_process_reply(nlsk, monitor_link_cb, state);
+	ctx->devname = saved_devname;
+	nlctx->is_dump = saved_is_dump;
+	/* the reply may be processed while handling a carrier change */
+	nlctx->rx_time = saved_rx_time;
+
+	return ret < 0 ? ret : 0;
+}
+
+/* query link state of all monitored devices */
+static int monitor_poll_links(struct monitor_state *state,
+			      enum monitor_link_src src)
+{
+	state->link_src = src;
+	return monitor_probe_link(state, state->nlctx->filter_devname ?:
+					 WILDCARD_DEVNAME);
+}
+
+/**
+ * monitor_carrier_cb() - handle a link message from rtnetlink
+ * @nlhdr: RTM_NEWLINK message
+ * @data:  monitor state
+ *
+ * Carrier changes are not reported by ethtool notifications and polling link
+ * state would miss flaps shorter than the interval, link history follows
+ * RTNLGRP_LINK instead. RTM_NEWLINK is sent on any change of a device, only
+ * carrier (operational state, i.e. IFF_RUNNING, if carrier is not reported)
+ * different from the history is recorded; coalesced link settings
+ * notifications show flap statistics from it. In watch mode, link state is
+ * queried when the link goes down for the reason and SQI.
+ *
+ * Return: MNL_CB_OK, MNL_CB_STOP if interrupted or MNL_CB_ERROR on failure
+ */
+static int monitor_carrier_cb(const struct nlmsghdr *nlhdr, void *data)
+{
+	const struct nlattr *tb[__IFLA_MAX] = {};
+	struct linkhist_sample sample = {
+		.ext_state	= -1,
+		.ext_substate	= -1,
+		.sqi		= -1,
+		.sqi_max	= -1,
+	};
+	DECLARE_ATTR_TB_INFO(tb);
+	struct monitor_state *state = data;
+	const struct linkhist_dev *known;
+	const struct ifinfomsg *ifinfo;
+	const char *ifname;
+	int ret;
+
+	if (monitor_stopped)
+		return MNL_CB_STOP;
+	if (nlhdr->nlmsg_type != RTM_NEWLINK ||
+	    mnl_nlmsg_get_payload_len(nlhdr) < sizeof(*ifinfo))
+		return MNL_CB_OK;
+	ifinfo = mnl_nlmsg_get_payload(nlhdr);
+	/* bridge port messages etc. carry no carrier */
+	if (ifinfo->ifi_family != AF_UNSPEC)
+		return MNL_CB_OK;
+	ret = mnl_attr_parse(nlhdr, sizeof(*ifinfo), attr_cb, &tb_info);
+	if (ret < 0 || !tb[IFLA_IFNAME])
+		return MNL_CB_OK;
+	ifname = mnl_attr_get_str(tb[IFLA_IFNAME]);
+	if (!monitor_name_wanted(state, ifname))
+		return MNL_CB_OK;
+	if (tb[IFLA_CARRIER])
+		sample.up = (ifinfo->ifi_flags & IFF_UP) &&
+			    mnl_attr_get_u8(tb[IFLA_CARRIER]);
+	else
+		sample.up = ifinfo->ifi_flags & IFF_RUNNING;
+	known = linkhist_get(state->linkhist, ifinfo->ifi_index);
+	if (known && known->up == sample.up)
 		return MNL_CB_OK;
 
-	for (i = 0; i < MNL_ARRAY_SIZE(monitor_callbacks); i++)
-		if (monitor_callbacks[i].cmd == ghdr->cmd)
-			return monitor_callbacks[i].cb(nlhdr, data);
+	state->link_dev = NULL;
+	state->link_time = state->nlctx->rx_time;
+	if (state->watch && !sample.up) {
+		/* failure is not fatal, the change is recorded without reason */
+		state->link_src = MONITOR_LINK_DOWN;
+		monitor_probe_link(state, ifname);
+	}
+	if (!state->link_dev)
+		ret = monitor_link_update(state, ifinfo->ifi_index, ifname,
+					  &sample);
+	memset(&state->link_time, '\0', sizeof(state->link_time));
+
+	return ret < 0 ? MNL_CB_ERROR : MNL_CB_OK;
+}
+
+/* process carrier changes received so far */
+static int monitor_carriers(struct monitor_state *state)
+{
+	struct nl_socket *nlsk = state->nlctx->rtnl_socket;
+	int ret;
+
+	ret = nlsock_process_reply(nlsk, monitor_carrier_cb, state);
+	while (ret == -ENOBUFS) {
+		/* changes were lost, start over from current link state */
+		fputs("carrier changes lost, querying link state\n", stderr);
+		monitor_poll_links(state, MONITOR_LINK_SEED);
+		ret = nlsock_process_reply(nlsk, monitor_carrier_cb, state);
+	}
+
+	return ret == -EAGAIN ? 0 : ret;
+}
+
+static void monitor_report(struct monitor_state *state)
+{
+	json_writer_t *jw = state->jw;
+
+	if (!jw) {
+		linkhist_print_report(state->linkhist, NULL);
+		return;
+	}
+	jsonw_start_object(jw);
+	monitor_json_time(jw, &state->nlctx->rx_time);
+	linkhist_print_report(state->linkhist, jw);
+	jsonw_end_object(jw);
+	jsonw_end_record(jw);
+}
+
+/**
+ * monitor_timers() - sample SQI and report link history when due
+ * @state: monitor state
+ *
+ * Return: time until the next poll or report in milliseconds (rounded up),
+ * -1 if not watching link state
+ */
+static int monitor_timers(struct monitor_state *state)
+{
+	uint64_t now, next;
+
+	if (!state->watch)
+		return -1;
+	now = linkhist_now();
+	if (now >= state->next_poll) {
+		/* failure is not fatal, link state is probed again later */
+		monitor_poll_links(state, MONITOR_LINK_SAMPLE);
+		state->next_poll = now + state->watch * 1000000000ULL;
+	}
+	if (state->report && now >= state->next_report) {
+		monitor_report(state);
+		state->next_report = now + state->report * 1000000000ULL;
+	}
+
+	next = state->next_poll;
+	if (state->report && state->next_report < next)
+		next = state->next_report;
+	return (next - now + 999999) / 1000000;
+}
+
+/* show a burst of coalesced notifications */
+static int monitor_burst_cb(const struct ntfburst *burst, void *data)
+{
+	const struct linkhist_dev *link = NULL;
+	struct monitor_state *state = data;
+	int ret;
+
+	/* flap statistics are kept up to date from carrier changes */
+	if (state->linkhist &&
+	    (burst->cmd == ETHTOOL_MSG_LINKINFO_NTF ||
+	     burst->cmd == ETHTOOL_MSG_LINKMODES_NTF))
+		link = linkhist_get(state->linkhist, burst->ifindex);
+	if (state->jw)
+		return monitor_json_record(state, burst->msg, burst, link);
+
+	ret = monitor_show(state, burst->msg);
+	if (ret < 0)
+		return ret;
+	if (burst->count > 1)
+		printf("\t(%u notifications in %.3f s)\n", burst->count,
+		       monitor_seconds(burst->last - burst->first));
+	if (link) {
+		printf("\tLink %s, %u flaps, down %.3f s in total, longest %.3f s",
+		       link->up ? "up" : "down", link->flaps,
+		       monitor_seconds(link->down_total),
+		       monitor_seconds(link->down_max));
+		if (!link->up)
+			printf(", now down for %.3f s",
+			       monitor_seconds(linkhist_now() - link->changed));
+		putchar('\n');
+	}
 
 	return MNL_CB_OK;
 }
 
+/* add a notification to its burst, @added is false if it is to be shown now */
+static int monitor_coalesce(struct monitor_state *state,
+			    const struct nlmsghdr *nlhdr, bool *added)
+{
+	const struct genlmsghdr *ghdr = mnl_nlmsg_get_payload(nlhdr);
+	const struct monitor_callback *mcb;
+	const char *ifname;
+	int ifindex;
+	int ret;
+
+	*added = false;
+	/* cable test notifications carry results, not state */
+	mcb = monitor_callback_get(ghdr->cmd);
+	if (!mcb || !mcb->get_cmd)
+		return 0;
+
+	monitor_msg_dev(nlhdr, &ifindex, &ifname);
+	ret = ntfburst_add(state->bursts, nlhdr, ifindex);
+	if (ret < 0)
+		return ret;
+	*added = ret;
+	/* a continuous storm does not let the socket go idle */
+	return ntfburst_flush(state->bursts, false, monitor_burst_cb, state);
+}
+
+/* update state model and/or log instead of showing a notification */
+static int monitor_record(struct monitor_state *state,
+			  const struct nlmsghdr *nlhdr, uint8_t cmd,
+			  unsigned int flags)
+{
+	int ret;
+
+	if (state->devstate) {
+		ret = devstate_update(state->devstate, nlhdr);
+		if (ret < 0)
+			return ret;
+	}
+	if (state->evlog) {
+		ret = evlog_append(state->evlog, nlhdr, cmd, flags);
+		if (ret == -EMSGSIZE)
+			fprintf(stderr,
+				"notification too big to log, dropped\n");
+		else if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int monitor_any_cb(const struct nlmsghdr *nlhdr, void *data)
+{
+	const struct genlmsghdr *ghdr = (const struct genlmsghdr *)(nlhdr + 1);
+	struct monitor_state *state = data;
+	struct nl_context *nlctx = state->nlctx;
+	bool added;
+
+	/* a steady stream of notifications would never let us wait */
+	if (monitor_stopped)
+		return MNL_CB_STOP;
+	if (!test_filter_cmd(nlctx, ghdr->cmd) ||
+	    !monitor_dev_wanted(state, nlhdr))
+		return MNL_CB_OK;
+	if (state->watch) {
+		/* link state comes from rtnetlink, a continuous storm of
+		 * notifications must not keep the timers from running
+		 */
+		monitor_timers(state);
+		return MNL_CB_OK;
+	}
+	if (state->devstate || state->evlog)
+		return monitor_record(state, nlhdr, ghdr->cmd, 0) < 0 ?
+		       MNL_CB_ERROR : MNL_CB_OK;
+	if (state->bursts) {
+		if (monitor_coalesce(state, nlhdr, &added) < 0)
+			return MNL_CB_ERROR;
+		if (added)
+			return MNL_CB_OK;
+	}
+
+	return monitor_show(state, nlhdr);
+}
+
 struct monitor_option {
 	const char	*pattern;
 	uint8_t		cmd;
@@ -203,50 +1058,686 @@ static bool pattern_match(const char *s, const char *pattern)
 	return false;
 }
 
-static int parse_monitor(struct cmd_context *ctx)
+/* split device arguments (names, shell patterns or comma separated lists of
+ * them) into patterns; if @all is not null, "*" is not a pattern but sets it
+ */
+static int monitor_dev_patterns(struct nl_context *nlctx, char *const *args,
+				unsigned int n_args, const char ***patterns,
+				unsigned int *n_patterns, bool *all)
 {
-	struct nl_context *nlctx = ctx->nlctx;
-	char **argp = ctx->argp;
-	int argc = ctx->argc;
-	const char *opt = "";
-	bool opt_found;
+	unsigned int n = 0;
 	unsigned int i;
+	char *buff;
+	char *pat;
 
-	if (*argp && argp[0][0] == '-') {
-		opt = *argp;
-		argp++;
-		argc--;
+	*n_patterns = 0;
+	if (!n_args)
+		return 0;
+	for (i = 0; i < n_args; i++) {
+		n++;
+		for (pat = args[i]; *pat; pat++)
+			if (*pat == ',')
+				n++;
 	}
-	opt_found = false;
-	clear_filter(nlctx);
-	for (i = 0; i < MNL_ARRAY_SIZE(monitor_opts); i++) {
-		if (pattern_match(opt, monitor_opts[i].pattern)) {
-			unsigned int cmd = monitor_opts[i].cmd;
-
-			if (!cmd)
-				set_filter_all(nlctx);
+	*patterns = arena_alloc(&nlctx->arena, n * sizeof(char *));
+	if (!*patterns)
+		return -ENOMEM;
+	for (i = 0; i < n_args; i++) {
+		buff = arena_alloc(&nlctx->arena, strlen(args[i]) + 1);
+		if (!buff)
+			return -ENOMEM;
+		strcpy(buff, args[i]);
+		for (pat = strtok(buff, ","); pat; pat = strtok(NULL, ",")) {
+			if (all && !strcmp(pat, WILDCARD_DEVNAME))
+				*all = true;
 			else
-				set_filter_cmd(nlctx, cmd);
-			opt_found = true;
+				(*patterns)[(*n_patterns)++] = pat;
 		}
 	}
+
+	return 0;
+}
+
+/* Device arguments: names, shell patterns or comma separated lists of them,
+ * devices matching an excluded one are not monitored. A single device name
+ * is handled by filter_devname (requests for one device on resync), anything
+ * else by the device set.
+ */
+static int parse_monitor_devs(struct nl_context *nlctx,
+			      struct monitor_state *state, char *const *devs,
+			      unsigned int n_devs, char *const *excludes,
+			      unsigned int n_excludes)
+{
+	struct monitor_devset *devset = &state->devset;
+	struct cmd_context *ctx = nlctx->ctx;
+	bool all = false;
+	int ret;
+
+	if (n_devs == 1 && !n_excludes && !strpbrk(devs[0], "*?[,")) {
+		ctx->devname = devs[0];
+		return 0;
+	}
+
+	ret = monitor_dev_patterns(nlctx, devs, n_devs, &devset->patterns,
+				   &devset->n_patterns, &all);
+	if (ret < 0)
+		return ret;
+	if (n_devs && !devset->n_patterns && !all)
+		goto err_nodev;
+	/* everything, no filtering needed */
+	if (all)
+		devset->n_patterns = 0;
+	ret = monitor_dev_patterns(nlctx, excludes, n_excludes,
+				   &devset->excludes, &devset->n_excludes,
+				   NULL);
+	if (ret < 0)
+		return ret;
+	if (n_excludes && !devset->n_excludes)
+		goto err_nodev;
+
+	return 0;
+
+err_nodev:
+	fprintf(stderr, "no device to monitor\n");
+	return -EINVAL;
+}
+
+/* add notification types monitored for a command option to a mask */
+static int parse_monitor_cmd(const char *opt, uint32_t *mask)
+{
+	bool opt_found = false;
+	unsigned int i;
+
+	for (i = 0; i < MNL_ARRAY_SIZE(monitor_opts); i++) {
+		if (!pattern_match(opt, monitor_opts[i].pattern))
+			continue;
+		if (monitor_opts[i].cmd)
+			cmdmask_set(mask, monitor_opts[i].cmd);
+		else
+			cmdmask_set_all(mask);
+		opt_found = true;
+	}
 	if (!opt_found) {
 		fprintf(stderr, "monitoring for option '%s' not supported\n",
-			*argp);
+			opt);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * parse_monitor_filter() - compile notification type and device filters
+ * @nlctx: netlink context
+ * @state: monitor state
+ * @argp:  remaining arguments
+ *
+ * Arguments are command options (notification types), device names and
+ * patterns, each of them may be preceded by "--exclude". Notification types
+ * of all command options (all types if there are none) except the excluded
+ * ones are compiled into the filter bitmask tested for each notification,
+ * devices into the device set.
+ *
+ * Return: 0 on success or negative error code
+ */
+static int parse_monitor_filter(struct nl_context *nlctx,
+				struct monitor_state *state, char **argp)
+{
+	uint32_t exclude_cmds[CMDMASK_WORDS] = {};
+	unsigned int n_devs = 0, n_excludes = 0;
+	unsigned int n_args = 0;
+	bool any_cmd = false;
+	char **excludes;
+	bool exclude;
+	bool empty;
+	char **devs;
+	unsigned int i;
+	int ret;
+
+	while (argp[n_args])
+		n_args++;
+	devs = arena_alloc(&nlctx->arena, (2 * n_args + 1) * sizeof(char *));
+	if (!devs)
+		return -ENOMEM;
+	excludes = devs + n_args;
+
+	memset(nlctx->filter_cmds, '\0', sizeof(nlctx->filter_cmds));
+	for (; *argp; argp++) {
+		exclude = !strcmp(*argp, "--exclude");
+		if (exclude && !*++argp) {
+			fprintf(stderr, "--exclude requires an argument\n");
+			return -EINVAL;
+		}
+		if (argp[0][0] != '-') {
+			if (exclude)
+				excludes[n_excludes++] = *argp;
+			else
+				devs[n_devs++] = *argp;
+			continue;
+		}
+		ret = parse_monitor_cmd(*argp, exclude ? exclude_cmds :
+							 nlctx->filter_cmds);
+		if (ret < 0)
+			return ret;
+		any_cmd |= !exclude;
+	}
+	if (!any_cmd)
+		cmdmask_set_all(nlctx->filter_cmds);
+	empty = true;
+	for (i = 0; i < CMDMASK_WORDS; i++) {
+		nlctx->filter_cmds[i] &= ~exclude_cmds[i];
+		if (nlctx->filter_cmds[i])
+			empty = false;
+	}
+	if (empty) {
+		fprintf(stderr, "no notification type to monitor\n");
+		return -EINVAL;
+	}
+
+	return parse_monitor_devs(nlctx, state, devs, n_devs, excludes,
+				  n_excludes);
+}
+
+/* seconds since the epoch or local time "[YYYY-MM-DD[T]]HH:MM[:SS]" */
+static int parse_monitor_time(const char *arg, uint64_t *ns)
+{
+	static const char *const formats[] = {
+		"%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M:%S",
+		"%Y-%m-%dT%H:%M", "%Y-%m-%d %H:%M",
+		"%H:%M:%S", "%H:%M",
+	};
+	unsigned long long secs;
+	unsigned int scale;
+	const char *p;
+	struct tm tm;
+	unsigned int i;
+	time_t now;
+	char *end;
+
+	secs = strtoull(arg, &end, 10);
+	if (end != arg && isdigit(*arg) && (!*end || *end == '.')) {
+		*ns = secs * 1000000000ULL;
+		if (!*end)
+			return 0;
+		scale = 100000000;
+		for (p = end + 1; isdigit(*p); p++) {
+			*ns += (*p - '0') * scale;
+			scale /= 10;
+		}
+		return *p || p == end + 1 ? -EINVAL : 0;
+	}
+
+	now = time(NULL);
+	for (i = 0; i < ARRAY_SIZE(formats); i++) {
+		/* time of day only: today */
+		localtime_r(&now, &tm);
+		tm.tm_sec = 0;
+		end = strptime(arg, formats[i], &tm);
+		if (!end || *end)
+			continue;
+		tm.tm_isdst = -1;
+		now = mktime(&tm);
+		if (now == (time_t)-1 || now < 0)
+			return -EINVAL;
+		*ns = (uint64_t)now * 1000000000ULL;
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+static int parse_monitor(struct cmd_context *ctx, struct monitor_state *state)
+{
+	struct nl_context *nlctx = ctx->nlctx;
+	char **argp = ctx->argp;
+	int argc = ctx->argc;
+	bool time_range = false;
+
+	state->rcvbuf = MONITOR_RCVBUF_DEFAULT;
+	state->until = UINT64_MAX;
+	while (*argp) {
+		unsigned long val;
+		char *end;
+
+		if (!strcmp(*argp, "--line-buffered")) {
+			state->line_flush = true;
+			argp++;
+			argc--;
+			continue;
+		}
+		if (!strcmp(*argp, "--state")) {
+			if (argc < 2 || !argp[1][0]) {
+				fprintf(stderr,
+					"--state requires a file name\n");
+				return -1;
+			}
+			state->state_file = argp[1];
+			argp += 2;
+			argc -= 2;
+			continue;
+		}
+		if (!strcmp(*argp, "--log")) {
+			if (argc < 2 || !argp[1][0]) {
+				fprintf(stderr, "--log requires a file name\n");
+				return -1;
+			}
+			state->log_file = argp[1];
+			argp += 2;
+			argc -= 2;
+			continue;
+		}
+		if (!strcmp(*argp, "--query")) {
+			state->query = true;
+			argp++;
+			argc--;
+			continue;
+		}
+		if (!strcmp(*argp, "--since") || !strcmp(*argp, "--until")) {
+			uint64_t *ns = argp[0][2] == 's' ? &state->since :
+							   &state->until;
+
+			if (argc < 2 || parse_monitor_time(argp[1], ns) < 0) {
+				fprintf(stderr, "invalid time for %s\n", *argp);
+				return -1;
+			}
+			time_range = true;
+			argp += 2;
+			argc -= 2;
+			continue;
+		}
+		if (!strcmp(*argp, "--link-watch") ||
+		    !strcmp(*argp, "--report")) {
+			unsigned int *interval = argp[0][2] == 'l' ?
+						 &state->watch : &state->report;
+
+			if (argc < 2 || !argp[1][0])
+				goto err_interval;
+			val = strtoul(argp[1], &end, 0);
+			if (*end || !val || val > MONITOR_MAX_INTERVAL)
+				goto err_interval;
+			*interval = val;
+			argp += 2;
+			argc -= 2;
+			continue;
+		}
+		if (!strcmp(*argp, "--window")) {
+			if (argc < 2 || !argp[1][0])
+				goto err_window;
+			val = strtoul(argp[1], &end, 0);
+			if (*end || val > INT_MAX)
+				goto err_window;
+			state->window = val;
+			argp += 2;
+			argc -= 2;
+			continue;
+		}
+		if (strcmp(*argp, "--rcvbuf"))
+			break;
+		if (argc < 2 || !argp[1][0])
+			goto err_rcvbuf;
+		val = strtoul(argp[1], &end, 0);
+		if (*end || !val || val > INT_MAX)
+			goto err_rcvbuf;
+		state->rcvbuf = val;
+		argp += 2;
+		argc -= 2;
+	}
+	if (time_range && !state->query) {
+		fprintf(stderr, "--since and --until require --query\n");
 		return -1;
 	}
+	return parse_monitor_filter(nlctx, state, argp);
+
+err_rcvbuf:
+	fprintf(stderr, "invalid receive buffer size\n");
+	return -1;
+err_window:
+	fprintf(stderr, "invalid coalescing window\n");
+	return -1;
+err_interval:
+	fprintf(stderr, "invalid interval for %s\n", *argp);
+	return -1;
+}
+
+static int monitor_resync_cb(const struct nlmsghdr *nlhdr, void *data)
+{
+	struct monitor_state *state = data;
+
+	if (!monitor_dev_wanted(state, nlhdr))
+		return MNL_CB_OK;
+	/* replies are logged as notifications for the query to show them */
+	if (state->devstate || state->evlog)
+		return monitor_record(state, nlhdr, state->resync_mcb->cmd,
+				      EVLOG_F_DUMP) < 0 ?
+		       MNL_CB_ERROR : MNL_CB_OK;
+	if (state->jw)
+		return monitor_json_cb(nlhdr, state);
+	return state->resync_mcb->cb(nlhdr, state->nlctx);
+}
+
+/* dump state of one notification type, replies are shown as notifications */
+static int monitor_resync_one(struct monitor_state *state,
+			      struct nl_socket *nlsk,
+			      const struct monitor_callback *mcb)
+{
+	int ret;
+
+	ret = nlsock_prep_get_request(nlsk, mcb->get_cmd, mcb->hdr_attr, 0);
+	if (ret < 0)
+		return ret;
+	ret = nlsock_sendmsg(nlsk, NULL);
+	if (ret < 0)
+		return ret;
+	state->resync_mcb = mcb;
+	if (state->devstate)
+		devstate_dump_start(state->devstate);
+	ret = nlsock_process_reply(nlsk, monitor_resync_cb, state);
+	if (ret == 0 && state->devstate)
+		devstate_dump_end(state->devstate, mcb->get_cmd);
+	return ret;
+}
+
+/* dump current state of all monitored notification types */
+static int monitor_dump_all(struct monitor_state *state)
+{
+	struct nl_context *nlctx = state->nlctx;
+	struct cmd_context *ctx = nlctx->ctx;
+	const char *saved_devname = ctx->devname;
+	const struct monitor_callback *mcb;
+	unsigned int i;
+	int ret;
+
+	ret = monitor_resync_sock(state);
+	if (ret < 0)
+		return ret;
+
+	/* dump all devices unless filtering by device */
+	ctx->devname = nlctx->filter_devname ?: WILDCARD_DEVNAME;
+	for (i = 0; i < MNL_ARRAY_SIZE(monitor_callbacks); i++) {
+		mcb = &monitor_callbacks[i];
+		if (!mcb->get_cmd || !test_filter_cmd(nlctx, i))
+			continue;
+		if (nlctx->ops_info &&
+		    !(nlctx->ops_info[mcb->get_cmd].op_flags &
+		      GENL_CMD_CAP_DUMP))
+			continue;
+		/* failure of one type should not prevent the others */
+		monitor_resync_one(state, state->resync_sock, mcb);
+	}
+	ctx->devname = saved_devname;
+	nlctx->is_dump = false;
+
+	return 0;
+}
+
+/**
+ * monitor_resync() - recover after lost notifications
+ * @nlctx: netlink context
+ * @state: monitor state
+ *
+ * The kernel reports ENOBUFS when notifications did not fit into the receive
+ * buffer. As there is no way to find out which were lost, current state of
+ * all monitored notification types is dumped (through a separate socket so
+ * that notifications keep queueing meanwhile) and shown like notifications
+ * after a "resync" line (record in JSON mode), so that consumers can rebuild
+ * their state. With --state, the dump simply refreshes the state model,
+ * with --link-watch, there is nothing to do as link state comes from
+ * rtnetlink (see monitor_carriers()).
+ *
+ * Return: 0 on success or negative error code
+ */
+static int monitor_resync(struct monitor_state *state)
+{
+	int ret;
+
+	/* coalesced notifications precede the loss */
+	if (state->bursts) {
+		ret = ntfburst_flush(state->bursts, true, monitor_burst_cb,
+				     state);
+		if (ret < 0)
+			return ret;
+	}
+	state->overruns++;
+	fprintf(stderr, "notifications lost (overrun %u), resynchronizing\n",
+		state->overruns);
+	if (state->jw) {
+		jsonw_start_object(state->jw);
+		monitor_json_time(state->jw, &state->nlctx->rx_time);
+		jsonw_string_field(state->jw, "msg", "resync");
+		jsonw_uint_field(state->jw, "overruns", state->overruns);
+		jsonw_end_object(state->jw);
+		jsonw_end_record(state->jw);
+	} else if (!state->devstate && !state->evlog) {
+		printf("\nresync (overrun %u)\n", state->overruns);
+	}
+
+	/* in watch mode, link state is not affected */
+	ret = state->watch ? 0 : monitor_dump_all(state);
+	fflush(stdout);
+	return ret;
+}
+
+/* Rewrite the device state snapshot if the model changed, but at most once
+ * per MONITOR_STATE_INTERVAL; a later change shortens @timeout so that it is
+ * written when the interval is over. The final state is written at exit.
+ */
+static int monitor_write_state(struct monitor_state *state, int *timeout)
+{
+	uint64_t now = linkhist_now();
+	uint64_t next;
+	int wait;
+	int ret;
+
+	if (!devstate_dirty(state->devstate))
+		return 0;
+	next = state->state_written + MONITOR_STATE_INTERVAL;
+	if (state->state_written && now < next) {
+		wait = (next - now + 999999) / 1000000;
+		if (*timeout < 0 || wait < *timeout)
+			*timeout = wait;
+		return 0;
+	}
+	ret = devstate_write(state->devstate, state->state_file);
+	if (ret < 0)
+		return ret;
+	state->state_written = now;
+	return 0;
+}
+
+/* rtnetlink socket receiving carrier changes of all devices */
+static int monitor_link_sock(struct monitor_state *state)
+{
+	struct nl_context *nlctx = state->nlctx;
+	struct nl_socket *nlsk;
+	int ret;
+
+	ret = netlink_init_rtnl_socket(nlctx);
+	if (ret < 0)
+		return ret;
+	nlsk = nlctx->rtnl_socket;
+	nlsock_set_rcvbuf(nlsk, state->rcvbuf);
+	if (state->jw)
+		nlsock_set_timestamps(nlsk);
+	ret = nlsock_add_membership(nlsk, RTNLGRP_LINK);
+	if (ret < 0)
+		return ret;
+	nlsk->port = 0;
+	nlsk->seq = 0;
+
+	return nlsock_set_nonblock(nlsk);
+}
+
+/* nothing more queued: flush output and wait for next notification */
+static int monitor_idle(struct monitor_state *state)
+{
+	struct nl_context *nlctx = state->nlctx;
+	struct nl_socket *socks[2] = {
+		nlctx->ethnl_socket, nlctx->rtnl_socket
+	};
+	unsigned int n_socks = state->carriers ? 2 : 1;
+	sigset_t mask, orig_mask;
+	int timeout = -1;
+	int ret;
+
+	if (state->bursts) {
+		ret = ntfburst_flush(state->bursts, false, monitor_burst_cb,
+				     state);
+		if (ret < 0)
+			return ret;
+		timeout = ntfburst_timeout(state->bursts);
+	}
+	if (state->watch)
+		timeout = monitor_timers(state);
+	fflush(stdout);
+	if (state->devstate) {
+		ret = monitor_write_state(state, &timeout);
+		if (ret < 0)
+			return ret;
+	}
+	if (state->evlog) {
+		ret = evlog_sync(state->evlog);
+		if (ret < 0) {
+			fprintf(stderr, "failed to write log %s: %s\n",
+				state->log_file, strerror(-ret));
+			return ret;
+		}
+	}
+
+	/* on timeout, -EAGAIN brings us back here to show expired bursts */
+	if (!state->watch) {
+		ret = nlsock_wait(socks, n_socks, timeout, NULL);
+		return ret < 0 ? ret : 0;
+	}
+
+	/* block SIGINT and SIGTERM so that none gets lost between the check
+	 * and the wait, ppoll() unblocks them atomically
+	 */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, &orig_mask);
+	if (monitor_stopped)
+		ret = -EINTR;
+	else
+		ret = nlsock_wait(socks, n_socks, timeout, &orig_mask);
+	sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+	if (ret == -EINTR && !monitor_stopped)
+		return 0;
+	return ret < 0 ? ret : 0;
+}
+
+static int monitor_query_cb(const struct nlmsghdr *nlhdr, uint64_t time,
+			    unsigned int flags, void *data)
+{
+	const struct genlmsghdr *ghdr = mnl_nlmsg_get_payload(nlhdr);
+	struct monitor_state *state = data;
+	char buff[32];
+	time_t secs;
+	struct tm tm;
+
+	if (!test_filter_cmd(state->nlctx, ghdr->cmd) ||
+	    !monitor_dev_wanted(state, nlhdr))
+		return 0;
+	state->log_time = time;
+	state->log_flags = flags;
+	if (!state->jw) {
+		secs = time / 1000000000ULL;
+		localtime_r(&secs, &tm);
+		strftime(buff, sizeof(buff), "%Y-%m-%d %H:%M:%S", &tm);
+		printf("\n%s.%06u%s\n", buff,
+		       (unsigned int)(time % 1000000000ULL / 1000),
+		       flags & EVLOG_F_DUMP ? " (state dump)" : "");
+	}
+
+	return monitor_show(state, nlhdr) < 0 ? -EINVAL : 0;
+}
+
+/**
+ * monitor_query() - show logged notifications
+ * @state: monitor state
+ *
+ * Show notifications from the log which match the time range, notification
+ * type and device filters like live ones. When looking for devices by name
+ * (no shell patterns), blocks without records for them are not even read.
+ *
+ * Return: 0 on success or negative error code
+ */
+static int monitor_query(struct monitor_state *state)
+{
+	const struct monitor_devset *devset = &state->devset;
+	struct nl_context *nlctx = state->nlctx;
+	const char *const *devs = NULL;
+	unsigned int n_devs = 0;
+	unsigned int i;
+	int ret;
+
+	if (nlctx->filter_devname) {
+		devs = &nlctx->filter_devname;
+		n_devs = 1;
+	} else if (devset->n_patterns) {
+		devs = devset->patterns;
+		n_devs = devset->n_patterns;
+		for (i = 0; i < n_devs; i++) {
+			if (strpbrk(devs[i], "*?[")) {
+				devs = NULL;
+				n_devs = 0;
+				break;
+			}
+		}
+	}
+
+	ret = evlog_query(state->log_file, state->since, state->until, devs,
+			  n_devs, monitor_query_cb, state);
+	if (ret < 0)
+		fprintf(stderr, "failed to query log %s: %s\n",
+			state->log_file, strerror(-ret));
+	return ret;
+}
+
+static void monitor_stop(int sig __maybe_unused)
+{
+	monitor_stopped = 1;
+}
+
+static int monitor_check_options(const struct monitor_state *state)
+{
+	if (state->query && !state->log_file) {
+		fprintf(stderr, "--query requires --log\n");
+		return -EINVAL;
+	}
+	if (state->window && (state->state_file || state->log_file)) {
+		fprintf(stderr,
+			"--window cannot be used with --state or --log\n");
+		return -EINVAL;
+	}
+	if (state->query && state->state_file) {
+		fprintf(stderr, "--query cannot be used with --state\n");
+		return -EINVAL;
+	}
+	if (state->report && !state->watch) {
+		fprintf(stderr, "--report requires --link-watch\n");
+		return -EINVAL;
+	}
+	if (state->watch &&
+	    (state->window || state->state_file || state->log_file)) {
+		fprintf(stderr,
+			"--link-watch cannot be used with --window, --state or --log\n");
+		return -EINVAL;
+	}
 
-	if (*argp && strcmp(*argp, WILDCARD_DEVNAME))
-		ctx->devname = *argp;
 	return 0;
 }
 
 int nl_monitor(struct cmd_context *ctx)
 {
+	struct sigaction sa = { .sa_handler = monitor_stop };
+	struct sigaction old_sigint, old_sigterm;
+	struct monitor_state state = {};
 	struct nl_context *nlctx;
 	struct nl_socket *nlsk;
 	uint32_t grpid;
 	bool is_dev;
+	bool raw;
 	int ret;
 
 	ret = netlink_init(ctx);
@@ -255,25 +1746,88 @@ int nl_monitor(struct cmd_context *ctx)
 		return ret;
 	}
 	nlctx = ctx->nlctx;
+	state.nlctx = nlctx;
 	nlsk = nlctx->ethnl_socket;
+
+	if (parse_monitor(ctx, &state) < 0 || monitor_check_options(&state) < 0)
+		return 1;
 	grpid = nlctx->ethnl_mongrp;
-	if (!grpid) {
+	if (!grpid && !state.query) {
 		fprintf(stderr, "multicast group 'monitor' not found\n");
 		return -EOPNOTSUPP;
 	}
-
-	if (parse_monitor(ctx) < 0)
-		return 1;
 	is_dev = ctx->devname && strcmp(ctx->devname, WILDCARD_DEVNAME);
+	if (state.state_file) {
+		state.devstate = devstate_new();
+		if (!state.devstate)
+			return -ENOMEM;
+	}
+	if (state.log_file && !state.query) {
+		state.evlog = evlog_open(state.log_file, &ret);
+		if (!state.evlog) {
+			fprintf(stderr, "failed to open log %s: %s\n",
+				state.log_file, strerror(-ret));
+			devstate_free(state.devstate);
+			return ret;
+		}
+	} else if (ctx->json && !state.devstate) {
+		fflush(stdout);
+		setvbuf(stdout, monitor_json_buff,
+			state.line_flush ? _IOLBF : _IOFBF,
+			sizeof(monitor_json_buff));
+		state.jw = jsonw_new(stdout);
+		if (!state.jw)
+			return -ENOMEM;
+	}
+	if (state.window) {
+		state.bursts = ntfburst_new(state.window);
+		if (!state.bursts) {
+			ret = -ENOMEM;
+			goto out_json;
+		}
+	}
+	state.carriers = state.watch ||
+			 (state.window &&
+			  (test_filter_cmd(nlctx, ETHTOOL_MSG_LINKINFO_NTF) ||
+			   test_filter_cmd(nlctx, ETHTOOL_MSG_LINKMODES_NTF)));
+	if (state.carriers) {
+		state.linkhist = linkhist_new();
+		if (!state.linkhist) {
+			ret = -ENOMEM;
+			goto out_json;
+		}
+	}
+	/* JSON records, state model and log keep raw attributes, no names
+	 * need to be resolved
+	 */
+	raw = state.jw || state.devstate || state.evlog;
 
-	ret = preload_global_strings(nlsk);
-	if (ret < 0)
-		return ret;
-	ret = mnl_socket_setsockopt(nlsk->sk, NETLINK_ADD_MEMBERSHIP,
-				    &grpid, sizeof(grpid));
+	if (!raw) {
+		ret = preload_global_strings(nlsk);
+		if (ret < 0)
+			goto out_json;
+	}
+	/* logged devices need not exist any more, no per device strings */
+	if (state.query) {
+		nlctx->filter_devname = ctx->devname;
+		nlctx->is_monitor = true;
+		ret = monitor_query(&state);
+		goto out_strings;
+	}
+	/* failure is not fatal, overruns are handled anyway */
+	nlsock_set_rcvbuf(nlsk, state.rcvbuf);
+	/* JSON records show receive time, processing time without it */
+	if (state.jw)
+		nlsock_set_timestamps(nlsk);
+	ret = nlsock_add_membership(nlsk, grpid);
 	if (ret < 0)
-		return ret;
-	if (is_dev) {
+		goto out_strings;
+	if (state.carriers) {
+		ret = monitor_link_sock(&state);
+		if (ret < 0)
+			goto out_strings;
+	}
+	if (is_dev && !raw) {
 		ret = preload_perdev_strings(nlsk, ctx->devname);
 		if (ret < 0)
 			goto out_strings;
@@ -284,12 +1838,74 @@ int nl_monitor(struct cmd_context *ctx)
 	nlsk->port = 0;
 	nlsk->seq = 0;
 
-	fputs("listening...\n", stdout);
-	fflush(stdout);
-	ret = nlsock_process_reply(nlsk, monitor_any_cb, nlctx);
+	ret = nlsock_set_nonblock(nlsk);
+	if (ret < 0)
+		goto out_strings;
+	if (state.devstate || state.evlog) {
+		/* notifications are already queued, nothing gets lost */
+		ret = monitor_dump_all(&state);
+		if (ret < 0)
+			goto out_strings;
+	} else if (!state.jw) {
+		fputs("listening...\n", stdout);
+		fflush(stdout);
+	}
+	if (state.watch) {
+		/* interrupted monitor still shows the link history */
+		monitor_stopped = 0;
+		sigaction(SIGINT, &sa, &old_sigint);
+		sigaction(SIGTERM, &sa, &old_sigterm);
+		state.next_poll = linkhist_now() +
+				  state.watch * 1000000000ULL;
+		state.next_report = linkhist_now() +
+				    state.report * 1000000000ULL;
+	}
+	/* failure is not fatal, carrier changes are recorded anyway */
+	if (state.carriers)
+		monitor_poll_links(&state, MONITOR_LINK_SEED);
+	for (;;) {
+		if (state.carriers) {
+			ret = monitor_carriers(&state);
+			if (ret < 0)
+				break;
+		}
+		ret = nlsock_process_reply(nlsk, monitor_any_cb, &state);
+		if (ret == -ENOBUFS)
+			ret = monitor_resync(&state);
+		else if (ret == -EAGAIN)
+			ret = monitor_idle(&state);
+		else
+			break;
+		if (ret < 0)
+			break;
+	}
+	if (state.bursts && ret >= 0)
+		ret = ntfburst_flush(state.bursts, true, monitor_burst_cb,
+				     &state);
+	if (state.watch) {
+		sigaction(SIGINT, &old_sigint, NULL);
+		sigaction(SIGTERM, &old_sigterm, NULL);
+		if (ret == -EINTR)
+			ret = 0;
+		monitor_report(&state);
+	}
+	if (state.devstate && devstate_dirty(state.devstate) &&
+	    devstate_write(state.devstate, state.state_file) < 0 && !ret)
+		ret = -EIO;
+	if (state.evlog && evlog_sync(state.evlog) < 0 && !ret)
+		ret = -EIO;
 
 out_strings:
+	nlsock_done(state.resync_sock);
 	cleanup_all_strings();
+	free(state.devset.devs);
+out_json:
+	devstate_free(state.devstate);
+	evlog_close(state.evlog);
+	ntfburst_free(state.bursts);
+	linkhist_free(state.linkhist);
+	if (state.jw)
+		jsonw_destroy(&state.jw);
 	return ret;
 }
 
@@ -300,6 +1916,13 @@ void nl_monitor_usage(void)
 
 	fputs("        ethtool --monitor               Show kernel notifications\n",
 	      stdout);
+	fputs("                [ --rcvbuf BYTES ] [ --line-buffered ]\n",
+	      stdout);
+	fputs("                [ --state FILE ] [ --window MS ]\n", stdout);
+	fputs("                [ --link-watch SECONDS [ --report SECONDS ] ]\n",
+	      stdout);
+	fputs("                [ --log FILE [ --query [ --since TIME ] [ --until TIME ] ] ]\n",
+	      stdout);
 	fputs("                ( [ --all ]", stdout);
 	for (i = 1; i < MNL_ARRAY_SIZE(monitor_opts); i++) {
 		if (!strcmp(monitor_opts[i].pattern, monitor_opts[i - 1].pattern))
@@ -311,6 +1934,8 @@ void nl_monitor_usage(void)
 			else
 				fputc(*p, stdout);
 	}
-	fputs(" )\n", stdout);
-	fputs("                [ DEVNAME | * ]\n", stdout);
+	fputs(" ) ...\n", stdout);
+	fputs("                [ DEVNAME | PATTERN[,...] ... | * ]\n", stdout);
+	fputs("                [ --exclude OPTION | DEVNAME | PATTERN[,...] ] ...\n",
+	      stdout);
 }
@@ -12,6 +12,7 @@
 #include "../internal.h"
 #include "netlink.h"
 #include "msgbuff.h"
+#include "arena.h"
 
 #define MAX_MSG_SIZE (4 << 20)		/* 4 MB */
 
@@ -42,7 +43,11 @@ int msgbuff_realloc(struct nl_msg_buff *msgbuff, unsigned int new_size)
 		return 0;
 	if (new_size > MAX_MSG_SIZE)
 		return -EMSGSIZE;
-	nbuff = realloc(msgbuff->buff, new_size);
+	if (msgbuff->arena)
+		nbuff = arena_realloc(msgbuff->arena, msgbuff->buff, old_size,
+				      new_size);
+	else
+		nbuff = realloc(msgbuff->buff, new_size);
 	if (!nbuff) {
 		msgbuff->buff = NULL;
 		msgbuff->size = 0;
@@ -231,25 +236,29 @@ int msg_init(struct nl_context *nlctx, struct nl_msg_buff *msgbuff, int cmd,
 /**
  * msgbuff_init() - initialize a message buffer
  * @msgbuff: message buffer
+ * @arena:   arena to allocate the buffer from (null to use malloc())
  *
  * Initialize a message buffer structure before first use. Buffer length is
  * set to zero and the buffer is not allocated until the first call to
  * msgbuff_reallocate().
  */
-void msgbuff_init(struct nl_msg_buff *msgbuff)
+void msgbuff_init(struct nl_msg_buff *msgbuff, struct nl_arena *arena)
 {
 	memset(msgbuff, '\0', sizeof(*msgbuff));
+	msgbuff->arena = arena;
 }
 
 /**
  * msg_done() - destroy a message buffer
  * @msgbuff: message buffer
  *
- * Free the buffer and reset size and remaining size.
+ * Free the buffer and reset size and remaining size. Buffers allocated from
+ * an arena are only released with the arena.
  */
 void msgbuff_done(struct nl_msg_buff *msgbuff)
 {
-	free(msgbuff->buff);
+	if (!msgbuff->arena)
+		free(msgbuff->buff);
 	msgbuff->buff = NULL;
 	msgbuff->size = 0;
 	msgbuff->left = 0;
@@ -13,6 +13,7 @@
 #include <linux/genetlink.h>
 
 struct nl_context;
+struct nl_arena;
 
 /**
  * struct nl_msg_buff - message buffer abstraction
@@ -22,6 +23,7 @@ struct nl_context;
  * @nlhdr:   pointer to netlink header of current message
  * @genlhdr: pointer to genetlink header of current message
  * @payload: pointer to message payload (after genetlink header)
+ * @arena:   arena to allocate the buffer from (null to use malloc())
  */
 struct nl_msg_buff {
 	char			*buff;
@@ -30,9 +32,10 @@ struct nl_msg_buff {
 	struct nlmsghdr		*nlhdr;
 	struct genlmsghdr	*genlhdr;
 	void			*payload;
+	struct nl_arena		*arena;
 };
 
-void msgbuff_init(struct nl_msg_buff *msgbuff);
+void msgbuff_init(struct nl_msg_buff *msgbuff, struct nl_arena *arena);
 void msgbuff_done(struct nl_msg_buff *msgbuff);
 int msgbuff_realloc(struct nl_msg_buff *msgbuff, unsigned int new_size);
 int msgbuff_append(struct nl_msg_buff *dest, struct nl_msg_buff *src);
@@ -274,10 +274,23 @@ static int read_flags_policy(struct nl_context *nlctx, struct nl_socket *nlsk,
 	return 0;
 }
 
+/**
+ * get_stats_flag() - request header flag for statistics
+ * @nlctx:   netlink context
+ * @nlcmd:   netlink command id
+ * @hdrattr: request header attribute type
+ *
+ * Statistics are requested with -I or, if --fields is used, only if they are
+ * selected. Checking kernel support costs a policy request so that it is
+ * only done if statistics are wanted.
+ *
+ * Return: ETHTOOL_FLAG_STATS or 0
+ */
 u32 get_stats_flag(struct nl_context *nlctx, unsigned int nlcmd,
 		   unsigned int hdrattr)
 {
-	if (!nlctx->ctx->show_stats)
+	if (nlctx->n_fields ? !field_wanted(nlctx, "statistics") :
+			      !nlctx->ctx->show_stats)
 		return 0;
 	if (nlcmd > ETHTOOL_MSG_USER_MAX ||
 	    !(nlctx->ops_info[nlcmd].op_flags & GENL_CMD_CAP_HASPOL))
@@ -289,6 +302,131 @@ u32 get_stats_flag(struct nl_context *nlctx, unsigned int nlcmd,
 	return nlctx->ops_info[nlcmd].hdr_flags & ETHTOOL_FLAG_STATS;
 }
 
+/**
+ * preload_cmd_strings() - declare string sets used by a subcommand
+ * @nlctx:       netlink context
+ * @global_sets: global string sets (mask of STRSET_BIT(ETH_SS_*))
+ * @perdev_sets: per device string sets (mask of STRSET_BIT(ETH_SS_*))
+ *
+ * Fetch the string sets a subcommand is going to need before its main request
+ * is composed so that reply callbacks find them in the cache. Failure is not
+ * fatal (e.g. an older kernel may not know some of the sets); sets missing
+ * from the cache are still requested on demand.
+ *
+ * Return: 0 if all sets are available, negative error code otherwise
+ */
+int preload_cmd_strings(struct nl_context *nlctx, uint32_t global_sets,
+			uint32_t perdev_sets)
+{
+	const char *devname = nlctx->ctx->devname;
+	const char *saved_devname = nlctx->devname;
+	unsigned int saved_suppress = nlctx->suppress_nlerr;
+	int ret;
+
+	if (devname && !strcmp(devname, WILDCARD_DEVNAME))
+		devname = NULL;
+
+	nlctx->suppress_nlerr = 2;
+	ret = preload_stringsets(nlctx->ethnl_socket, devname, global_sets,
+				 perdev_sets);
+	nlctx->suppress_nlerr = saved_suppress;
+	nlctx->devname = saved_devname;
+
+	return ret;
+}
+
+/**
+ * get_bitset_flags() - request header flags for bitsets with known names
+ * @nlctx:       netlink context
+ * @global_sets: global string sets naming the bits (mask of STRSET_BIT())
+ * @perdev_sets: per device string sets naming the bits
+ *
+ * Preload the string sets naming the bits of bitsets in the reply and ask for
+ * compact bitsets if they are available; verbose bitsets carry a name string
+ * for each bit which is wasted if the names are already known. If the string
+ * sets cannot be loaded, verbose bitsets are requested so that the names are
+ * taken from the reply.
+ *
+ * Return: ETHTOOL_FLAG_COMPACT_BITSETS or 0
+ */
+u32 get_bitset_flags(struct nl_context *nlctx, uint32_t global_sets,
+		     uint32_t perdev_sets)
+{
+	if (preload_cmd_strings(nlctx, global_sets, perdev_sets) < 0)
+		return 0;
+	return ETHTOOL_FLAG_COMPACT_BITSETS;
+}
+
+/* field selection */
+
+/* @sel selects @path itself, one of its ancestors or one of its descendants */
+static bool field_match(const char *sel, const char *path)
+{
+	size_t sel_len = strlen(sel);
+	size_t path_len = strlen(path);
+
+	if (sel_len <= path_len)
+		return !strncmp(sel, path, sel_len) &&
+		       (!path[sel_len] || path[sel_len] == '.');
+	return !strncmp(sel, path, path_len) && sel[path_len] == '.';
+}
+
+/**
+ * field_wanted() - check if an output field should be shown
+ * @nlctx: netlink context
+ * @path:  JSON path of the field, keys separated by dots
+ *
+ * Without --fields, all fields are wanted. Otherwise a field is wanted if it
+ * is selected, if its parent object is (e.g. "statistics" selects all
+ * statistics) or if one of its members is; the latter is needed for objects
+ * like "statistics" to be requested and opened at all. Reply callbacks skip
+ * decoding (and any additional requests) for fields which are not wanted.
+ *
+ * Return: true if the field should be shown
+ */
+bool field_wanted(const struct nl_context *nlctx, const char *path)
+{
+	unsigned int i;
+
+	if (!nlctx->n_fields)
+		return true;
+	for (i = 0; i < nlctx->n_fields; i++)
+		if (field_match(nlctx->fields[i], path))
+			return true;
+
+	return false;
+}
+
+/* split comma separated list of --fields selectors */
+static int fields_init(struct nl_context *nlctx)
+{
+	const char *list = nlctx->ctx->fields;
+	unsigned int n = 1;
+	const char *p;
+	char *buff;
+	char *sel;
+
+	if (!list)
+		return 0;
+	for (p = list; *p; p++)
+		if (*p == ',')
+			n++;
+	nlctx->fields = arena_alloc(&nlctx->arena, n * sizeof(char *));
+	buff = arena_alloc(&nlctx->arena, strlen(list) + 1);
+	if (!nlctx->fields || !buff)
+		return -ENOMEM;
+	strcpy(buff, list);
+
+	for (sel = strtok(buff, ","); sel; sel = strtok(NULL, ","))
+		nlctx->fields[nlctx->n_fields++] = sel;
+	if (!nlctx->n_fields) {
+		fprintf(stderr, "ethtool: no fields selected\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 /* initialization */
 
 static int genl_read_ops(struct nl_context *nlctx,
@@ -377,7 +515,7 @@ static int __maybe_unused family_info_cb(const struct nlmsghdr *nlhdr,
 	return MNL_CB_OK;
 }
 
-#ifdef TEST_ETHTOOL
+#if defined(TEST_ETHTOOL) && !defined(TEST_NL_BACKEND)
 static int get_genl_family(struct nl_context *nlctx __maybe_unused,
 			   struct nl_socket *nlsk __maybe_unused)
 {
@@ -417,6 +555,18 @@ int netlink_init(struct cmd_context *ctx)
 	if (!nlctx)
 		return -ENOMEM;
 	nlctx->ctx = ctx;
+#ifdef TEST_NL_BACKEND
+	nlctx->backend = &nlfake_backend;
+#endif
+	ret = trace_init(nlctx);
+	if (ret < 0)
+		goto out_free;
+	ret = replay_init(nlctx);
+	if (ret < 0)
+		goto out_free;
+	ret = fields_init(nlctx);
+	if (ret < 0)
+		goto out_free;
 	ret = nlsock_init(nlctx, &nlctx->ethnl_socket, NETLINK_GENERIC);
 	if (ret < 0)
 		goto out_free;
@@ -430,25 +580,32 @@ int netlink_init(struct cmd_context *ctx)
 out_nlsk:
 	nlsock_done(nlctx->ethnl_socket);
 out_free:
+	replay_done(nlctx);
+	trace_done(nlctx);
 	free(nlctx->ops_info);
+	arena_release(&nlctx->arena);
 	free(nlctx);
 	return ret;
 }
 
-static void netlink_done(struct cmd_context *ctx)
+void netlink_done(struct cmd_context *ctx)
 {
 	struct nl_context *nlctx = ctx->nlctx;
 
 	if (!nlctx)
 		return;
 
+	trace_done(nlctx);
 	nlsock_done(nlctx->ethnl_socket);
 	nlsock_done(nlctx->ethnl2_socket);
 	nlsock_done(nlctx->rtnl_socket);
+	replay_done(nlctx);
+	/* string sets live in the arena */
+	cleanup_all_strings();
 	free(nlctx->ops_info);
+	arena_release(&nlctx->arena);
 	free(nlctx);
 	ctx->nlctx = NULL;
-	cleanup_all_strings();
 }
 
 /**
@@ -485,6 +642,9 @@ void netlink_run_handler(struct cmd_context *ctx, nl_chk_t nlchk,
 		goto no_support;
 	}
 	if (netlink_init(ctx)) {
+		/* do not silently query running kernel instead */
+		if (ctx->replay_file)
+			exit(1);
 		reason = "netlink interface initialization failed";
 		goto no_support;
 	}
@@ -7,11 +7,13 @@
 #ifndef ETHTOOL_NETLINK_INT_H__
 #define ETHTOOL_NETLINK_INT_H__
 
+#include <time.h>
 #include <libmnl/libmnl.h>
 #include <linux/netlink.h>
 #include <linux/genetlink.h>
 #include <linux/ethtool_netlink.h>
 #include "nlsock.h"
+#include "arena.h"
 
 #define WILDCARD_DEVNAME "*"
 #define CMDMASK_WORDS DIV_ROUND_UP(__ETHTOOL_MSG_KERNEL_CNT, 32)
@@ -54,6 +56,16 @@ struct nl_context {
 	unsigned int		argc;
 	bool			ioctl_fallback;
 	bool			wildcard_unsupported;
+	struct nl_arena		arena;
+	const char		**fields;
+	unsigned int		n_fields;
+	struct eeprom_cache	*eeprom_cache;
+	struct nl_trace		*trace;
+	struct nl_record	*record;
+	struct nl_replay	*replay;
+	const struct nlsock_backend *backend;
+	unsigned int		n_sockets;
+	struct timespec		rx_time;
 };
 
 struct attr_tb_info {
@@ -68,12 +80,18 @@ int nomsg_reply_cb(const struct nlmsghdr *nlhdr, void *data);
 int attr_cb(const struct nlattr *attr, void *data);
 
 int netlink_init(struct cmd_context *ctx);
+void netlink_done(struct cmd_context *ctx);
 bool netlink_cmd_check(struct cmd_context *ctx, unsigned int cmd,
 		       bool allow_wildcard);
 const char *get_dev_name(const struct nlattr *nest);
 int get_dev_info(const struct nlattr *nest, int *ifindex, char *ifname);
 u32 get_stats_flag(struct nl_context *nlctx, unsigned int nlcmd,
 		   unsigned int hdrattr);
+int preload_cmd_strings(struct nl_context *nlctx, uint32_t global_sets,
+			uint32_t perdev_sets);
+u32 get_bitset_flags(struct nl_context *nlctx, uint32_t global_sets,
+		     uint32_t perdev_sets);
+bool field_wanted(const struct nl_context *nlctx, const char *path);
 
 int linkmodes_reply_cb(const struct nlmsghdr *nlhdr, void *data);
 int linkinfo_reply_cb(const struct nlmsghdr *nlhdr, void *data);
@@ -91,10 +109,36 @@ int cable_test_ntf_cb(const struct nlmsghdr *nlhdr, void *data);
 int cable_test_tdr_reply_cb(const struct nlmsghdr *nlhdr, void *data);
 int cable_test_tdr_ntf_cb(const struct nlmsghdr *nlhdr, void *data);
 int fec_reply_cb(const struct nlmsghdr *nlhdr, void *data);
+int stats_reply_cb(const struct nlmsghdr *nlhdr, void *data);
+
+const char *link_ext_state_name(uint8_t link_ext_state_val);
+const char *link_ext_substate_name(uint8_t link_ext_state_val,
+				   uint8_t link_ext_substate_val);
+
+/**
+ * struct monitor_callback - handling of a notification type
+ * @cmd:      notification message type (ETHTOOL_MSG_*_NTF)
+ * @cb:       callback showing the notification
+ * @get_cmd:  get request providing the same information (0 if none)
+ * @hdr_attr: request header attribute of @get_cmd
+ *
+ * After notifications were lost, current state is dumped with @get_cmd and
+ * the replies shown as if they were notifications.
+ */
+struct monitor_callback {
+	uint8_t		cmd;
+	mnl_cb_t	cb;
+	uint8_t		get_cmd;
+	uint16_t	hdr_attr;
+};
+
+const struct monitor_callback *monitor_callback_get(unsigned int cmd);
 
 /* dump helpers */
 
-int dump_link_modes(struct nl_context *nlctx, const struct nlattr *bitset,
+struct nl_bitset;
+
+int dump_link_modes(struct nl_context *nlctx, const struct nl_bitset *modes,
 		    bool mask, unsigned int class, const char *before,
 		    const char *between, const char *after,
 		    const char *if_none);
@@ -4,15 +4,20 @@
  * Data structure and code for netlink socket abstraction.
  */
 
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
 
 #include "../internal.h"
 #include "nlsock.h"
 #include "netlink.h"
 #include "prettymsg.h"
 
-#define NLSOCK_RECV_BUFFSIZE 65536
+/* longest datagram we are willing to receive (size of a receive slot) */
+#define NLSOCK_RECV_MAXSIZE	(1 << 20)
 
 static void ctrl_msg_summary(const struct nlmsghdr *nlhdr)
 {
@@ -220,6 +225,98 @@ tlv_done:
 	return nlerr->error;
 }
 
+/* Receive slots are large blocks of the arena of netlink context, i.e.
+ * malloc()ed chunks of their own which are never cleared so that only the
+ * pages actually written by the kernel become resident; a slot fits the
+ * longest datagram accepted so that nothing has to be peeked at first.
+ * A slot kept by nlsock_keep_reply() is replaced by a new one.
+ */
+static int nlsock_rx_slots_get(struct nl_socket *nlsk, unsigned int n_slots)
+{
+	unsigned int i;
+
+	for (i = 0; i < n_slots; i++) {
+		if (nlsk->rx_slots[i])
+			continue;
+		nlsk->rx_slots[i] = arena_alloc(&nlsk->nlctx->arena,
+						NLSOCK_RECV_MAXSIZE);
+		if (!nlsk->rx_slots[i])
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+/* receive timestamp of a datagram (zero if the socket does not report it) */
+static void nlsock_msg_time(struct msghdr *msg, struct timespec *time)
+{
+	struct cmsghdr *cmsg;
+
+	memset(time, '\0', sizeof(*time));
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_TIMESTAMPNS &&
+		    cmsg->cmsg_len >= CMSG_LEN(sizeof(*time)))
+			memcpy(time, CMSG_DATA(cmsg), sizeof(*time));
+}
+
+/* Receive up to @n datagrams into first slots of @nlsk->rx_slots. Only
+ * the first one is waited for. Return number of datagrams received, 0 if
+ * a backend has no more replies or negative error code.
+ */
+static int nlsock_recv_batch(struct nl_socket *nlsk, unsigned int n,
+			     unsigned int *lens, struct timespec *times)
+{
+	char cbufs[NLSOCK_RECV_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+	struct sockaddr_nl addrs[NLSOCK_RECV_BATCH];
+	struct mmsghdr msgs[NLSOCK_RECV_BATCH];
+	struct iovec iovs[NLSOCK_RECV_BATCH];
+	unsigned int i;
+	ssize_t len;
+	int ret;
+
+	if (!nlsk->sk) {
+		len = nlsk->nlctx->backend->peek_len(nlsk);
+		if (len <= 0)
+			return len;
+		if (len > NLSOCK_RECV_MAXSIZE)
+			return -EMSGSIZE;
+		len = nlsk->nlctx->backend->recv(nlsk, nlsk->rx_slots[0],
+						 NLSOCK_RECV_MAXSIZE);
+		if (len <= 0)
+			return len ? len : -EFAULT;
+		lens[0] = len;
+		memset(&times[0], '\0', sizeof(times[0]));
+		return 1;
+	}
+
+	memset(msgs, '\0', n * sizeof(msgs[0]));
+	for (i = 0; i < n; i++) {
+		iovs[i].iov_base = nlsk->rx_slots[i];
+		iovs[i].iov_len = NLSOCK_RECV_MAXSIZE;
+		msgs[i].msg_hdr.msg_name = &addrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = cbufs[i];
+		msgs[i].msg_hdr.msg_controllen = sizeof(cbufs[i]);
+	}
+	ret = recvmmsg(mnl_socket_get_fd(nlsk->sk), msgs, n, MSG_WAITFORONE,
+		       NULL);
+	if (ret < 0)
+		return -errno;
+
+	for (i = 0; i < (unsigned int)ret; i++) {
+		if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+			return -EMSGSIZE;
+		if (msgs[i].msg_hdr.msg_namelen != sizeof(addrs[i]))
+			return -EINVAL;
+		lens[i] = msgs[i].msg_len;
+		nlsock_msg_time(&msgs[i].msg_hdr, &times[i]);
+	}
+
+	return ret;
+}
+
 /**
  * nlsock_process_reply() - process reply packet(s) from kernel
  * @nlsk:     netlink socket to read from
@@ -228,52 +325,184 @@ tlv_done:
  *
  * Read packets from kernel and pass reply messages to @reply_cb callback
  * until an error is encountered or NLMSG_ERR message is received. In the
- * latter case, return value is the error code extracted from it.
+ * latter case, return value is the error code extracted from it. The receive
+ * slot is reused for next packets unless @reply_cb takes it over with
+ * nlsock_keep_reply() to keep pointers into a message.
+ *
+ * Each packet is received with one system call into a slot long enough for
+ * any packet we accept. Replies to dump requests and notifications are
+ * received in batches of up to NLSOCK_RECV_BATCH packets per system call (the
+ * kernel generates next part of a dump on each read so that it is usually
+ * available immediately).
+ *
+ * While @reply_cb runs, @nlsk->nlctx->rx_time is the time the packet was
+ * received if the socket reports it (see nlsock_set_timestamps()), zero
+ * otherwise.
+ *
+ * If @n_reqs requests were sent back to back (see nlsock_process_replies()),
+ * replies to all of them are processed until the last ack; each message must
+ * carry the sequence number of one of them. As their replies are usually
+ * queued already, they are received in batches too. If @reply_cb fails or a
+ * message carries a foreign sequence number, the remaining messages are only
+ * received and dropped until the last ack so that none is left on the socket.
  *
  * Return: 0 on success or negative error code
  */
-int nlsock_process_reply(struct nl_socket *nlsk, mnl_cb_t reply_cb, void *data)
+static int __nlsock_process_reply(struct nl_socket *nlsk, unsigned int n_reqs,
+				  mnl_cb_t reply_cb, void *data)
 {
+	bool batch = nlsk->is_dump || nlsk->nlctx->is_monitor || n_reqs > 1;
+	struct nl_context *nlctx = nlsk->nlctx;
+	unsigned int first_seq = nlsk->seq - n_reqs + 1;
+	unsigned int n_slots = batch && nlsk->sk ? NLSOCK_RECV_BATCH : 1;
 	struct nl_msg_buff *msgbuff = &nlsk->msgbuff;
+	struct timespec times[NLSOCK_RECV_BATCH];
+	unsigned int lens[NLSOCK_RECV_BATCH];
+	unsigned int n_acks = 0;
 	struct nlmsghdr *nlhdr;
-	ssize_t len;
-	char *buff;
+	bool drain = false;
+	unsigned int n, i;
+	int err = 0;
 	int ret;
 
-	ret = msgbuff_realloc(msgbuff, NLSOCK_RECV_BUFFSIZE);
-	if (ret < 0)
-		return ret;
-	buff = msgbuff->buff;
-
-	do {
-		len = mnl_socket_recvfrom(nlsk->sk, buff, msgbuff->size);
-		if (len <= 0)
-			return (len ? -EFAULT : 0);
-		debug_msg(nlsk, buff, len, false);
-		if (len < NLMSG_HDRLEN)
-			return -EFAULT;
-
-		nlhdr = (struct nlmsghdr *)buff;
-		if (nlhdr->nlmsg_type == NLMSG_ERROR) {
-			unsigned int suppress = nlsk->nlctx->suppress_nlerr;
-			bool pretty;
-
-			pretty = debug_on(nlsk->nlctx->ctx->debug,
-					  DEBUG_NL_PRETTY_MSG);
-			return nlsock_process_ack(nlhdr, len, suppress, pretty);
+	for (;;) {
+		ret = nlsock_rx_slots_get(nlsk, n_slots);
+		if (ret < 0)
+			return err ?: ret;
+		/* errors like ENOBUFS (lost notifications) are passed on */
+		ret = nlsock_recv_batch(nlsk, n_slots, lens, times);
+		if (ret <= 0)
+			return err ?: ret;
+		n = ret;
+
+		for (i = 0; i < n; i++) {
+			char *dgram = nlsk->rx_slots[i];
+			unsigned int len = lens[i];
+
+			debug_msg(nlsk, dgram, len, false);
+			if (nlsk->nlctx->trace)
+				trace_reply(nlsk, dgram, len);
+			if (nlsk->nlctx->record)
+				record_datagram(nlsk, dgram, len, false);
+			if (len < NLMSG_HDRLEN)
+				return -EFAULT;
+
+			nlhdr = (struct nlmsghdr *)dgram;
+			if (n_reqs > 1 &&
+			    nlhdr->nlmsg_seq - first_seq >= n_reqs) {
+				if (!err)
+					err = -ESRCH;
+				drain = true;
+				continue;
+			}
+			if (nlhdr->nlmsg_type == NLMSG_ERROR) {
+				unsigned int suppress =
+					nlsk->nlctx->suppress_nlerr;
+				bool pretty;
+
+				pretty = debug_on(nlsk->nlctx->ctx->debug,
+						  DEBUG_NL_PRETTY_MSG);
+				ret = nlsock_process_ack(nlhdr, len, suppress,
+							 pretty);
+				if (!err)
+					err = ret;
+				if (++n_acks == n_reqs)
+					return err;
+				continue;
+			}
+			if (drain)
+				continue;
+
+			msgbuff->nlhdr = nlhdr;
+			msgbuff->genlhdr = mnl_nlmsg_get_payload(nlhdr);
+			msgbuff->payload =
+				mnl_nlmsg_get_payload_offset(nlhdr,
+							     GENL_HDRLEN);
+			nlctx->rx_time = times[i];
+			nlsk->rx_cur = i;
+			ret = mnl_cb_run(dgram, len,
+					 n_reqs > 1 ? 0 : nlsk->seq,
+					 nlsk->port, reply_cb, data);
+			memset(&nlctx->rx_time, '\0', sizeof(nlctx->rx_time));
+			if (ret > 0)
+				continue;
+			if (n_reqs == 1)
+				return ret;
+			/* the other replies must not be left on the socket */
+			if (ret < 0 && !err)
+				err = ret;
+			drain = true;
 		}
+	}
+}
 
-		msgbuff->nlhdr = nlhdr;
-		msgbuff->genlhdr = mnl_nlmsg_get_payload(nlhdr);
-		msgbuff->payload =
-			mnl_nlmsg_get_payload_offset(nlhdr, GENL_HDRLEN);
-		ret = mnl_cb_run(buff, len, nlsk->seq, nlsk->port, reply_cb,
-				 data);
-	} while (ret > 0);
+int nlsock_process_reply(struct nl_socket *nlsk, mnl_cb_t reply_cb, void *data)
+{
+	int ret;
+
+	ret = __nlsock_process_reply(nlsk, 1, reply_cb, data);
+	if (nlsk->nlctx->trace)
+		trace_complete(nlsk, ret);
 
 	return ret;
 }
 
+/**
+ * nlsock_keep_reply() - take over the receive slot of current reply
+ * @nlsk: netlink socket
+ *
+ * Called from a reply callback which wants to keep pointers into the message
+ * it is processing instead of copying the data. The slot is not reused for
+ * next packets, a new one is allocated instead; as slots are allocated from
+ * the arena of netlink context, the message stays valid until netlink_done().
+ */
+void nlsock_keep_reply(struct nl_socket *nlsk)
+{
+	nlsk->rx_slots[nlsk->rx_cur] = NULL;
+}
+
+/**
+ * nlsock_can_pipeline() - check if requests can be sent back to back
+ * @nlsk: netlink socket
+ *
+ * Several requests can be in flight on a kernel socket or with a backend
+ * queueing them. Tracing and session recording expect one request at a time.
+ *
+ * Return: true if nlsock_process_replies() can be used
+ */
+bool nlsock_can_pipeline(const struct nl_socket *nlsk)
+{
+	const struct nl_context *nlctx = nlsk->nlctx;
+
+	if (nlctx->trace || nlctx->record)
+		return false;
+	return nlsk->sk || nlctx->backend->pipeline;
+}
+
+/**
+ * nlsock_process_replies() - process replies to pipelined requests
+ * @nlsk:     netlink socket to read from
+ * @n_reqs:   number of requests sent without processing their replies
+ * @reply_cb: callback to process each message
+ * @data:     pointer passed as argument to @reply_cb callback
+ *
+ * The requests (not dumps) were sent by nlsock_sendmsg() one after another
+ * so that their sequence numbers are consecutive, ending with @nlsk->seq.
+ * Reply messages are passed to @reply_cb, which tells the requests apart by
+ * nlmsg_seq, until all requests are acked. This holds even if one of the
+ * requests or @reply_cb fails, the socket is then ready for next requests.
+ *
+ * Return: 0 on success, error code of the first failed request or other
+ * negative error code
+ */
+int nlsock_process_replies(struct nl_socket *nlsk, unsigned int n_reqs,
+			   mnl_cb_t reply_cb, void *data)
+{
+	if (!n_reqs)
+		return 0;
+	return __nlsock_process_reply(nlsk, n_reqs, reply_cb, data);
+}
+
 int nlsock_prep_get_request(struct nl_socket *nlsk, unsigned int nlcmd,
 			    uint16_t hdr_attrtype, u32 flags)
 {
@@ -297,7 +526,7 @@ int nlsock_prep_get_request(struct nl_socket *nlsk, unsigned int nlcmd,
 	return 0;
 }
 
-#ifndef TEST_ETHTOOL
+#if !defined(TEST_ETHTOOL) || defined(TEST_NL_BACKEND)
 /**
  * nlsock_sendmsg() - send a netlink message to kernel
  * @nlsk:    netlink socket
@@ -311,7 +540,14 @@ ssize_t nlsock_sendmsg(struct nl_socket *nlsk, struct nl_msg_buff *altbuff)
 	struct nlmsghdr *nlhdr = msgbuff->nlhdr;
 
 	nlhdr->nlmsg_seq = ++nlsk->seq;
+	nlsk->is_dump = nlhdr->nlmsg_flags & NLM_F_DUMP;
 	debug_msg(nlsk, msgbuff->buff, nlhdr->nlmsg_len, true);
+	if (nlsk->nlctx->trace)
+		trace_request(nlsk, nlhdr);
+	if (nlsk->nlctx->record)
+		record_datagram(nlsk, nlhdr, nlhdr->nlmsg_len, true);
+	if (!nlsk->sk)
+		return nlsk->nlctx->backend->send(nlsk, nlhdr);
 	return mnl_socket_sendto(nlsk->sk, nlhdr, nlhdr->nlmsg_len);
 }
 #endif
@@ -339,6 +575,138 @@ err:
 	return nlsk->nlctx->exit_code ?: 1;
 }
 
+/**
+ * nlsock_add_membership() - subscribe to a multicast group
+ * @nlsk:  netlink socket
+ * @grpid: multicast group id
+ *
+ * Return: 0 on success or negative error code
+ */
+int nlsock_add_membership(struct nl_socket *nlsk, uint32_t grpid)
+{
+	/* backend delivers notifications (if any) unconditionally */
+	if (!nlsk->sk)
+		return 0;
+	if (mnl_socket_setsockopt(nlsk->sk, NETLINK_ADD_MEMBERSHIP, &grpid,
+				  sizeof(grpid)) < 0)
+		return -errno;
+	return 0;
+}
+
+/**
+ * nlsock_set_rcvbuf() - set receive buffer size of a socket
+ * @nlsk: netlink socket
+ * @size: requested size (bytes)
+ *
+ * Try SO_RCVBUFFORCE first so that privileged users are not limited by
+ * net.core.rmem_max, then SO_RCVBUF (capped by the kernel).
+ *
+ * Return: actual buffer size or negative error code
+ */
+int nlsock_set_rcvbuf(struct nl_socket *nlsk, int size)
+{
+	socklen_t len = sizeof(size);
+	int fd;
+
+	/* backend has no queue to overflow */
+	if (!nlsk->sk)
+		return size;
+	fd = mnl_socket_get_fd(nlsk->sk);
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) &&
+	    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)))
+		return -errno;
+	if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &len))
+		return -errno;
+	return size;
+}
+
+/**
+ * nlsock_set_timestamps() - report receive time of packets
+ * @nlsk: netlink socket
+ *
+ * Ask the kernel for the time each packet was queued to the socket
+ * (SO_TIMESTAMPNS) so that reply callbacks find it in nlctx->rx_time. There
+ * is nothing to do for a backend, its packets have no receive time.
+ *
+ * Return: 0 on success or negative error code
+ */
+int nlsock_set_timestamps(struct nl_socket *nlsk)
+{
+	int val = 1;
+
+	if (!nlsk->sk)
+		return 0;
+	if (setsockopt(mnl_socket_get_fd(nlsk->sk), SOL_SOCKET,
+		       SO_TIMESTAMPNS, &val, sizeof(val)))
+		return -errno;
+	return 0;
+}
+
+/**
+ * nlsock_set_nonblock() - make reads from a socket non-blocking
+ * @nlsk: netlink socket
+ *
+ * Once there are no more datagrams queued, nlsock_process_reply() returns
+ * -EAGAIN instead of waiting so that the caller can do some work (e.g. flush
+ * output) before waiting with nlsock_wait().
+ *
+ * Return: 0 on success or negative error code
+ */
+int nlsock_set_nonblock(struct nl_socket *nlsk)
+{
+	int flags;
+	int fd;
+
+	/* backend reports an idle socket as end of data */
+	if (!nlsk->sk)
+		return 0;
+	fd = mnl_socket_get_fd(nlsk->sk);
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return -errno;
+	return 0;
+}
+
+/**
+ * nlsock_wait() - wait for a datagram on any of several sockets
+ * @nlsks:   netlink sockets
+ * @n:       number of sockets (at most NLSOCK_WAIT_MAX)
+ * @timeout: timeout in milliseconds, negative to wait indefinitely
+ * @sigmask: signal mask while waiting (null to keep the current one)
+ *
+ * A caller blocking some signals and checking a flag set by their handlers
+ * before the wait passes the mask with the signals unblocked, so that a
+ * signal arriving after the check still interrupts the wait (see ppoll()).
+ *
+ * Return: 1 if a datagram can be read, 0 on timeout or negative error code
+ * (-EINTR if interrupted by a signal)
+ */
+int nlsock_wait(struct nl_socket *const *nlsks, unsigned int n, int timeout,
+		const sigset_t *sigmask)
+{
+	struct pollfd pfds[NLSOCK_WAIT_MAX] = {};
+	struct timespec ts, *pts = NULL;
+	unsigned int i;
+	int ret;
+
+	if (n > NLSOCK_WAIT_MAX)
+		return -EINVAL;
+	for (i = 0; i < n; i++) {
+		if (!nlsks[i]->sk)
+			return 1;
+		pfds[i].fd = mnl_socket_get_fd(nlsks[i]->sk);
+		pfds[i].events = POLLIN;
+	}
+	if (timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000L;
+		pts = &ts;
+	}
+	ret = ppoll(pfds, n, pts, sigmask);
+
+	return ret < 0 ? -errno : !!ret;
+}
+
 /**
  * nlsock_init() - allocate and initialize netlink socket
  * @nlctx:  netlink context
@@ -347,7 +715,8 @@ err:
  *
  * Allocate and initialize netlink socket and its embedded message buffer.
  * Cleans up on error, caller is responsible for destroying the socket with
- * nlsock_done() on success.
+ * nlsock_done() on success. If netlink context has a backend (e.g. replay
+ * of a recorded session), no kernel socket is opened.
  *
  * Return: 0 on success or negative error code
  */
@@ -361,7 +730,15 @@ int nlsock_init(struct nl_context *nlctx, struct nl_socket **__nlsk, int nl_fam)
 	if (!nlsk)
 		return -ENOMEM;
 	nlsk->nlctx = nlctx;
-	msgbuff_init(&nlsk->msgbuff);
+	msgbuff_init(&nlsk->msgbuff, &nlctx->arena);
+	nlsk->id = nlctx->n_sockets++;
+	nlsk->nl_fam = nl_fam;
+
+	if (nlctx->backend) {
+		nlsk->port = nlsk->id + 1;
+		*__nlsk = nlsk;
+		return 0;
+	}
 
 	ret = -ECONNREFUSED;
 	nlsk->sk = mnl_socket_open(nl_fam);
@@ -373,7 +750,6 @@ int nlsock_init(struct nl_context *nlctx, struct nl_socket **__nlsk, int nl_fam)
 	if (ret < 0)
 		goto out_close;
 	nlsk->port = mnl_socket_get_portid(nlsk->sk);
-	nlsk->nl_fam = nl_fam;
 
 	*__nlsk = nlsk;
 	return 0;
@@ -399,6 +775,8 @@ void nlsock_done(struct nl_socket *nlsk)
 		return;
 	if (nlsk->sk)
 		mnl_socket_close(nlsk->sk);
+	else if (nlsk->nlctx->backend->release)
+		nlsk->nlctx->backend->release(nlsk);
 	msgbuff_done(&nlsk->msgbuff);
 	memset(nlsk, '\0', sizeof(*nlsk));
 	free(nlsk);
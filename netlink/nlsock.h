@@ -7,13 +7,48 @@
 #ifndef ETHTOOL_NETLINK_NLSOCK_H__
 #define ETHTOOL_NETLINK_NLSOCK_H__
 
+#include <signal.h>
 #include <libmnl/libmnl.h>
 #include <linux/netlink.h>
 #include <linux/genetlink.h>
 #include <linux/ethtool_netlink.h>
 #include "msgbuff.h"
+#include "trace.h"
+#include "replay.h"
+
+/* most sockets nlsock_wait() can wait on */
+#define NLSOCK_WAIT_MAX		4
+/* maximum number of datagrams received with one recvmmsg() */
+#define NLSOCK_RECV_BATCH	8
 
 struct nl_context;
+struct nl_socket;
+
+/**
+ * struct nlsock_backend - replacement of kernel netlink sockets
+ * @send:     process a request; return its length or negative error code
+ * @peek_len: length of next reply datagram, 0 if there are no more
+ * @recv:     copy next reply datagram into buffer, return its length
+ * @release:  release private data of a socket (optional)
+ * @pipeline: requests sent before the replies to previous ones are received
+ *            are queued and answered in order
+ *
+ * If netlink context has a backend, no kernel sockets are opened and all
+ * traffic goes through these callbacks instead. This is used to replay
+ * recorded sessions and by the test suite.
+ */
+struct nlsock_backend {
+	ssize_t (*send)(struct nl_socket *nlsk, const struct nlmsghdr *nlhdr);
+	ssize_t (*peek_len)(struct nl_socket *nlsk);
+	ssize_t (*recv)(struct nl_socket *nlsk, void *buff, unsigned int size);
+	void (*release)(struct nl_socket *nlsk);
+	bool pipeline;
+};
+
+#ifdef TEST_NL_BACKEND
+/* in-process fake of ethtool genetlink family (test-nlfake.c) */
+extern const struct nlsock_backend nlfake_backend;
+#endif
 
 /**
  * struct nl_socket - netlink socket abstraction
@@ -23,6 +58,14 @@ struct nl_context;
  * @port:    port number for netlink header
  * @seq:     autoincremented sequence number for netlink header
  * @nl_fam:  netlink family (e.g. NETLINK_GENERIC or NETLINK_ROUTE)
+ * @id:      index of the socket within netlink context
+ * @rx_slots: receive slots (see nlsock_process_reply()), null if not
+ *            allocated yet or kept by a reply callback
+ * @rx_cur:  slot holding the datagram being processed
+ * @is_dump: last request sent was a dump
+ * @trace:   request in flight (if tracing is enabled)
+ * @replay:  replay state (fake socket without @sk in replay mode)
+ * @backend_priv: private data of netlink context backend (if any)
  */
 struct nl_socket {
 	struct nl_context	*nlctx;
@@ -31,6 +74,13 @@ struct nl_socket {
 	unsigned int		port;
 	unsigned int		seq;
 	int			nl_fam;
+	unsigned int		id;
+	char			*rx_slots[NLSOCK_RECV_BATCH];
+	unsigned int		rx_cur;
+	bool			is_dump;
+	struct nl_trace_req	trace;
+	struct nl_replay_cursor	replay;
+	void			*backend_priv;
 };
 
 int nlsock_init(struct nl_context *nlctx, struct nl_socket **__nlsk,
@@ -41,5 +91,15 @@ int nlsock_prep_get_request(struct nl_socket *nlsk, unsigned int nlcmd,
 ssize_t nlsock_sendmsg(struct nl_socket *nlsk, struct nl_msg_buff *__msgbuff);
 int nlsock_send_get_request(struct nl_socket *nlsk, mnl_cb_t cb);
 int nlsock_process_reply(struct nl_socket *nlsk, mnl_cb_t reply_cb, void *data);
+bool nlsock_can_pipeline(const struct nl_socket *nlsk);
+int nlsock_process_replies(struct nl_socket *nlsk, unsigned int n_reqs,
+			   mnl_cb_t reply_cb, void *data);
+int nlsock_add_membership(struct nl_socket *nlsk, uint32_t grpid);
+int nlsock_set_rcvbuf(struct nl_socket *nlsk, int size);
+int nlsock_set_timestamps(struct nl_socket *nlsk);
+int nlsock_set_nonblock(struct nl_socket *nlsk);
+int nlsock_wait(struct nl_socket *const *nlsks, unsigned int n, int timeout,
+		const sigset_t *sigmask);
+void nlsock_keep_reply(struct nl_socket *nlsk);
 
 #endif /* ETHTOOL_NETLINK_NLSOCK_H__ */
@@ -0,0 +1,239 @@
+/*
+ * ntfburst.c - coalescing of notification bursts
+ *
+ * A marginal link or a script changing settings in a loop can produce
+ * hundreds of notifications per second. Notifications of the same type for
+ * the same device received within a window starting with the first of them
+ * are merged into one burst carrying their number, time of the first and the
+ * last one and the last message (which describes the final state, ethtool
+ * notifications carry complete information like get replies). As the window
+ * has a fixed length, bursts expire in the order they were started and
+ * a simple queue is enough to find the next one to expire.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "../internal.h"
+#include "netlink.h"
+#include "ntfburst.h"
+
+/* devices are indexed by ifindex, notifications for higher ones are not
+ * coalesced
+ */
+#define NTFBURST_MAX_INDEX	(1 << 20)
+
+/**
+ * struct ntfburst_dev - coalescing state of a device
+ * @bursts: bursts indexed by notification type (allocated on first use)
+ */
+struct ntfburst_dev {
+	struct ntfburst		*bursts[__ETHTOOL_MSG_KERNEL_CNT];
+};
+
+/**
+ * struct ntfburst_table - notification coalescing state
+ * @window: length of coalescing window (ns)
+ * @devs:   devices indexed by ifindex
+ * @n_devs: number of entries in @devs
+ * @head:   pending burst expiring first
+ * @tail:   pending burst expiring last
+ */
+struct ntfburst_table {
+	uint64_t		window;
+	struct ntfburst_dev	*devs;
+	unsigned int		n_devs;
+	struct ntfburst		*head;
+	struct ntfburst		*tail;
+};
+
+static uint64_t ntfburst_clock(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * ntfburst_now() - current time for coalescing windows
+ *
+ * Return: CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t ntfburst_now(void)
+{
+	return ntfburst_clock(CLOCK_MONOTONIC);
+}
+
+struct ntfburst_table *ntfburst_new(unsigned int window_ms)
+{
+	struct ntfburst_table *table;
+
+	table = calloc(1, sizeof(*table));
+	if (!table)
+		return NULL;
+	table->window = (uint64_t)window_ms * 1000000ULL;
+
+	return table;
+}
+
+void ntfburst_free(struct ntfburst_table *table)
+{
+	struct ntfburst *burst;
+	unsigned int i, j;
+
+	if (!table)
+		return;
+	for (i = 0; i < table->n_devs; i++) {
+		for (j = 0; j < __ETHTOOL_MSG_KERNEL_CNT; j++) {
+			burst = table->devs[i].bursts[j];
+			if (!burst)
+				continue;
+			free(burst->msg);
+			free(burst);
+		}
+	}
+	free(table->devs);
+	free(table);
+}
+
+static struct ntfburst_dev *ntfburst_get_dev(struct ntfburst_table *table,
+					     int ifindex)
+{
+	struct ntfburst_dev *devs;
+	unsigned int n;
+
+	if (ifindex <= 0 || ifindex >= NTFBURST_MAX_INDEX)
+		return NULL;
+	if ((unsigned int)ifindex < table->n_devs)
+		return &table->devs[ifindex];
+
+	n = table->n_devs ?: 64;
+	while (n <= (unsigned int)ifindex)
+		n *= 2;
+	devs = realloc(table->devs, n * sizeof(devs[0]));
+	if (!devs)
+		return NULL;
+	memset(devs + table->n_devs, '\0',
+	       (n - table->n_devs) * sizeof(devs[0]));
+	table->devs = devs;
+	table->n_devs = n;
+
+	return &table->devs[ifindex];
+}
+
+/**
+ * ntfburst_add() - add a notification to the burst of its device and type
+ * @table:   coalescing state
+ * @nlhdr:   notification
+ * @ifindex: device index from the request header of @nlhdr
+ *
+ * Start a new burst (and its window) if there is no pending one for the
+ * device and notification type, otherwise merge @nlhdr into the pending one.
+ *
+ * Return: 1 if @nlhdr was added, 0 if it cannot be coalesced and is to be
+ * shown immediately, negative error code on failure
+ */
+int ntfburst_add(struct ntfburst_table *table, const struct nlmsghdr *nlhdr,
+		 int ifindex)
+{
+	const struct genlmsghdr *ghdr = mnl_nlmsg_get_payload(nlhdr);
+	struct ntfburst_dev *dev;
+	struct ntfburst *burst;
+
+	if (ghdr->cmd >= __ETHTOOL_MSG_KERNEL_CNT)
+		return 0;
+	dev = ntfburst_get_dev(table, ifindex);
+	if (!dev)
+		return ifindex > 0 && ifindex < NTFBURST_MAX_INDEX ?
+		       -ENOMEM : 0;
+	burst = dev->bursts[ghdr->cmd];
+	if (!burst) {
+		burst = calloc(1, sizeof(*burst));
+		if (!burst)
+			return -ENOMEM;
+		burst->ifindex = ifindex;
+		burst->cmd = ghdr->cmd;
+		dev->bursts[ghdr->cmd] = burst;
+	}
+	if (nlhdr->nlmsg_len > burst->size) {
+		struct nlmsghdr *msg = realloc(burst->msg, nlhdr->nlmsg_len);
+
+		if (!msg)
+			return -ENOMEM;
+		burst->msg = msg;
+		burst->size = nlhdr->nlmsg_len;
+	}
+	memcpy(burst->msg, nlhdr, nlhdr->nlmsg_len);
+
+	burst->last = ntfburst_clock(CLOCK_REALTIME);
+	if (burst->count++)
+		return 1;
+	burst->first = burst->last;
+	burst->deadline = ntfburst_now() + table->window;
+	burst->next = NULL;
+	if (table->tail)
+		table->tail->next = burst;
+	else
+		table->head = burst;
+	table->tail = burst;
+
+	return 1;
+}
+
+/**
+ * ntfburst_timeout() - time until the next burst expires
+ * @table: coalescing state
+ *
+ * Return: time in milliseconds (rounded up), 0 if a burst has already
+ * expired, -1 if there are no pending bursts
+ */
+int ntfburst_timeout(const struct ntfburst_table *table)
+{
+	uint64_t now;
+
+	if (!table->head)
+		return -1;
+	now = ntfburst_now();
+	if (table->head->deadline <= now)
+		return 0;
+	return (table->head->deadline - now + 999999) / 1000000;
+}
+
+/**
+ * ntfburst_flush() - pass expired bursts to a callback
+ * @table: coalescing state
+ * @all:   pass all pending bursts, not only expired ones
+ * @cb:    callback showing a burst
+ * @data:  data passed to @cb
+ *
+ * Bursts are passed in the order they were started and removed from the
+ * queue before @cb is called so that a new notification for the same device
+ * and type starts a new burst.
+ *
+ * Return: 0 on success or negative error code returned by @cb
+ */
+int ntfburst_flush(struct ntfburst_table *table, bool all, ntfburst_cb_t cb,
+		   void *data)
+{
+	struct ntfburst *burst;
+	uint64_t now = 0;
+	int ret;
+
+	if (!all && table->head)
+		now = ntfburst_now();
+	while ((burst = table->head)) {
+		if (!all && burst->deadline > now)
+			break;
+		table->head = burst->next;
+		if (!table->head)
+			table->tail = NULL;
+		ret = cb(burst, data);
+		burst->count = 0;
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * ntfburst.h - coalescing of notification bursts
+ *
+ * Declarations of notification coalescing used by the notification monitor.
+ */
+
+#ifndef ETHTOOL_NETLINK_NTFBURST_H__
+#define ETHTOOL_NETLINK_NTFBURST_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/netlink.h>
+
+/**
+ * struct ntfburst - coalesced notifications
+ * @ifindex:  device index
+ * @cmd:      notification type (ETHTOOL_MSG_*_NTF)
+ * @count:    number of notifications merged
+ * @first:    receive time of first notification (CLOCK_REALTIME, ns)
+ * @last:     receive time of last notification (CLOCK_REALTIME, ns)
+ * @deadline: end of coalescing window (CLOCK_MONOTONIC, ns)
+ * @msg:      last notification (final state)
+ * @size:     allocated size of @msg
+ * @next:     next pending burst (pending bursts are kept in order of
+ *            @deadline)
+ */
+struct ntfburst {
+	int			ifindex;
+	uint8_t			cmd;
+	unsigned int		count;
+	uint64_t		first;
+	uint64_t		last;
+	uint64_t		deadline;
+	struct nlmsghdr		*msg;
+	unsigned int		size;
+	struct ntfburst		*next;
+};
+
+struct ntfburst_table;
+
+typedef int (*ntfburst_cb_t)(const struct ntfburst *burst, void *data);
+
+uint64_t ntfburst_now(void);
+struct ntfburst_table *ntfburst_new(unsigned int window_ms);
+void ntfburst_free(struct ntfburst_table *table);
+int ntfburst_add(struct ntfburst_table *table, const struct nlmsghdr *nlhdr,
+		 int ifindex);
+int ntfburst_timeout(const struct ntfburst_table *table);
+int ntfburst_flush(struct ntfburst_table *table, bool all, ntfburst_cb_t cb,
+		   void *data);
+
+#endif /* ETHTOOL_NETLINK_NTFBURST_H__ */
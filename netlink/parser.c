@@ -948,7 +948,12 @@ static struct tmp_buff *tmp_buff_find(struct tmp_buff *head, unsigned int id)
 	return buff;
 }
 
-static struct tmp_buff *tmp_buff_find_or_create(struct tmp_buff **phead,
+/* Temporary buffers and their messages are allocated from the arena of
+ * @nlctx so that they need not be freed; message buffers passed to caller
+ * for PARSER_GROUP_MSG stay valid until netlink_done().
+ */
+static struct tmp_buff *tmp_buff_find_or_create(struct nl_context *nlctx,
+						struct tmp_buff **phead,
 						unsigned int id)
 {
 	struct tmp_buff **pbuff;
@@ -958,38 +963,21 @@ static struct tmp_buff *tmp_buff_find_or_create(struct tmp_buff **phead,
 		if ((*pbuff)->id == id)
 			return *pbuff;
 
-	new_buff = malloc(sizeof(*new_buff));
+	new_buff = arena_alloc(&nlctx->arena, sizeof(*new_buff));
 	if (!new_buff)
 		return NULL;
 	new_buff->id = id;
-	new_buff->msgbuff = malloc(sizeof(*new_buff->msgbuff));
-	if (!new_buff->msgbuff) {
-		free(new_buff);
+	new_buff->msgbuff = arena_alloc(&nlctx->arena,
+					sizeof(*new_buff->msgbuff));
+	if (!new_buff->msgbuff)
 		return NULL;
-	}
-	msgbuff_init(new_buff->msgbuff);
+	msgbuff_init(new_buff->msgbuff, &nlctx->arena);
 	new_buff->next = NULL;
 	*pbuff = new_buff;
 
 	return new_buff;
 }
 
-static void tmp_buff_destroy(struct tmp_buff *head)
-{
-	struct tmp_buff *buff = head;
-	struct tmp_buff *next;
-
-	while (buff) {
-		next = buff->next;
-		if (buff->msgbuff) {
-			msgbuff_done(buff->msgbuff);
-			free(buff->msgbuff);
-		}
-		free(buff);
-		buff = next;
-	}
-}
-
 /* Main entry point of parser implementation.
  * @nlctx: netlink context
  * @params:      array of struct param_parser describing expected arguments
@@ -1005,7 +993,8 @@ static void tmp_buff_destroy(struct tmp_buff *head)
  *               as the number of different .group values in params array;
  *               entries are filled from the start, remaining entries are not
  *               modified; caller should zero initialize the array before
- *               calling nl_parser()
+ *               calling nl_parser(); the buffers are allocated from
+ *               nlctx->arena
  */
 int nl_parser(struct nl_context *nlctx, const struct param_parser *params,
 	      void *dest, enum parser_group_style group_style,
@@ -1029,27 +1018,27 @@ int nl_parser(struct nl_context *nlctx, const struct param_parser *params,
 		if (group_style == PARSER_GROUP_NONE || !parser->group)
 			continue;
 		ret = -ENOMEM;
-		buff = tmp_buff_find_or_create(&buffs, parser->group);
+		buff = tmp_buff_find_or_create(nlctx, &buffs, parser->group);
 		if (!buff)
-			goto out_free_buffs;
+			goto out;
 		msgbuff = buff->msgbuff;
 		ret = msg_init(nlctx, msgbuff, parser->group,
 			       NLM_F_REQUEST | NLM_F_ACK);
 		if (ret < 0)
-			goto out_free_buffs;
+			goto out;
 
 		switch (group_style) {
 		case PARSER_GROUP_NEST:
 			ret = -EMSGSIZE;
 			nest = ethnla_nest_start(buff->msgbuff, parser->group);
 			if (!nest)
-				goto out_free_buffs;
+				goto out;
 			break;
 		case PARSER_GROUP_MSG:
 			if (ethnla_fill_header(msgbuff,
 					       ETHTOOL_A_LINKINFO_HEADER,
 					       nlctx->devname, 0))
-				goto out_free_buffs;
+				goto out;
 			break;
 		default:
 			break;
@@ -1060,7 +1049,7 @@ int nl_parser(struct nl_context *nlctx, const struct param_parser *params,
 	ret = -ENOMEM;
 	params_seen = calloc(DIV_ROUND_UP(n_params, 64), sizeof(uint64_t));
 	if (!params_seen)
-		goto out_free_buffs;
+		goto out;
 
 	while (nlctx->argc > 0) {
 		struct nl_msg_buff *msgbuff;
@@ -1135,7 +1124,6 @@ int nl_parser(struct nl_context *nlctx, const struct param_parser *params,
 	ret = 0;
 out_free:
 	free(params_seen);
-out_free_buffs:
-	tmp_buff_destroy(buffs);
+out:
 	return ret;
 }
@@ -14,6 +14,7 @@
 #include "netlink.h"
 #include "bitset.h"
 #include "parser.h"
+#include "template.h"
 
 /* PAUSE_GET */
 
@@ -75,8 +76,10 @@ static int pause_autoneg_cb(const struct nlmsghdr *nlhdr, void *data)
 	}
 
 	open_json_object("negotiated");
-	show_bool_val("rx", "RX negotiated: %s\n", &rx_status);
-	show_bool_val("tx", "TX negotiated: %s\n", &tx_status);
+	if (field_wanted(nlctx, "negotiated.rx"))
+		show_bool_val("rx", "RX negotiated: %s\n", &rx_status);
+	if (field_wanted(nlctx, "negotiated.tx"))
+		show_bool_val("tx", "TX negotiated: %s\n", &tx_status);
 	close_json_object();
 
 	return MNL_CB_OK;
@@ -106,7 +109,8 @@ out:
 	return ret;
 }
 
-static int show_pause_stats(const struct nlattr *nest)
+static int show_pause_stats(const struct nl_context *nlctx,
+			    const struct nlattr *nest)
 {
 	const struct nlattr *tb[ETHTOOL_A_PAUSE_STAT_MAX + 1] = {};
 	DECLARE_ATTR_TB_INFO(tb);
@@ -128,10 +132,14 @@ static int show_pause_stats(const struct nlattr *nest)
 
 	open_json_object("statistics");
 	for (i = 0; i < ARRAY_SIZE(stats); i++) {
+		char path[48];
 		char fmt[32];
 
 		if (!tb[stats[i].attr])
 			continue;
+		snprintf(path, sizeof(path), "statistics.%s", stats[i].name);
+		if (!field_wanted(nlctx, path))
+			continue;
 
 		if (!header && !is_json_context()) {
 			printf("Statistics:\n");
@@ -188,19 +196,24 @@ int pause_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 	print_string(PRINT_ANY, "ifname", "Pause parameters for %s:\n",
 		     nlctx->devname);
 
-	show_bool("autonegotiate", "Autonegotiate:\t%s\n",
-		  tb[ETHTOOL_A_PAUSE_AUTONEG]);
-	show_bool("rx", "RX:\t\t%s\n", tb[ETHTOOL_A_PAUSE_RX]);
-	show_bool("tx", "TX:\t\t%s\n", tb[ETHTOOL_A_PAUSE_TX]);
-
-	if (!nlctx->is_monitor && tb[ETHTOOL_A_PAUSE_AUTONEG] &&
+	if (field_wanted(nlctx, "autonegotiate"))
+		show_bool("autonegotiate", "Autonegotiate:\t%s\n",
+			  tb[ETHTOOL_A_PAUSE_AUTONEG]);
+	if (field_wanted(nlctx, "rx"))
+		show_bool("rx", "RX:\t\t%s\n", tb[ETHTOOL_A_PAUSE_RX]);
+	if (field_wanted(nlctx, "tx"))
+		show_bool("tx", "TX:\t\t%s\n", tb[ETHTOOL_A_PAUSE_TX]);
+
+	/* negotiated state needs link modes of both sides */
+	if (!nlctx->is_monitor && field_wanted(nlctx, "negotiated") &&
+	    tb[ETHTOOL_A_PAUSE_AUTONEG] &&
 	    mnl_attr_get_u8(tb[ETHTOOL_A_PAUSE_AUTONEG])) {
 		ret = show_pause_autoneg_status(nlctx);
 		if (ret < 0)
 			goto err_close_dev;
 	}
-	if (tb[ETHTOOL_A_PAUSE_STATS]) {
-		ret = show_pause_stats(tb[ETHTOOL_A_PAUSE_STATS]);
+	if (tb[ETHTOOL_A_PAUSE_STATS] && field_wanted(nlctx, "statistics")) {
+		ret = show_pause_stats(nlctx, tb[ETHTOOL_A_PAUSE_STATS]);
 		if (ret < 0)
 			goto err_close_dev;
 	}
@@ -271,36 +284,26 @@ static const struct param_parser spause_params[] = {
 int nl_spause(struct cmd_context *ctx)
 {
 	struct nl_context *nlctx = ctx->nlctx;
-	struct nl_msg_buff *msgbuff;
-	struct nl_socket *nlsk;
 	int ret;
 
-	if (netlink_cmd_check(ctx, ETHTOOL_MSG_PAUSE_SET, false))
+	if (tmpl_cmd_check(ctx, ETHTOOL_MSG_PAUSE_SET, ETHTOOL_MSG_PAUSE_GET))
 		return -EOPNOTSUPP;
 
 	nlctx->cmd = "-A";
 	nlctx->argp = ctx->argp;
 	nlctx->argc = ctx->argc;
 	nlctx->devname = ctx->devname;
-	nlsk = nlctx->ethnl_socket;
-	msgbuff = &nlsk->msgbuff;
 
-	ret = msg_init(nlctx, msgbuff, ETHTOOL_MSG_PAUSE_SET,
-		       NLM_F_REQUEST | NLM_F_ACK);
+	ret = tmpl_msg_init(nlctx, ETHTOOL_MSG_PAUSE_SET,
+			    ETHTOOL_A_PAUSE_HEADER);
 	if (ret < 0)
 		return 2;
-	if (ethnla_fill_header(msgbuff, ETHTOOL_A_PAUSE_HEADER,
-			       ctx->devname, 0))
-		return -EMSGSIZE;
 
 	ret = nl_parser(nlctx, spause_params, NULL, PARSER_GROUP_NONE, NULL);
 	if (ret < 0)
 		return 1;
 
-	ret = nlsock_sendmsg(nlsk, NULL);
-	if (ret < 0)
-		return 76;
-	ret = nlsock_process_reply(nlsk, nomsg_reply_cb, nlctx);
+	ret = tmpl_send(nlctx, ETHTOOL_MSG_PAUSE_GET, ETHTOOL_A_PAUSE_HEADER);
 	if (ret == 0)
 		return 0;
 	else
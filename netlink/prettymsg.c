@@ -5,6 +5,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <stdint.h>
@@ -18,6 +19,8 @@
 #include "prettymsg.h"
 
 #define __INDENT 4
+#define __JSON_KEY_LEN 64
+#define __JSON_HEX_LEN 256
 #define __DUMP_LINE 16
 #define __DUMP_BLOCK 4
 
@@ -254,3 +257,244 @@ int pretty_print_rtnlmsg(const struct nlmsghdr *nlhdr, unsigned int err_offset)
 				  msg_desc ? msg_desc->attrs : NULL,
 				  msg_desc ? msg_desc->n_attrs : 0, err_offset);
 }
+
+/* JSON output */
+
+/* Attribute names without the common prefix of their description table
+ * (name of the UNSPEC entry without "UNSPEC"), lower case; e.g.
+ * ETHTOOL_A_LINKINFO_PORT becomes "port".
+ */
+static const char *json_attr_key(const struct pretty_nla_desc *desc,
+				 unsigned int ndesc, unsigned int atype,
+				 char *buff)
+{
+	const char *unspec = (ndesc && desc[0].name) ? desc[0].name : "";
+	const char *name = (atype < ndesc) ? desc[atype].name : NULL;
+	size_t prefix_len = strlen(unspec);
+	unsigned int i;
+
+	if (!name) {
+		snprintf(buff, __JSON_KEY_LEN, "%u", atype);
+		return buff;
+	}
+	if (prefix_len >= 6 && !strcmp(unspec + prefix_len - 6, "UNSPEC") &&
+	    !strncmp(name, unspec, prefix_len - 6))
+		name += prefix_len - 6;
+	for (i = 0; name[i] && i < __JSON_KEY_LEN - 1; i++)
+		buff[i] = (name[i] >= 'A' && name[i] <= 'Z') ?
+			  name[i] - 'A' + 'a' : name[i];
+	buff[i] = '\0';
+
+	return buff;
+}
+
+static void json_print_binary(json_writer_t *jw, const uint8_t *adata,
+			      unsigned int alen)
+{
+	static const char hex_digits[] = "0123456789abcdef";
+	char short_buff[2 * __JSON_HEX_LEN + 1];
+	char *buff = short_buff;
+	unsigned int i;
+
+	if (alen > __JSON_HEX_LEN) {
+		buff = malloc(2 * alen + 1);
+		if (!buff) {
+			jsonw_null(jw);
+			return;
+		}
+	}
+	for (i = 0; i < alen; i++) {
+		buff[2 * i] = hex_digits[adata[i] >> 4];
+		buff[2 * i + 1] = hex_digits[adata[i] & 0xf];
+	}
+	buff[2 * alen] = '\0';
+	jsonw_string(jw, buff);
+	if (buff != short_buff)
+		free(buff);
+}
+
+/* a nest is shown as an array if its children are entries of a list, i.e.
+ * the description has only one attribute type or a type repeats
+ */
+static bool json_nest_is_list(const struct nlattr *nest,
+			      const struct pretty_nla_desc *adesc)
+{
+	const struct nlattr *child;
+	uint64_t seen = 0;
+	unsigned int type;
+
+	if (adesc && adesc->n_children == 2)
+		return true;
+	mnl_attr_for_each_nested(child, nest) {
+		type = mnl_attr_get_type(child);
+		if (type >= 64)
+			continue;
+		if (seen & (1ULL << type))
+			return true;
+		seen |= (1ULL << type);
+	}
+
+	return false;
+}
+
+static void json_print_value(json_writer_t *jw, const struct nlattr *attr,
+			     const struct pretty_nla_desc *adesc);
+static void json_print_attr(json_writer_t *jw, const struct nlattr *attr,
+			    const struct pretty_nla_desc *desc,
+			    unsigned int ndesc);
+
+static void json_print_nest(json_writer_t *jw, const struct nlattr *nest,
+			    const struct pretty_nla_desc *adesc)
+{
+	const struct pretty_nla_desc *desc = adesc ? adesc->children : NULL;
+	unsigned int ndesc = adesc ? adesc->n_children : 0;
+	const struct nlattr *child;
+
+	if (adesc && adesc->format == NLA_ARRAY) {
+		jsonw_start_array(jw);
+		mnl_attr_for_each_nested(child, nest)
+			json_print_value(jw, child, desc);
+		jsonw_end_array(jw);
+	} else if (!json_nest_is_list(nest, adesc)) {
+		jsonw_start_object(jw);
+		mnl_attr_for_each_nested(child, nest)
+			json_print_attr(jw, child, desc, ndesc);
+		jsonw_end_object(jw);
+	} else if (ndesc == 2) {
+		/* entries of a one type list are shown as bare values */
+		jsonw_start_array(jw);
+		mnl_attr_for_each_nested(child, nest)
+			json_print_value(jw, child, &desc[1]);
+		jsonw_end_array(jw);
+	} else {
+		jsonw_start_array(jw);
+		mnl_attr_for_each_nested(child, nest) {
+			jsonw_start_object(jw);
+			json_print_attr(jw, child, desc, ndesc);
+			jsonw_end_object(jw);
+		}
+		jsonw_end_array(jw);
+	}
+}
+
+static void json_print_value(json_writer_t *jw, const struct nlattr *attr,
+			     const struct pretty_nla_desc *adesc)
+{
+	unsigned int alen = mnl_attr_get_payload_len(attr);
+	const char *adata = mnl_attr_get_payload(attr);
+
+	if ((adesc && (adesc->format == NLA_NESTED ||
+		       adesc->format == NLA_ARRAY)) ||
+	    (attr->nla_type & NLA_F_NESTED)) {
+		json_print_nest(jw, attr, adesc);
+		return;
+	}
+
+	switch (adesc ? adesc->format : NLA_BINARY) {
+	case NLA_U8:
+	case NLA_X8:
+		jsonw_uint(jw, mnl_attr_get_u8(attr));
+		break;
+	case NLA_U16:
+	case NLA_X16:
+		jsonw_uint(jw, mnl_attr_get_u16(attr));
+		break;
+	case NLA_U32:
+	case NLA_X32:
+		jsonw_uint(jw, mnl_attr_get_u32(attr));
+		break;
+	case NLA_U64:
+	case NLA_X64:
+		jsonw_u64(jw, mnl_attr_get_u64(attr));
+		break;
+	case NLA_S8:
+		jsonw_int(jw, (int8_t)mnl_attr_get_u8(attr));
+		break;
+	case NLA_S16:
+		jsonw_int(jw, (int16_t)mnl_attr_get_u16(attr));
+		break;
+	case NLA_S32:
+		jsonw_int(jw, (int32_t)mnl_attr_get_u32(attr));
+		break;
+	case NLA_S64:
+		jsonw_s64(jw, (int64_t)mnl_attr_get_u64(attr));
+		break;
+	case NLA_STRING:
+		if (alen && !adata[alen - 1])
+			jsonw_string(jw, adata);
+		else
+			json_print_binary(jw, (const uint8_t *)adata, alen);
+		break;
+	case NLA_FLAG:
+		jsonw_bool(jw, true);
+		break;
+	case NLA_BOOL:
+		jsonw_bool(jw, mnl_attr_get_u8(attr));
+		break;
+	case NLA_U32_ENUM: {
+		uint32_t val = mnl_attr_get_u32(attr);
+
+		if (val < adesc->n_names && adesc->names[val])
+			jsonw_string(jw, adesc->names[val]);
+		else
+			jsonw_uint(jw, val);
+		break;
+	}
+	default:
+		json_print_binary(jw, (const uint8_t *)adata, alen);
+	}
+}
+
+static void json_print_attr(json_writer_t *jw, const struct nlattr *attr,
+			    const struct pretty_nla_desc *desc,
+			    unsigned int ndesc)
+{
+	unsigned int atype = mnl_attr_get_type(attr);
+	char key[__JSON_KEY_LEN];
+
+	jsonw_name(jw, json_attr_key(desc, ndesc, atype, key));
+	json_print_value(jw, attr,
+			 (desc && atype < ndesc) ? &desc[atype] : NULL);
+}
+
+/**
+ * json_print_genlmsg() - show genetlink message as JSON object members
+ * @jw:    JSON writer with an open object
+ * @nlhdr: message to show
+ * @desc:  message descriptions
+ * @ndesc: number of message descriptions
+ *
+ * Add "msg" (message type name) and "attrs" (attributes as an object)
+ * members to the current object of @jw; the same descriptions as for the
+ * pretty print are used so that all message types are covered.
+ *
+ * Return: 0 on success or negative error code
+ */
+int json_print_genlmsg(json_writer_t *jw, const struct nlmsghdr *nlhdr,
+		       const struct pretty_nlmsg_desc *desc, unsigned int ndesc)
+{
+	const struct pretty_nlmsg_desc *msg_desc;
+	const struct genlmsghdr *genlhdr;
+	const struct nlattr *attr;
+	char key[__JSON_KEY_LEN];
+
+	if (mnl_nlmsg_get_payload_len(nlhdr) < GENL_HDRLEN)
+		return -EINVAL;
+	genlhdr = mnl_nlmsg_get_payload(nlhdr);
+	msg_desc = (desc && genlhdr->cmd < ndesc) ? &desc[genlhdr->cmd] : NULL;
+	if (msg_desc && msg_desc->name) {
+		jsonw_string_field(jw, "msg", msg_desc->name);
+	} else {
+		snprintf(key, sizeof(key), "%u", genlhdr->cmd);
+		jsonw_string_field(jw, "msg", key);
+	}
+
+	jsonw_name(jw, "attrs");
+	jsonw_start_object(jw);
+	mnl_attr_for_each(attr, nlhdr, GENL_HDRLEN)
+		json_print_attr(jw, attr, msg_desc ? msg_desc->attrs : NULL,
+				msg_desc ? msg_desc->n_attrs : 0);
+	jsonw_end_object(jw);
+
+	return 0;
+}
@@ -7,8 +7,11 @@
 #ifndef ETHTOOL_NETLINK_PRETTYMSG_H__
 #define ETHTOOL_NETLINK_PRETTYMSG_H__
 
+#include <stdio.h>
 #include <linux/netlink.h>
 
+#include "../json_writer.h"
+
 /* data structures for message format descriptions */
 
 enum pretty_nla_format {
@@ -119,6 +122,9 @@ int pretty_print_genlmsg(const struct nlmsghdr *nlhdr,
 			 const struct pretty_nlmsg_desc *desc,
 			 unsigned int ndesc, unsigned int err_offset);
 int pretty_print_rtnlmsg(const struct nlmsghdr *nlhdr, unsigned int err_offset);
+/* function to show a genetlink message as JSON */
+int json_print_genlmsg(json_writer_t *jw, const struct nlmsghdr *nlhdr,
+		       const struct pretty_nlmsg_desc *desc, unsigned int ndesc);
 
 /* message descriptions */
 
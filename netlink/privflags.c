@@ -55,6 +55,7 @@ int privflags_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 	const struct stringset *flag_names = NULL;
 	struct nl_context *nlctx = data;
 	unsigned int maxlen = 0;
+	struct nl_bitset flags;
 	bool silent;
 	int err_ret;
 	int ret;
@@ -77,22 +78,24 @@ int privflags_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 					      nlctx->ethnl2_socket);
 	}
 
-	ret = walk_bitset(tb[ETHTOOL_A_PRIVFLAGS_FLAGS], flag_names,
-			  privflags_maxlen_walk_cb, &maxlen);
+	ret = bitset_decode(&flags, tb[ETHTOOL_A_PRIVFLAGS_FLAGS]);
 	if (ret < 0)
 		return err_ret;
+	bitset_walk(&flags, flag_names, privflags_maxlen_walk_cb, &maxlen);
 	if (silent)
 		putchar('\n');
 	printf("Private flags for %s:\n", nlctx->devname);
-	ret = walk_bitset(tb[ETHTOOL_A_PRIVFLAGS_FLAGS], flag_names,
-			  privflags_dump_walk_cb, &maxlen);
-	return (ret < 0) ? err_ret : MNL_CB_OK;
+	bitset_walk(&flags, flag_names, privflags_dump_walk_cb, &maxlen);
+	bitset_release(&flags);
+
+	return MNL_CB_OK;
 }
 
 int nl_gprivflags(struct cmd_context *ctx)
 {
 	struct nl_context *nlctx = ctx->nlctx;
 	struct nl_socket *nlsk = nlctx->ethnl_socket;
+	u32 flags;
 	int ret;
 
 	if (netlink_cmd_check(ctx, ETHTOOL_MSG_PRIVFLAGS_GET, true))
@@ -103,8 +106,9 @@ int nl_gprivflags(struct cmd_context *ctx)
 		return 1;
 	}
 
+	flags = get_bitset_flags(nlctx, 0, STRSET_BIT(ETH_SS_PRIV_FLAGS));
 	ret = nlsock_prep_get_request(nlsk, ETHTOOL_MSG_PRIVFLAGS_GET,
-				      ETHTOOL_A_PRIVFLAGS_HEADER, 0);
+				      ETHTOOL_A_PRIVFLAGS_HEADER, flags);
 	if (ret < 0)
 		return ret;
 	return nlsock_send_get_request(nlsk, privflags_reply_cb);
@@ -0,0 +1,386 @@
+/*
+ * replay.c - record and replay of netlink sessions
+ *
+ * With --record, every datagram sent to or received from the kernel is saved
+ * with a timestamp and the socket it went through. With --replay, no netlink
+ * sockets are opened; each request is matched against requests of a recorded
+ * session by message type, flags and contents (command and attributes) and
+ * the replies recorded for it are served instead of kernel replies. This
+ * allows reproducing output and profiling message processing without access
+ * to the original system.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../internal.h"
+#include "netlink.h"
+#include "nlsock.h"
+#include "replay.h"
+
+#define REPLAY_ALIGN(len)	(((len) + 7) & ~7U)
+
+struct nl_record {
+	FILE			*file;
+	const char		*file_name;
+	uint64_t		t_start;
+};
+
+struct replay_entry {
+	const struct nl_replay_rec	*rec;
+	const void			*data;
+	bool				used;
+};
+
+struct nl_replay {
+	char			*buff;
+	struct replay_entry	*entries;
+	unsigned int		n_entries;
+};
+
+static uint64_t replay_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * record_datagram() - save a datagram into session file
+ * @nlsk: netlink socket the datagram went through
+ * @data: datagram contents
+ * @len:  datagram length
+ * @sent: true for datagrams sent to kernel, false for received ones
+ */
+void record_datagram(struct nl_socket *nlsk, const void *data,
+		     unsigned int len, bool sent)
+{
+	static const char padding[8];
+	struct nl_record *record = nlsk->nlctx->record;
+	struct nl_replay_rec rec = {};
+
+	rec.time = replay_now() - record->t_start;
+	rec.len = len;
+	rec.sock = nlsk->id;
+	rec.nl_fam = nlsk->nl_fam;
+	rec.dir = sent ? REPLAY_DIR_SENT : REPLAY_DIR_RECEIVED;
+	fwrite(&rec, sizeof(rec), 1, record->file);
+	fwrite(data, 1, len, record->file);
+	fwrite(padding, 1, REPLAY_ALIGN(len) - len, record->file);
+	/* monitor only ends when killed */
+	if (nlsk->nlctx->is_monitor)
+		fflush(record->file);
+}
+
+static int record_init(struct nl_context *nlctx, const char *fname)
+{
+	struct nl_replay_file_hdr hdr = {};
+	struct nl_record *record;
+	int ret;
+
+	record = calloc(1, sizeof(*record));
+	if (!record)
+		return -ENOMEM;
+	record->file = fopen(fname, "wb");
+	if (!record->file) {
+		ret = -errno;
+		fprintf(stderr, "failed to create session file %s: %s\n",
+			fname, strerror(-ret));
+		free(record);
+		return ret;
+	}
+	record->file_name = fname;
+	record->t_start = replay_now();
+
+	memcpy(hdr.magic, REPLAY_FILE_MAGIC, sizeof(hdr.magic));
+	hdr.version = REPLAY_FILE_VERSION;
+	fwrite(&hdr, sizeof(hdr), 1, record->file);
+
+	nlctx->record = record;
+	return 0;
+}
+
+static void record_done(struct nl_context *nlctx)
+{
+	struct nl_record *record = nlctx->record;
+	bool failed;
+
+	if (!record)
+		return;
+	failed = ferror(record->file);
+	if (fclose(record->file) || failed)
+		fprintf(stderr, "failed to write session file %s\n",
+			record->file_name);
+	free(record);
+	nlctx->record = NULL;
+}
+
+static char *replay_read_file(const char *fname, size_t *len)
+{
+	size_t size = 65536;
+	char *buff = NULL;
+	char *nbuff;
+	size_t n = 0;
+	FILE *file;
+
+	file = fopen(fname, "rb");
+	if (!file)
+		return NULL;
+	do {
+		if (n == size || !buff) {
+			size = buff ? 2 * size : size;
+			nbuff = realloc(buff, size);
+			if (!nbuff)
+				goto err;
+			buff = nbuff;
+		}
+		n += fread(buff + n, 1, size - n, file);
+	} while (n == size);
+	if (ferror(file))
+		goto err;
+
+	fclose(file);
+	*len = n;
+	return buff;
+err:
+	free(buff);
+	fclose(file);
+	return NULL;
+}
+
+static int replay_parse(struct nl_replay *replay, size_t len)
+{
+	const struct nl_replay_file_hdr *hdr = (void *)replay->buff;
+	const struct nl_replay_rec *rec;
+	unsigned int n = 0;
+	size_t pos;
+
+	if (len < sizeof(*hdr) ||
+	    memcmp(hdr->magic, REPLAY_FILE_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != REPLAY_FILE_VERSION)
+		return -EINVAL;
+
+	/* first pass to count records, second to index them; a truncated
+	 * record at the end (recording process was killed) is ignored
+	 */
+	for (pos = sizeof(*hdr); pos < len;
+	     pos += sizeof(*rec) + REPLAY_ALIGN(rec->len)) {
+		rec = (const void *)(replay->buff + pos);
+		if (len - pos < sizeof(*rec) ||
+		    len - pos - sizeof(*rec) < rec->len)
+			break;
+		n++;
+	}
+	replay->entries = calloc(n ?: 1, sizeof(replay->entries[0]));
+	if (!replay->entries)
+		return -ENOMEM;
+	for (pos = sizeof(*hdr); replay->n_entries < n;
+	     pos += sizeof(*rec) + REPLAY_ALIGN(rec->len)) {
+		rec = (const void *)(replay->buff + pos);
+		replay->entries[replay->n_entries].rec = rec;
+		replay->entries[replay->n_entries].data = rec + 1;
+		replay->n_entries++;
+	}
+
+	return 0;
+}
+
+static int replay_load(struct nl_context *nlctx, const char *fname)
+{
+	struct nl_replay *replay;
+	size_t len;
+	int ret;
+
+	replay = calloc(1, sizeof(*replay));
+	if (!replay)
+		return -ENOMEM;
+	replay->buff = replay_read_file(fname, &len);
+	if (!replay->buff) {
+		ret = -errno;
+		fprintf(stderr, "failed to read session file %s: %s\n",
+			fname, strerror(errno));
+		goto err;
+	}
+	ret = replay_parse(replay, len);
+	if (ret < 0) {
+		fprintf(stderr, "invalid session file %s\n", fname);
+		goto err;
+	}
+
+	nlctx->replay = replay;
+	return 0;
+err:
+	free(replay->entries);
+	free(replay->buff);
+	free(replay);
+	return ret;
+}
+
+/* requests match if they have the same type, flags and payload */
+static bool replay_match(const struct replay_entry *entry,
+			 const struct nl_socket *nlsk,
+			 const struct nlmsghdr *nlhdr)
+{
+	const struct nlmsghdr *rec_nlhdr = entry->data;
+	const struct nl_replay_rec *rec = entry->rec;
+
+	return rec->dir == REPLAY_DIR_SENT && !entry->used &&
+	       rec->nl_fam == nlsk->nl_fam && rec->len == nlhdr->nlmsg_len &&
+	       rec->len >= NLMSG_HDRLEN &&
+	       rec_nlhdr->nlmsg_type == nlhdr->nlmsg_type &&
+	       rec_nlhdr->nlmsg_flags == nlhdr->nlmsg_flags &&
+	       !memcmp(rec_nlhdr + 1, nlhdr + 1, rec->len - NLMSG_HDRLEN);
+}
+
+/**
+ * replay_send() - "send" a request to recorded session
+ * @nlsk:  fake netlink socket
+ * @nlhdr: request message
+ *
+ * Find the first request of the recorded session matching @nlhdr which was
+ * not used yet; replies recorded after it on the same socket are then
+ * returned by replay_recv().
+ *
+ * Return: length of the request or negative error code
+ */
+static ssize_t replay_send(struct nl_socket *nlsk,
+			   const struct nlmsghdr *nlhdr)
+{
+	struct nl_replay *replay = nlsk->nlctx->replay;
+	unsigned int i;
+
+	for (i = 0; i < replay->n_entries; i++) {
+		if (!replay_match(&replay->entries[i], nlsk, nlhdr))
+			continue;
+		replay->entries[i].used = true;
+		nlsk->replay.sock = replay->entries[i].rec->sock;
+		nlsk->replay.next = i + 1;
+		nlsk->replay.active = true;
+		return nlhdr->nlmsg_len;
+	}
+
+	fprintf(stderr, "no matching request in recorded session\n");
+	nlsk->replay.active = false;
+	return -ENOENT;
+}
+
+/* next recorded reply for the socket, null at the end of replies */
+static const struct replay_entry *replay_next(struct nl_socket *nlsk)
+{
+	struct nl_replay *replay = nlsk->nlctx->replay;
+	const struct replay_entry *entry;
+
+	if (!nlsk->replay.active)
+		return NULL;
+	for (; nlsk->replay.next < replay->n_entries; nlsk->replay.next++) {
+		entry = &replay->entries[nlsk->replay.next];
+		if (entry->rec->sock != nlsk->replay.sock)
+			continue;
+		if (entry->rec->dir == REPLAY_DIR_SENT)
+			break;
+		return entry;
+	}
+
+	nlsk->replay.active = false;
+	return NULL;
+}
+
+/**
+ * replay_peek_len() - length of next recorded reply
+ * @nlsk: fake netlink socket
+ *
+ * Return: length of next reply, 0 if there are no more
+ */
+static ssize_t replay_peek_len(struct nl_socket *nlsk)
+{
+	const struct replay_entry *entry = replay_next(nlsk);
+
+	return entry ? entry->rec->len : 0;
+}
+
+/**
+ * replay_recv() - "receive" next recorded reply
+ * @nlsk: fake netlink socket
+ * @buff: buffer to copy the reply into
+ * @size: size of @buff
+ *
+ * Sequence numbers and port ids in the reply are rewritten to match the
+ * current request of @nlsk.
+ *
+ * Return: length of the reply, 0 if there are no more or negative error code
+ */
+static ssize_t replay_recv(struct nl_socket *nlsk, void *buff,
+			   unsigned int size)
+{
+	const struct replay_entry *entry = replay_next(nlsk);
+	struct nlmsghdr *nlhdr = buff;
+	int left;
+
+	if (!entry)
+		return 0;
+	if (entry->rec->len > size)
+		return -EMSGSIZE;
+	memcpy(buff, entry->data, entry->rec->len);
+	nlsk->replay.next++;
+
+	left = entry->rec->len;
+	while (mnl_nlmsg_ok(nlhdr, left)) {
+		if (nlhdr->nlmsg_seq)
+			nlhdr->nlmsg_seq = nlsk->seq;
+		if (nlhdr->nlmsg_pid)
+			nlhdr->nlmsg_pid = nlsk->port;
+		nlhdr = mnl_nlmsg_next(nlhdr, &left);
+	}
+
+	return entry->rec->len;
+}
+
+static const struct nlsock_backend replay_backend = {
+	.send		= replay_send,
+	.peek_len	= replay_peek_len,
+	.recv		= replay_recv,
+};
+
+/**
+ * replay_init() - set up session recording or replay
+ * @nlctx: netlink context
+ *
+ * Return: 0 on success or negative error code
+ */
+int replay_init(struct nl_context *nlctx)
+{
+	const struct cmd_context *ctx = nlctx->ctx;
+	int ret;
+
+	if (ctx->replay_file) {
+		ret = replay_load(nlctx, ctx->replay_file);
+		if (ret == 0)
+			nlctx->backend = &replay_backend;
+		return ret;
+	}
+	if (ctx->record_file)
+		return record_init(nlctx, ctx->record_file);
+	return 0;
+}
+
+/**
+ * replay_done() - finish session recording or replay
+ * @nlctx: netlink context
+ */
+void replay_done(struct nl_context *nlctx)
+{
+	struct nl_replay *replay = nlctx->replay;
+
+	record_done(nlctx);
+	if (!replay)
+		return;
+	free(replay->entries);
+	free(replay->buff);
+	free(replay);
+	nlctx->replay = NULL;
+	nlctx->backend = NULL;
+}
@@ -0,0 +1,79 @@
+/*
+ * replay.h - record and replay of netlink sessions
+ *
+ * Declarations of recording netlink traffic into a file and serving recorded
+ * replies in place of the kernel.
+ */
+
+#ifndef ETHTOOL_NETLINK_REPLAY_H__
+#define ETHTOOL_NETLINK_REPLAY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <libmnl/libmnl.h>
+
+struct nl_context;
+struct nl_socket;
+struct nl_record;
+struct nl_replay;
+
+#define REPLAY_FILE_MAGIC	"ETNR"
+#define REPLAY_FILE_VERSION	1
+
+enum {
+	REPLAY_DIR_SENT,
+	REPLAY_DIR_RECEIVED,
+};
+
+/**
+ * struct nl_replay_file_hdr - header of session file
+ * @magic:    REPLAY_FILE_MAGIC (not null terminated)
+ * @version:  REPLAY_FILE_VERSION
+ * @reserved: always zero
+ */
+struct nl_replay_file_hdr {
+	char		magic[4];
+	uint16_t	version;
+	uint16_t	reserved;
+};
+
+/**
+ * struct nl_replay_rec - header of one datagram in session file
+ * @time:   time since start of the session (ns)
+ * @len:    length of the datagram
+ * @sock:   socket the datagram was sent or received on (index in session)
+ * @nl_fam: netlink family of the socket (NETLINK_GENERIC or NETLINK_ROUTE)
+ * @dir:    REPLAY_DIR_SENT or REPLAY_DIR_RECEIVED
+ *
+ * Session file consists of struct nl_replay_file_hdr followed by records,
+ * each record is this header followed by the datagram padded to a multiple
+ * of 8 bytes. All values are in host byte order.
+ */
+struct nl_replay_rec {
+	uint64_t	time;
+	uint32_t	len;
+	uint16_t	sock;
+	uint8_t		nl_fam;
+	uint8_t		dir;
+};
+
+/**
+ * struct nl_replay_cursor - replay state of a fake socket
+ * @sock:   recorded socket the replies are taken from
+ * @next:   index of next record to look at
+ * @active: a request was matched, replies are being served
+ */
+struct nl_replay_cursor {
+	unsigned int	sock;
+	unsigned int	next;
+	bool		active;
+};
+
+int replay_init(struct nl_context *nlctx);
+void replay_done(struct nl_context *nlctx);
+
+void record_datagram(struct nl_socket *nlsk, const void *data,
+		     unsigned int len, bool sent);
+
+#endif /* ETHTOOL_NETLINK_REPLAY_H__ */
@@ -12,6 +12,7 @@
 #include "../common.h"
 #include "netlink.h"
 #include "parser.h"
+#include "template.h"
 
 /* RINGS_GET */
 
@@ -104,36 +105,26 @@ static const struct param_parser sring_params[] = {
 int nl_sring(struct cmd_context *ctx)
 {
 	struct nl_context *nlctx = ctx->nlctx;
-	struct nl_msg_buff *msgbuff;
-	struct nl_socket *nlsk;
 	int ret;
 
-	if (netlink_cmd_check(ctx, ETHTOOL_MSG_RINGS_SET, false))
+	if (tmpl_cmd_check(ctx, ETHTOOL_MSG_RINGS_SET, ETHTOOL_MSG_RINGS_GET))
 		return -EOPNOTSUPP;
 
 	nlctx->cmd = "-G";
 	nlctx->argp = ctx->argp;
 	nlctx->argc = ctx->argc;
 	nlctx->devname = ctx->devname;
-	nlsk = nlctx->ethnl_socket;
-	msgbuff = &nlsk->msgbuff;
 
-	ret = msg_init(nlctx, msgbuff, ETHTOOL_MSG_RINGS_SET,
-		       NLM_F_REQUEST | NLM_F_ACK);
+	ret = tmpl_msg_init(nlctx, ETHTOOL_MSG_RINGS_SET,
+			    ETHTOOL_A_RINGS_HEADER);
 	if (ret < 0)
 		return 2;
-	if (ethnla_fill_header(msgbuff, ETHTOOL_A_RINGS_HEADER,
-			       ctx->devname, 0))
-		return -EMSGSIZE;
 
 	ret = nl_parser(nlctx, sring_params, NULL, PARSER_GROUP_NONE, NULL);
 	if (ret < 0)
 		return 1;
 
-	ret = nlsock_sendmsg(nlsk, NULL);
-	if (ret < 0)
-		return 81;
-	ret = nlsock_process_reply(nlsk, nomsg_reply_cb, nlctx);
+	ret = tmpl_send(nlctx, ETHTOOL_MSG_RINGS_GET, ETHTOOL_A_RINGS_HEADER);
 	if (ret == 0)
 		return 0;
 	else
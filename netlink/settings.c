@@ -189,18 +189,17 @@ static void print_enum(const char *const *info, unsigned int n_info,
 		printf("\t%s: %s\n", label, info[val]);
 }
 
-static int dump_pause(const struct nlattr *attr, bool mask, const char *label)
+static int dump_pause(const struct nl_bitset *modes, bool mask,
+		      const char *label)
 {
 	bool pause, asym;
-	int ret = 0;
 
-	pause = bitset_get_bit(attr, mask, ETHTOOL_LINK_MODE_Pause_BIT, &ret);
-	if (ret < 0)
-		goto err;
-	asym = bitset_get_bit(attr, mask, ETHTOOL_LINK_MODE_Asym_Pause_BIT,
-			      &ret);
-	if (ret < 0)
-		goto err;
+	if (mask && modes->nomask) {
+		fprintf(stderr, "malformed netlink message (pause modes)\n");
+		return -EFAULT;
+	}
+	pause = bitset_test(modes, mask, ETHTOOL_LINK_MODE_Pause_BIT);
+	asym = bitset_test(modes, mask, ETHTOOL_LINK_MODE_Asym_Pause_BIT);
 
 	printf("\t%s", label);
 	if (pause)
@@ -209,9 +208,6 @@ static int dump_pause(const struct nlattr *attr, bool mask, const char *label)
 		printf("%s\n", asym ? "Transmit-only" : "No");
 
 	return 0;
-err:
-	fprintf(stderr, "malformed netlink message (pause modes)\n");
-	return ret;
 }
 
 static void print_banner(struct nl_context *nlctx)
@@ -222,108 +218,44 @@ static void print_banner(struct nl_context *nlctx)
 	nlctx->no_banner = true;
 }
 
-int dump_link_modes(struct nl_context *nlctx, const struct nlattr *bitset,
+int dump_link_modes(struct nl_context *nlctx, const struct nl_bitset *modes,
 		    bool mask, unsigned int class, const char *before,
 		    const char *between, const char *after, const char *if_none)
 {
-	const struct nlattr *bitset_tb[ETHTOOL_A_BITSET_MAX + 1] = {};
-	DECLARE_ATTR_TB_INFO(bitset_tb);
+	const struct stringset *lm_strings = NULL;
 	const unsigned int before_len = strlen(before);
 	unsigned int prev = UINT_MAX - 1;
-	const struct nlattr *bits;
-	const struct nlattr *bit;
 	bool first = true;
-	bool nomask;
+	unsigned int idx;
 	int ret;
 
-	ret = mnl_attr_parse_nested(bitset, attr_cb, &bitset_tb_info);
-	if (ret < 0)
-		goto err_nonl;
-
-	nomask = bitset_tb[ETHTOOL_A_BITSET_NOMASK];
 	/* Trying to print the mask of a "no mask" bitset doesn't make sense */
-	if (mask && nomask) {
-		ret = -EFAULT;
-		goto err_nonl;
+	if (mask && modes->nomask) {
+		fflush(stdout);
+		fprintf(stderr, "malformed netlink message (link_modes)\n");
+		return -EFAULT;
 	}
-
-	bits = bitset_tb[ETHTOOL_A_BITSET_BITS];
-
-	if (!bits) {
-		const struct stringset *lm_strings;
-		unsigned int count;
-		unsigned int idx;
-		const char *name;
-
+	if (!modes->names) {
 		ret = netlink_init_ethnl2_socket(nlctx);
 		if (ret < 0)
-			goto err_nonl;
+			return ret;
 		lm_strings = global_stringset(ETH_SS_LINK_MODES,
 					      nlctx->ethnl2_socket);
-		bits = mask ? bitset_tb[ETHTOOL_A_BITSET_MASK] :
-			      bitset_tb[ETHTOOL_A_BITSET_VALUE];
-		ret = -EFAULT;
-		if (!bits || !bitset_tb[ETHTOOL_A_BITSET_SIZE])
-			goto err_nonl;
-		count = mnl_attr_get_u32(bitset_tb[ETHTOOL_A_BITSET_SIZE]);
-		if (mnl_attr_get_payload_len(bits) / 4 < (count + 31) / 32)
-			goto err_nonl;
-
-		printf("\t%s", before);
-		for (idx = 0; idx < count; idx++) {
-			const uint32_t *raw_data = mnl_attr_get_payload(bits);
-			char buff[14];
-
-			if (!(raw_data[idx / 32] & (1U << (idx % 32))))
-				continue;
-			if (!lm_class_match(idx, class))
-				continue;
-			name = get_string(lm_strings, idx);
-			if (!name) {
-				snprintf(buff, sizeof(buff), "BIT%u", idx);
-				name = buff;
-			}
-			if (first)
-				first = false;
-			/* ugly hack to preserve old output format */
-			if (class == LM_CLASS_REAL && (idx == prev + 1) &&
-			    prev < link_modes_count &&
-			    link_modes[prev].class == LM_CLASS_REAL &&
-			    link_modes[prev].duplex == DUPLEX_HALF)
-				putchar(' ');
-			else if (between)
-				printf("\t%s", between);
-			else
-				printf("\n\t%*s", before_len, "");
-			printf("%s", name);
-			prev = idx;
-		}
-		goto after;
 	}
 
 	printf("\t%s", before);
-	mnl_attr_for_each_nested(bit, bits) {
-		const struct nlattr *tb[ETHTOOL_A_BITSET_BIT_MAX + 1] = {};
-		DECLARE_ATTR_TB_INFO(tb);
-		unsigned int idx;
+	bitset_for_each_set(idx, modes, mask) {
 		const char *name;
+		char buff[14];
 
-		if (mnl_attr_get_type(bit) != ETHTOOL_A_BITSET_BITS_BIT)
-			continue;
-		ret = mnl_attr_parse_nested(bit, attr_cb, &tb_info);
-		if (ret < 0)
-			goto err;
-		ret = -EFAULT;
-		if (!tb[ETHTOOL_A_BITSET_BIT_INDEX] ||
-		    !tb[ETHTOOL_A_BITSET_BIT_NAME])
-			goto err;
-		if (!mask && !nomask && !tb[ETHTOOL_A_BITSET_BIT_VALUE])
-			continue;
-
-		idx = mnl_attr_get_u32(tb[ETHTOOL_A_BITSET_BIT_INDEX]);
-		name = mnl_attr_get_str(tb[ETHTOOL_A_BITSET_BIT_NAME]);
 		if (!lm_class_match(idx, class))
 			continue;
+		name = modes->names ? modes->names[idx] :
+				      get_string(lm_strings, idx);
+		if (!name) {
+			snprintf(buff, sizeof(buff), "BIT%u", idx);
+			name = buff;
+		}
 		if (first) {
 			first = false;
 		} else {
@@ -341,100 +273,102 @@ int dump_link_modes(struct nl_context *nlctx, const struct nlattr *bitset,
 		printf("%s", name);
 		prev = idx;
 	}
-after:
 	if (first && if_none)
 		printf("%s", if_none);
 	printf("%s", after);
 
 	return 0;
-err:
-	putchar('\n');
-err_nonl:
-	fflush(stdout);
-	fprintf(stderr, "malformed netlink message (link_modes)\n");
-	return ret;
 }
 
 static int dump_our_modes(struct nl_context *nlctx, const struct nlattr *attr)
 {
-	bool autoneg;
+	struct nl_bitset modes;
 	int ret;
 
+	ret = bitset_decode(&modes, attr);
+	if (ret < 0) {
+		fprintf(stderr, "malformed netlink message (link_modes)\n");
+		return ret;
+	}
+
 	print_banner(nlctx);
-	ret = dump_link_modes(nlctx, attr, true, LM_CLASS_PORT,
+	ret = dump_link_modes(nlctx, &modes, true, LM_CLASS_PORT,
 			      "Supported ports: [ ", " ", " ]\n", NULL);
 	if (ret < 0)
-		return ret;
+		goto out;
 
-	ret = dump_link_modes(nlctx, attr, true, LM_CLASS_REAL,
+	ret = dump_link_modes(nlctx, &modes, true, LM_CLASS_REAL,
 			      "Supported link modes:   ", NULL, "\n",
 			      "Not reported");
 	if (ret < 0)
-		return ret;
-	ret = dump_pause(attr, true, "Supported pause frame use: ");
+		goto out;
+	ret = dump_pause(&modes, true, "Supported pause frame use: ");
 	if (ret < 0)
-		return ret;
+		goto out;
 
-	autoneg = bitset_get_bit(attr, true, ETHTOOL_LINK_MODE_Autoneg_BIT,
-				 &ret);
-	if (ret < 0)
-		return ret;
-	printf("\tSupports auto-negotiation: %s\n", autoneg ? "Yes" : "No");
+	printf("\tSupports auto-negotiation: %s\n",
+	       bitset_test(&modes, true, ETHTOOL_LINK_MODE_Autoneg_BIT) ?
+	       "Yes" : "No");
 
-	ret = dump_link_modes(nlctx, attr, true, LM_CLASS_FEC,
+	ret = dump_link_modes(nlctx, &modes, true, LM_CLASS_FEC,
 			      "Supported FEC modes: ", " ", "\n",
 			      "Not reported");
 	if (ret < 0)
-		return ret;
+		goto out;
 
-	ret = dump_link_modes(nlctx, attr, false, LM_CLASS_REAL,
+	ret = dump_link_modes(nlctx, &modes, false, LM_CLASS_REAL,
 			      "Advertised link modes:  ", NULL, "\n",
 			      "Not reported");
 	if (ret < 0)
-		return ret;
+		goto out;
 
-	ret = dump_pause(attr, false, "Advertised pause frame use: ");
-	if (ret < 0)
-		return ret;
-	autoneg = bitset_get_bit(attr, false, ETHTOOL_LINK_MODE_Autoneg_BIT,
-				 &ret);
+	ret = dump_pause(&modes, false, "Advertised pause frame use: ");
 	if (ret < 0)
-		return ret;
-	printf("\tAdvertised auto-negotiation: %s\n", autoneg ? "Yes" : "No");
+		goto out;
+	printf("\tAdvertised auto-negotiation: %s\n",
+	       bitset_test(&modes, false, ETHTOOL_LINK_MODE_Autoneg_BIT) ?
+	       "Yes" : "No");
 
-	ret = dump_link_modes(nlctx, attr, false, LM_CLASS_FEC,
+	ret = dump_link_modes(nlctx, &modes, false, LM_CLASS_FEC,
 			      "Advertised FEC modes: ", " ", "\n",
 			      "Not reported");
+out:
+	bitset_release(&modes);
 	return ret;
 }
 
 static int dump_peer_modes(struct nl_context *nlctx, const struct nlattr *attr)
 {
-	bool autoneg;
+	struct nl_bitset modes;
 	int ret;
 
+	ret = bitset_decode(&modes, attr);
+	if (ret < 0) {
+		fprintf(stderr, "malformed netlink message (link_modes)\n");
+		return ret;
+	}
+
 	print_banner(nlctx);
-	ret = dump_link_modes(nlctx, attr, false, LM_CLASS_REAL,
+	ret = dump_link_modes(nlctx, &modes, false, LM_CLASS_REAL,
 			      "Link partner advertised link modes:  ",
 			      NULL, "\n", "Not reported");
 	if (ret < 0)
-		return ret;
+		goto out;
 
-	ret = dump_pause(attr, false,
+	ret = dump_pause(&modes, false,
 			 "Link partner advertised pause frame use: ");
 	if (ret < 0)
-		return ret;
+		goto out;
 
-	autoneg = bitset_get_bit(attr, false,
-				 ETHTOOL_LINK_MODE_Autoneg_BIT, &ret);
-	if (ret < 0)
-		return ret;
 	printf("\tLink partner advertised auto-negotiation: %s\n",
-	       autoneg ? "Yes" : "No");
+	       bitset_test(&modes, false, ETHTOOL_LINK_MODE_Autoneg_BIT) ?
+	       "Yes" : "No");
 
-	ret = dump_link_modes(nlctx, attr, false, LM_CLASS_FEC,
+	ret = dump_link_modes(nlctx, &modes, false, LM_CLASS_FEC,
 			      "Link partner advertised FEC modes: ",
 			      " ", "\n", "Not reported");
+out:
+	bitset_release(&modes);
 	return ret;
 }
 
@@ -680,6 +614,22 @@ static const char *link_ext_substate_get(uint8_t link_ext_state_val, uint8_t lin
 	}
 }
 
+/* name of extended link state or null if unknown */
+const char *link_ext_state_name(uint8_t link_ext_state_val)
+{
+	return get_enum_string(names_link_ext_state,
+			       ARRAY_SIZE(names_link_ext_state),
+			       link_ext_state_val);
+}
+
+/* name of extended link substate or null if unknown */
+const char *link_ext_substate_name(uint8_t link_ext_state_val,
+				   uint8_t link_ext_substate_val)
+{
+	return link_ext_substate_get(link_ext_state_val,
+				     link_ext_substate_val);
+}
+
 static void linkstate_link_ext_substate_print(const struct nlattr *tb[],
 					      uint8_t link_ext_state_val)
 {
@@ -872,11 +822,11 @@ int debug_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 }
 
 static int gset_request(struct nl_socket *nlsk, uint8_t msg_type,
-			uint16_t hdr_attr, mnl_cb_t cb)
+			uint16_t hdr_attr, u32 flags, mnl_cb_t cb)
 {
 	int ret;
 
-	ret = nlsock_prep_get_request(nlsk, msg_type, hdr_attr, 0);
+	ret = nlsock_prep_get_request(nlsk, msg_type, hdr_attr, flags);
 	if (ret < 0)
 		return ret;
 	return nlsock_send_get_request(nlsk, cb);
@@ -886,6 +836,7 @@ int nl_gset(struct cmd_context *ctx)
 {
 	struct nl_context *nlctx = ctx->nlctx;
 	struct nl_socket *nlsk = nlctx->ethnl_socket;
+	u32 flags;
 	int ret;
 
 	if (netlink_cmd_check(ctx, ETHTOOL_MSG_LINKMODES_GET, true) ||
@@ -895,30 +846,32 @@ int nl_gset(struct cmd_context *ctx)
 	    netlink_cmd_check(ctx, ETHTOOL_MSG_LINKSTATE_GET, true))
 		return -EOPNOTSUPP;
 
+	flags = get_bitset_flags(nlctx, STRSET_BIT(ETH_SS_LINK_MODES) |
+					STRSET_BIT(ETH_SS_MSG_CLASSES), 0);
 	nlctx->suppress_nlerr = 1;
 
 	ret = gset_request(nlsk, ETHTOOL_MSG_LINKMODES_GET,
-			   ETHTOOL_A_LINKMODES_HEADER, linkmodes_reply_cb);
+			   ETHTOOL_A_LINKMODES_HEADER, flags, linkmodes_reply_cb);
 	if (ret == -ENODEV)
 		return ret;
 
 	ret = gset_request(nlsk, ETHTOOL_MSG_LINKINFO_GET,
-			   ETHTOOL_A_LINKINFO_HEADER, linkinfo_reply_cb);
+			   ETHTOOL_A_LINKINFO_HEADER, 0, linkinfo_reply_cb);
 	if (ret == -ENODEV)
 		return ret;
 
 	ret = gset_request(nlsk, ETHTOOL_MSG_WOL_GET, ETHTOOL_A_WOL_HEADER,
-			   wol_reply_cb);
+			   ETHTOOL_FLAG_COMPACT_BITSETS, wol_reply_cb);
 	if (ret == -ENODEV)
 		return ret;
 
 	ret = gset_request(nlsk, ETHTOOL_MSG_DEBUG_GET, ETHTOOL_A_DEBUG_HEADER,
-			   debug_reply_cb);
+			   flags, debug_reply_cb);
 	if (ret == -ENODEV)
 		return ret;
 
 	ret = gset_request(nlsk, ETHTOOL_MSG_LINKSTATE_GET,
-			   ETHTOOL_A_LINKSTATE_HEADER, linkstate_reply_cb);
+			   ETHTOOL_A_LINKSTATE_HEADER, 0, linkstate_reply_cb);
 	if (ret == -ENODEV)
 		return ret;
 
@@ -1254,10 +1207,8 @@ int nl_sset(struct cmd_context *ctx)
 	}
 
 out_free:
-	for (i = 0; i < SSET_MAX_MSGS && msgbuffs[i]; i++) {
+	for (i = 0; i < SSET_MAX_MSGS && msgbuffs[i]; i++)
 		msgbuff_done(msgbuffs[i]);
-		free(msgbuffs[i]);
-	}
 	if (ret >= 0)
 		return ret;
 	return nlctx->exit_code ?: 75;
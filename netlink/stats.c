@@ -165,7 +165,7 @@ err_close_grp:
 	return 1;
 }
 
-static int stats_reply_cb(const struct nlmsghdr *nlhdr, void *data)
+int stats_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 {
 	const struct nlattr *tb[ETHTOOL_A_STATS_MAX + 1] = {};
 	DECLARE_ATTR_TB_INFO(tb);
@@ -215,6 +215,12 @@ err_close_dev:
 	return err_ret;
 }
 
+/* standard stats names and names of statistics in all groups */
+#define STATS_STRSETS \
+	(STRSET_BIT(ETH_SS_STATS_STD) | STRSET_BIT(ETH_SS_STATS_ETH_PHY) | \
+	 STRSET_BIT(ETH_SS_STATS_ETH_MAC) | STRSET_BIT(ETH_SS_STATS_ETH_CTRL) | \
+	 STRSET_BIT(ETH_SS_STATS_RMON))
+
 static const struct bitset_parser_data stats_parser_data = {
 	.no_mask	= true,
 	.force_hex	= false,
@@ -292,6 +298,7 @@ int nl_gstats(struct cmd_context *ctx)
 	struct nl_socket *nlsk = nlctx->ethnl_socket;
 	int ret;
 
+	preload_cmd_strings(nlctx, STATS_STRSETS, 0);
 	ret = nlsock_prep_get_request(nlsk, ETHTOOL_MSG_STATS_GET,
 				      ETHTOOL_A_STATS_HEADER, 0);
 	if (ret < 0)
@@ -1,52 +1,67 @@
 /*
  * strset.c - string set handling
  *
- * Implementation of local cache of ethtool string sets.
+ * Implementation of local cache of ethtool string sets. All cache data are
+ * allocated from the arena of netlink context so that the cache must be
+ * cleaned up (cleanup_all_strings()) before the arena is released.
  */
 
 #include <errno.h>
 #include <string.h>
 
 #include "../internal.h"
+#include "../strcache.h"
 #include "netlink.h"
 #include "nlsock.h"
 #include "msgbuff.h"
+#include "strset.h"
 
 struct stringset {
 	const char		**strings;
-	void			*raw_data;
 	unsigned int		count;
 	bool			loaded;
 };
 
+/* Per device sets are looked up by ifindex when imported and by name when
+ * used; after a wildcard dump there is one entry for each device.
+ */
+#define PERDEV_HASH_SIZE	1024
+
 struct perdev_strings {
 	int			ifindex;
 	char			devname[ALTIFNAMSIZ];
 	struct stringset	strings[ETH_SS_COUNT];
-	struct perdev_strings	*next;
+	struct perdev_strings	*next;		/* ifindex hash chain */
+	struct perdev_strings	*name_next;	/* name hash chain */
+	bool			named;		/* in name hash */
 };
 
 /* universal string sets */
 static struct stringset global_strings[ETH_SS_COUNT];
-/* linked list of string sets related to network devices */
-static struct perdev_strings *device_strings;
+/* string sets related to network devices */
+static struct perdev_strings *perdev_by_ifindex[PERDEV_HASH_SIZE];
+static struct perdev_strings *perdev_by_name[PERDEV_HASH_SIZE];
+/* per device sets fetched for all devices at once */
+static uint32_t perdev_dumped_sets;
 
+/* memory is left to the arena, only forget the set */
 static void drop_stringset(struct stringset *set)
 {
 	if (!set)
 		return;
 
-	free(set->strings);
-	free(set->raw_data);
 	memset(set, 0, sizeof(*set));
 }
 
-static int import_stringset(struct stringset *dest, const struct nlattr *nest)
+/* Strings are not copied, the pointers point into the message; the caller
+ * must make sure the receive slot is not reused (nlsock_keep_reply()).
+ */
+static int import_stringset(struct nl_arena *arena, struct stringset *dest,
+			    const struct nlattr *nest)
 {
 	const struct nlattr *tb_stringset[ETHTOOL_A_STRINGSET_MAX + 1] = {};
 	DECLARE_ATTR_TB_INFO(tb_stringset);
 	const struct nlattr *string;
-	unsigned int size;
 	unsigned int count;
 	unsigned int idx;
 	int ret;
@@ -68,19 +83,14 @@ static int import_stringset(struct stringset *dest, const struct nlattr *nest)
 	if (count == 0)
 		return 0;
 
-	size = mnl_attr_get_len(tb_stringset[ETHTOOL_A_STRINGSET_STRINGS]);
 	ret = -ENOMEM;
-	dest[idx].raw_data = malloc(size);
-	if (!dest[idx].raw_data)
-		goto err;
-	memcpy(dest[idx].raw_data, tb_stringset[ETHTOOL_A_STRINGSET_STRINGS],
-	       size);
-	dest[idx].strings = calloc(count, sizeof(dest[idx].strings[0]));
+	dest[idx].strings = arena_zalloc(arena,
+					 count * sizeof(dest[idx].strings[0]));
 	if (!dest[idx].strings)
 		goto err;
 	dest[idx].count = count;
 
-	nest = dest[idx].raw_data;
+	nest = tb_stringset[ETHTOOL_A_STRINGSET_STRINGS];
 	mnl_attr_for_each_nested(string, nest) {
 		const struct nlattr *tb[ETHTOOL_A_STRING_MAX + 1] = {};
 		DECLARE_ATTR_TB_INFO(tb);
@@ -108,31 +118,87 @@ err:
 	return ret;
 }
 
-static struct perdev_strings *get_perdev_by_ifindex(int ifindex)
+static unsigned int perdev_name_hash(const char *devname)
 {
-	struct perdev_strings *perdev = device_strings;
+	unsigned int hash = 0;
+
+	while (*devname)
+		hash = hash * 31 + (unsigned char)*devname++;
+	return hash % PERDEV_HASH_SIZE;
+}
+
+static struct perdev_strings *get_perdev_by_ifindex(struct nl_arena *arena,
+						    int ifindex)
+{
+	struct perdev_strings **head;
+	struct perdev_strings *perdev;
 
-	while (perdev && perdev->ifindex != ifindex)
-		perdev = perdev->next;
-	if (perdev)
-		return perdev;
+	head = &perdev_by_ifindex[(unsigned int)ifindex % PERDEV_HASH_SIZE];
+	for (perdev = *head; perdev; perdev = perdev->next)
+		if (perdev->ifindex == ifindex)
+			return perdev;
 
-	/* not found, allocate and insert into list */
-	perdev = calloc(sizeof(*perdev), 1);
+	/* not found, allocate and insert into hash */
+	perdev = arena_zalloc(arena, sizeof(*perdev));
 	if (!perdev)
 		return NULL;
 	perdev->ifindex = ifindex;
-	perdev->next = device_strings;
-	device_strings = perdev;
+	perdev->next = *head;
+	*head = perdev;
 
 	return perdev;
 }
 
+static struct perdev_strings *get_perdev_by_name(const char *devname)
+{
+	struct perdev_strings *perdev;
+
+	perdev = perdev_by_name[perdev_name_hash(devname)];
+	for (; perdev; perdev = perdev->name_next)
+		if (!strcmp(perdev->devname, devname))
+			return perdev;
+
+	return NULL;
+}
+
+/* set (or update after rename) device name of an entry */
+static void set_perdev_name(struct perdev_strings *perdev, const char *devname)
+{
+	struct perdev_strings **pos;
+
+	if (perdev->named) {
+		if (!strcmp(perdev->devname, devname))
+			return;
+		pos = &perdev_by_name[perdev_name_hash(perdev->devname)];
+		while (*pos != perdev)
+			pos = &(*pos)->name_next;
+		*pos = perdev->name_next;
+	}
+	snprintf(perdev->devname, sizeof(perdev->devname), "%s", devname);
+	pos = &perdev_by_name[perdev_name_hash(perdev->devname)];
+	perdev->name_next = *pos;
+	*pos = perdev;
+	perdev->named = true;
+}
+
+static unsigned int stringset_get_id(const struct nlattr *nest)
+{
+	const struct nlattr *attr;
+
+	mnl_attr_for_each_nested(attr, nest) {
+		if (mnl_attr_get_type(attr) == ETHTOOL_A_STRINGSET_ID)
+			return mnl_attr_get_u32(attr);
+	}
+
+	return ETH_SS_COUNT;
+}
+
 static int strset_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 {
 	const struct nlattr *tb[ETHTOOL_A_STRSET_MAX + 1] = {};
 	DECLARE_ATTR_TB_INFO(tb);
-	struct nl_context *nlctx = data;
+	struct nl_socket *nlsk = data;
+	struct nl_context *nlctx = nlsk->nlctx;
 	char devname[ALTIFNAMSIZ] = "";
 	struct stringset *dest;
 	struct nlattr *attr;
@@ -155,10 +221,10 @@ static int strset_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 	if (ifindex) {
 		struct perdev_strings *perdev;
 
-		perdev = get_perdev_by_ifindex(ifindex);
+		perdev = get_perdev_by_ifindex(&nlctx->arena, ifindex);
 		if (!perdev)
 			return MNL_CB_OK;
-		copy_devname(perdev->devname, devname);
+		set_perdev_name(perdev, devname);
 		dest = perdev->strings;
 	} else {
 		dest = global_strings;
@@ -166,15 +232,143 @@ static int strset_reply_cb(const struct nlmsghdr *nlhdr, void *data)
 
 	if (!tb[ETHTOOL_A_STRSET_STRINGSETS])
 		return MNL_CB_OK;
+	/* imported strings point into the message */
+	nlsock_keep_reply(nlsk);
 	mnl_attr_for_each_nested(attr, tb[ETHTOOL_A_STRSET_STRINGSETS]) {
-		if (mnl_attr_get_type(attr) ==
+		unsigned int id;
+
+		if (mnl_attr_get_type(attr) !=
 		    ETHTOOL_A_STRINGSETS_STRINGSET)
-			import_stringset(dest, attr);
+			continue;
+		/* global sets come with device replies as well, keep only
+		 * one copy of them
+		 */
+		id = stringset_get_id(attr);
+		if (id < ETH_SS_COUNT &&
+		    !(STRSET_BIT(id) & STRSET_PERDEV_SETS))
+			import_stringset(&nlctx->arena, global_strings, attr);
+		else
+			import_stringset(&nlctx->arena, dest, attr);
 	}
 
 	return MNL_CB_OK;
 }
 
+/* per device sets which can be kept in the on-disk cache (see strcache.c) */
+#define STRSET_CACHED_SETS \
+	(STRSET_BIT(ETH_SS_TEST) | STRSET_BIT(ETH_SS_STATS) | \
+	 STRSET_BIT(ETH_SS_PRIV_FLAGS))
+
+static int import_cached_stringset(struct nl_arena *arena,
+				   struct stringset *dest,
+				   const struct ethtool_gstrings *gstrings)
+{
+	size_t size = (size_t)gstrings->len * ETH_GSTRING_LEN;
+	char *data;
+	unsigned int i;
+
+	data = arena_alloc(arena, size);
+	dest->strings = arena_alloc(arena,
+				    gstrings->len * sizeof(dest->strings[0]));
+	if (!data || !dest->strings)
+		return -ENOMEM;
+	memcpy(data, gstrings->data, size);
+	for (i = 0; i < gstrings->len; i++) {
+		char *s = data + i * ETH_GSTRING_LEN;
+
+		s[ETH_GSTRING_LEN - 1] = '\0';
+		dest->strings[i] = s;
+	}
+	dest->count = gstrings->len;
+	dest->loaded = true;
+
+	return 0;
+}
+
+/* Look up per device sets in the on-disk cache; keys for sets which could
+ * be cached but were not found are left in @keys (with nonzero len) so that
+ * strcache_update_sets() can store them once fetched from kernel. Returns
+ * mask of sets found in the cache.
+ */
+static uint32_t strcache_lookup_sets(struct nl_context *nlctx,
+				     const char *devname, uint32_t sets,
+				     struct strcache_key *keys)
+{
+	struct nl_arena *arena = &nlctx->arena;
+	struct ethtool_drvinfo drvinfo;
+	struct perdev_strings *perdev;
+	uint32_t found = 0;
+	unsigned int type;
+	int ifindex;
+	int ret;
+
+	memset(keys, '\0', ETH_SS_COUNT * sizeof(keys[0]));
+	sets &= STRSET_CACHED_SETS;
+	/* recorded sessions must be self contained */
+	if (nlctx->record || nlctx->replay)
+		return 0;
+	if (!sets || !strcache_enabled() ||
+	    strcache_get_drvinfo(devname, &drvinfo) < 0)
+		return 0;
+	ifindex = if_nametoindex(devname);
+	if (!ifindex)
+		return 0;
+
+	for (type = 0; type < ETH_SS_COUNT; type++) {
+		struct ethtool_gstrings *gstrings;
+
+		if (!(sets & STRSET_BIT(type)) ||
+		    strcache_key_init(&keys[type], &drvinfo, type) < 0)
+			continue;
+		gstrings = strcache_load(&keys[type]);
+		if (!gstrings)
+			continue;
+		perdev = get_perdev_by_ifindex(arena, ifindex);
+		ret = perdev ? import_cached_stringset(arena,
+						       &perdev->strings[type],
+						       gstrings) : -ENOMEM;
+		free(gstrings);
+		if (ret < 0)
+			continue;
+		if (!perdev->named)
+			set_perdev_name(perdev, devname);
+		keys[type].len = 0;
+		found |= STRSET_BIT(type);
+	}
+
+	return found;
+}
+
+static void strcache_update_sets(const char *devname,
+				 const struct strcache_key *keys)
+{
+	const struct perdev_strings *p = get_perdev_by_name(devname);
+	struct ethtool_gstrings *gstrings;
+	unsigned int type;
+	unsigned int i;
+
+	for (type = 0; p && type < ETH_SS_COUNT; type++) {
+		const struct stringset *set = &p->strings[type];
+
+		if (!keys[type].len || !set->loaded ||
+		    set->count != keys[type].len)
+			continue;
+		gstrings = calloc(1, sizeof(*gstrings) +
+				     set->count * ETH_GSTRING_LEN);
+		if (!gstrings)
+			return;
+		gstrings->string_set = type;
+		gstrings->len = set->count;
+		for (i = 0; i < set->count; i++)
+			if (set->strings[i])
+				strncpy((char *)gstrings->data +
+					i * ETH_GSTRING_LEN, set->strings[i],
+					ETH_GSTRING_LEN - 1);
+		strcache_store(&keys[type], gstrings);
+		free(gstrings);
+	}
+}
+
 static int fill_stringset_id(struct nl_msg_buff *msgbuff, unsigned int type)
 {
 	struct nlattr *nest_sets;
@@ -197,6 +391,47 @@ err:
 	return -EMSGSIZE;
 }
 
+static int fill_stringset_ids(struct nl_msg_buff *msgbuff, uint32_t sets)
+{
+	struct nlattr *nest_sets;
+	struct nlattr *nest_set;
+	unsigned int type;
+
+	nest_sets = ethnla_nest_start(msgbuff, ETHTOOL_A_STRSET_STRINGSETS);
+	if (!nest_sets)
+		return -EMSGSIZE;
+	for (type = 0; type < ETH_SS_COUNT; type++) {
+		if (!(sets & STRSET_BIT(type)))
+			continue;
+		nest_set = ethnla_nest_start(msgbuff,
+					     ETHTOOL_A_STRINGSETS_STRINGSET);
+		if (!nest_set)
+			goto err;
+		if (ethnla_put_u32(msgbuff, ETHTOOL_A_STRINGSET_ID, type))
+			goto err;
+		ethnla_nest_end(msgbuff, nest_set);
+	}
+	ethnla_nest_end(msgbuff, nest_sets);
+	return 0;
+
+err:
+	ethnla_nest_cancel(msgbuff, nest_sets);
+	return -EMSGSIZE;
+}
+
+/* like nlsock_send_get_request() but strset_reply_cb() needs the socket and
+ * errors are returned as negative error codes
+ */
+static int strset_send_request(struct nl_socket *nlsk)
+{
+	int ret;
+
+	ret = nlsock_sendmsg(nlsk, NULL);
+	if (ret < 0)
+		return ret;
+	return nlsock_process_reply(nlsk, strset_reply_cb, nlsk);
+}
+
 static int stringset_load_request(struct nl_socket *nlsk, const char *devname,
 				  int type, bool is_dump)
 {
@@ -215,7 +450,43 @@ static int stringset_load_request(struct nl_socket *nlsk, const char *devname,
 			return ret;
 	}
 
-	ret = nlsock_send_get_request(nlsk, strset_reply_cb);
+	return strset_send_request(nlsk);
+}
+
+static int stringsets_load_request(struct nl_socket *nlsk, const char *devname,
+				   uint32_t sets, bool is_dump)
+{
+	struct nl_msg_buff *msgbuff = &nlsk->msgbuff;
+	unsigned int type;
+	int ret;
+
+	ret = msg_init(nlsk->nlctx, msgbuff, ETHTOOL_MSG_STRSET_GET,
+		       NLM_F_REQUEST | NLM_F_ACK | (is_dump ? NLM_F_DUMP : 0));
+	if (ret < 0)
+		return ret;
+	if (ethnla_fill_header(msgbuff, ETHTOOL_A_STRSET_HEADER, devname, 0))
+		return -EMSGSIZE;
+	ret = fill_stringset_ids(msgbuff, sets);
+	if (ret < 0)
+		return ret;
+	ret = strset_send_request(nlsk);
+	if (ret >= 0 || !(sets & (sets - 1)))
+		return ret;
+
+	/* A kernel not knowing one of the sets rejects the whole request, load
+	 * them one by one so that at least the known ones are available.
+	 */
+	ret = 0;
+	for (type = 0; type < ETH_SS_COUNT; type++) {
+		int err;
+
+		if (!(sets & STRSET_BIT(type)))
+			continue;
+		err = stringset_load_request(nlsk, devname, type, is_dump);
+		if (err < 0 && !ret)
+			ret = err;
+	}
+
 	return ret;
 }
 
@@ -224,36 +495,103 @@ static int stringset_load_request(struct nl_socket *nlsk, const char *devname,
 const struct stringset *global_stringset(unsigned int type,
 					 struct nl_socket *nlsk)
 {
-	int ret;
-
 	if (type >= ETH_SS_COUNT)
 		return NULL;
-	if (global_strings[type].loaded)
+	if (global_strings[type].loaded || !nlsk)
 		return &global_strings[type];
-	ret = stringset_load_request(nlsk, NULL, type, false);
-	return ret < 0 ? NULL : &global_strings[type];
+	/* set unknown to the kernel stays empty */
+	stringset_load_request(nlsk, NULL, type, false);
+	return &global_strings[type];
 }
 
 const struct stringset *perdev_stringset(const char *devname, unsigned int type,
 					 struct nl_socket *nlsk)
 {
+	struct strcache_key keys[ETH_SS_COUNT];
 	const struct perdev_strings *p;
-	int ret;
 
 	if (type >= ETH_SS_COUNT)
 		return NULL;
-	for (p = device_strings; p; p = p->next)
-		if (!strcmp(p->devname, devname))
-			return &p->strings[type];
-
-	ret = stringset_load_request(nlsk, devname, type, false);
-	if (ret < 0)
+	p = get_perdev_by_name(devname);
+	if ((p && p->strings[type].loaded) || !nlsk)
+		return p ? &p->strings[type] : NULL;
+	/* the device was not there when the set was fetched for all devices;
+	 * a request now would stall the dump being processed
+	 */
+	if ((perdev_dumped_sets & STRSET_BIT(type)) && nlsk->nlctx->is_dump)
 		return NULL;
-	for (p = device_strings; p; p = p->next)
-		if (!strcmp(p->devname, devname))
-			return &p->strings[type];
+	if (strcache_lookup_sets(nlsk->nlctx, devname,
+				 STRSET_BIT(type), keys))
+		goto out;
 
-	return NULL;
+	if (stringset_load_request(nlsk, devname, type, false) == 0)
+		strcache_update_sets(devname, keys);
+out:
+	p = get_perdev_by_name(devname);
+
+	return p ? &p->strings[type] : NULL;
+}
+
+/**
+ * preload_stringsets() - load string sets needed by a subcommand at once
+ * @nlsk:        netlink socket to use
+ * @devname:     device name, NULL to load per device sets for all devices
+ * @global_sets: global string sets to load (mask of STRSET_BIT(ETH_SS_*))
+ * @perdev_sets: per device string sets to load (mask of STRSET_BIT(ETH_SS_*))
+ *
+ * Subcommands call this before composing their main request so that string
+ * sets are never requested from inside a reply callback. Sets already in the
+ * cache are skipped. For a single device, all missing sets are fetched with
+ * one request; with @devname null, per device sets are fetched with one dump
+ * and global sets (if any are missing) with one additional request.
+ * Per device sets of a single device are looked up in the on-disk cache
+ * first. If the kernel rejects a request for several sets (it does so if it
+ * does not know one of them), they are requested one by one. Once per
+ * device sets were fetched for all devices, reply callbacks of a dump find
+ * them without issuing nested requests.
+ *
+ * Return: 0 on success or negative error code
+ */
+int preload_stringsets(struct nl_socket *nlsk, const char *devname,
+		       uint32_t global_sets, uint32_t perdev_sets)
+{
+	struct strcache_key keys[ETH_SS_COUNT];
+	const struct perdev_strings *p;
+	unsigned int type;
+	int ret;
+
+	for (type = 0; type < ETH_SS_COUNT; type++)
+		if (global_strings[type].loaded)
+			global_sets &= ~STRSET_BIT(type);
+	if (devname) {
+		p = get_perdev_by_name(devname);
+		for (type = 0; p && type < ETH_SS_COUNT; type++)
+			if (p->strings[type].loaded)
+				perdev_sets &= ~STRSET_BIT(type);
+		perdev_sets &= ~strcache_lookup_sets(nlsk->nlctx,
+						     devname, perdev_sets, keys);
+		if (!(global_sets | perdev_sets))
+			return 0;
+		ret = stringsets_load_request(nlsk, devname,
+					      global_sets | perdev_sets, false);
+		if (ret == 0)
+			strcache_update_sets(devname, keys);
+		return ret;
+	}
+
+	ret = 0;
+	if (global_sets)
+		ret = stringsets_load_request(nlsk, NULL, global_sets, false);
+	if (perdev_sets) {
+		int err;
+
+		err = stringsets_load_request(nlsk, NULL, perdev_sets, true);
+		if (err < 0)
+			return err;
+		perdev_dumped_sets |= perdev_sets;
+	}
+
+	return ret;
 }
 
 unsigned int get_count(const struct stringset *set)
@@ -278,20 +616,16 @@ int preload_perdev_strings(struct nl_socket *nlsk, const char *dev)
 	return stringset_load_request(nlsk, dev, -1, !dev);
 }
 
+/* Forget all cached sets, the memory itself is released with the arena of
+ * netlink context.
+ */
 void cleanup_all_strings(void)
 {
-	struct perdev_strings *perdev;
 	unsigned int i;
 
 	for (i = 0; i < ETH_SS_COUNT; i++)
 		drop_stringset(&global_strings[i]);
-
-	perdev = device_strings;
-	while (perdev) {
-		device_strings = perdev->next;
-		for (i = 0; i < ETH_SS_COUNT; i++)
-			drop_stringset(&perdev->strings[i]);
-		free(perdev);
-		perdev = device_strings;
-	}
+	memset(perdev_by_ifindex, '\0', sizeof(perdev_by_ifindex));
+	memset(perdev_by_name, '\0', sizeof(perdev_by_name));
+	perdev_dumped_sets = 0;
 }
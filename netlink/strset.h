@@ -10,6 +10,12 @@
 struct nl_socket;
 struct stringset;
 
+#define STRSET_BIT(id) (1U << (id))
+/* string sets whose contents depend on the device */
+#define STRSET_PERDEV_SETS \
+	(STRSET_BIT(ETH_SS_TEST) | STRSET_BIT(ETH_SS_STATS) | \
+	 STRSET_BIT(ETH_SS_PRIV_FLAGS) | STRSET_BIT(ETH_SS_PHY_STATS))
+
 const struct stringset *global_stringset(unsigned int type,
 					 struct nl_socket *nlsk);
 const struct stringset *perdev_stringset(const char *dev, unsigned int type,
@@ -20,6 +26,8 @@ const char *get_string(const struct stringset *set, unsigned int idx);
 
 int preload_global_strings(struct nl_socket *nlsk);
 int preload_perdev_strings(struct nl_socket *nlsk, const char *dev);
+int preload_stringsets(struct nl_socket *nlsk, const char *devname,
+		       uint32_t global_sets, uint32_t perdev_sets);
 void cleanup_all_strings(void);
 
 #endif /* ETHTOOL_NETLINK_STRSET_H__ */
@@ -0,0 +1,248 @@
+/*
+ * template.c - request templates
+ *
+ * With "*" as device name, a set request (e.g. "ethtool -G * rx 512") is
+ * applied to all devices supporting it. Command line is parsed and the
+ * request message built only once, with a placeholder device index in the
+ * request header. Devices are then enumerated by a dump of corresponding get
+ * request and for each of them only the device index (and sequence number)
+ * is rewritten before the message is sent again.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "../internal.h"
+#include "netlink.h"
+#include "msgbuff.h"
+#include "nlsock.h"
+#include "template.h"
+
+/**
+ * struct tmpl_dev - device to send the request to
+ * @ifindex: device index
+ * @name:    device name (for error messages)
+ */
+struct tmpl_dev {
+	uint32_t	ifindex;
+	char		name[ALTIFNAMSIZ];
+};
+
+/**
+ * struct tmpl_devlist - devices collected from get request dump
+ * @nlctx:        netlink context
+ * @hdr_attrtype: request header attribute type
+ * @devs:         array of devices (allocated from the arena)
+ * @n_devs:       number of devices in @devs
+ * @size:         allocated size of @devs (entries)
+ */
+struct tmpl_devlist {
+	struct nl_context	*nlctx;
+	uint16_t		hdr_attrtype;
+	struct tmpl_dev		*devs;
+	unsigned int		n_devs;
+	unsigned int		size;
+};
+
+static bool is_wildcard(const char *devname)
+{
+	return devname && !strcmp(devname, WILDCARD_DEVNAME);
+}
+
+/**
+ * tmpl_cmd_check() - check support for set request sent as template
+ * @ctx:     ethtool command context
+ * @cmd:     set request command id
+ * @get_cmd: get request used to enumerate devices
+ *
+ * Like netlink_cmd_check() but with "*" as device name, it checks that
+ * @get_cmd can be dumped and @cmd sent for a single device.
+ *
+ * Return: true if we know the netlink request is not supported
+ */
+bool tmpl_cmd_check(struct cmd_context *ctx, unsigned int cmd,
+		    unsigned int get_cmd)
+{
+	struct nl_context *nlctx = ctx->nlctx;
+
+	if (!is_wildcard(ctx->devname))
+		return netlink_cmd_check(ctx, cmd, false);
+	if (netlink_cmd_check(ctx, get_cmd, true))
+		return true;
+	if (!nlctx->ops_info)
+		return false;
+	if (cmd > ETHTOOL_MSG_USER_MAX ||
+	    !(nlctx->ops_info[cmd].op_flags & GENL_CMD_CAP_DO)) {
+		nlctx->ioctl_fallback = true;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * tmpl_msg_init() - start set request message
+ * @nlctx:        netlink context
+ * @cmd:          set request command id
+ * @hdr_attrtype: request header attribute type
+ *
+ * Initialize the message in the buffer of the ethtool socket and add request
+ * header. With "*" as device name, the header contains a placeholder device
+ * index rewritten by tmpl_send() for each device.
+ *
+ * Return: 0 on success or negative error code
+ */
+int tmpl_msg_init(struct nl_context *nlctx, unsigned int cmd,
+		  uint16_t hdr_attrtype)
+{
+	struct nl_msg_buff *msgbuff = &nlctx->ethnl_socket->msgbuff;
+	struct nlattr *nest;
+	int ret;
+
+	ret = msg_init(nlctx, msgbuff, cmd, NLM_F_REQUEST | NLM_F_ACK);
+	if (ret < 0)
+		return ret;
+	if (!is_wildcard(nlctx->devname))
+		return ethnla_fill_header(msgbuff, hdr_attrtype,
+					  nlctx->devname, 0) ? -EMSGSIZE : 0;
+
+	nest = ethnla_nest_start(msgbuff, hdr_attrtype);
+	if (!nest || ethnla_put_u32(msgbuff, ETHTOOL_A_HEADER_DEV_INDEX, 0))
+		return -EMSGSIZE;
+	ethnla_nest_end(msgbuff, nest);
+
+	return 0;
+}
+
+static int tmpl_dev_cb(const struct nlmsghdr *nlhdr, void *data)
+{
+	struct tmpl_devlist *devlist = data;
+	struct nl_context *nlctx = devlist->nlctx;
+	const struct nlattr *hdr = NULL;
+	const struct nlattr *attr;
+	struct tmpl_dev *dev;
+	unsigned int size;
+	int ifindex;
+
+	mnl_attr_for_each(attr, nlhdr, GENL_HDRLEN)
+		if (mnl_attr_get_type(attr) == devlist->hdr_attrtype) {
+			hdr = attr;
+			break;
+		}
+	if (devlist->n_devs == devlist->size) {
+		size = devlist->size ? 2 * devlist->size : 64;
+		dev = arena_realloc(&nlctx->arena, devlist->devs,
+				    devlist->size * sizeof(*dev),
+				    size * sizeof(*dev));
+		if (!dev)
+			return MNL_CB_ERROR;
+		devlist->devs = dev;
+		devlist->size = size;
+	}
+	dev = &devlist->devs[devlist->n_devs];
+	if (get_dev_info(hdr, &ifindex, dev->name) < 0)
+		return MNL_CB_OK;
+	dev->ifindex = ifindex;
+	devlist->n_devs++;
+
+	return MNL_CB_OK;
+}
+
+/* Move the request out of the socket buffer which is going to be reused for
+ * the dump and replies; return pointer to the placeholder device index.
+ */
+static uint32_t *tmpl_detach(struct nl_msg_buff *tmpl,
+			     struct nl_msg_buff *msgbuff,
+			     uint16_t hdr_attrtype)
+{
+	unsigned int len = msgbuff_len(msgbuff);
+	const struct nlattr *hdr;
+	struct nlattr *attr;
+
+	if (msgbuff_realloc(tmpl, len) < 0)
+		return NULL;
+	memcpy(tmpl->buff, msgbuff->buff, len);
+	tmpl->left = tmpl->size - len;
+	tmpl->nlhdr = (struct nlmsghdr *)tmpl->buff;
+	tmpl->genlhdr = mnl_nlmsg_get_payload(tmpl->nlhdr);
+	tmpl->payload = mnl_nlmsg_get_payload_offset(tmpl->nlhdr,
+						     GENL_HDRLEN);
+
+	/* tmpl_msg_init() put the header first, device index first in it */
+	hdr = tmpl->payload;
+	if (mnl_attr_get_type(hdr) != hdr_attrtype)
+		return NULL;
+	attr = mnl_attr_get_payload(hdr);
+	if (mnl_attr_get_type(attr) != ETHTOOL_A_HEADER_DEV_INDEX)
+		return NULL;
+
+	return mnl_attr_get_payload(attr);
+}
+
+/**
+ * tmpl_send() - send set request and process replies
+ * @nlctx:        netlink context
+ * @get_cmd:      get request used to enumerate devices
+ * @hdr_attrtype: request header attribute type (same for get and set)
+ *
+ * Send the message built in the buffer of the ethtool socket. With "*" as
+ * device name, it is sent to each device listed in a dump of @get_cmd, i.e.
+ * each device providing the information the request modifies. Failure for
+ * one device does not prevent sending the request to the others.
+ *
+ * Return: 0 on success or negative error code of (first) failed request
+ */
+int tmpl_send(struct nl_context *nlctx, unsigned int get_cmd,
+	      uint16_t hdr_attrtype)
+{
+	struct nl_socket *nlsk = nlctx->ethnl_socket;
+	struct tmpl_devlist devlist = {};
+	struct nl_msg_buff tmpl;
+	uint32_t *ifindex;
+	unsigned int i;
+	int ret;
+
+	if (!is_wildcard(nlctx->devname)) {
+		ret = nlsock_sendmsg(nlsk, NULL);
+		if (ret < 0)
+			return ret;
+		return nlsock_process_reply(nlsk, nomsg_reply_cb, nlctx);
+	}
+
+	msgbuff_init(&tmpl, &nlctx->arena);
+	ifindex = tmpl_detach(&tmpl, &nlsk->msgbuff, hdr_attrtype);
+	if (!ifindex)
+		return -EFAULT;
+
+	devlist.nlctx = nlctx;
+	devlist.hdr_attrtype = hdr_attrtype;
+	ret = nlsock_prep_get_request(nlsk, get_cmd, hdr_attrtype, 0);
+	if (ret < 0)
+		return ret;
+	ret = nlsock_sendmsg(nlsk, NULL);
+	if (ret < 0)
+		return ret;
+	ret = nlsock_process_reply(nlsk, tmpl_dev_cb, &devlist);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < devlist.n_devs; i++) {
+		int dev_ret;
+
+		*ifindex = devlist.devs[i].ifindex;
+		nlctx->devname = devlist.devs[i].name;
+		dev_ret = nlsock_sendmsg(nlsk, &tmpl);
+		if (dev_ret >= 0)
+			dev_ret = nlsock_process_reply(nlsk, nomsg_reply_cb,
+						       nlctx);
+		if (dev_ret < 0) {
+			fprintf(stderr, "ethtool (%s): request for %s failed\n",
+				nlctx->cmd, devlist.devs[i].name);
+			ret = ret ?: dev_ret;
+		}
+	}
+	nlctx->devname = WILDCARD_DEVNAME;
+
+	return ret;
+}
@@ -0,0 +1,24 @@
+/*
+ * template.h - request templates
+ *
+ * Declarations of helpers sending one prebuilt set request to multiple
+ * devices.
+ */
+
+#ifndef ETHTOOL_NETLINK_TEMPLATE_H__
+#define ETHTOOL_NETLINK_TEMPLATE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct cmd_context;
+struct nl_context;
+
+bool tmpl_cmd_check(struct cmd_context *ctx, unsigned int cmd,
+		    unsigned int get_cmd);
+int tmpl_msg_init(struct nl_context *nlctx, unsigned int cmd,
+		  uint16_t hdr_attrtype);
+int tmpl_send(struct nl_context *nlctx, unsigned int get_cmd,
+	      uint16_t hdr_attrtype);
+
+#endif /* ETHTOOL_NETLINK_TEMPLATE_H__ */
@@ -0,0 +1,426 @@
+/*
+ * trace.c - netlink request tracing
+ *
+ * Records timing and size of each netlink request and its reply into
+ * a preallocated ring, keeps per-operation latency histograms and the list of
+ * slowest devices which are printed at exit. Records can be also saved into
+ * a binary trace file. Unlike the message dumps enabled by --debug, the cost
+ * per request is only a few clock reads so that tracing can be used to find
+ * slow driver operations in production.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../internal.h"
+#include "netlink.h"
+#include "nlsock.h"
+#include "prettymsg.h"
+#include "trace.h"
+
+/* number of records kept in memory (flushed to trace file when full) */
+#define TRACE_RING_SIZE		1024
+/* distinct operations with their own histogram */
+#define TRACE_MAX_OPS		64
+/* log2 histogram buckets, bucket n holds latencies [2^(n-1), 2^n) us */
+#define TRACE_HIST_BUCKETS	32
+/* number of slowest devices reported */
+#define TRACE_SLOWEST		5
+/* width of histogram bars */
+#define TRACE_BAR_WIDTH		40
+/* request header attribute type, the same for all ethtool messages */
+#define TRACE_HEADER_ATTR	1
+
+struct trace_op {
+	uint16_t	msg_type;
+	uint8_t		cmd;
+	uint8_t		nl_fam;
+	unsigned int	count;
+	unsigned int	errors;
+	uint64_t	reply_msgs;
+	uint64_t	reply_bytes;
+	uint64_t	total_ns;
+	uint64_t	max_ns;
+	unsigned int	hist[TRACE_HIST_BUCKETS];
+};
+
+struct trace_slow_dev {
+	char			devname[IFNAMSIZ];
+	const struct trace_op	*op;
+	uint64_t		ns;
+};
+
+struct nl_trace {
+	struct nl_trace_rec	ring[TRACE_RING_SIZE];
+	unsigned int		ring_head;
+	unsigned int		ring_len;
+	uint64_t		n_requests;
+	struct trace_op		ops[TRACE_MAX_OPS];
+	unsigned int		n_ops;
+	struct trace_slow_dev	slowest[TRACE_SLOWEST];
+	FILE			*file;
+	const char		*file_name;
+};
+
+static uint64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int hist_bucket(uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	unsigned int bucket;
+
+	bucket = us ? 64 - __builtin_clzll(us) : 0;
+	return bucket < TRACE_HIST_BUCKETS ? bucket : TRACE_HIST_BUCKETS - 1;
+}
+
+/* device name from request or reply header of an ethtool message */
+static void trace_get_devname(const struct nl_context *nlctx,
+			      const struct nlmsghdr *nlhdr, char *devname)
+{
+	const struct nlattr *header, *attr;
+
+	devname[0] = '\0';
+	if (nlhdr->nlmsg_type != nlctx->ethnl_fam ||
+	    nlhdr->nlmsg_len < NLMSG_HDRLEN + GENL_HDRLEN)
+		return;
+	mnl_attr_for_each(header, nlhdr, GENL_HDRLEN) {
+		if (mnl_attr_get_type(header) != TRACE_HEADER_ATTR)
+			continue;
+		mnl_attr_for_each_nested(attr, header) {
+			if (mnl_attr_get_type(attr) != ETHTOOL_A_HEADER_DEV_NAME ||
+			    mnl_attr_validate(attr, MNL_TYPE_NUL_STRING) < 0)
+				continue;
+			snprintf(devname, IFNAMSIZ, "%s",
+				 mnl_attr_get_str(attr));
+			return;
+		}
+		return;
+	}
+}
+
+static struct trace_op *trace_find_op(struct nl_trace *trace,
+				      const struct nl_trace_rec *rec)
+{
+	struct trace_op *op;
+	unsigned int i;
+
+	for (i = 0; i < trace->n_ops; i++) {
+		op = &trace->ops[i];
+		if (op->msg_type == rec->msg_type && op->cmd == rec->cmd &&
+		    op->nl_fam == rec->nl_fam)
+			return op;
+	}
+	if (trace->n_ops == TRACE_MAX_OPS)
+		return NULL;
+
+	op = &trace->ops[trace->n_ops++];
+	op->msg_type = rec->msg_type;
+	op->cmd = rec->cmd;
+	op->nl_fam = rec->nl_fam;
+	return op;
+}
+
+static void trace_op_name(const struct nl_context *nlctx,
+			  const struct trace_op *op, char *buff, size_t size)
+{
+	if (op->nl_fam == NETLINK_GENERIC && op->msg_type == nlctx->ethnl_fam &&
+	    op->cmd < ethnl_umsg_n_desc && ethnl_umsg_desc[op->cmd].name)
+		snprintf(buff, size, "%s", ethnl_umsg_desc[op->cmd].name);
+	else if (op->nl_fam == NETLINK_GENERIC && op->msg_type == GENL_ID_CTRL)
+		snprintf(buff, size, "genl-ctrl cmd %u", op->cmd);
+	else if (op->nl_fam == NETLINK_ROUTE && op->msg_type < rtnl_msg_n_desc &&
+		 rtnl_msg_desc[op->msg_type].name)
+		snprintf(buff, size, "%s", rtnl_msg_desc[op->msg_type].name);
+	else
+		snprintf(buff, size, "family %u type %u cmd %u", op->nl_fam,
+			 op->msg_type, op->cmd);
+}
+
+/* keep the table of slowest devices sorted, one entry per device */
+static void trace_slow_device(struct nl_trace *trace, const char *devname,
+			      const struct trace_op *op, uint64_t ns)
+{
+	struct trace_slow_dev *slowest = trace->slowest;
+	unsigned int i, pos;
+
+	if (!devname[0] || ns <= slowest[TRACE_SLOWEST - 1].ns)
+		return;
+	for (i = 0; i < TRACE_SLOWEST - 1; i++)
+		if (!slowest[i].ns || !strcmp(slowest[i].devname, devname))
+			break;
+	if (slowest[i].ns && !strcmp(slowest[i].devname, devname) &&
+	    ns <= slowest[i].ns)
+		return;
+	for (pos = i; pos > 0 && slowest[pos - 1].ns < ns; pos--)
+		slowest[pos] = slowest[pos - 1];
+	snprintf(slowest[pos].devname, IFNAMSIZ, "%s", devname);
+	slowest[pos].op = op;
+	slowest[pos].ns = ns;
+}
+
+static void trace_flush(struct nl_trace *trace)
+{
+	unsigned int start, n;
+
+	if (!trace->file || !trace->ring_len)
+		return;
+	start = (trace->ring_head + TRACE_RING_SIZE - trace->ring_len) %
+		TRACE_RING_SIZE;
+	n = trace->ring_len;
+	if (start + n > TRACE_RING_SIZE) {
+		fwrite(&trace->ring[start], sizeof(trace->ring[0]),
+		       TRACE_RING_SIZE - start, trace->file);
+		n -= TRACE_RING_SIZE - start;
+		start = 0;
+	}
+	fwrite(&trace->ring[start], sizeof(trace->ring[0]), n, trace->file);
+	trace->ring_len = 0;
+}
+
+/**
+ * trace_request() - start tracing a request
+ * @nlsk:  netlink socket the request is sent to
+ * @nlhdr: the request message
+ *
+ * A request still in flight on the same socket is considered complete.
+ */
+void trace_request(struct nl_socket *nlsk, const struct nlmsghdr *nlhdr)
+{
+	struct nl_trace_rec *rec = &nlsk->trace.rec;
+	const struct genlmsghdr *ghdr;
+
+	if (nlsk->trace.pending)
+		trace_complete(nlsk, 0);
+
+	memset(rec, '\0', sizeof(*rec));
+	rec->seq = nlhdr->nlmsg_seq;
+	rec->msg_type = nlhdr->nlmsg_type;
+	rec->nl_fam = nlsk->nl_fam;
+	if (nlhdr->nlmsg_flags & NLM_F_DUMP)
+		rec->flags |= TRACE_REC_DUMP;
+	if (nlsk->nl_fam == NETLINK_GENERIC &&
+	    nlhdr->nlmsg_len >= NLMSG_HDRLEN + GENL_HDRLEN) {
+		ghdr = mnl_nlmsg_get_payload(nlhdr);
+		rec->cmd = ghdr->cmd;
+	}
+	trace_get_devname(nlsk->nlctx, nlhdr, rec->devname);
+	rec->t_send = trace_now();
+	nlsk->trace.t_last = rec->t_send;
+	nlsk->trace.pending = true;
+}
+
+/**
+ * trace_reply() - account a reply packet
+ * @nlsk: netlink socket the packet was received from
+ * @buff: packet contents
+ * @len:  packet length
+ *
+ * For dumps, the time since previous packet (i.e. the time kernel needed to
+ * fill this one) is attributed to each device with a message in the packet.
+ */
+void trace_reply(struct nl_socket *nlsk, const void *buff, unsigned int len)
+{
+	struct nl_trace *trace = nlsk->nlctx->trace;
+	struct nl_trace_req *req = &nlsk->trace;
+	const struct nlmsghdr *nlhdr = buff;
+	char devname[IFNAMSIZ];
+	struct trace_op *op;
+	int left = len;
+	uint64_t now;
+
+	if (!req->pending)
+		return;
+	now = trace_now();
+	if (!req->rec.t_first)
+		req->rec.t_first = now;
+	req->rec.reply_bytes += len;
+
+	op = (req->rec.flags & TRACE_REC_DUMP) ?
+	     trace_find_op(trace, &req->rec) : NULL;
+	while (mnl_nlmsg_ok(nlhdr, left)) {
+		if (nlhdr->nlmsg_type >= NLMSG_MIN_TYPE) {
+			req->rec.reply_msgs++;
+			if (op) {
+				trace_get_devname(nlsk->nlctx, nlhdr, devname);
+				trace_slow_device(trace, devname, op,
+						  now - req->t_last);
+			}
+		}
+		nlhdr = mnl_nlmsg_next(nlhdr, &left);
+	}
+	req->t_last = now;
+}
+
+/**
+ * trace_complete() - finish tracing current request
+ * @nlsk: netlink socket
+ * @ret:  result of the request (0 or negative error code)
+ */
+void trace_complete(struct nl_socket *nlsk, int ret)
+{
+	struct nl_trace *trace = nlsk->nlctx->trace;
+	struct nl_trace_rec *rec = &nlsk->trace.rec;
+	struct trace_op *op;
+	uint64_t ns;
+
+	if (!nlsk->trace.pending)
+		return;
+	nlsk->trace.pending = false;
+	rec->t_done = trace_now();
+	rec->error = ret < 0 ? ret : 0;
+	ns = rec->t_done - rec->t_send;
+
+	trace->n_requests++;
+	op = trace_find_op(trace, rec);
+	if (op) {
+		op->count++;
+		if (rec->error)
+			op->errors++;
+		op->reply_msgs += rec->reply_msgs;
+		op->reply_bytes += rec->reply_bytes;
+		op->total_ns += ns;
+		if (ns > op->max_ns)
+			op->max_ns = ns;
+		op->hist[hist_bucket(ns)]++;
+		if (!(rec->flags & TRACE_REC_DUMP))
+			trace_slow_device(trace, rec->devname, op, ns);
+	}
+
+	trace->ring[trace->ring_head] = *rec;
+	trace->ring_head = (trace->ring_head + 1) % TRACE_RING_SIZE;
+	if (trace->ring_len < TRACE_RING_SIZE)
+		trace->ring_len++;
+	if (trace->ring_len == TRACE_RING_SIZE)
+		trace_flush(trace);
+}
+
+static void trace_print_op(const struct nl_context *nlctx,
+			   const struct trace_op *op)
+{
+	unsigned int max_count = 0;
+	unsigned int i, bar;
+	char name[64];
+
+	trace_op_name(nlctx, op, name, sizeof(name));
+	fprintf(stderr,
+		"%s: %u requests, %u errors, %llu replies, %llu bytes, latency avg %llu us, max %llu us\n",
+		name, op->count, op->errors,
+		(unsigned long long)op->reply_msgs,
+		(unsigned long long)op->reply_bytes,
+		(unsigned long long)(op->total_ns / op->count / 1000),
+		(unsigned long long)(op->max_ns / 1000));
+
+	for (i = 0; i < TRACE_HIST_BUCKETS; i++)
+		if (op->hist[i] > max_count)
+			max_count = op->hist[i];
+	for (i = 0; i < TRACE_HIST_BUCKETS; i++) {
+		if (!op->hist[i])
+			continue;
+		if (i == 0)
+			fprintf(stderr, "    %8s    < 1 us", "");
+		else
+			fprintf(stderr, "    %8llu - %8llu us",
+				1ULL << (i - 1), (1ULL << i) - 1);
+		bar = (op->hist[i] * TRACE_BAR_WIDTH + max_count - 1) /
+		      max_count;
+		fprintf(stderr, " %6u %.*s\n", op->hist[i], bar,
+			"########################################");
+	}
+}
+
+static void trace_print_summary(const struct nl_context *nlctx)
+{
+	const struct nl_trace *trace = nlctx->trace;
+	const struct trace_slow_dev *slow;
+	unsigned int i;
+	char name[64];
+
+	fprintf(stderr, "netlink trace: %llu requests\n",
+		(unsigned long long)trace->n_requests);
+	for (i = 0; i < trace->n_ops; i++)
+		if (trace->ops[i].count)
+			trace_print_op(nlctx, &trace->ops[i]);
+
+	if (!trace->slowest[0].ns)
+		return;
+	fprintf(stderr, "slowest devices:\n");
+	for (i = 0; i < TRACE_SLOWEST && trace->slowest[i].ns; i++) {
+		slow = &trace->slowest[i];
+		trace_op_name(nlctx, slow->op, name, sizeof(name));
+		fprintf(stderr, "    %-16s %8llu us  %s\n", slow->devname,
+			(unsigned long long)(slow->ns / 1000), name);
+	}
+}
+
+/**
+ * trace_init() - set up request tracing if requested
+ * @nlctx: netlink context
+ *
+ * Tracing is enabled by DEBUG_NL_TRACE debugging flag or by --trace option
+ * which also names the binary trace file. Failure to create the file is
+ * reported but tracing continues without it.
+ *
+ * Return: 0 on success or negative error code
+ */
+int trace_init(struct nl_context *nlctx)
+{
+	const struct cmd_context *ctx = nlctx->ctx;
+	struct nl_trace_file_hdr hdr = {};
+	struct nl_trace *trace;
+
+	if (!debug_on(ctx->debug, DEBUG_NL_TRACE) && !ctx->trace_file)
+		return 0;
+	trace = calloc(1, sizeof(*trace));
+	if (!trace)
+		return -ENOMEM;
+
+	if (ctx->trace_file) {
+		trace->file = fopen(ctx->trace_file, "wb");
+		if (!trace->file) {
+			fprintf(stderr, "failed to create trace file %s: %s\n",
+				ctx->trace_file, strerror(errno));
+		} else {
+			memcpy(hdr.magic, TRACE_FILE_MAGIC, sizeof(hdr.magic));
+			hdr.version = TRACE_FILE_VERSION;
+			hdr.rec_size = sizeof(struct nl_trace_rec);
+			fwrite(&hdr, sizeof(hdr), 1, trace->file);
+			trace->file_name = ctx->trace_file;
+		}
+	}
+
+	nlctx->trace = trace;
+	return 0;
+}
+
+/**
+ * trace_done() - print trace summary and release tracing data
+ * @nlctx: netlink context
+ */
+void trace_done(struct nl_context *nlctx)
+{
+	struct nl_trace *trace = nlctx->trace;
+
+	if (!trace)
+		return;
+	trace_print_summary(nlctx);
+	if (trace->file) {
+		bool failed;
+
+		trace_flush(trace);
+		failed = ferror(trace->file);
+		if (fclose(trace->file) || failed)
+			fprintf(stderr, "failed to write trace file %s\n",
+				trace->file_name);
+	}
+	free(trace);
+	nlctx->trace = NULL;
+}
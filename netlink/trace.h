@@ -0,0 +1,92 @@
+/*
+ * trace.h - netlink request tracing
+ *
+ * Declarations of lightweight tracing of netlink requests and their replies
+ * with latency summary printed at exit.
+ */
+
+#ifndef ETHTOOL_NETLINK_TRACE_H__
+#define ETHTOOL_NETLINK_TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <net/if.h>
+#include <libmnl/libmnl.h>
+
+struct nl_context;
+struct nl_socket;
+struct nl_trace;
+
+#define TRACE_FILE_MAGIC	"ETNT"
+#define TRACE_FILE_VERSION	1
+
+/* request was a dump */
+#define TRACE_REC_DUMP		(1 << 0)
+
+/**
+ * struct nl_trace_rec - trace record of one request
+ * @t_send:      time the request was sent (ns, CLOCK_MONOTONIC)
+ * @t_first:     time the first reply packet was received (0 if none)
+ * @t_done:      time the request was completed (ACK, error or end of dump)
+ * @seq:         sequence number of the request
+ * @reply_bytes: total length of reply packets
+ * @reply_msgs:  number of reply messages (not counting ACK and NLMSG_DONE)
+ * @error:       result of the request (0 or negative error code)
+ * @msg_type:    netlink message type of the request
+ * @cmd:         genetlink command (0 for other families)
+ * @nl_fam:      netlink family (NETLINK_GENERIC or NETLINK_ROUTE)
+ * @flags:       combination of TRACE_REC_* flags
+ * @reserved:    padding, always zero
+ * @devname:     target device, empty for dumps and global requests
+ *
+ * This is also the record format of binary trace file: it consists of
+ * struct nl_trace_file_hdr followed by records in the order in which the
+ * requests completed, all in host byte order.
+ */
+struct nl_trace_rec {
+	uint64_t	t_send;
+	uint64_t	t_first;
+	uint64_t	t_done;
+	uint32_t	seq;
+	uint32_t	reply_bytes;
+	uint32_t	reply_msgs;
+	int32_t		error;
+	uint16_t	msg_type;
+	uint8_t		cmd;
+	uint8_t		nl_fam;
+	uint8_t		flags;
+	uint8_t		reserved[3];
+	char		devname[IFNAMSIZ];
+};
+
+/**
+ * struct nl_trace_file_hdr - header of binary trace file
+ * @magic:    TRACE_FILE_MAGIC (not null terminated)
+ * @version:  TRACE_FILE_VERSION
+ * @rec_size: size of one record (struct nl_trace_rec)
+ */
+struct nl_trace_file_hdr {
+	char		magic[4];
+	uint16_t	version;
+	uint16_t	rec_size;
+};
+
+/**
+ * struct nl_trace_req - request in flight on a socket
+ * @rec:     trace record being filled
+ * @t_last:  time of last reply packet (or the request)
+ * @pending: @rec describes an outstanding request
+ */
+struct nl_trace_req {
+	struct nl_trace_rec	rec;
+	uint64_t		t_last;
+	bool			pending;
+};
+
+int trace_init(struct nl_context *nlctx);
+void trace_done(struct nl_context *nlctx);
+void trace_request(struct nl_socket *nlsk, const struct nlmsghdr *nlhdr);
+void trace_reply(struct nl_socket *nlsk, const void *buff, unsigned int len);
+void trace_complete(struct nl_socket *nlsk, int ret);
+
+#endif /* ETHTOOL_NETLINK_TRACE_H__ */
@@ -218,6 +218,7 @@ int nl_gtunnels(struct cmd_context *ctx)
 {
 	struct nl_context *nlctx = ctx->nlctx;
 	struct nl_socket *nlsk = nlctx->ethnl_socket;
+	u32 flags;
 	int ret;
 
 	if (netlink_cmd_check(ctx, ETHTOOL_MSG_TUNNEL_INFO_GET, true))
@@ -228,8 +229,9 @@ int nl_gtunnels(struct cmd_context *ctx)
 		return 1;
 	}
 
+	flags = get_bitset_flags(nlctx, STRSET_BIT(ETH_SS_UDP_TUNNEL_TYPES), 0);
 	ret = nlsock_prep_get_request(nlsk, ETHTOOL_MSG_TUNNEL_INFO_GET,
-				      ETHTOOL_A_TUNNEL_INFO_HEADER, 0);
+				      ETHTOOL_A_TUNNEL_INFO_HEADER, flags);
 	if (ret < 0)
 		return ret;
 	return nlsock_send_get_request(nlsk, tunnel_info_reply_cb);
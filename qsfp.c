@@ -971,8 +971,10 @@ static int
 sff8636_memory_map_init_pages(struct cmd_context *ctx,
 			      struct sff8636_memory_map *map)
 {
+	struct ethtool_module_eeprom requests[2];
 	struct ethtool_module_eeprom request;
-	int ret;
+	int n = 0, ret;
+	bool paged;
 
 	/* Lower Memory and Page 00h are always present.
 	 *
@@ -986,24 +988,20 @@ sff8636_memory_map_init_pages(struct cmd_context *ctx,
 		return ret;
 	map->lower_memory = request.data;
 
-	sff8636_request_init(&request, 0x0, SFF8636_PAGE_SIZE);
-	ret = nl_get_eeprom_page(ctx, &request);
-	if (ret < 0)
-		return ret;
-	map->page_00h = request.data - SFF8636_PAGE_SIZE;
-
 	/* Page 03h is only present when the module memory model is paged and
-	 * not flat.
+	 * not flat. It is requested together with Page 00h.
 	 */
-	if (map->lower_memory[SFF8636_STATUS_2_OFFSET] &
-	    SFF8636_STATUS_PAGE_3_PRESENT)
-		return 0;
-
-	sff8636_request_init(&request, 0x3, SFF8636_PAGE_SIZE);
-	ret = nl_get_eeprom_page(ctx, &request);
+	paged = !(map->lower_memory[SFF8636_STATUS_2_OFFSET] &
+		  SFF8636_STATUS_PAGE_3_PRESENT);
+	sff8636_request_init(&requests[n++], 0x0, SFF8636_PAGE_SIZE);
+	if (paged)
+		sff8636_request_init(&requests[n++], 0x3, SFF8636_PAGE_SIZE);
+	ret = nl_get_eeprom_pages(ctx, requests, n);
 	if (ret < 0)
 		return ret;
-	map->page_03h = request.data - SFF8636_PAGE_SIZE;
+	map->page_00h = requests[0].data - SFF8636_PAGE_SIZE;
+	if (paged)
+		map->page_03h = requests[1].data - SFF8636_PAGE_SIZE;
 
 	return 0;
 }
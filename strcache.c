@@ -0,0 +1,289 @@
+/*
+ * strcache.c - on-disk string set cache
+ *
+ * Per-device string sets (statistics names, private flags, self-test names)
+ * are the same for all ports handled by the same driver and firmware. Keep
+ * them in files keyed by driver, driver and firmware version, bus type and
+ * set length so that they need not be transferred from the kernel on every
+ * invocation.
+ *
+ * The cache is only used if the cache directory exists; creating it is left
+ * to the administrator. Without it, no ETHTOOL_GDRVINFO or other lookup is
+ * done for the cache and string sets are fetched as before.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "internal.h"
+#include "strcache.h"
+
+#define STRCACHE_MAGIC		0x43535445	/* "ETSC" */
+#define STRCACHE_VERSION	1
+/* sanity limit, no driver comes anywhere close */
+#define STRCACHE_MAX_LEN	65536
+
+struct strcache_hdr {
+	u32			magic;
+	u32			version;
+	struct strcache_key	key;
+};
+
+static void copy_field(char *dst, const char *src, size_t size)
+{
+	size_t len = strnlen(src, size - 1);
+
+	memset(dst, '\0', size);
+	memcpy(dst, src, len);
+}
+
+/**
+ * strcache_key_init() - compose cache key for a device string set
+ * @key:     key to fill
+ * @drvinfo: driver information from ETHTOOL_GDRVINFO
+ * @set_id:  string set id (ETH_SS_*)
+ *
+ * Only string sets whose length is reported by ETHTOOL_GDRVINFO can be
+ * cached as the length is part of the key; this allows the lookup without
+ * asking the kernel for the set length separately.
+ *
+ * Return: 0 on success, -EOPNOTSUPP if the set cannot be cached
+ */
+int strcache_key_init(struct strcache_key *key,
+		      const struct ethtool_drvinfo *drvinfo, u32 set_id)
+{
+	unsigned int i;
+
+	memset(key, '\0', sizeof(*key));
+	switch (set_id) {
+	case ETH_SS_STATS:
+		key->len = drvinfo->n_stats;
+		break;
+	case ETH_SS_TEST:
+		key->len = drvinfo->testinfo_len;
+		break;
+	case ETH_SS_PRIV_FLAGS:
+		key->len = drvinfo->n_priv_flags;
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+	if (!drvinfo->driver[0] || !key->len || key->len > STRCACHE_MAX_LEN)
+		return -EOPNOTSUPP;
+
+	key->set_id = set_id;
+	copy_field(key->driver, drvinfo->driver, sizeof(key->driver));
+	copy_field(key->version, drvinfo->version, sizeof(key->version));
+	copy_field(key->fw_version, drvinfo->fw_version,
+		   sizeof(key->fw_version));
+	copy_field(key->bus_class, drvinfo->bus_info, sizeof(key->bus_class));
+	for (i = 0; key->bus_class[i]; i++)
+		if (isxdigit((unsigned char)key->bus_class[i]))
+			key->bus_class[i] = 'x';
+
+	return 0;
+}
+
+#ifndef TEST_ETHTOOL
+static const char *strcache_dir(void)
+{
+	const char *dir = getenv("ETHTOOL_CACHE_DIR");
+
+	return (dir && *dir) ? dir : STRCACHE_DIR;
+}
+
+/* FNV-1a, only used to tell files of different versions apart */
+static u32 strcache_hash(const struct strcache_key *key)
+{
+	const unsigned char *p = (const unsigned char *)key;
+	u32 hash = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < sizeof(*key); i++) {
+		hash ^= p[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static int strcache_path(const struct strcache_key *key, char *buff,
+			 size_t size)
+{
+	int len;
+
+	len = snprintf(buff, size, "%s/%.32s-%u-%08x", strcache_dir(),
+		       key->driver, key->set_id, strcache_hash(key));
+	if (len < 0 || (size_t)len >= size)
+		return -ENAMETOOLONG;
+	/* driver names should not contain one but better be safe */
+	if (strchr(buff + strlen(strcache_dir()) + 1, '/'))
+		return -EINVAL;
+
+	return 0;
+}
+
+/**
+ * strcache_enabled() - check if the cache directory is usable
+ *
+ * Checked once per process so that without a cache directory, callers can
+ * skip everything they would only do to compose a cache key.
+ *
+ * Return: true if the cache directory exists and can be searched and read
+ */
+bool strcache_enabled(void)
+{
+	static int enabled = -1;
+	struct stat st;
+
+	if (enabled < 0)
+		enabled = !stat(strcache_dir(), &st) && S_ISDIR(st.st_mode) &&
+			  !access(strcache_dir(), R_OK | X_OK);
+
+	return enabled;
+}
+
+/**
+ * strcache_get_drvinfo() - get driver information for cache lookup
+ * @devname: device name
+ * @drvinfo: buffer for ETHTOOL_GDRVINFO result
+ *
+ * Helper for code which has no ioctl socket of its own (netlink).
+ *
+ * Return: 0 on success or negative error code
+ */
+int strcache_get_drvinfo(const char *devname, struct ethtool_drvinfo *drvinfo)
+{
+	struct ifreq ifr;
+	int ret = 0;
+	int fd;
+
+	if (strlen(devname) >= IFNAMSIZ)
+		return -ENAMETOOLONG;
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -errno;
+
+	memset(&ifr, '\0', sizeof(ifr));
+	strcpy(ifr.ifr_name, devname);
+	memset(drvinfo, '\0', sizeof(*drvinfo));
+	drvinfo->cmd = ETHTOOL_GDRVINFO;
+	ifr.ifr_data = (void *)drvinfo;
+	if (ioctl(fd, SIOCETHTOOL, &ifr) < 0)
+		ret = -errno;
+	close(fd);
+
+	return ret;
+}
+
+/**
+ * strcache_load() - look up a string set in the cache
+ * @key: cache key composed by strcache_key_init()
+ *
+ * Return: string set (to be freed by caller) or null if not cached
+ */
+struct ethtool_gstrings *strcache_load(const struct strcache_key *key)
+{
+	struct ethtool_gstrings *strings = NULL;
+	size_t data_len = (size_t)key->len * ETH_GSTRING_LEN;
+	struct strcache_hdr hdr;
+	char path[PATH_MAX];
+	struct stat st;
+	int fd;
+
+	if (strcache_path(key, path, sizeof(path)) < 0)
+		return NULL;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || st.st_size != (off_t)(sizeof(hdr) + data_len))
+		goto out;
+	if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    hdr.magic != STRCACHE_MAGIC || hdr.version != STRCACHE_VERSION ||
+	    memcmp(&hdr.key, key, sizeof(*key)))
+		goto out;
+
+	strings = malloc(sizeof(*strings) + data_len);
+	if (!strings)
+		goto out;
+	if (read(fd, strings->data, data_len) != (ssize_t)data_len) {
+		free(strings);
+		strings = NULL;
+		goto out;
+	}
+	strings->cmd = ETHTOOL_GSTRINGS;
+	strings->string_set = key->set_id;
+	strings->len = key->len;
+
+out:
+	close(fd);
+	return strings;
+}
+
+/**
+ * strcache_store() - save a string set into the cache
+ * @key:     cache key composed by strcache_key_init()
+ * @strings: string set as returned by ETHTOOL_GSTRINGS
+ *
+ * The file is written under a temporary name and renamed so that concurrent
+ * readers never see a partial file. Errors are silently ignored, the cache
+ * is only an optimization.
+ */
+void strcache_store(const struct strcache_key *key,
+		    const struct ethtool_gstrings *strings)
+{
+	size_t data_len = (size_t)key->len * ETH_GSTRING_LEN;
+	struct strcache_hdr hdr;
+	char tmp_path[PATH_MAX];
+	char path[PATH_MAX];
+	bool ok;
+	int fd;
+
+	if (strings->len != key->len || strcache_path(key, path, sizeof(path)))
+		return;
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path,
+		     (int)getpid()) >= (int)sizeof(tmp_path))
+		return;
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return;
+
+	memset(&hdr, '\0', sizeof(hdr));
+	hdr.magic = STRCACHE_MAGIC;
+	hdr.version = STRCACHE_VERSION;
+	hdr.key = *key;
+	ok = write(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+	     write(fd, strings->data, data_len) == (ssize_t)data_len;
+	ok = !close(fd) && ok;
+	if (!ok || rename(tmp_path, path) < 0)
+		unlink(tmp_path);
+}
+#else
+/* keep test results independent of the state of the test machine */
+bool strcache_enabled(void)
+{
+	return false;
+}
+
+int strcache_get_drvinfo(const char *devname __maybe_unused,
+			 struct ethtool_drvinfo *drvinfo __maybe_unused)
+{
+	return -EOPNOTSUPP;
+}
+
+struct ethtool_gstrings *
+strcache_load(const struct strcache_key *key __maybe_unused)
+{
+	return NULL;
+}
+
+void strcache_store(const struct strcache_key *key __maybe_unused,
+		    const struct ethtool_gstrings *strings __maybe_unused)
+{
+}
+#endif
@@ -0,0 +1,43 @@
+/*
+ * strcache.h - on-disk string set cache
+ *
+ * Declarations of persistent cache of per-device string sets shared by ioctl
+ * and netlink code.
+ */
+
+#ifndef ETHTOOL_STRCACHE_H__
+#define ETHTOOL_STRCACHE_H__
+
+#include "internal.h"
+
+/* default cache directory, can be overridden by ETHTOOL_CACHE_DIR */
+#define STRCACHE_DIR		"/var/cache/ethtool"
+
+/**
+ * struct strcache_key - identification of a cached string set
+ * @driver:     driver name from ETHTOOL_GDRVINFO
+ * @version:    driver version from ETHTOOL_GDRVINFO
+ * @fw_version: firmware version from ETHTOOL_GDRVINFO
+ * @bus_class:  bus info with hex digits masked, e.g. "xxxx:xx:xx.x" for PCI
+ * @set_id:     string set id (ETH_SS_*)
+ * @len:        number of strings in the set
+ */
+struct strcache_key {
+	char	driver[32];
+	char	version[32];
+	char	fw_version[ETHTOOL_FWVERS_LEN];
+	char	bus_class[ETHTOOL_BUSINFO_LEN];
+	u32	set_id;
+	u32	len;
+};
+
+bool strcache_enabled(void);
+int strcache_get_drvinfo(const char *devname,
+			 struct ethtool_drvinfo *drvinfo);
+int strcache_key_init(struct strcache_key *key,
+		      const struct ethtool_drvinfo *drvinfo, u32 set_id);
+struct ethtool_gstrings *strcache_load(const struct strcache_key *key);
+void strcache_store(const struct strcache_key *key,
+		    const struct ethtool_gstrings *strings);
+
+#endif /* ETHTOOL_STRCACHE_H__ */
@@ -57,6 +57,7 @@ static void list_del(struct list_head *entry)
 /* Free memory at end of test */
 
 static struct list_head malloc_list = LIST_HEAD_INIT(malloc_list);
+unsigned long test_alloc_count;
 
 void *test_malloc(size_t size)
 {
@@ -64,6 +65,7 @@ void *test_malloc(size_t size)
 
 	if (!block)
 		return NULL;
+	test_alloc_count++;
 	list_add(block, &malloc_list);
 	return block + 1;
 }
@@ -109,6 +111,7 @@ void *test_realloc(void *ptr, size_t size)
 	block = realloc(block, sizeof(*block) + size);
 	if (!block)
 		return NULL;
+	test_alloc_count++;
 	list_add(block, &malloc_list);
 	return block + 1;
 }
@@ -291,7 +294,7 @@ int test_ioctl(const struct cmd_expect *expect, void *cmd)
 	}
 }
 
-int test_cmdline(const char *args)
+static int run_cmdline(const char *args, int out_fd)
 {
 	int volatile orig_stdout_fd = -1;
 	int volatile orig_stderr_fd = -1;
@@ -334,16 +337,18 @@ int test_cmdline(const char *args)
 
 	fflush(NULL);
 	dup2(dev_null, STDIN_FILENO);
-	if (getenv("TEST_TEST_VERBOSE")) {
-		orig_stderr = stderr;
-	} else {
+	if (out_fd >= 0 || !getenv("TEST_TEST_VERBOSE")) {
 		orig_stdout_fd = dup(STDOUT_FILENO);
 		if (orig_stdout_fd < 0) {
 			perror("dup stdout");
 			rc = -1;
 			goto out;
 		}
-		dup2(dev_null, STDOUT_FILENO);
+		dup2(out_fd >= 0 ? out_fd : dev_null, STDOUT_FILENO);
+	}
+	if (getenv("TEST_TEST_VERBOSE")) {
+		orig_stderr = stderr;
+	} else {
 		orig_stderr_fd = dup(STDERR_FILENO);
 		if (orig_stderr_fd < 0) {
 			perror("dup stderr");
@@ -383,3 +388,31 @@ out:
 	test_close_all();
 	return rc;
 }
+
+int test_cmdline(const char *args)
+{
+	return run_cmdline(args, -1);
+}
+
+/* Like test_cmdline() but standard output is stored into @buff (at most
+ * @size - 1 bytes, null terminated).
+ */
+int test_cmdline_output(const char *args, char *buff, size_t size)
+{
+	FILE *out;
+	size_t len;
+	int rc;
+
+	out = tmpfile();
+	if (!out) {
+		perror("tmpfile");
+		return -1;
+	}
+	rc = run_cmdline(args, fileno(out));
+	rewind(out);
+	len = fread(buff, 1, size - 1, out);
+	buff[len] = '\0';
+	fclose(out);
+
+	return rc;
+}
@@ -14,11 +14,17 @@
 #define TEST_NO_WRAPPERS
 #include "internal.h"
 
+/* lengths of all string sets used by ioctl code are requested at once */
 static const struct {
 	struct ethtool_sset_info cmd;
 	u32 data[1];
 }
-cmd_gssetinfo = { { ETHTOOL_GSSET_INFO, 0, 1ULL << ETH_SS_FEATURES }, { 34 } };
+cmd_gssetinfo = { { ETHTOOL_GSSET_INFO, 0,
+		    (1ULL << ETH_SS_TEST) | (1ULL << ETH_SS_STATS) |
+		    (1ULL << ETH_SS_PRIV_FLAGS) | (1ULL << ETH_SS_FEATURES) |
+		    (1ULL << ETH_SS_RSS_HASH_FUNCS) |
+		    (1ULL << ETH_SS_PHY_STATS) }, { 0 } },
+resp_gssetinfo = { { ETHTOOL_GSSET_INFO, 0, 1ULL << ETH_SS_FEATURES }, { 34 } };
 
 static const struct ethtool_value
 cmd_grxcsum_off = { ETHTOOL_GRXCSUM, 0 },
@@ -275,7 +281,7 @@ cmd_sfeatures_ipv4_on =  { { ETHTOOL_SFEATURES, 2 },
 
 static const struct cmd_expect cmd_expect_get_strings[] = {
 	{ &cmd_gssetinfo, sizeof(cmd_gssetinfo.cmd),
-	  0, &cmd_gssetinfo, sizeof(cmd_gssetinfo) },
+	  0, &resp_gssetinfo, sizeof(resp_gssetinfo) },
 	{ &cmd_gstrings, sizeof(cmd_gstrings.cmd),
 	  0, &cmd_gstrings, sizeof(cmd_gstrings) },
 	{ 0, 0, 0, 0, 0 }
@@ -283,7 +289,7 @@ static const struct cmd_expect cmd_expect_get_strings[] = {
 
 static const struct cmd_expect cmd_expect_get_features_min_off[] = {
 	{ &cmd_gssetinfo, sizeof(cmd_gssetinfo.cmd),
-	  0, &cmd_gssetinfo, sizeof(cmd_gssetinfo) },
+	  0, &resp_gssetinfo, sizeof(resp_gssetinfo) },
 	{ &cmd_gstrings, sizeof(cmd_gstrings.cmd),
 	  0, &cmd_gstrings, sizeof(cmd_gstrings) },
 	{ &cmd_grxcsum_off, 4, 0, &cmd_grxcsum_off, sizeof(cmd_grxcsum_off) },
@@ -301,7 +307,7 @@ static const struct cmd_expect cmd_expect_get_features_min_off[] = {
 
 static const struct cmd_expect cmd_expect_get_features_max_on[] = {
 	{ &cmd_gssetinfo, sizeof(cmd_gssetinfo.cmd),
-	  0, &cmd_gssetinfo, sizeof(cmd_gssetinfo) },
+	  0, &resp_gssetinfo, sizeof(resp_gssetinfo) },
 	{ &cmd_gstrings, sizeof(cmd_gstrings.cmd),
 	  0, &cmd_gstrings, sizeof(cmd_gstrings) },
 	{ &cmd_grxcsum_on, 4, 0, &cmd_grxcsum_on, sizeof(cmd_grxcsum_on) },
@@ -319,7 +325,7 @@ static const struct cmd_expect cmd_expect_get_features_max_on[] = {
 
 static const struct cmd_expect cmd_expect_set_features_min_off_min_on[] = {
 	{ &cmd_gssetinfo, sizeof(cmd_gssetinfo.cmd),
-	  0, &cmd_gssetinfo, sizeof(cmd_gssetinfo) },
+	  0, &resp_gssetinfo, sizeof(resp_gssetinfo) },
 	{ &cmd_gstrings, sizeof(cmd_gstrings.cmd),
 	  0, &cmd_gstrings, sizeof(cmd_gstrings) },
 	{ &cmd_grxcsum_off, 4, 0, &cmd_grxcsum_off, sizeof(cmd_grxcsum_off) },
@@ -349,7 +355,7 @@ static const struct cmd_expect cmd_expect_set_features_min_off_min_on[] = {
 
 static const struct cmd_expect cmd_expect_set_features_min_off_min_off[] = {
 	{ &cmd_gssetinfo, sizeof(cmd_gssetinfo.cmd),
-	  0, &cmd_gssetinfo, sizeof(cmd_gssetinfo) },
+	  0, &resp_gssetinfo, sizeof(resp_gssetinfo) },
 	{ &cmd_gstrings, sizeof(cmd_gstrings.cmd),
 	  0, &cmd_gstrings, sizeof(cmd_gstrings) },
 	{ &cmd_grxcsum_off, 4, 0, &cmd_grxcsum_off, sizeof(cmd_grxcsum_off) },
@@ -378,7 +384,7 @@ static const struct cmd_expect cmd_expect_set_features_min_off_min_off[] = {
 
 static const struct cmd_expect cmd_expect_set_features_min_on_min_off[] = {
 	{ &cmd_gssetinfo, sizeof(cmd_gssetinfo.cmd),
-	  0, &cmd_gssetinfo, sizeof(cmd_gssetinfo) },
+	  0, &resp_gssetinfo, sizeof(resp_gssetinfo) },
 	{ &cmd_gstrings, sizeof(cmd_gstrings.cmd),
 	  0, &cmd_gstrings, sizeof(cmd_gstrings) },
 	{ &cmd_grxcsum_off, 4, 0, &cmd_grxcsum_off, sizeof(cmd_grxcsum_off) },
@@ -407,7 +413,7 @@ static const struct cmd_expect cmd_expect_set_features_min_on_min_off[] = {
 
 static const struct cmd_expect cmd_expect_set_features_min_off_unsup_on[] = {
 	{ &cmd_gssetinfo, sizeof(cmd_gssetinfo.cmd),
-	  0, &cmd_gssetinfo, sizeof(cmd_gssetinfo) },
+	  0, &resp_gssetinfo, sizeof(resp_gssetinfo) },
 	{ &cmd_gstrings, sizeof(cmd_gstrings.cmd),
 	  0, &cmd_gstrings, sizeof(cmd_gstrings) },
 	{ &cmd_grxcsum_off, 4, 0, &cmd_grxcsum_off, sizeof(cmd_grxcsum_off) },
@@ -436,7 +442,7 @@ static const struct cmd_expect cmd_expect_set_features_min_off_unsup_on[] = {
 
 static const struct cmd_expect cmd_expect_set_features_ipv4_off_many_on[] = {
 	{ &cmd_gssetinfo, sizeof(cmd_gssetinfo.cmd),
-	  0, &cmd_gssetinfo, sizeof(cmd_gssetinfo) },
+	  0, &resp_gssetinfo, sizeof(resp_gssetinfo) },
 	{ &cmd_gstrings, sizeof(cmd_gstrings.cmd),
 	  0, &cmd_gstrings, sizeof(cmd_gstrings) },
 	{ &cmd_grxcsum_off, 4, 0, &cmd_grxcsum_off, sizeof(cmd_grxcsum_off) },
@@ -0,0 +1,891 @@
+/****************************************************************************
+ * Test cases for ethtool netlink code
+ *
+ * Subcommands are run against an in-process fake of the ethtool genetlink
+ * family (test-nlfake.c) so that neither root privileges nor any particular
+ * network devices are needed.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, incorporated herein by reference.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define TEST_NO_WRAPPERS
+#include "internal.h"
+#include "test-nlfake.h"
+#include "netlink/netlink.h"
+#include "netlink/evlog.h"
+#include "netlink/extapi.h"
+#include "netlink/strset.h"
+
+/* device state snapshot written by monitor test cases */
+#define STATE_FILE "test-netlink.state"
+/* notification log written by monitor test cases */
+#define LOG_FILE "test-netlink.log"
+
+static const struct nlfake_config default_config = {
+	.n_devices	= 4,
+	.n_queues	= 4,
+	.n_counters	= 8,
+};
+
+static struct test_case {
+	int rc;
+	const char *args;
+} test_cases[] = {
+	{ 0, "fake0" },
+	{ 0, "fake3" },
+	{ 75, "fake4" },
+	{ 75, "nosuchdev" },
+	{ 0, "-k fake0" },
+	{ 0, "-k *" },
+	{ 1, "-k fake4" },
+	{ 0, "--show-priv-flags fake1" },
+	{ 0, "--show-priv-flags *" },
+	{ 0, "-l fake2" },
+	{ 0, "-l *" },
+	{ 0, "-a fake1" },
+	{ 0, "--fields rx -a fake1" },
+	{ 0, "--json --fields rx,statistics -a *" },
+	{ 1, "--fields rx -l fake1" },
+	{ 0, "-L fake2 combined 2" },
+	{ 1, "-L fake2 combined 8" },
+	{ 0, "-L * combined 2" },
+	{ 1, "-L * combined 8" },
+	{ 1, "-L * combined" },
+	{ 0, "-S fake0 --all-groups" },
+	{ 0, "-S * --all-groups" },
+	{ 0, "-m fake0" },
+	/* full hex dump falls back to ioctl */
+	{ 1, "-m fake0 hex on" },
+	{ 0, "-m fake0 offset 20 length 16" },
+	{ 1, "-m fake0 offset 250 length 16" },
+	{ 1, "-m *" },
+	{ 0, "--monitor -l fake1 fake2" },
+	{ 1, "--monitor -l ," },
+	{ 1, "--monitor --window 1s" },
+	{ 1, "--monitor --window 100 --state " STATE_FILE },
+	{ 1, "--monitor --query" },
+	{ 1, "--monitor --since 0" },
+	{ 1, "--monitor --log " LOG_FILE " --query --since 25:00" },
+	{ 1, "--monitor --log " LOG_FILE " --window 100" },
+	{ 1, "--monitor --log " LOG_FILE " --query" },
+	{ 1, "--monitor --link-watch 0" },
+	{ 1, "--monitor --report 10" },
+	{ 1, "--monitor --link-watch 10 --window 100" },
+	{ 0, "--monitor -s -k fake1" },
+	{ 1, "--monitor --exclude" },
+	{ 1, "--monitor --exclude ," },
+	{ 1, "--monitor -s --exclude -s" },
+};
+
+/**
+ * struct scale_case - subcommand run on many devices
+ * @args:         command line
+ * @n_devices:    number of fake devices
+ * @max_requests: maximum number of ethtool requests allowed
+ * @msg_type:     request type which must be sent as one dump
+ * @set_type:     set request sent once to each device (0 if none)
+ *
+ * The number of requests must not grow with the number of devices; with
+ * 10000 devices, a per device request in the wrong place is easy to spot.
+ * String sets are fetched before the main dump (one request for global and
+ * one dump for per device sets) so that its replies are decoded without
+ * nested requests. Set requests to all devices are built once and sent to
+ * each device listed in one dump of the corresponding get request; they are
+ * not counted in @max_requests.
+ */
+static const struct scale_case {
+	const char *args;
+	unsigned int n_devices;
+	unsigned int max_requests;
+	unsigned int msg_type;
+	unsigned int set_type;
+} scale_cases[] = {
+	{ "-k *", 10000, 2, ETHTOOL_MSG_FEATURES_GET },
+	{ "--show-priv-flags *", 10000, 2, ETHTOOL_MSG_PRIVFLAGS_GET },
+	{ "-S * --all-groups", 512, 2, ETHTOOL_MSG_STATS_GET },
+	{ "-S * --all-groups", 10000, 2, ETHTOOL_MSG_STATS_GET },
+	{ "-l *", 10000, 1, ETHTOOL_MSG_CHANNELS_GET },
+	{ "-L * combined 2", 10000, 1, ETHTOOL_MSG_CHANNELS_GET,
+	  ETHTOOL_MSG_CHANNELS_SET },
+};
+
+/**
+ * struct eeprom_case - module EEPROM reads
+ * @args:       command line
+ * @n_requests: expected number of module EEPROM requests (each half page is
+ *              only read once, identifier byte included)
+ * @in_flight:  expected maximum number of requests in flight (pages needed
+ *              by CMIS and SFF-8636 decoders are read in batches)
+ */
+static const struct eeprom_case {
+	const char *args;
+	unsigned int n_requests;
+	unsigned int in_flight;
+} eeprom_cases[] = {
+	{ "-m fake0", 1, 1 },
+	{ "-m fake0 offset 20 length 16", 1, 1 },
+	{ "-m fake1 page 1 offset 200 length 8", 1, 1 },
+#ifdef ETHTOOL_ENABLE_PRETTY_DUMP
+	/* lower memory, then pages 00h, 01h, 02h and 11h, then bank 1 */
+	{ "-m fake2", 6, 4 },
+	/* lower memory, then pages 00h and 03h */
+	{ "-m fake3", 3, 2 },
+	/* traced requests are not pipelined */
+	{ "--trace /dev/null -m fake2", 6, 1 },
+#endif
+};
+
+/**
+ * struct output_case - subcommand output
+ * @args:            command line
+ * @n_notifications: number of link info notifications (devices take turns)
+ * @output:          expected standard output
+ *
+ * Bit names and link modes decoded from bitsets, output restricted by
+ * --fields and monitor output filtered by device sets and --exclude are
+ * compared as a whole.
+ */
+static const struct output_case {
+	const char *args;
+	unsigned int n_notifications;
+	const char *output;
+} output_cases[] = {
+	{ "fake0", 0,
+	  "Settings for fake0:\n"
+	  "\tSupported ports: [ link-mode-7 ]\n"
+	  "\tSupported link modes:   link-mode-0 link-mode-1\n"
+	  "\t                        link-mode-2 link-mode-3\n"
+	  "\t                        link-mode-4 link-mode-5\n"
+	  "\tSupported pause frame use: No\n"
+	  "\tSupports auto-negotiation: Yes\n"
+	  "\tSupported FEC modes: Not reported\n"
+	  "\tAdvertised link modes:  link-mode-0 link-mode-1\n"
+	  "\t                        link-mode-2 link-mode-3\n"
+	  "\t                        link-mode-4 link-mode-5\n"
+	  "\tAdvertised pause frame use: No\n"
+	  "\tAdvertised auto-negotiation: Yes\n"
+	  "\tAdvertised FEC modes: Not reported\n"
+	  "\tLink partner advertised link modes:  link-mode-0 link-mode-1\n"
+	  "\t                                     link-mode-2 link-mode-3\n"
+	  "\t                                     link-mode-4 link-mode-5\n"
+	  "\tLink partner advertised pause frame use: No\n"
+	  "\tLink partner advertised auto-negotiation: No\n"
+	  "\tLink partner advertised FEC modes: Not reported\n"
+	  "\tSpeed: 1000Mb/s\n"
+	  "\tDuplex: Full\n"
+	  "\tAuto-negotiation: on\n"
+	  "\tPort: Twisted Pair\n"
+	  "\tPHYAD: 0\n"
+	  "\tTransceiver: internal\n"
+	  "\tMDI-X: off (auto)\n"
+	  "\tSupports Wake-on: pg\n"
+	  "\tWake-on: d\n"
+	  "        Current message level: 0x00000007 (7)\n"
+	  "                               msg-class-0 msg-class-1 msg-class-2\n"
+	  "\tLink detected: yes\n"
+	  "\tSQI: 7/7\n" },
+	{ "--show-priv-flags fake1", 0,
+	  "Private flags for fake1:\n"
+	  "priv-flag-0: on\n"
+	  "priv-flag-1: off\n"
+	  "priv-flag-2: off\n"
+	  "priv-flag-3: off\n" },
+	{ "-a fake1", 0,
+	  "Pause parameters for fake1:\n"
+	  "Autonegotiate:\toff\n"
+	  "RX:\t\ton\n"
+	  "TX:\t\ton\n"
+	  "\n" },
+	{ "--fields rx -a fake1", 0,
+	  "Pause parameters for fake1:\n"
+	  "RX:\t\ton\n"
+	  "\n" },
+	{ "--json --fields rx,statistics -a fake1", 0,
+	  "[ {\n"
+	  "        \"ifname\": \"fake1\",\n"
+	  "        \"rx\": true\n"
+	  "    } ]\n" },
+	{ "--monitor -s fake1,fake3", 8,
+	  "listening...\n"
+	  "Settings for fake1:\n"
+	  "\tPort: Twisted Pair\n"
+	  "\tPHYAD: 0\n"
+	  "\tTransceiver: internal\n"
+	  "\tMDI-X: off (auto)\n"
+	  "Settings for fake3:\n"
+	  "\tPort: Twisted Pair\n"
+	  "\tPHYAD: 0\n"
+	  "\tTransceiver: internal\n"
+	  "\tMDI-X: off (auto)\n"
+	  "Settings for fake1:\n"
+	  "\tPort: Twisted Pair\n"
+	  "\tPHYAD: 0\n"
+	  "\tTransceiver: internal\n"
+	  "\tMDI-X: off (auto)\n"
+	  "Settings for fake3:\n"
+	  "\tPort: Twisted Pair\n"
+	  "\tPHYAD: 0\n"
+	  "\tTransceiver: internal\n"
+	  "\tMDI-X: off (auto)\n" },
+	{ "--monitor -s fake[0-2] --exclude fake1", 8,
+	  "listening...\n"
+	  "Settings for fake0:\n"
+	  "\tPort: Twisted Pair\n"
+	  "\tPHYAD: 0\n"
+	  "\tTransceiver: internal\n"
+	  "\tMDI-X: off (auto)\n"
+	  "Settings for fake2:\n"
+	  "\tPort: Twisted Pair\n"
+	  "\tPHYAD: 0\n"
+	  "\tTransceiver: internal\n"
+	  "\tMDI-X: off (auto)\n"
+	  "Settings for fake0:\n"
+	  "\tPort: Twisted Pair\n"
+	  "\tPHYAD: 0\n"
+	  "\tTransceiver: internal\n"
+	  "\tMDI-X: off (auto)\n"
+	  "Settings for fake2:\n"
+	  "\tPort: Twisted Pair\n"
+	  "\tPHYAD: 0\n"
+	  "\tTransceiver: internal\n"
+	  "\tMDI-X: off (auto)\n" },
+	{ "--monitor -s -l --exclude -s", 8,
+	  "listening...\n" },
+};
+
+/**
+ * struct strset_case - kernel not knowing some string sets
+ * @args:         command line
+ * @missing_sets: string sets the fake kernel does not know
+ *
+ * Bit names missing from string sets are taken from verbose bitsets in the
+ * reply, so the output must be the same as with all sets known.
+ */
+static const struct strset_case {
+	const char *args;
+	unsigned int missing_sets;
+} strset_cases[] = {
+	{ "fake0", STRSET_BIT(ETH_SS_MSG_CLASSES) },
+	{ "fake1", STRSET_BIT(ETH_SS_LINK_MODES) },
+	{ "--show-priv-flags fake1", STRSET_BIT(ETH_SS_PRIV_FLAGS) },
+	{ "--show-priv-flags *", STRSET_BIT(ETH_SS_PRIV_FLAGS) },
+};
+
+/**
+ * struct monitor_case - monitor with lost notifications
+ * @args:       command line
+ * @n_overruns: number of receive buffer overruns
+ * @msg_type:   request type which must be sent once after each overrun
+ * @initial:    @msg_type is also dumped once at start (device state model
+ *              written into STATE_FILE)
+ * @state_dev:  the only device STATE_FILE may list (null if not checked)
+ * @n_notifications: number of link info notifications before the overruns
+ *              (devices take turns)
+ *
+ * The monitor ends when the notifications and overruns have been handled.
+ */
+static const struct monitor_case {
+	const char *args;
+	unsigned int n_overruns;
+	unsigned int msg_type;
+	bool initial;
+	const char *state_dev;
+	unsigned int n_notifications;
+} monitor_cases[] = {
+	{ "--monitor", 0, ETHTOOL_MSG_CHANNELS_GET },
+	{ "--monitor", 3, ETHTOOL_MSG_CHANNELS_GET },
+	{ "--monitor --rcvbuf 65536 -l fake1", 2, ETHTOOL_MSG_CHANNELS_GET },
+	{ "--monitor -k *", 1, ETHTOOL_MSG_FEATURES_GET },
+	{ "--json --monitor", 2, ETHTOOL_MSG_LINKMODES_GET },
+	{ "--json --monitor --line-buffered -l fake1", 1,
+	  ETHTOOL_MSG_CHANNELS_GET },
+	{ "--monitor -l fake1 fake3", 1, ETHTOOL_MSG_CHANNELS_GET },
+	{ "--json --monitor -k fake[12],fake0", 2, ETHTOOL_MSG_FEATURES_GET },
+	{ "--monitor --state " STATE_FILE, 0, ETHTOOL_MSG_FEATURES_GET, true },
+	{ "--monitor --state " STATE_FILE " -l fake1,fake2", 2,
+	  ETHTOOL_MSG_CHANNELS_GET, true },
+	{ "--monitor --state " STATE_FILE " fake1", 0,
+	  ETHTOOL_MSG_FEATURES_GET, true, "fake1", 8 },
+	{ "--monitor --state " STATE_FILE " fake2", 1,
+	  ETHTOOL_MSG_FEATURES_GET, true, "fake2", 8 },
+};
+
+/**
+ * struct coalesce_case - monitor with notification coalescing or link watch
+ * @args:            command line
+ * @n_notifications: number of link info notifications (devices take turns)
+ * @n_overruns:      number of receive buffer overruns after them
+ * @n_linkstate:     expected number of link state requests, one at start if
+ *                   link history is kept and, with --link-watch, one for
+ *                   each carrier change to down (every other link info
+ *                   notification for a device)
+ * @link:            expected flap statistics in the output (null if not
+ *                   checked)
+ */
+static const struct coalesce_case {
+	const char *args;
+	unsigned int n_notifications;
+	unsigned int n_overruns;
+	unsigned int n_linkstate;
+	const char *link;
+} coalesce_cases[] = {
+	{ "--monitor -s", 40, 0, 0 },
+	{ "--monitor --window 0 -s", 40, 0, 0 },
+	{ "--monitor --window 10000 -s", 40, 0, 1 },
+	{ "--monitor --window 10000 -s fake1", 40, 0, 1 },
+	{ "--monitor --window 10000 -l", 40, 0, 0 },
+	{ "--json --monitor --window 10000", 10, 2, 1 },
+	{ "--json --monitor --window 10000 -s fake[01]", 1000, 0, 1 },
+	{ "--monitor --window 10000 -s --exclude fake1", 40, 0, 1 },
+	{ "--monitor --window 10000 -k -s fake* --exclude fake[01]", 40, 0, 1 },
+	{ "--monitor --window 10000 --exclude -s", 40, 0, 0 },
+	{ "--json --monitor --window 10000 -s fake1", 40, 0, 1,
+	  "\"link\":{\"up\":true,\"flaps\":5," },
+	{ "--json --monitor --window 10000 -s fake2", 43, 0, 1,
+	  "\"link\":{\"up\":false,\"flaps\":6," },
+	{ "--monitor --link-watch 60", 40, 0, 21 },
+	{ "--monitor --link-watch 60 -l", 40, 0, 21 },
+	{ "--json --monitor --link-watch 60 --report 1 -s fake1", 40, 0, 6 },
+	{ "--json --monitor --link-watch 60 fake[01]", 10, 2, 5 },
+};
+
+/**
+ * struct log_case - monitor writing a notification log
+ * @args:            command line
+ * @n_notifications: number of link info notifications (devices take turns)
+ * @n_overruns:      number of receive buffer overruns after them
+ * @n_records:       expected number of records in the log
+ * @n_dumps:         expected number of replies to state dumps among them
+ * @query:           command line showing the logged notifications
+ *
+ * The monitor is run twice to check that the second run appends to the log.
+ */
+static const struct log_case {
+	const char *args;
+	unsigned int n_notifications;
+	unsigned int n_overruns;
+	unsigned int n_records;
+	unsigned int n_dumps;
+	const char *query;
+} log_cases[] = {
+	{ "--monitor --log " LOG_FILE " -s", 40, 0, 56, 16,
+	  "--monitor --log " LOG_FILE " --query --since 1000000000.5 -s" },
+	{ "--monitor --log " LOG_FILE " -s fake1", 40, 0, 14, 4,
+	  "--json --monitor --log " LOG_FILE " --query -s fake1" },
+	{ "--monitor --log " LOG_FILE " -s fake[12]", 40, 2, 44, 24,
+	  "--monitor --log " LOG_FILE " --query --until 2000-01-01T00:00 -k" },
+	{ "--monitor --log " LOG_FILE " -l", 0, 1, 8, 8,
+	  "--json --monitor --log " LOG_FILE " --query fake0,fake3" },
+	/* a shell pattern before a plain name reads all blocks */
+	{ "--monitor --log " LOG_FILE " -l", 0, 0, 4, 4,
+	  "--monitor --log " LOG_FILE " --query fake[01] fake3" },
+};
+
+int send_ioctl(struct cmd_context *ctx __maybe_unused, void *cmd __maybe_unused)
+{
+	/* fake devices only exist for netlink */
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e3 +
+	       (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int run_scale_case(const struct scale_case *sc)
+{
+	struct nlfake_config config = default_config;
+	unsigned int requests = 0;
+	unsigned int set_requests;
+	struct timespec start;
+	unsigned int i;
+	int test_rc;
+
+	config.n_devices = sc->n_devices;
+	nlfake_setup(&config);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	test_rc = test_cmdline(sc->args);
+	for (i = 0; i < __ETHTOOL_MSG_USER_CNT; i++)
+		requests += nlfake_stats.requests[i];
+	set_requests = sc->set_type ? nlfake_stats.requests[sc->set_type] : 0;
+	requests -= set_requests;
+	if (getenv("ETHTOOL_TEST_VERBOSE"))
+		printf("I: ethtool %s (%u devices): %.1f ms, %u requests, %lu datagrams, %llu bytes\n",
+		       sc->args, sc->n_devices, elapsed_ms(&start), requests,
+		       nlfake_stats.datagrams, nlfake_stats.bytes);
+	if (test_rc != 0) {
+		fprintf(stderr, "E: ethtool %s returns %d\n", sc->args,
+			test_rc);
+		return 1;
+	}
+	if (requests > sc->max_requests ||
+	    nlfake_stats.requests[sc->msg_type] != 1 ||
+	    nlfake_stats.dumps[sc->msg_type] != 1 ||
+	    (sc->set_type && set_requests != sc->n_devices)) {
+		fprintf(stderr,
+			"E: ethtool %s sends %u requests (%u of type %u) for %u devices\n",
+			sc->args, requests, nlfake_stats.requests[sc->msg_type],
+			sc->msg_type, sc->n_devices);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int run_eeprom_case(const struct eeprom_case *ec)
+{
+	unsigned int n_requests;
+	int test_rc;
+
+	nlfake_setup(&default_config);
+	test_rc = test_cmdline(ec->args);
+	if (test_rc != 0) {
+		fprintf(stderr, "E: ethtool %s returns %d\n", ec->args,
+			test_rc);
+		return 1;
+	}
+	n_requests = nlfake_stats.requests[ETHTOOL_MSG_MODULE_EEPROM_GET];
+	if (n_requests != ec->n_requests) {
+		fprintf(stderr, "E: ethtool %s reads module EEPROM %u times\n",
+			ec->args, n_requests);
+		return 1;
+	}
+	if (nlfake_stats.max_in_flight != ec->in_flight) {
+		fprintf(stderr, "E: ethtool %s sends %u requests at once\n",
+			ec->args, nlfake_stats.max_in_flight);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* init module EEPROM requests for upper halves of CMIS pages 00h, 01h, 02h
+ * and 11h
+ */
+static void eeprom_batch_init(struct ethtool_module_eeprom *requests)
+{
+	static const u8 pages[] = { 0x00, 0x01, 0x02, 0x11 };
+	unsigned int i;
+
+	memset(requests, '\0', sizeof(pages) * sizeof(*requests));
+	for (i = 0; i < ARRAY_SIZE(pages); i++) {
+		requests[i].offset = 128;
+		requests[i].length = 128;
+		requests[i].page = pages[i];
+		requests[i].i2c_address = 0x50;
+	}
+}
+
+/* a failed read of a batch must leave neither its replies on the socket nor
+ * the cache slots of the batch taken
+ */
+static int check_eeprom_batch_error(void)
+{
+	struct nlfake_config config = default_config;
+	struct ethtool_module_eeprom requests[4];
+	struct cmd_context ctx = {};
+	const char *failed = NULL;
+	unsigned int n_requests;
+	int ret;
+
+	config.short_eeprom_page = 0x02;
+	nlfake_setup(&config);
+	ctx.devname = "fake2";
+	ret = netlink_init(&ctx);
+	if (ret < 0) {
+		fprintf(stderr, "E: netlink init fails (%s)\n", strerror(-ret));
+		return 1;
+	}
+	eeprom_batch_init(requests);
+	ret = nl_get_eeprom_pages(&ctx, requests, ARRAY_SIZE(requests));
+	if (ret >= 0) {
+		failed = "short module EEPROM page is accepted";
+		goto out;
+	}
+
+	nlfake_setup(&default_config);
+	eeprom_batch_init(requests);
+	ret = nl_get_eeprom_pages(&ctx, requests, ARRAY_SIZE(requests));
+	n_requests = nlfake_stats.requests[ETHTOOL_MSG_MODULE_EEPROM_GET];
+	if (ret < 0)
+		failed = "module EEPROM read after a failed batch fails";
+	else if (n_requests != ARRAY_SIZE(requests) ||
+		 memcmp(requests[0].data + 1, "NLFAKE", 6))
+		failed = "module EEPROM pages are not read again after a failed batch";
+out:
+	netlink_done(&ctx);
+	if (failed) {
+		fprintf(stderr, "E: %s\n", failed);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* output of test_cmdline_output() */
+static char output[65536];
+static char ref_output[sizeof(output)];
+
+static int run_output_case(const struct output_case *oc)
+{
+	struct nlfake_config config = default_config;
+	int test_rc;
+
+	config.n_notifications = oc->n_notifications;
+	nlfake_setup(&config);
+	test_rc = test_cmdline_output(oc->args, output, sizeof(output));
+	if (test_rc != 0) {
+		fprintf(stderr, "E: ethtool %s returns %d\n", oc->args,
+			test_rc);
+		return 1;
+	}
+	if (strcmp(output, oc->output)) {
+		fprintf(stderr, "E: ethtool %s output:\n%s", oc->args, output);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int run_strset_case(const struct strset_case *sc)
+{
+	struct nlfake_config config = default_config;
+	int test_rc;
+
+	nlfake_setup(&config);
+	test_rc = test_cmdline_output(sc->args, ref_output,
+				      sizeof(ref_output));
+	if (test_rc != 0 || !ref_output[0]) {
+		fprintf(stderr, "E: ethtool %s returns %d\n", sc->args,
+			test_rc);
+		return 1;
+	}
+	config.missing_sets = sc->missing_sets;
+	nlfake_setup(&config);
+	test_rc = test_cmdline_output(sc->args, output, sizeof(output));
+	if (test_rc != 0) {
+		fprintf(stderr,
+			"E: ethtool %s returns %d with string sets %#x missing\n",
+			sc->args, test_rc, sc->missing_sets);
+		return 1;
+	}
+	if (strcmp(output, ref_output)) {
+		fprintf(stderr,
+			"E: ethtool %s output with string sets %#x missing:\n%s",
+			sc->args, sc->missing_sets, output);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* snapshot must exist and list devices (only @dev if not null) */
+static int check_state_file(const char *args, const char *dev)
+{
+	static char buff[65536];
+	const char *p;
+	size_t len;
+	FILE *file;
+
+	file = fopen(STATE_FILE, "r");
+	if (!file) {
+		fprintf(stderr, "E: ethtool %s writes no state file\n", args);
+		return 1;
+	}
+	len = fread(buff, 1, sizeof(buff) - 1, file);
+	fclose(file);
+	remove(STATE_FILE);
+	buff[len] = '\0';
+	if (!strstr(buff, "\"devices\":[{\"ifindex\":")) {
+		fprintf(stderr, "E: ethtool %s writes bad state file\n", args);
+		return 1;
+	}
+	for (p = strstr(buff, "\"dev\":\""); dev && p;
+	     p = strstr(p + 1, "\"dev\":\"")) {
+		p += strlen("\"dev\":\"");
+		if (strncmp(p, dev, strlen(dev)) || p[strlen(dev)] != '"') {
+			fprintf(stderr,
+				"E: ethtool %s writes state of other devices\n",
+				args);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int run_monitor_case(const struct monitor_case *mc)
+{
+	struct nlfake_config config = default_config;
+	unsigned int n_requests;
+	int test_rc;
+
+	config.n_overruns = mc->n_overruns;
+	config.n_notifications = mc->n_notifications;
+	nlfake_setup(&config);
+	test_rc = test_cmdline(mc->args);
+	if (test_rc != 0) {
+		fprintf(stderr, "E: ethtool %s returns %d\n", mc->args,
+			test_rc);
+		return 1;
+	}
+	n_requests = mc->n_overruns + (mc->initial ? 1 : 0);
+	if (nlfake_stats.requests[mc->msg_type] != n_requests) {
+		fprintf(stderr,
+			"E: ethtool %s sends %u requests of type %u after %u overruns\n",
+			mc->args, nlfake_stats.requests[mc->msg_type],
+			mc->msg_type, mc->n_overruns);
+		return 1;
+	}
+	if (mc->initial)
+		return check_state_file(mc->args, mc->state_dev);
+
+	return 0;
+}
+
+static int run_coalesce_case(const struct coalesce_case *cc)
+{
+	struct nlfake_config config = default_config;
+	unsigned int n_requests;
+	int test_rc;
+
+	config.n_notifications = cc->n_notifications;
+	config.n_overruns = cc->n_overruns;
+	nlfake_setup(&config);
+	if (cc->link)
+		test_rc = test_cmdline_output(cc->args, output, sizeof(output));
+	else
+		test_rc = test_cmdline(cc->args);
+	if (test_rc != 0) {
+		fprintf(stderr, "E: ethtool %s returns %d\n", cc->args,
+			test_rc);
+		return 1;
+	}
+	n_requests = nlfake_stats.requests[ETHTOOL_MSG_LINKSTATE_GET];
+	if (n_requests != cc->n_linkstate) {
+		fprintf(stderr,
+			"E: ethtool %s sends %u link state requests for %u notifications\n",
+			cc->args, n_requests, cc->n_notifications);
+		return 1;
+	}
+	if (cc->link && !strstr(output, cc->link)) {
+		fprintf(stderr, "E: ethtool %s does not show %s\n", cc->args,
+			cc->link);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* dispatch table must agree with notification types it is indexed by */
+static int check_monitor_dispatch(void)
+{
+	const struct monitor_callback *mcb;
+	unsigned int cmd;
+
+	for (cmd = 0; cmd <= __ETHTOOL_MSG_KERNEL_CNT; cmd++) {
+		mcb = monitor_callback_get(cmd);
+		if (mcb && (mcb->cmd != cmd || !mcb->cb)) {
+			fprintf(stderr,
+				"E: monitor handler of type %u is for type %u\n",
+				cmd, mcb->cmd);
+			return 1;
+		}
+	}
+	mcb = monitor_callback_get(ETHTOOL_MSG_LINKINFO_NTF);
+	if (!mcb || mcb->get_cmd != ETHTOOL_MSG_LINKINFO_GET ||
+	    monitor_callback_get(__ETHTOOL_MSG_KERNEL_CNT)) {
+		fprintf(stderr, "E: monitor dispatch table is wrong\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+struct log_count {
+	unsigned int records;
+	unsigned int dumps;
+};
+
+static int count_log_cb(const struct nlmsghdr *nlhdr __maybe_unused,
+			uint64_t time __maybe_unused, unsigned int flags,
+			void *data)
+{
+	struct log_count *count = data;
+
+	count->records++;
+	if (flags & EVLOG_F_DUMP)
+		count->dumps++;
+	return 0;
+}
+
+static int run_log_case(const struct log_case *lc)
+{
+	struct nlfake_config config = default_config;
+	struct log_count count = {};
+	const char *failed = NULL;
+	unsigned int run;
+	int ret;
+
+	remove(LOG_FILE);
+	for (run = 0; run < 2 && !failed; run++) {
+		config.n_notifications = lc->n_notifications;
+		config.n_overruns = lc->n_overruns;
+		nlfake_setup(&config);
+		if (test_cmdline(lc->args))
+			failed = lc->args;
+	}
+	if (!failed && test_cmdline(lc->query))
+		failed = lc->query;
+	if (failed) {
+		fprintf(stderr, "E: ethtool %s fails\n", failed);
+		remove(LOG_FILE);
+		return 1;
+	}
+
+	ret = evlog_query(LOG_FILE, 0, UINT64_MAX, NULL, 0, count_log_cb,
+			  &count);
+	if (ret < 0 || count.records != 2 * lc->n_records ||
+	    count.dumps != 2 * lc->n_dumps) {
+		fprintf(stderr,
+			"E: ethtool %s logs %u records (%u dump replies)\n",
+			lc->args, count.records, count.dumps);
+		remove(LOG_FILE);
+		return 1;
+	}
+	/* nothing is that old */
+	count.records = 0;
+	ret = evlog_query(LOG_FILE, 0, 1000000000ULL, NULL, 0, count_log_cb,
+			  &count);
+	remove(LOG_FILE);
+	if (ret < 0 || count.records) {
+		fprintf(stderr, "E: ethtool %s logs records from 1970\n",
+			lc->args);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* records written by evlog_sync() after each append can be queried at once */
+static int check_log_sync(void)
+{
+	struct log_count count = {};
+	char buff[1000] = {};
+	struct nlmsghdr *nlhdr = (struct nlmsghdr *)buff;
+	struct evlog *log;
+	unsigned int i;
+	int ret;
+
+	nlhdr->nlmsg_len = sizeof(buff);
+	remove(LOG_FILE);
+	log = evlog_open(LOG_FILE, &ret);
+	if (!log)
+		goto err;
+	/* enough for three blocks */
+	for (i = 0; i < 150 && ret >= 0; i++) {
+		ret = evlog_append(log, nlhdr, ETHTOOL_MSG_LINKINFO_NTF, 0);
+		if (ret == 0)
+			ret = evlog_sync(log);
+		if (ret == 0)
+			ret = evlog_query(LOG_FILE, 0, UINT64_MAX, NULL, 0,
+					  count_log_cb, &count);
+		if (ret == 0 && count.records != i + 1)
+			ret = -EIO;
+		count.records = 0;
+	}
+	if (evlog_close(log) < 0 && ret >= 0)
+		ret = -EIO;
+	if (ret >= 0)
+		ret = evlog_query(LOG_FILE, 0, UINT64_MAX, NULL, 0,
+				  count_log_cb, &count);
+	if (ret >= 0 && count.records == 150) {
+		remove(LOG_FILE);
+		return 0;
+	}
+err:
+	fprintf(stderr, "E: log written record by record is wrong (%s)\n",
+		ret < 0 ? strerror(-ret) : "lost records");
+	remove(LOG_FILE);
+	return 1;
+}
+
+int main(void)
+{
+	const struct coalesce_case *cc;
+	const struct eeprom_case *ec;
+	const struct log_case *lc;
+	const struct monitor_case *mc;
+	const struct output_case *oc;
+	const struct scale_case *sc;
+	const struct strset_case *ssc;
+	struct test_case *tc;
+	int test_rc;
+	int rc = 0;
+
+	for (tc = test_cases; tc < test_cases + ARRAY_SIZE(test_cases); tc++) {
+		if (getenv("ETHTOOL_TEST_VERBOSE"))
+			printf("I: Test command line: ethtool %s\n", tc->args);
+		nlfake_setup(&default_config);
+		test_rc = test_cmdline(tc->args);
+		if (test_rc != tc->rc) {
+			fprintf(stderr, "E: ethtool %s returns %d\n",
+				tc->args, test_rc);
+			rc = 1;
+		}
+	}
+
+	for (ec = eeprom_cases; ec < eeprom_cases + ARRAY_SIZE(eeprom_cases);
+	     ec++)
+		if (run_eeprom_case(ec))
+			rc = 1;
+	if (check_eeprom_batch_error())
+		rc = 1;
+
+	for (oc = output_cases;
+	     oc < output_cases + ARRAY_SIZE(output_cases); oc++)
+		if (run_output_case(oc))
+			rc = 1;
+
+	for (ssc = strset_cases;
+	     ssc < strset_cases + ARRAY_SIZE(strset_cases); ssc++)
+		if (run_strset_case(ssc))
+			rc = 1;
+
+	if (check_monitor_dispatch())
+		rc = 1;
+
+	for (mc = monitor_cases;
+	     mc < monitor_cases + ARRAY_SIZE(monitor_cases); mc++)
+		if (run_monitor_case(mc))
+			rc = 1;
+
+	for (cc = coalesce_cases;
+	     cc < coalesce_cases + ARRAY_SIZE(coalesce_cases); cc++)
+		if (run_coalesce_case(cc))
+			rc = 1;
+
+	for (lc = log_cases; lc < log_cases + ARRAY_SIZE(log_cases); lc++)
+		if (run_log_case(lc))
+			rc = 1;
+	if (check_log_sync())
+		rc = 1;
+
+	for (sc = scale_cases; sc < scale_cases + ARRAY_SIZE(scale_cases); sc++)
+		if (run_scale_case(sc))
+			rc = 1;
+
+	return rc;
+}
@@ -0,0 +1,1274 @@
+/*
+ * test-nlfake.c - in-process fake of ethtool genetlink family
+ *
+ * Netlink backend (struct nlsock_backend) answering requests of ethtool
+ * netlink code in place of the kernel: genetlink family lookup, string sets,
+ * link settings, features, private flags, channels, pause parameters,
+ * statistics and module EEPROM, both for a single device and as dumps, and
+ * setting channels. Requests sent before the replies to previous ones are
+ * received are queued and answered in order like by the kernel. The "system"
+ * consists of any number of synthetic devices (identical except for the type
+ * of their module) so that netlink code can be tested, and its performance
+ * measured, with thousands of devices and without root privileges. An idle
+ * monitor socket can receive a number of link info notifications (link of
+ * a device goes down, with no cable, and up with each of them) and report
+ * overruns. Once an rtnetlink monitor socket has been read from, each
+ * notification is followed by a carrier change (RTM_NEWLINK) on it; the
+ * genetlink socket looks idle until that has been received.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+#include "internal.h"
+#include "netlink/netlink.h"
+#include "netlink/bitset.h"
+#include "netlink/strset.h"
+#include "test-nlfake.h"
+
+#define NLFAKE_FAMILY_ID	0x20
+#define NLFAKE_MONGRP_ID	0x21
+#define NLFAKE_DEVNAME_PREFIX	"fake"
+/* dump replies are split into datagrams of (about) this size */
+#define NLFAKE_DUMP_SIZE	32768
+/* nests are filled through pointers into the message buffer which must not
+ * be reallocated while a message is built
+ */
+#define NLFAKE_MSG_SIZE		(1 << 20)
+/* no implemented request has more top level attributes */
+#define NLFAKE_MAX_ATTR		15
+
+#define NLFAKE_FEATURE_COUNT	64
+#define NLFAKE_MSG_CLASS_COUNT	15
+#define NLFAKE_WOL_MODE_COUNT	8
+#define NLFAKE_PRIV_FLAG_COUNT	4
+#define NLFAKE_EEPROM_SIZE	256
+
+enum nlfake_stage {
+	NLFAKE_IDLE,
+	NLFAKE_REPLY,
+	NLFAKE_ACK,
+	NLFAKE_DUMP,
+};
+
+/**
+ * struct nlfake_sock - state of a fake socket
+ * @req:       copy of current request
+ * @tb:        top level attributes of @req
+ * @dev:       target device of @req, -1 if none
+ * @hdr_flags: flags from request header (ETHTOOL_FLAG_*)
+ * @stage:     what comes next: reply, ack, next part of dump or nothing
+ * @error:     error code for the ack
+ * @next_dev:  next device of a dump
+ * @dgram:     next reply datagram, generated on demand
+ * @len:       length of @dgram, 0 if not generated yet
+ * @size:      allocated size of @dgram
+ * @msgbuff:   buffer to compose one reply message in
+ * @queue:     requests sent while @req was being answered
+ * @n_queued:  number of requests in @queue
+ */
+struct nlfake_sock {
+	struct nlmsghdr		*req;
+	const struct nlattr	*tb[NLFAKE_MAX_ATTR + 1];
+	int			dev;
+	uint32_t		hdr_flags;
+	enum nlfake_stage	stage;
+	int			error;
+	unsigned int		next_dev;
+	char			*dgram;
+	unsigned int		len;
+	unsigned int		size;
+	struct nl_msg_buff	msgbuff;
+	struct nlmsghdr		**queue;
+	unsigned int		n_queued;
+};
+
+typedef int (*nlfake_fill_t)(struct nl_msg_buff *msg,
+			     const struct nlfake_sock *fsk, int dev);
+typedef int (*nlfake_check_t)(const struct nlfake_sock *fsk);
+
+/**
+ * struct nlfake_op - implemented ethtool request
+ * @reply_cmd: genetlink command of reply messages
+ * @hdr_attr:  request header attribute (also used in replies)
+ * @global:    request can be sent without a device
+ * @no_dump:   dump requests are not supported
+ * @fill:      compose reply message for a device (-1 for global requests)
+ * @check:     validate a request; set requests (no @fill) are answered only
+ *             by an ack
+ */
+struct nlfake_op {
+	uint8_t		reply_cmd;
+	uint16_t	hdr_attr;
+	bool		global;
+	bool		no_dump;
+	nlfake_fill_t	fill;
+	nlfake_check_t	check;
+};
+
+static struct nlfake_config config = {
+	.n_devices	= 1,
+	.n_queues	= 4,
+	.n_counters	= 8,
+};
+struct nlfake_stats nlfake_stats;
+static unsigned int overruns_left;
+static unsigned int notifications_sent;
+static unsigned int carriers_sent;
+static bool carrier_listener;
+static uint8_t sfp_eeprom[NLFAKE_EEPROM_SIZE];
+
+/* string sets */
+
+static const char *const set_prefix[ETH_SS_COUNT] = {
+	[ETH_SS_PRIV_FLAGS]		= "priv-flag",
+	[ETH_SS_FEATURES]		= "feature",
+	[ETH_SS_LINK_MODES]		= "link-mode",
+	[ETH_SS_MSG_CLASSES]		= "msg-class",
+	[ETH_SS_WOL_MODES]		= "wol-mode",
+	[ETH_SS_STATS_ETH_PHY]		= "counter",
+	[ETH_SS_STATS_ETH_MAC]		= "counter",
+	[ETH_SS_STATS_ETH_CTRL]		= "counter",
+	[ETH_SS_STATS_RMON]		= "counter",
+};
+
+static const char *const std_stats_names[__ETHTOOL_STATS_CNT] = {
+	[ETHTOOL_STATS_ETH_PHY]		= "eth-phy",
+	[ETHTOOL_STATS_ETH_MAC]		= "eth-mac",
+	[ETHTOOL_STATS_ETH_CTRL]	= "eth-ctrl",
+	[ETHTOOL_STATS_RMON]		= "rmon",
+};
+
+static unsigned int set_count(unsigned int ss_id)
+{
+	switch (ss_id) {
+	case ETH_SS_STATS:
+		return config.n_counters + 2 * config.n_queues;
+	case ETH_SS_PRIV_FLAGS:
+		return NLFAKE_PRIV_FLAG_COUNT;
+	case ETH_SS_FEATURES:
+		return NLFAKE_FEATURE_COUNT;
+	case ETH_SS_LINK_MODES:
+		return __ETHTOOL_LINK_MODE_MASK_NBITS;
+	case ETH_SS_MSG_CLASSES:
+		return NLFAKE_MSG_CLASS_COUNT;
+	case ETH_SS_WOL_MODES:
+		return NLFAKE_WOL_MODE_COUNT;
+	case ETH_SS_STATS_STD:
+		return __ETHTOOL_STATS_CNT;
+	case ETH_SS_STATS_ETH_PHY:
+	case ETH_SS_STATS_ETH_MAC:
+	case ETH_SS_STATS_ETH_CTRL:
+	case ETH_SS_STATS_RMON:
+		return config.n_counters;
+	default:
+		return 0;
+	}
+}
+
+static void set_string(unsigned int ss_id, unsigned int idx, char *buff)
+{
+	unsigned int queue;
+
+	switch (ss_id) {
+	case ETH_SS_STATS:
+		if (idx < config.n_counters) {
+			snprintf(buff, ETH_GSTRING_LEN, "counter%u", idx);
+			break;
+		}
+		queue = (idx - config.n_counters) / 2;
+		snprintf(buff, ETH_GSTRING_LEN, "%cx%u_packets",
+			 (idx - config.n_counters) % 2 ? 't' : 'r', queue);
+		break;
+	case ETH_SS_STATS_STD:
+		snprintf(buff, ETH_GSTRING_LEN, "%s", std_stats_names[idx]);
+		break;
+	default:
+		snprintf(buff, ETH_GSTRING_LEN, "%s-%u", set_prefix[ss_id], idx);
+		break;
+	}
+}
+
+/* message composition helpers */
+
+static bool put_header(struct nl_msg_buff *msg, uint16_t type, int dev)
+{
+	char name[IFNAMSIZ];
+	struct nlattr *nest;
+
+	snprintf(name, sizeof(name), NLFAKE_DEVNAME_PREFIX "%d", dev);
+	nest = ethnla_nest_start(msg, type);
+	if (!nest ||
+	    ethnla_put_u32(msg, ETHTOOL_A_HEADER_DEV_INDEX, dev + 1) ||
+	    ethnla_put_strz(msg, ETHTOOL_A_HEADER_DEV_NAME, name))
+		return true;
+	ethnla_nest_end(msg, nest);
+	return false;
+}
+
+/* Compact or verbose bitset of @count bits named by string set @ss_id; list
+ * (no mask) bitset if @mask is null.
+ */
+static bool put_bitset(struct nl_msg_buff *msg, uint16_t type,
+		       unsigned int count, const uint32_t *value,
+		       const uint32_t *mask, unsigned int ss_id, bool compact)
+{
+	unsigned int words = DIV_ROUND_UP(count, 32);
+	struct nlattr *bits, *bit;
+	char name[ETH_GSTRING_LEN];
+	struct nlattr *nest;
+	unsigned int i;
+
+	nest = ethnla_nest_start(msg, type);
+	if (!nest ||
+	    ethnla_put_flag(msg, ETHTOOL_A_BITSET_NOMASK, !mask) ||
+	    ethnla_put_u32(msg, ETHTOOL_A_BITSET_SIZE, count))
+		return true;
+	if (compact) {
+		if (ethnla_put(msg, ETHTOOL_A_BITSET_VALUE, words * 4, value) ||
+		    (mask && ethnla_put(msg, ETHTOOL_A_BITSET_MASK, words * 4,
+					mask)))
+			return true;
+		ethnla_nest_end(msg, nest);
+		return false;
+	}
+
+	bits = ethnla_nest_start(msg, ETHTOOL_A_BITSET_BITS);
+	if (!bits)
+		return true;
+	for (i = 0; i < count; i++) {
+		if (!bitmap_test(mask ?: value, i))
+			continue;
+		set_string(ss_id, i, name);
+		bit = ethnla_nest_start(msg, ETHTOOL_A_BITSET_BITS_BIT);
+		if (!bit ||
+		    ethnla_put_u32(msg, ETHTOOL_A_BITSET_BIT_INDEX, i) ||
+		    ethnla_put_strz(msg, ETHTOOL_A_BITSET_BIT_NAME, name) ||
+		    ethnla_put_flag(msg, ETHTOOL_A_BITSET_BIT_VALUE,
+				    bitmap_test(value, i)))
+			return true;
+		ethnla_nest_end(msg, bit);
+	}
+	ethnla_nest_end(msg, bits);
+	ethnla_nest_end(msg, nest);
+	return false;
+}
+
+static bool compact_bitsets(const struct nlfake_sock *fsk)
+{
+	return fsk->hdr_flags & ETHTOOL_FLAG_COMPACT_BITSETS;
+}
+
+/* request handlers */
+
+static bool put_stringset(struct nl_msg_buff *msg, unsigned int ss_id,
+			  bool counts_only)
+{
+	unsigned int count = set_count(ss_id);
+	struct nlattr *nest, *strings, *string;
+	char name[ETH_GSTRING_LEN];
+	unsigned int i;
+
+	nest = ethnla_nest_start(msg, ETHTOOL_A_STRINGSETS_STRINGSET);
+	if (!nest ||
+	    ethnla_put_u32(msg, ETHTOOL_A_STRINGSET_ID, ss_id) ||
+	    ethnla_put_u32(msg, ETHTOOL_A_STRINGSET_COUNT, count))
+		return true;
+	if (counts_only || !count)
+		goto out;
+	strings = ethnla_nest_start(msg, ETHTOOL_A_STRINGSET_STRINGS);
+	if (!strings)
+		return true;
+	for (i = 0; i < count; i++) {
+		set_string(ss_id, i, name);
+		string = ethnla_nest_start(msg, ETHTOOL_A_STRINGS_STRING);
+		if (!string ||
+		    ethnla_put_u32(msg, ETHTOOL_A_STRING_INDEX, i) ||
+		    ethnla_put_strz(msg, ETHTOOL_A_STRING_VALUE, name))
+			return true;
+		ethnla_nest_end(msg, string);
+	}
+	ethnla_nest_end(msg, strings);
+out:
+	ethnla_nest_end(msg, nest);
+	return false;
+}
+
+/* like a kernel older than some of the sets, reject the whole request */
+static int check_strset(const struct nlfake_sock *fsk)
+{
+	const struct nlattr *sets_attr = fsk->tb[ETHTOOL_A_STRSET_STRINGSETS];
+	const struct nlattr *set, *attr;
+	unsigned int id;
+
+	if (!sets_attr)
+		return 0;
+	mnl_attr_for_each_nested(set, sets_attr) {
+		mnl_attr_for_each_nested(attr, set) {
+			if (mnl_attr_get_type(attr) != ETHTOOL_A_STRINGSET_ID)
+				continue;
+			id = mnl_attr_get_u32(attr);
+			if (id < ETH_SS_COUNT &&
+			    (STRSET_BIT(id) & config.missing_sets))
+				return -EOPNOTSUPP;
+		}
+	}
+
+	return 0;
+}
+
+static int fill_strset(struct nl_msg_buff *msg, const struct nlfake_sock *fsk,
+		       int dev)
+{
+	const struct nlattr *sets_attr = fsk->tb[ETHTOOL_A_STRSET_STRINGSETS];
+	bool counts_only = fsk->tb[ETHTOOL_A_STRSET_COUNTS_ONLY];
+	const struct nlattr *set, *attr;
+	struct nlattr *nest;
+	uint32_t sets = 0;
+	unsigned int id;
+
+	if (sets_attr) {
+		mnl_attr_for_each_nested(set, sets_attr) {
+			mnl_attr_for_each_nested(attr, set) {
+				if (mnl_attr_get_type(attr) !=
+				    ETHTOOL_A_STRINGSET_ID)
+					continue;
+				id = mnl_attr_get_u32(attr);
+				if (id >= ETH_SS_COUNT)
+					return -EINVAL;
+				sets |= STRSET_BIT(id);
+			}
+		}
+		if (dev < 0 && (sets & STRSET_PERDEV_SETS))
+			return -EINVAL;
+	} else {
+		sets = ((1U << ETH_SS_COUNT) - 1) & ~config.missing_sets;
+		if (dev < 0)
+			sets &= ~STRSET_PERDEV_SETS;
+	}
+
+	if (dev >= 0 && put_header(msg, ETHTOOL_A_STRSET_HEADER, dev))
+		return -EMSGSIZE;
+	nest = ethnla_nest_start(msg, ETHTOOL_A_STRSET_STRINGSETS);
+	if (!nest)
+		return -EMSGSIZE;
+	for (id = 0; id < ETH_SS_COUNT; id++)
+		if ((sets & STRSET_BIT(id)) &&
+		    put_stringset(msg, id, counts_only))
+			return -EMSGSIZE;
+	ethnla_nest_end(msg, nest);
+
+	return 0;
+}
+
+static int fill_linkinfo(struct nl_msg_buff *msg,
+			 const struct nlfake_sock *fsk __maybe_unused, int dev)
+{
+	if (put_header(msg, ETHTOOL_A_LINKINFO_HEADER, dev) ||
+	    ethnla_put_u8(msg, ETHTOOL_A_LINKINFO_PORT, PORT_TP) ||
+	    ethnla_put_u8(msg, ETHTOOL_A_LINKINFO_PHYADDR, 0) ||
+	    ethnla_put_u8(msg, ETHTOOL_A_LINKINFO_TP_MDIX, ETH_TP_MDI) ||
+	    ethnla_put_u8(msg, ETHTOOL_A_LINKINFO_TP_MDIX_CTRL,
+			  ETH_TP_MDI_AUTO) ||
+	    ethnla_put_u8(msg, ETHTOOL_A_LINKINFO_TRANSCEIVER, XCVR_INTERNAL))
+		return -EMSGSIZE;
+	return 0;
+}
+
+static int fill_linkmodes(struct nl_msg_buff *msg,
+			  const struct nlfake_sock *fsk, int dev)
+{
+	uint32_t modes[DIV_ROUND_UP(__ETHTOOL_LINK_MODE_MASK_NBITS, 32)] = {};
+	uint32_t peer[DIV_ROUND_UP(__ETHTOOL_LINK_MODE_MASK_NBITS, 32)] = {};
+	bool compact = compact_bitsets(fsk);
+
+	/* 10/100/1000 Mb/s twisted pair, half and full duplex */
+	modes[0] = (1U << (ETHTOOL_LINK_MODE_1000baseT_Full_BIT + 1)) - 1;
+	peer[0] = modes[0];
+	modes[0] |= 1U << ETHTOOL_LINK_MODE_Autoneg_BIT;
+	modes[0] |= 1U << ETHTOOL_LINK_MODE_TP_BIT;
+
+	if (put_header(msg, ETHTOOL_A_LINKMODES_HEADER, dev) ||
+	    ethnla_put_u8(msg, ETHTOOL_A_LINKMODES_AUTONEG, AUTONEG_ENABLE) ||
+	    put_bitset(msg, ETHTOOL_A_LINKMODES_OURS,
+		       __ETHTOOL_LINK_MODE_MASK_NBITS, modes, modes,
+		       ETH_SS_LINK_MODES, compact) ||
+	    put_bitset(msg, ETHTOOL_A_LINKMODES_PEER,
+		       __ETHTOOL_LINK_MODE_MASK_NBITS, peer, NULL,
+		       ETH_SS_LINK_MODES, compact) ||
+	    ethnla_put_u32(msg, ETHTOOL_A_LINKMODES_SPEED, SPEED_1000) ||
+	    ethnla_put_u8(msg, ETHTOOL_A_LINKMODES_DUPLEX, DUPLEX_FULL))
+		return -EMSGSIZE;
+	return 0;
+}
+
+/* link is down after an odd number of notifications for the device */
+static int fill_linkstate(struct nl_msg_buff *msg,
+			  const struct nlfake_sock *fsk __maybe_unused,
+			  int dev)
+{
+	unsigned int ntfs = notifications_sent / config.n_devices +
+			    (dev < (int)(notifications_sent % config.n_devices));
+
+	if (put_header(msg, ETHTOOL_A_LINKSTATE_HEADER, dev) ||
+	    ethnla_put_u8(msg, ETHTOOL_A_LINKSTATE_LINK, !(ntfs & 1)) ||
+	    ethnla_put_u32(msg, ETHTOOL_A_LINKSTATE_SQI, 7 - ntfs / 2 % 8) ||
+	    ethnla_put_u32(msg, ETHTOOL_A_LINKSTATE_SQI_MAX, 7))
+		return -EMSGSIZE;
+	if ((ntfs & 1) &&
+	    ethnla_put_u8(msg, ETHTOOL_A_LINKSTATE_EXT_STATE,
+			  ETHTOOL_LINK_EXT_STATE_NO_CABLE))
+		return -EMSGSIZE;
+	return 0;
+}
+
+static int fill_debug(struct nl_msg_buff *msg, const struct nlfake_sock *fsk,
+		      int dev)
+{
+	const uint32_t mask = (1U << NLFAKE_MSG_CLASS_COUNT) - 1;
+	const uint32_t value = 0x7;
+
+	if (put_header(msg, ETHTOOL_A_DEBUG_HEADER, dev) ||
+	    put_bitset(msg, ETHTOOL_A_DEBUG_MSGMASK, NLFAKE_MSG_CLASS_COUNT,
+		       &value, &mask, ETH_SS_MSG_CLASSES,
+		       compact_bitsets(fsk)))
+		return -EMSGSIZE;
+	return 0;
+}
+
+static int fill_wol(struct nl_msg_buff *msg, const struct nlfake_sock *fsk,
+		    int dev)
+{
+	const uint32_t mask = WAKE_PHY | WAKE_MAGIC;
+	const uint32_t value = 0;
+
+	if (put_header(msg, ETHTOOL_A_WOL_HEADER, dev) ||
+	    put_bitset(msg, ETHTOOL_A_WOL_MODES, NLFAKE_WOL_MODE_COUNT,
+		       &value, &mask, ETH_SS_WOL_MODES, compact_bitsets(fsk)))
+		return -EMSGSIZE;
+	return 0;
+}
+
+static int fill_features(struct nl_msg_buff *msg,
+			 const struct nlfake_sock *fsk, int dev)
+{
+	const uint32_t hw[2] = { 0xffffffff, 0 };
+	const uint32_t active[2] = { 0x0000ffff, 0 };
+	const uint32_t nochange[2] = { 0, 0xf0000000 };
+	bool compact = compact_bitsets(fsk);
+
+	if (put_header(msg, ETHTOOL_A_FEATURES_HEADER, dev) ||
+	    put_bitset(msg, ETHTOOL_A_FEATURES_HW, NLFAKE_FEATURE_COUNT, hw,
+		       NULL, ETH_SS_FEATURES, compact) ||
+	    put_bitset(msg, ETHTOOL_A_FEATURES_WANTED, NLFAKE_FEATURE_COUNT,
+		       active, NULL, ETH_SS_FEATURES, compact) ||
+	    put_bitset(msg, ETHTOOL_A_FEATURES_ACTIVE, NLFAKE_FEATURE_COUNT,
+		       active, NULL, ETH_SS_FEATURES, compact) ||
+	    put_bitset(msg, ETHTOOL_A_FEATURES_NOCHANGE, NLFAKE_FEATURE_COUNT,
+		       nochange, NULL, ETH_SS_FEATURES, compact))
+		return -EMSGSIZE;
+	return 0;
+}
+
+static int fill_privflags(struct nl_msg_buff *msg,
+			  const struct nlfake_sock *fsk, int dev)
+{
+	const uint32_t mask = (1U << NLFAKE_PRIV_FLAG_COUNT) - 1;
+	const uint32_t value = dev & mask;
+
+	if (put_header(msg, ETHTOOL_A_PRIVFLAGS_HEADER, dev) ||
+	    put_bitset(msg, ETHTOOL_A_PRIVFLAGS_FLAGS, NLFAKE_PRIV_FLAG_COUNT,
+		       &value, &mask, ETH_SS_PRIV_FLAGS, compact_bitsets(fsk)))
+		return -EMSGSIZE;
+	return 0;
+}
+
+static int fill_channels(struct nl_msg_buff *msg,
+			 const struct nlfake_sock *fsk __maybe_unused, int dev)
+{
+	if (put_header(msg, ETHTOOL_A_CHANNELS_HEADER, dev) ||
+	    ethnla_put_u32(msg, ETHTOOL_A_CHANNELS_COMBINED_MAX,
+			   config.n_queues) ||
+	    ethnla_put_u32(msg, ETHTOOL_A_CHANNELS_COMBINED_COUNT,
+			   config.n_queues))
+		return -EMSGSIZE;
+	return 0;
+}
+
+static int fill_pause(struct nl_msg_buff *msg,
+		      const struct nlfake_sock *fsk __maybe_unused, int dev)
+{
+	if (put_header(msg, ETHTOOL_A_PAUSE_HEADER, dev) ||
+	    ethnla_put_u8(msg, ETHTOOL_A_PAUSE_AUTONEG, 0) ||
+	    ethnla_put_u8(msg, ETHTOOL_A_PAUSE_RX, 1) ||
+	    ethnla_put_u8(msg, ETHTOOL_A_PAUSE_TX, dev % 2))
+		return -EMSGSIZE;
+	return 0;
+}
+
+static int check_channels(const struct nlfake_sock *fsk)
+{
+	const struct nlattr *attr = fsk->tb[ETHTOOL_A_CHANNELS_COMBINED_COUNT];
+
+	if (attr && mnl_attr_get_u32(attr) > config.n_queues)
+		return -EINVAL;
+	return 0;
+}
+
+static bool put_stats_group(struct nl_msg_buff *msg, unsigned int grp,
+			    int dev)
+{
+	struct nlattr *nest, *stat;
+	unsigned int i;
+	uint64_t val;
+
+	nest = ethnla_nest_start(msg, ETHTOOL_A_STATS_GRP);
+	if (!nest ||
+	    ethnla_put_u32(msg, ETHTOOL_A_STATS_GRP_ID, grp) ||
+	    ethnla_put_u32(msg, ETHTOOL_A_STATS_GRP_SS_ID,
+			   ETH_SS_STATS_ETH_PHY + grp))
+		return true;
+	for (i = 0; i < config.n_counters; i++) {
+		val = (uint64_t)dev * 1000000 + grp * 1000 + i;
+		stat = ethnla_nest_start(msg, ETHTOOL_A_STATS_GRP_STAT);
+		if (!stat || ethnla_put(msg, i, sizeof(val), &val))
+			return true;
+		ethnla_nest_end(msg, stat);
+	}
+	ethnla_nest_end(msg, nest);
+	return false;
+}
+
+static int fill_stats(struct nl_msg_buff *msg, const struct nlfake_sock *fsk,
+		      int dev)
+{
+	struct nl_bitset groups;
+	unsigned int grp;
+	int ret;
+
+	if (!fsk->tb[ETHTOOL_A_STATS_GROUPS])
+		return -EINVAL;
+	ret = bitset_decode(&groups, fsk->tb[ETHTOOL_A_STATS_GROUPS]);
+	if (ret < 0)
+		return -EINVAL;
+
+	ret = -EMSGSIZE;
+	if (put_header(msg, ETHTOOL_A_STATS_HEADER, dev))
+		goto out;
+	for (grp = 0; grp < __ETHTOOL_STATS_CNT; grp++)
+		if (bitset_test(&groups, false, grp) &&
+		    put_stats_group(msg, grp, dev))
+			goto out;
+	ret = 0;
+out:
+	bitset_release(&groups);
+	return ret;
+}
+
+/* Contents of a module EEPROM page (lower memory and the upper half of the
+ * page) as seen at I2C address @i2c. Every fourth device, starting with
+ * "fake2", has a QSFP-DD (CMIS) module with paged memory and two banks, each
+ * fourth, starting with "fake3", a paged QSFP28 (SFF-8636) module and the
+ * rest an SFP. Only identification data are filled, the rest reads as zeros.
+ */
+static void module_eeprom_page(uint8_t *data, int dev, uint8_t page,
+			       uint8_t bank, uint8_t i2c)
+{
+	if (i2c != 0x50)
+		return;
+
+	switch (dev % 4) {
+	case 2:
+		if (bank > 1)
+			return;
+		data[0] = 0x18;			/* QSFP-DD */
+		if (page == 0x00)
+			memcpy(data + 129, "NLFAKE          ", 16);
+		if (page == 0x01)
+			data[142] = 0x01;	/* banks 0 and 1 */
+		break;
+	case 3:
+		if (bank)
+			return;
+		data[0] = 0x11;			/* QSFP28 */
+		if (page == 0x00) {
+			data[128] = 0x11;
+			memcpy(data + 148, "NLFAKE          ", 16);
+		}
+		break;
+	default:
+		/* SFP: page 0 is the identification data */
+		if (!page && !bank)
+			memcpy(data, sfp_eeprom, sizeof(sfp_eeprom));
+		break;
+	}
+}
+
+static int fill_module_eeprom(struct nl_msg_buff *msg,
+			      const struct nlfake_sock *fsk, int dev)
+{
+	const struct nlattr *const *tb = fsk->tb;
+	uint32_t offset, length;
+	uint8_t data[NLFAKE_EEPROM_SIZE] = {};
+	uint8_t page, bank, i2c;
+
+	if (!tb[ETHTOOL_A_MODULE_EEPROM_OFFSET] ||
+	    !tb[ETHTOOL_A_MODULE_EEPROM_LENGTH] ||
+	    !tb[ETHTOOL_A_MODULE_EEPROM_PAGE] ||
+	    !tb[ETHTOOL_A_MODULE_EEPROM_I2C_ADDRESS])
+		return -EINVAL;
+	offset = mnl_attr_get_u32(tb[ETHTOOL_A_MODULE_EEPROM_OFFSET]);
+	length = mnl_attr_get_u32(tb[ETHTOOL_A_MODULE_EEPROM_LENGTH]);
+	page = mnl_attr_get_u8(tb[ETHTOOL_A_MODULE_EEPROM_PAGE]);
+	bank = tb[ETHTOOL_A_MODULE_EEPROM_BANK] ?
+	       mnl_attr_get_u8(tb[ETHTOOL_A_MODULE_EEPROM_BANK]) : 0;
+	i2c = mnl_attr_get_u8(tb[ETHTOOL_A_MODULE_EEPROM_I2C_ADDRESS]);
+	if (!length || offset >= NLFAKE_EEPROM_SIZE ||
+	    length > NLFAKE_EEPROM_SIZE - offset || (page && offset < 128))
+		return -EINVAL;
+
+	module_eeprom_page(data, dev, page, bank, i2c);
+	if (page && page == config.short_eeprom_page)
+		length--;
+	if (put_header(msg, ETHTOOL_A_MODULE_EEPROM_HEADER, dev) ||
+	    ethnla_put(msg, ETHTOOL_A_MODULE_EEPROM_DATA, length,
+		       data + offset))
+		return -EMSGSIZE;
+	return 0;
+}
+
+static const struct nlfake_op nlfake_ops[__ETHTOOL_MSG_USER_CNT] = {
+	[ETHTOOL_MSG_STRSET_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_STRSET_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_STRSET_HEADER,
+		.global		= true,
+		.fill		= fill_strset,
+		.check		= check_strset,
+	},
+	[ETHTOOL_MSG_LINKINFO_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_LINKINFO_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_LINKINFO_HEADER,
+		.fill		= fill_linkinfo,
+	},
+	[ETHTOOL_MSG_LINKMODES_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_LINKMODES_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_LINKMODES_HEADER,
+		.fill		= fill_linkmodes,
+	},
+	[ETHTOOL_MSG_LINKSTATE_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_LINKSTATE_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_LINKSTATE_HEADER,
+		.fill		= fill_linkstate,
+	},
+	[ETHTOOL_MSG_DEBUG_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_DEBUG_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_DEBUG_HEADER,
+		.fill		= fill_debug,
+	},
+	[ETHTOOL_MSG_WOL_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_WOL_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_WOL_HEADER,
+		.fill		= fill_wol,
+	},
+	[ETHTOOL_MSG_FEATURES_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_FEATURES_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_FEATURES_HEADER,
+		.fill		= fill_features,
+	},
+	[ETHTOOL_MSG_PRIVFLAGS_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_PRIVFLAGS_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_PRIVFLAGS_HEADER,
+		.fill		= fill_privflags,
+	},
+	[ETHTOOL_MSG_CHANNELS_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_CHANNELS_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_CHANNELS_HEADER,
+		.fill		= fill_channels,
+	},
+	[ETHTOOL_MSG_PAUSE_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_PAUSE_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_PAUSE_HEADER,
+		.fill		= fill_pause,
+	},
+	[ETHTOOL_MSG_CHANNELS_SET] = {
+		.hdr_attr	= ETHTOOL_A_CHANNELS_HEADER,
+		.no_dump	= true,
+		.check		= check_channels,
+	},
+	[ETHTOOL_MSG_MODULE_EEPROM_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_MODULE_EEPROM_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_MODULE_EEPROM_HEADER,
+		.no_dump	= true,
+		.fill		= fill_module_eeprom,
+	},
+	[ETHTOOL_MSG_STATS_GET] = {
+		.reply_cmd	= ETHTOOL_MSG_STATS_GET_REPLY,
+		.hdr_attr	= ETHTOOL_A_STATS_HEADER,
+		.fill		= fill_stats,
+	},
+};
+
+static int fill_family(struct nl_msg_buff *msg)
+{
+	struct nlattr *ops, *op, *grps, *grp;
+	unsigned int cmd, n = 0;
+	uint32_t flags;
+
+	if (ethnla_put_u16(msg, CTRL_ATTR_FAMILY_ID, NLFAKE_FAMILY_ID) ||
+	    ethnla_put_strz(msg, CTRL_ATTR_FAMILY_NAME, ETHTOOL_GENL_NAME) ||
+	    ethnla_put_u32(msg, CTRL_ATTR_VERSION, ETHTOOL_GENL_VERSION))
+		return -EMSGSIZE;
+	ops = ethnla_nest_start(msg, CTRL_ATTR_OPS);
+	if (!ops)
+		return -EMSGSIZE;
+	for (cmd = 0; cmd < __ETHTOOL_MSG_USER_CNT; cmd++) {
+		if (!nlfake_ops[cmd].fill && !nlfake_ops[cmd].check)
+			continue;
+		flags = GENL_CMD_CAP_DO;
+		if (!nlfake_ops[cmd].no_dump)
+			flags |= GENL_CMD_CAP_DUMP;
+		op = ethnla_nest_start(msg, ++n);
+		if (!op ||
+		    ethnla_put_u32(msg, CTRL_ATTR_OP_ID, cmd) ||
+		    ethnla_put_u32(msg, CTRL_ATTR_OP_FLAGS, flags))
+			return -EMSGSIZE;
+		ethnla_nest_end(msg, op);
+	}
+	ethnla_nest_end(msg, ops);
+
+	grps = ethnla_nest_start(msg, CTRL_ATTR_MCAST_GROUPS);
+	if (!grps)
+		return -EMSGSIZE;
+	grp = ethnla_nest_start(msg, 1);
+	if (!grp ||
+	    ethnla_put_strz(msg, CTRL_ATTR_MCAST_GRP_NAME,
+			    ETHTOOL_MCGRP_MONITOR_NAME) ||
+	    ethnla_put_u32(msg, CTRL_ATTR_MCAST_GRP_ID, NLFAKE_MONGRP_ID))
+		return -EMSGSIZE;
+	ethnla_nest_end(msg, grp);
+	ethnla_nest_end(msg, grps);
+
+	return 0;
+}
+
+/* request parsing */
+
+static int dev_by_name(const char *name)
+{
+	const char *num = name + strlen(NLFAKE_DEVNAME_PREFIX);
+	unsigned long idx;
+	char *end;
+
+	if (strncmp(name, NLFAKE_DEVNAME_PREFIX,
+		    strlen(NLFAKE_DEVNAME_PREFIX)) ||
+	    !isdigit((unsigned char)*num) || (num[0] == '0' && num[1]))
+		return -ENODEV;
+	idx = strtoul(num, &end, 10);
+	if (*end || idx >= config.n_devices)
+		return -ENODEV;
+
+	return idx;
+}
+
+static int parse_header(struct nlfake_sock *fsk, const struct nlattr *nest)
+{
+	const struct nlattr *tb[ETHTOOL_A_HEADER_MAX + 1] = {};
+	DECLARE_ATTR_TB_INFO(tb);
+	uint32_t ifindex;
+	int ret;
+
+	fsk->dev = -1;
+	fsk->hdr_flags = 0;
+	if (!nest)
+		return 0;
+	ret = mnl_attr_parse_nested(nest, attr_cb, &tb_info);
+	if (ret < 0)
+		return -EINVAL;
+
+	if (tb[ETHTOOL_A_HEADER_FLAGS])
+		fsk->hdr_flags = mnl_attr_get_u32(tb[ETHTOOL_A_HEADER_FLAGS]);
+	if (tb[ETHTOOL_A_HEADER_DEV_NAME]) {
+		fsk->dev = dev_by_name(
+			mnl_attr_get_str(tb[ETHTOOL_A_HEADER_DEV_NAME]));
+		if (fsk->dev < 0)
+			return fsk->dev;
+	}
+	if (tb[ETHTOOL_A_HEADER_DEV_INDEX]) {
+		ifindex = mnl_attr_get_u32(tb[ETHTOOL_A_HEADER_DEV_INDEX]);
+		if (!ifindex || ifindex > config.n_devices ||
+		    (fsk->dev >= 0 && (unsigned int)fsk->dev != ifindex - 1))
+			return -ENODEV;
+		fsk->dev = ifindex - 1;
+	}
+
+	return 0;
+}
+
+/* Check the request and decide what to reply, returns error code for the
+ * ack if the request is rejected.
+ */
+static int parse_request(struct nlfake_sock *fsk)
+{
+	const struct nlmsghdr *nlhdr = fsk->req;
+	struct attr_tb_info tb_info = { fsk->tb, NLFAKE_MAX_ATTR };
+	const struct genlmsghdr *genlhdr;
+	const struct nlfake_op *op;
+	bool is_dump;
+	int ret;
+
+	memset(fsk->tb, '\0', sizeof(fsk->tb));
+	if (nlhdr->nlmsg_len < NLMSG_HDRLEN + GENL_HDRLEN)
+		return -EINVAL;
+	genlhdr = mnl_nlmsg_get_payload(nlhdr);
+	if (mnl_attr_parse(nlhdr, GENL_HDRLEN, attr_cb, &tb_info) < 0)
+		return -EINVAL;
+	is_dump = nlhdr->nlmsg_flags & NLM_F_DUMP;
+
+	if (nlhdr->nlmsg_type == GENL_ID_CTRL) {
+		nlfake_stats.ctrl++;
+		if (genlhdr->cmd != CTRL_CMD_GETFAMILY || is_dump)
+			return -EOPNOTSUPP;
+		if (!fsk->tb[CTRL_ATTR_FAMILY_NAME] ||
+		    strcmp(mnl_attr_get_str(fsk->tb[CTRL_ATTR_FAMILY_NAME]),
+			   ETHTOOL_GENL_NAME))
+			return -ENOENT;
+		fsk->stage = NLFAKE_REPLY;
+		return 0;
+	}
+	if (nlhdr->nlmsg_type != NLFAKE_FAMILY_ID)
+		return -ENOENT;
+
+	if (genlhdr->cmd >= __ETHTOOL_MSG_USER_CNT)
+		return -EOPNOTSUPP;
+	nlfake_stats.requests[genlhdr->cmd]++;
+	if (is_dump)
+		nlfake_stats.dumps[genlhdr->cmd]++;
+	op = &nlfake_ops[genlhdr->cmd];
+	if ((!op->fill && !op->check) || (is_dump && op->no_dump))
+		return -EOPNOTSUPP;
+	ret = parse_header(fsk, fsk->tb[op->hdr_attr]);
+	if (ret < 0)
+		return ret;
+	/* a rejected get request gets no reply, not even a partial dump */
+	if (op->fill && op->check) {
+		ret = op->check(fsk);
+		if (ret < 0)
+			return ret;
+	}
+	if (is_dump) {
+		fsk->stage = NLFAKE_DUMP;
+		return 0;
+	}
+	if (fsk->dev < 0 && !op->global)
+		return -EINVAL;
+	if (!op->fill) {
+		fsk->stage = NLFAKE_ACK;
+		return op->check(fsk);
+	}
+
+	fsk->stage = NLFAKE_REPLY;
+	return 0;
+}
+
+/* reply generation */
+
+static int dgram_append(struct nlfake_sock *fsk, const struct nlmsghdr *nlhdr)
+{
+	unsigned int len = NLMSG_ALIGN(nlhdr->nlmsg_len);
+	char *buff;
+
+	if (fsk->len + len > fsk->size) {
+		buff = realloc(fsk->dgram, fsk->len + len);
+		if (!buff)
+			return -ENOMEM;
+		fsk->dgram = buff;
+		fsk->size = fsk->len + len;
+	}
+	memcpy(fsk->dgram + fsk->len, nlhdr, nlhdr->nlmsg_len);
+	memset(fsk->dgram + fsk->len + nlhdr->nlmsg_len, '\0',
+	       len - nlhdr->nlmsg_len);
+	fsk->len += len;
+	nlfake_stats.messages++;
+
+	return 0;
+}
+
+static int put_ack(struct nl_socket *nlsk, struct nlfake_sock *fsk)
+{
+	struct {
+		struct nlmsghdr	nlhdr;
+		struct nlmsgerr	err;
+	} ack = {};
+
+	ack.nlhdr.nlmsg_len = sizeof(ack);
+	ack.nlhdr.nlmsg_type = NLMSG_ERROR;
+	ack.nlhdr.nlmsg_flags = NLM_F_CAPPED;
+	ack.nlhdr.nlmsg_seq = fsk->req->nlmsg_seq;
+	ack.nlhdr.nlmsg_pid = nlsk->port;
+	ack.err.error = fsk->error;
+	ack.err.msg = *fsk->req;
+
+	return dgram_append(fsk, &ack.nlhdr);
+}
+
+static int put_done(struct nl_socket *nlsk, struct nlfake_sock *fsk)
+{
+	struct {
+		struct nlmsghdr	nlhdr;
+		int		error;
+	} done = {};
+
+	done.nlhdr.nlmsg_len = sizeof(done);
+	done.nlhdr.nlmsg_type = NLMSG_DONE;
+	done.nlhdr.nlmsg_flags = NLM_F_MULTI;
+	done.nlhdr.nlmsg_seq = fsk->req->nlmsg_seq;
+	done.nlhdr.nlmsg_pid = nlsk->port;
+
+	return dgram_append(fsk, &done.nlhdr);
+}
+
+/* compose reply message for @dev and append it to the datagram */
+static int put_reply(struct nl_socket *nlsk, struct nlfake_sock *fsk, int dev,
+		     uint16_t flags)
+{
+	struct nl_msg_buff *msg = &fsk->msgbuff;
+	const struct nlfake_op *op;
+	int ret;
+
+	if (fsk->req->nlmsg_type == GENL_ID_CTRL) {
+		ret = __msg_init(msg, GENL_ID_CTRL, CTRL_CMD_NEWFAMILY, flags,
+				 1);
+		if (ret == 0)
+			ret = fill_family(msg);
+	} else {
+		op = &nlfake_ops[((struct genlmsghdr *)
+				  mnl_nlmsg_get_payload(fsk->req))->cmd];
+		ret = __msg_init(msg, NLFAKE_FAMILY_ID, op->reply_cmd, flags,
+				 ETHTOOL_GENL_VERSION);
+		if (ret == 0)
+			ret = op->fill(msg, fsk, dev);
+	}
+	if (ret < 0)
+		return ret;
+	msg->nlhdr->nlmsg_seq = fsk->req->nlmsg_seq;
+	msg->nlhdr->nlmsg_pid = nlsk->port;
+
+	return dgram_append(fsk, msg->nlhdr);
+}
+
+/* generate next datagram, nothing if the request has been answered */
+static int nlfake_next(struct nl_socket *nlsk, struct nlfake_sock *fsk)
+{
+	struct timespec delay;
+	int ret = 0;
+
+	switch (fsk->stage) {
+	case NLFAKE_IDLE:
+		return 0;
+	case NLFAKE_REPLY:
+		ret = put_reply(nlsk, fsk, fsk->dev, 0);
+		if (ret < 0) {
+			fsk->error = ret;
+			ret = put_ack(nlsk, fsk);
+			fsk->stage = NLFAKE_IDLE;
+		} else {
+			fsk->stage = NLFAKE_ACK;
+		}
+		break;
+	case NLFAKE_ACK:
+		ret = put_ack(nlsk, fsk);
+		fsk->stage = NLFAKE_IDLE;
+		break;
+	case NLFAKE_DUMP:
+		while (fsk->next_dev < config.n_devices &&
+		       fsk->len < NLFAKE_DUMP_SIZE) {
+			/* devices without the information are skipped */
+			ret = put_reply(nlsk, fsk, fsk->next_dev++,
+					NLM_F_MULTI);
+			if (ret == -ENOMEM)
+				return ret;
+		}
+		ret = 0;
+		if (!fsk->len) {
+			ret = put_done(nlsk, fsk);
+			fsk->stage = NLFAKE_IDLE;
+		}
+		break;
+	}
+	if (ret < 0)
+		return ret;
+
+	if (config.delay_us) {
+		delay.tv_sec = config.delay_us / 1000000;
+		delay.tv_nsec = (config.delay_us % 1000000) * 1000;
+		nanosleep(&delay, NULL);
+	}
+	nlfake_stats.datagrams++;
+	nlfake_stats.bytes += fsk->len;
+	return 0;
+}
+
+/* next link info notification, devices take turns */
+static int put_notification(struct nl_socket *nlsk, struct nlfake_sock *fsk)
+{
+	struct nl_msg_buff *msg = &fsk->msgbuff;
+	int dev = notifications_sent % config.n_devices;
+	int ret;
+
+	ret = __msg_init(msg, NLFAKE_FAMILY_ID, ETHTOOL_MSG_LINKINFO_NTF, 0,
+			 ETHTOOL_GENL_VERSION);
+	if (ret == 0)
+		ret = fill_linkinfo(msg, fsk, dev);
+	if (ret < 0)
+		return ret;
+	msg->nlhdr->nlmsg_pid = nlsk->port;
+	ret = dgram_append(fsk, msg->nlhdr);
+	if (ret < 0)
+		return ret;
+
+	notifications_sent++;
+	nlfake_stats.datagrams++;
+	nlfake_stats.bytes += fsk->len;
+	return 0;
+}
+
+/* carrier change of the device of the next link info notification sent */
+static int put_carrier(struct nl_socket *nlsk, struct nlfake_sock *fsk)
+{
+	struct nl_msg_buff *msg = &fsk->msgbuff;
+	int dev = carriers_sent % config.n_devices;
+	unsigned int ntfs = carriers_sent / config.n_devices + 1;
+	char name[IFNAMSIZ];
+	struct ifinfomsg *ifinfo;
+	struct nlmsghdr *nlhdr;
+	bool up = !(ntfs & 1);
+	int ret;
+
+	snprintf(name, sizeof(name), NLFAKE_DEVNAME_PREFIX "%d", dev);
+	nlhdr = mnl_nlmsg_put_header(msg->buff);
+	nlhdr->nlmsg_type = RTM_NEWLINK;
+	nlhdr->nlmsg_pid = nlsk->port;
+	ifinfo = mnl_nlmsg_put_extra_header(nlhdr, sizeof(*ifinfo));
+	ifinfo->ifi_family = AF_UNSPEC;
+	ifinfo->ifi_index = dev + 1;
+	ifinfo->ifi_flags = IFF_UP | (up ? IFF_RUNNING : 0);
+	mnl_attr_put_strz(nlhdr, IFLA_IFNAME, name);
+	mnl_attr_put_u8(nlhdr, IFLA_CARRIER, up);
+	ret = dgram_append(fsk, nlhdr);
+	if (ret < 0)
+		return ret;
+
+	carriers_sent++;
+	nlfake_stats.datagrams++;
+	nlfake_stats.bytes += fsk->len;
+	return 0;
+}
+
+/* backend interface */
+
+static struct nlfake_sock *nlfake_sock_get(struct nl_socket *nlsk)
+{
+	struct nlfake_sock *fsk = nlsk->backend_priv;
+
+	if (fsk)
+		return fsk;
+	fsk = calloc(1, sizeof(*fsk));
+	if (!fsk)
+		return NULL;
+	msgbuff_init(&fsk->msgbuff, NULL);
+	nlsk->backend_priv = fsk;
+	if (msgbuff_realloc(&fsk->msgbuff, NLFAKE_MSG_SIZE) < 0)
+		return NULL;
+	return fsk;
+}
+
+/* make @req (allocated) the request being answered */
+static void nlfake_start(struct nl_socket *nlsk, struct nlfake_sock *fsk,
+			 struct nlmsghdr *req)
+{
+	free(fsk->req);
+	fsk->req = req;
+	fsk->len = 0;
+	fsk->next_dev = 0;
+	fsk->error = 0;
+
+	if (nlsk->nl_fam == NETLINK_GENERIC) {
+		fsk->error = parse_request(fsk);
+	} else {
+		nlfake_stats.other++;
+		fsk->error = -EOPNOTSUPP;
+	}
+	if (fsk->error)
+		fsk->stage = NLFAKE_ACK;
+}
+
+/* the current request has been answered and its replies received */
+static bool nlfake_done(const struct nlfake_sock *fsk)
+{
+	return fsk->stage == NLFAKE_IDLE && !fsk->len;
+}
+
+static ssize_t nlfake_send(struct nl_socket *nlsk,
+			   const struct nlmsghdr *nlhdr)
+{
+	struct nlfake_sock *fsk;
+	struct nlmsghdr **queue;
+	struct nlmsghdr *req;
+	unsigned int in_flight;
+
+	fsk = nlfake_sock_get(nlsk);
+	if (!fsk)
+		return -ENOMEM;
+	req = malloc(nlhdr->nlmsg_len);
+	if (!req)
+		return -ENOMEM;
+	memcpy(req, nlhdr, nlhdr->nlmsg_len);
+
+	if (nlfake_done(fsk)) {
+		nlfake_start(nlsk, fsk, req);
+		in_flight = 1;
+	} else {
+		queue = realloc(fsk->queue,
+				(fsk->n_queued + 1) * sizeof(queue[0]));
+		if (!queue) {
+			free(req);
+			return -ENOMEM;
+		}
+		queue[fsk->n_queued++] = req;
+		fsk->queue = queue;
+		in_flight = fsk->n_queued + 1;
+	}
+	if (in_flight > nlfake_stats.max_in_flight)
+		nlfake_stats.max_in_flight = in_flight;
+
+	return nlhdr->nlmsg_len;
+}
+
+static ssize_t nlfake_peek_len(struct nl_socket *nlsk)
+{
+	struct nlfake_sock *fsk = nlsk->backend_priv;
+	struct nl_context *nlctx = nlsk->nlctx;
+	int ret;
+
+	/* idle rtnetlink monitor socket: carrier changes */
+	if (nlctx->is_monitor && nlsk == nlctx->rtnl_socket &&
+	    (!fsk || (nlfake_done(fsk) && !fsk->n_queued))) {
+		carrier_listener = true;
+		if (carriers_sent < notifications_sent) {
+			fsk = nlfake_sock_get(nlsk);
+			if (!fsk)
+				return -ENOMEM;
+			ret = put_carrier(nlsk, fsk);
+			return ret < 0 ? ret : (ssize_t)fsk->len;
+		}
+	}
+	/* idle monitor socket: notifications arrive, then "get lost" */
+	if (nlctx->is_monitor && nlsk == nlctx->ethnl_socket &&
+	    (!fsk || (nlfake_done(fsk) && !fsk->n_queued))) {
+		if (carrier_listener && carriers_sent < notifications_sent)
+			return -EAGAIN;
+		if (notifications_sent < config.n_notifications) {
+			fsk = nlfake_sock_get(nlsk);
+			if (!fsk)
+				return -ENOMEM;
+			ret = put_notification(nlsk, fsk);
+			return ret < 0 ? ret : (ssize_t)fsk->len;
+		}
+		if (overruns_left) {
+			overruns_left--;
+			return -ENOBUFS;
+		}
+	}
+	if (!fsk)
+		return 0;
+	if (nlfake_done(fsk) && fsk->n_queued) {
+		nlfake_start(nlsk, fsk, fsk->queue[0]);
+		memmove(fsk->queue, fsk->queue + 1,
+			--fsk->n_queued * sizeof(fsk->queue[0]));
+	}
+	if (!fsk->len) {
+		ret = nlfake_next(nlsk, fsk);
+		if (ret < 0)
+			return ret;
+	}
+
+	return fsk->len;
+}
+
+static ssize_t nlfake_recv(struct nl_socket *nlsk, void *buff,
+			   unsigned int size)
+{
+	struct nlfake_sock *fsk = nlsk->backend_priv;
+	ssize_t len;
+
+	len = nlfake_peek_len(nlsk);
+	if (len <= 0)
+		return len;
+	if (len > size)
+		return -EMSGSIZE;
+	memcpy(buff, fsk->dgram, len);
+	fsk->len = 0;
+
+	return len;
+}
+
+static void nlfake_release(struct nl_socket *nlsk)
+{
+	struct nlfake_sock *fsk = nlsk->backend_priv;
+
+	if (nlsk == nlsk->nlctx->rtnl_socket)
+		carrier_listener = false;
+	if (!fsk)
+		return;
+	msgbuff_done(&fsk->msgbuff);
+	free(fsk->dgram);
+	free(fsk->req);
+	while (fsk->n_queued)
+		free(fsk->queue[--fsk->n_queued]);
+	free(fsk->queue);
+	free(fsk);
+	nlsk->backend_priv = NULL;
+}
+
+const struct nlsock_backend nlfake_backend = {
+	.send		= nlfake_send,
+	.peek_len	= nlfake_peek_len,
+	.recv		= nlfake_recv,
+	.release	= nlfake_release,
+	.pipeline	= true,
+};
+
+static void sfp_eeprom_init(void)
+{
+	memset(sfp_eeprom, '\0', sizeof(sfp_eeprom));
+	sfp_eeprom[0] = 0x03;		/* SFP */
+	sfp_eeprom[1] = 0x04;		/* serial ID via two wire interface */
+	sfp_eeprom[2] = 0x07;		/* LC connector */
+	sfp_eeprom[12] = 0x67;		/* 10.3 GBd */
+	memcpy(sfp_eeprom + 20, "NLFAKE          ", 16);
+	memcpy(sfp_eeprom + 40, "FAKE-SFP-10G    ", 16);
+	memcpy(sfp_eeprom + 56, "A   ", 4);
+	memcpy(sfp_eeprom + 68, "0123456789      ", 16);
+	memcpy(sfp_eeprom + 84, "261018  ", 8);
+}
+
+/**
+ * nlfake_setup() - configure the fake system and reset statistics
+ * @new_config: number of devices etc.
+ */
+void nlfake_setup(const struct nlfake_config *new_config)
+{
+	config = *new_config;
+	overruns_left = config.n_overruns;
+	notifications_sent = 0;
+	carriers_sent = 0;
+	carrier_listener = false;
+	memset(&nlfake_stats, '\0', sizeof(nlfake_stats));
+	sfp_eeprom_init();
+}
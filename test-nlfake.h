@@ -0,0 +1,67 @@
+/*
+ * test-nlfake.h - in-process fake of ethtool genetlink family
+ *
+ * Configuration and statistics of the fake netlink backend used by netlink
+ * tests (see test-nlfake.c).
+ */
+
+#ifndef ETHTOOL_TEST_NLFAKE_H__
+#define ETHTOOL_TEST_NLFAKE_H__
+
+#include <linux/ethtool_netlink.h>
+
+/**
+ * struct nlfake_config - shape of the fake system
+ * @n_devices:  number of network devices ("fake0", "fake1", ...)
+ * @n_queues:   number of queues (channels) of each device
+ * @n_counters: number of counters in each statistics group
+ * @delay_us:   delay before each reply datagram (microseconds)
+ * @n_overruns: number of receive buffer overruns (ENOBUFS) reported to an
+ *              idle monitor socket
+ * @n_notifications: number of link info notifications received by an idle
+ *              monitor socket (before the overruns), one device after
+ *              another; each changes carrier of the device, reported to an
+ *              rtnetlink monitor socket
+ * @missing_sets: string sets unknown to the fake kernel (mask of
+ *              STRSET_BIT()); a request naming one of them fails
+ * @short_eeprom_page: module EEPROM page (other than 0) whose reads return
+ *              less data than requested
+ */
+struct nlfake_config {
+	unsigned int	n_devices;
+	unsigned int	n_queues;
+	unsigned int	n_counters;
+	unsigned int	delay_us;
+	unsigned int	n_overruns;
+	unsigned int	n_notifications;
+	unsigned int	missing_sets;
+	unsigned int	short_eeprom_page;
+};
+
+/**
+ * struct nlfake_stats - traffic seen by the fake backend
+ * @requests:  number of ethtool requests per command (ETHTOOL_MSG_*)
+ * @dumps:     number of ethtool dump requests per command
+ * @ctrl:      number of genetlink control requests
+ * @other:     number of requests on other netlink families
+ * @datagrams: number of reply datagrams
+ * @messages:  number of reply messages (including acks and NLMSG_DONE)
+ * @bytes:     total length of reply datagrams
+ * @max_in_flight: most requests sent to a socket and not answered yet
+ */
+struct nlfake_stats {
+	unsigned int		requests[__ETHTOOL_MSG_USER_CNT];
+	unsigned int		dumps[__ETHTOOL_MSG_USER_CNT];
+	unsigned int		ctrl;
+	unsigned int		other;
+	unsigned long		datagrams;
+	unsigned long		messages;
+	unsigned long long	bytes;
+	unsigned int		max_in_flight;
+};
+
+extern struct nlfake_stats nlfake_stats;
+
+void nlfake_setup(const struct nlfake_config *config);
+
+#endif /* ETHTOOL_TEST_NLFAKE_H__ */